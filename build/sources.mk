@@ -9,15 +9,31 @@ O_SRCS :=
 S_UPPER_SRCS := 
 EXECUTABLES := 
 OBJS := 
+BENCHMARK_OBJS := 
+MICROBENCHMARK_OBJS := 
+COLLECTOR_OBJS := 
+COLLECTOR_TEST_OBJS := 
+RECOVERY_OBJS := 
 C_DEPS := 
 
 # Every subdirectory with source files must be described here
 SUBDIRS := \
+src/collector \
+src/core/common/arena \
 src/core/common/linkedList \
 src/core/common/linkedList/node \
+src/core/common/numa \
 src/core/common/queue \
 src/core/logger \
 src/core/logger/messageQueue \
+src/core/logger/moduleLevels \
+src/core/logger/sharedStrings \
+src/core/logger/sinks \
+src/core/logger/stats \
+src/recovery \
+src/test/benchmark \
+src/test/collector \
 src/test/logger \
+src/test/microbenchmark \
 src/writeMethods \
 
@@ -0,0 +1,24 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../src/collector/loggerCollector.c 
+
+COLLECTOR_OBJS += \
+./src/collector/loggerCollector.o 
+
+C_DEPS += \
+./src/collector/loggerCollector.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/collector/%.o: ../src/collector/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: Cross GCC Compiler'
+	gcc -std=c11 -O2 -flto -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
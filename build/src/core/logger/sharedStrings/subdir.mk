@@ -0,0 +1,24 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../src/core/logger/sharedStrings/sharedStrings.c 
+
+OBJS += \
+./src/core/logger/sharedStrings/sharedStrings.o 
+
+C_DEPS += \
+./src/core/logger/sharedStrings/sharedStrings.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/core/logger/sharedStrings/%.o: ../src/core/logger/sharedStrings/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: Cross GCC Compiler'
+	gcc -std=c11 -O0 -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
@@ -0,0 +1,27 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../src/core/logger/stats/threadStats.c \
+../src/core/logger/stats/latencyHistogram.c 
+
+OBJS += \
+./src/core/logger/stats/threadStats.o \
+./src/core/logger/stats/latencyHistogram.o 
+
+C_DEPS += \
+./src/core/logger/stats/threadStats.d \
+./src/core/logger/stats/latencyHistogram.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/core/logger/stats/%.o: ../src/core/logger/stats/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: Cross GCC Compiler'
+	gcc -std=c11 -O0 -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
@@ -0,0 +1,24 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../src/test/benchmark/loggerBenchmark.c 
+
+BENCHMARK_OBJS += \
+./src/test/benchmark/loggerBenchmark.o 
+
+C_DEPS += \
+./src/test/benchmark/loggerBenchmark.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/test/benchmark/%.o: ../src/test/benchmark/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: Cross GCC Compiler'
+	gcc -std=c11 -O2 -flto -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
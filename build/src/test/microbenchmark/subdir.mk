@@ -0,0 +1,27 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables 
+C_SRCS += \
+../src/test/microbenchmark/loggerMicrobenchmark.c \
+../src/test/microbenchmark/perfCounters.c 
+
+MICROBENCHMARK_OBJS += \
+./src/test/microbenchmark/loggerMicrobenchmark.o \
+./src/test/microbenchmark/perfCounters.o 
+
+C_DEPS += \
+./src/test/microbenchmark/loggerMicrobenchmark.d \
+./src/test/microbenchmark/perfCounters.d 
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/test/microbenchmark/%.o: ../src/test/microbenchmark/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: Cross GCC Compiler'
+	gcc -std=c11 -O2 -flto -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
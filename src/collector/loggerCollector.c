@@ -0,0 +1,64 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file loggerCollector.c
+ * @author Barak Sason Rofman
+ * @brief A collector process for applications that log in shared memory mode (see
+ * 'setSharedMemoryMode(...)'). It drains the application's buffers to the log file (in its
+ * working directory) until the application terminates its logger or exits, then removes the
+ * segment. Usage:
+ * 	LoggerCollector SEGMENT [ascii|binary|json]
+ * A segment left behind by an application that exited while no collector was attached may be
+ * collected later the same way.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/api/logger.h"
+#include "../writeMethods/writeMethods.h"
+
+int main(int argc, char** argv) {
+	void (*writeMethod)() = asciiWrite;
+
+	if (2 > argc || 3 < argc) {
+		fprintf(stderr, "Usage: %s SEGMENT [ascii|binary|json]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (3 == argc) {
+		if (0 == strcmp("binary", argv[2])) {
+			writeMethod = binaryWrite;
+		} else if (0 == strcmp("json", argv[2])) {
+			writeMethod = jsonWrite;
+		} else if (0 != strcmp("ascii", argv[2])) {
+			fprintf(stderr, "Unknown write method: %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (LOG_STATUS_SUCCESS != runLoggerCollector(argv[1], writeMethod)) {
+		fprintf(stderr, "Unable to collect segment %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -36,7 +36,9 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 enum loggerStatusCodes {
 	LOG_STATUS_FAILURE = -1, LOG_STATUS_SUCCESS
@@ -52,13 +54,87 @@ enum logLevels {
 	LOG_LEVEL_TRACE, /* Code-flow tracing */
 };
 
-//TODO: remove, for debug only
-long long cnt;
+enum logMethods {
+	LM_PRIVATE_BUFFER, /* Level 1 - private buffer */
+	LM_SHARED_BUFFER, /* Level 2 - shared buffer */
+	LM_DIRECT_WRITE, /* Level 3 - direct write */
+	LM_METHODS_NUM
+};
+
+typedef struct LoggerStats {
+	/** Number of messages written to the log file, per logging method (one of 'logMethods').
+	 * Buffered messages are counted once they are drained */
+	unsigned long long messages[LM_METHODS_NUM];
+	/** Number of message bytes (formatted additional arguments, excluding the record header)
+	 * written to the log file, per logging method (one of 'logMethods') */
+	unsigned long long bytes[LM_METHODS_NUM];
+	/** Number of messages that passed the logging level check but weren't logged */
+	unsigned long long drops;
+	/** Number of duplicate messages suppressed by the logger thread (reported by summary lines,
+	 * which are counted as written messages) */
+	unsigned long long duplicates;
+	/** Number of messages whose arguments were too long for a buffer slot (each spanned several
+	 * consecutive slots, or was written directly) */
+	unsigned long long largeMessages;
+	/** Number of failed attempts to register for a private buffer */
+	unsigned long long registrationFailures;
+	/** Total time (in nanoseconds) worker threads waited for the shared buffer lock */
+	unsigned long long sharedBufferLockWaitNsec;
+	/** Number of private buffers in the current layout */
+	int privateBuffersNum;
+	/** The highest occupancy (in messages) found in any private buffer of the current layout */
+	int privateBuffersHighWaterMark;
+	/** Number of dynamically allocated private buffers */
+	int dynamicBuffersNum;
+	/** Amount of logger buffers memory currently committed (resident), in bytes */
+	size_t committedMemory;
+} LoggerStats;
+
+typedef struct LatencySummary {
+	/** Number of sampled values */
+	unsigned long long count;
+	/** Mean value, in nanoseconds */
+	unsigned long long meanNsec;
+	/** Median value, in nanoseconds */
+	unsigned long long p50Nsec;
+	/** 90th percentile, in nanoseconds */
+	unsigned long long p90Nsec;
+	/** 99th percentile, in nanoseconds */
+	unsigned long long p99Nsec;
+	/** 99.9th percentile, in nanoseconds */
+	unsigned long long p999Nsec;
+	/** Maximal value, in nanoseconds */
+	unsigned long long maxNsec;
+} LatencySummary;
+
+enum keyValueTypes {
+	KV_TYPE_INT, /* long long */
+	KV_TYPE_DOUBLE, /* double */
+	KV_TYPE_STR /* Null-terminated string, copied into the message */
+};
+
+typedef struct KeyValue {
+	/** The key (must outlive the logger - a string literal) */
+	const char* key;
+	/** The type of the value (one of 'keyValueTypes') */
+	int type;
+	/** The value */
+	union {
+		long long i;
+		double d;
+		const char* s;
+	} value;
+} KeyValue;
+
+/** Typed fields of 'LOG_KV' */
+#define KV_INT(key, v) ((KeyValue) { key, KV_TYPE_INT, { .i = (v) } })
+#define KV_DOUBLE(key, v) ((KeyValue) { key, KV_TYPE_DOUBLE, { .d = (v) } })
+#define KV_STR(key, v) ((KeyValue) { key, KV_TYPE_STR, { .s = (v) } })
 
 /**
  * Initialize all data required by the logger.
- * Note: This method must be called before any other API is used, and it can be
- * called only once
+ * Note: This method must be called before any other API is used (except for APIs that
+ * configure the logger prior to initialization), and it can be called only once
  * @param threadsNumArg Maximum number of threads that will be able to register
  * @param privateBuffSizeArg Size of private buffers
  * @param sharedBuffSize Size of shared buffer
@@ -75,6 +151,269 @@ int initLogger(const int threadsNumArg, const int privateBuffSizeArg,
                const int maxMsgLenArg, const int maxArgsLenArg,
                const bool isDynamicAllocationArg, void (*writeMethodArg)());
 
+/**
+ * Configure the memory arena that backs the logger buffers.
+ * The private buffers and the shared buffer are carved from a single arena (one per NUMA node when
+ * NUMA awareness is enabled) that is reserved at initialization with mmap. By default, only
+ * address space is reserved and pages are committed as buffers are written to.
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param isHugePagesArg Whether or not to back the arena by huge pages where available (explicit
+ * huge pages, falling back to transparent huge pages)
+ * @param isPrefaultArg Whether or not to fault in all the arena pages at initialization, so no
+ * page faults occur when threads log their first messages
+ * @param isLockedArg Whether or not to lock the arena in memory (mlock)
+ */
+void setBuffersArenaOptions(const bool isHugePagesArg,
+                            const bool isPrefaultArg, const bool isLockedArg);
+
+/**
+ * Set whether or not the logger thread releases the memory of idle private buffers back to the
+ * OS. Buffers are released once drained and idle for the given threshold, whether their thread is
+ * registered or not (an unregistered thread's buffer may be taken by a new thread at any moment).
+ * Released memory is committed again on demand.
+ * Enabled by default (10 seconds threshold) unless the arena is configured to commit memory
+ * up-front (see 'setBuffersArenaOptions(...)' API)
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param isEnabledArg Whether or not to release the memory of idle private buffers
+ * @param idleThresholdMsecArg Idle time (in milliseconds) after which the memory of a private
+ * buffer is released
+ */
+void setIdleBuffersRelease(const bool isEnabledArg,
+                           const int idleThresholdMsecArg);
+
+/**
+ * Set shared memory mode - the private buffers and the shared buffer are carved from a POSIX
+ * shared memory segment, which is created at initialization, and are drained by a separate
+ * collector process (see 'runLoggerCollector(...)' API) rather than by an internal logger thread.
+ * The application then neither renders records nor writes the log file, and the messages buffered
+ * at the segment outlive the application (e.g. if it crashes). In this mode:
+ * - Messages that fit neither the private nor the shared buffer are dropped (and counted as such),
+ *   as there's no log file to write them to directly
+ * - Dynamic allocation, private buffers layout changes, NUMA awareness and the crash drain are
+ *   unavailable
+ * - 'terminateLogger()' waits (for up to 10 seconds) for an attached collector to write
+ *   everything out. If no collector is attached, the segment is kept until one attaches
+ * - Messages are counted in the statistics of the collector process
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect.
+ * 'initLogger(...)' fails if the segment already exists (it may hold messages of a previous run
+ * that weren't collected yet)
+ * @param segmentName Name of the segment (as accepted by shm_open, e.g. "/myapp_log"), or NULL to
+ * disable shared memory mode
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the name is too long
+ */
+int setSharedMemoryMode(const char* segmentName);
+
+/**
+ * Drain the buffers of an application that logs in shared memory mode (see
+ * 'setSharedMemoryMode(...)' API) to the log file. This is the collector process's counterpart of
+ * 'initLogger(...)' and 'terminateLogger()' - it returns after the application terminated its
+ * logger, or exited without doing so, and everything it buffered was written. The segment is
+ * removed then.
+ * NOTE: The segment is mapped at the address the application mapped it at. No other logger API
+ * may be used by the collector process
+ * @param segmentName Name of the segment
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the segment doesn't exist (or isn't
+ * initialized yet), another collector is attached to it, it can't be mapped at its address or the
+ * log file can't be created
+ */
+int runLoggerCollector(const char* segmentName, void (*writeMethodArg)());
+
+/**
+ * Set persistent buffers - the private buffers and the shared buffer are carved from a mapping of
+ * a file, which is created at initialization, and are drained by the internal logger thread as
+ * usual. If the process dies, the file's pages stay at the page cache (and are written back to the
+ * file by the OS), so the messages that weren't drained yet may be recovered from the file by
+ * 'recoverPersistentBuffers(...)' API (see the 'LoggerRecovery' tool). In this mode:
+ * - Dynamic allocation, private buffers layout changes and NUMA awareness are unavailable
+ * - File, function, event and key names are copied into the file
+ * - 'terminateLogger()' drains everything and removes the file
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect, and can't be
+ * combined with shared memory mode. 'initLogger(...)' fails if the file already exists (it may
+ * hold messages of a previous run that weren't recovered yet)
+ * @param path Path of the file, or NULL to disable persistent buffers
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the path is too long
+ */
+int setPersistentBuffers(const char* path);
+
+/**
+ * Write the messages left undrained at a persistent buffers file (see 'setPersistentBuffers(...)'
+ * API) by a process that died. Each buffer is read from the position its logger thread last read
+ * from for as long as its messages carry consecutive sequence numbers, so only whole messages that
+ * weren't drained are written. Messages are written at least once - those the logger thread was
+ * writing when the process died (and those the crash drain wrote) may be at the log file as well.
+ * The file isn't modified.
+ * NOTE: The file is mapped at the address the process mapped it at. The logger mustn't be
+ * initialized by the calling process
+ * @param path Path of the file
+ * @param outFile The file to write the messages to
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @return The number of messages written, or LOG_STATUS_FAILURE if the file doesn't exist, isn't
+ * a persistent buffers file (or wasn't initialized yet) or can't be mapped at its address
+ */
+int recoverPersistentBuffers(const char* path, FILE* outFile,
+                             void (*writeMethodArg)());
+
+/**
+ * Set flight recorder mode - the private buffers and the shared buffer aren't drained, the oldest
+ * messages of a full buffer are overwritten instead, so logging (e.g. at DEBUG or TRACE levels)
+ * costs no more than a copy into the buffer. Nothing is written to the log file until a trigger
+ * fires, then the messages of the last 'windowMsecArg' milliseconds from all buffers are written in
+ * time order (the window is bounded by how many messages the buffers hold). A dump never writes a
+ * message twice, and messages overwritten while they are being written are skipped. A dump is
+ * triggered by a message at 'triggerLevelArg' or a more severe level, by
+ * 'triggerFlightRecorderDump()' API or by 'triggerSignalArg'. In this mode:
+ * - Messages that fit no buffer are dropped (and counted as such) rather than written directly
+ * - Dynamic allocation, private buffers layout changes, per-node draining and idle buffers release
+ *   are unavailable
+ * - 'terminateLogger()' doesn't dump the buffers
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect, and can't be
+ * combined with shared memory mode or persistent buffers
+ * @param isEnabledArg Whether or not to enable flight recorder mode
+ * @param windowMsecArg How far back (in milliseconds) a dump goes
+ * @param triggerLevelArg The least severe level of messages that trigger a dump (one of the levels at
+ * 'logLevels'), or LOG_LEVEL_NONE if messages don't trigger dumps
+ * @param triggerSignalArg A signal that triggers a dump (its handler is installed by 'initLogger(...)'
+ * and restored by 'terminateLogger()'), or 0 if no signal does
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on invalid arguments
+ */
+int setFlightRecorderMode(const bool isEnabledArg, const int windowMsecArg,
+                          const int triggerLevelArg,
+                          const int triggerSignalArg);
+
+/**
+ * Trigger a flight recorder dump (see 'setFlightRecorderMode(...)' API). The dump is written by the
+ * logger thread shortly after - triggers that fire meanwhile are served by the same dump. Nothing
+ * is done if flight recorder mode isn't enabled
+ */
+void triggerFlightRecorderDump();
+
+/**
+ * Set priority lanes - each private buffer gets a small second buffer (its priority lane) for
+ * messages at 'levelArg' or a more severe level. The logger threads drain the priority lanes ahead
+ * of the private buffers, check them again before each private buffer and flush them to the log
+ * file right away, so urgent messages reach the log file within about the time it takes to drain
+ * a single private buffer, even while the private buffers are saturated. A message that doesn't
+ * fit its priority lane takes the usual path. In this mode:
+ * - An urgent message may precede messages its thread logged before it at the log file (its time
+ *   is kept)
+ * - Zero-copy payloads (see 'logReserve(...)') don't take the priority lanes
+ * - Priority lanes are unavailable in shared memory mode, with persistent buffers and in flight
+ *   recorder mode
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param levelArg The least severe level of urgent messages (one of the levels at 'logLevels'), or
+ * LOG_LEVEL_NONE to disable priority lanes
+ * @param sizeArg Size of each priority lane
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on invalid arguments
+ */
+int setPriorityLanes(const int levelArg, const int sizeArg);
+
+/**
+ * Add a sink that writes to a file (created or truncated). Once sinks are added, every message
+ * is written to the log file and to each sink whose level it passes. A message is formatted once
+ * per distinct write method, not once per sink. A sink with a queue is written by a thread of
+ * its own - while its queue is full, its messages are dropped (see 'getSinkDrops(...)' API)
+ * rather than stalling the other sinks. Without a queue, a sink is written by the logger threads
+ * directly, as the log file is. NOTE:
+ * - The logger's own messages and the crash drain (see 'setCrashDrain(...)' API) are written to
+ *   the log file only
+ * - Sinks are unavailable in shared memory mode - sinks added to the collector process (before
+ *   'runLoggerCollector(...)' API) are written by it
+ * - Sinks are removed (and their files closed) by 'terminateLogger()' API
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param path The path of the file
+ * @param loggingLevel Messages at this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels') - the logging level of the logger applies first
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @param queueSize Size (in bytes) of the sink's queue, or 0 for a sink without a queue
+ * @return The id of the sink on success, LOG_STATUS_FAILURE on failure
+ */
+int addFileSink(const char* path, const int loggingLevel,
+                void (*writeMethodArg)(), const int queueSize);
+
+/**
+ * Add a sink that writes to a stream (e.g. stdout), which isn't closed by the logger. See
+ * 'addFileSink(...)' API for details
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param stream The stream
+ * @param loggingLevel Messages at this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @param queueSize Size (in bytes) of the sink's queue, or 0 for a sink without a queue
+ * @return The id of the sink on success, LOG_STATUS_FAILURE on failure
+ */
+int addStreamSink(FILE* stream, const int loggingLevel,
+                  void (*writeMethodArg)(), const int queueSize);
+
+/**
+ * Add a sink that keeps the newest messages written to it in memory, at a ring of 'size' bytes
+ * (see 'readMemorySink(...)' API). See 'addFileSink(...)' API for details
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param size Size (in bytes) of the ring
+ * @param loggingLevel Messages at this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @return The id of the sink on success, LOG_STATUS_FAILURE on failure
+ */
+int addMemorySink(const int size, const int loggingLevel,
+                  void (*writeMethodArg)());
+
+/**
+ * Add a sink that streams messages to a local agent over a Unix domain socket (e.g. binaryWrite
+ * or jsonWrite messages, so the agent doesn't have to parse the log file). The sink's thread
+ * batches queued messages into a single non-blocking send - over SOCK_SEQPACKET, each packet
+ * holds one or more whole messages. While the agent doesn't keep up (the sink's queue is half
+ * full) or isn't connected, messages are appended to the spool file instead (or dropped if
+ * there's none, see 'getSinkDrops(...)' API) - spooled messages aren't resent. The connection is
+ * retried every second. See 'addFileSink(...)' API for details
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param socketPath The path of the agent's socket
+ * @param isSeqPacket Whether the agent's socket is SOCK_SEQPACKET (SOCK_STREAM otherwise)
+ * @param loggingLevel Messages at this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @param queueSize Size (in bytes) of the sink's queue
+ * @param spoolPath The path of the spool file (appended to), or NULL to drop messages instead
+ * @return The id of the sink on success, LOG_STATUS_FAILURE on failure
+ */
+int addSocketSink(const char* socketPath, const bool isSeqPacket,
+                  const int loggingLevel, void (*writeMethodArg)(),
+                  const int queueSize, const char* spoolPath);
+
+/**
+ * Copy the content of a memory sink (see 'addMemorySink(...)' API) - the newest bytes that fit in
+ * the buffer, oldest first. The oldest message may be partial
+ * @param sinkId The id of the memory sink
+ * @param buf The buffer to copy to (not terminated)
+ * @param len Length of the buffer
+ * @return Number of bytes copied on success, LOG_STATUS_FAILURE if the logger isn't initialized
+ * or there's no such memory sink
+ */
+int readMemorySink(const int sinkId, char* buf, const int len);
+
+/**
+ * Get the number of messages a sink dropped since its queue was full (or, for a socket sink
+ * without a spool file, since the agent couldn't take them)
+ * @param sinkId The id of the sink
+ * @param dropsNum The number of dropped messages (output)
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the logger isn't initialized or
+ * there's no such sink
+ */
+int getSinkDrops(const int sinkId, unsigned long long* dropsNum);
+
+/**
+ * Configure NUMA awareness of the private buffers.
+ * When enabled, private buffers are distributed evenly across NUMA nodes, each node's buffers
+ * are allocated on that node and kept in a separate pool, and a registering thread takes a buffer
+ * from the pool of the node it runs on (falling back to other nodes' pools when it's empty).
+ * NOTE: This API must be called before 'initLogger(...)' API in order to take effect
+ * @param isNumaAwareArg Whether or not to place private buffers according to NUMA topology
+ * @param isPerNodeDrainingArg Whether or not to drain each node's private buffers by a dedicated
+ * logger thread pinned to that node (requires NUMA awareness)
+ */
+void setNumaAwareness(const bool isNumaAwareArg,
+                      const bool isPerNodeDrainingArg);
+
 /**
  * Register a worker thread at the logger and assign a private buffers to it
  * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
@@ -103,8 +442,309 @@ void unregisterThread();
 void logMessage(const int loggingLevel, char* file, const char* func,
                const int line, char* msg, ...);
 
-/** A macro that defines the usage for 'logMessage(...) API */
-#define LOG_MSG(loggingLevel, msg ...) logMessage(loggingLevel, __FILE__,__PRETTY_FUNCTION__,  __LINE__  , msg)
+/**
+ * Log a message whose logging level was already checked by its call site - same as
+ * 'logMessage(...)' API otherwise
+ * NOTE: 'logSiteMessage' should be called only by using the macro 'LOG_MSG'
+ */
+void logSiteMessage(const int loggingLevel, char* file, const char* func,
+                    const int line, char* msg, ...);
+
+/* The most verbose logging level compiled in - 'LOG_MSG' statements of more verbose levels are
+ * compiled out entirely (e.g. -DLOG_COMPILE_LEVEL=LOG_LEVEL_INFO drops DEBUG and TRACE) */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+/* The module of the 'LOG_MSG' call sites of a file, matched against the overrides of
+ * 'setModuleLoggingLevel(...)' API - define it (e.g. "net/tcp") before including this header to
+ * tag a file, otherwise call sites belong to their source file path */
+#ifndef LOG_MODULE
+#define LOG_MODULE __FILE__
+#endif
+
+/* The levels epoch advances by this step (larger than any logging level) on each level change */
+#define LOG_LEVELS_EPOCH_STEP 16
+
+typedef struct LogSite {
+	/** The module the call site belongs to */
+	const char* module;
+	/** The effective logging level of the call site minus the levels epoch it was resolved at
+	 * (0 - never resolved) */
+	long long levelOffset;
+} LogSite;
+
+/* The levels epoch - exposed only for the inlined call site check of 'LOG_MSG' */
+extern long long loggerLevelsEpoch;
+
+/**
+ * Resolve the effective logging level of a call site at the current levels epoch
+ * NOTE: 'resolveLogSite' should be called only by 'isLogSiteEnabled(...)'
+ * @param site The call site
+ * @param loggingLevel The logging level of the message
+ * @return True if the message should be logged or false otherwise
+ */
+bool resolveLogSite(LogSite* site, const int loggingLevel);
+
+/**
+ * Check whether a call site logs messages of a given logging level
+ * @param site The call site
+ * @param loggingLevel The logging level of the message
+ * @return True if the message should be logged or false otherwise
+ */
+static inline bool isLogSiteEnabled(LogSite* site, const int loggingLevel) {
+	/* A call site resolved at the current epoch yields its effective level, while a stale one
+	 * yields at least a whole epoch step more - so a single compare rejects filtered messages
+	 * (message levels are positive, so LOG_LEVEL_NONE rejects all), and stale call sites pass
+	 * through to be resolved. Relaxed loads are enough, a level change only races messages that
+	 * are logged concurrently with it */
+	long long threshold = __atomic_load_n(&site->levelOffset, __ATOMIC_RELAXED)
+	        + __atomic_load_n(&loggerLevelsEpoch, __ATOMIC_RELAXED);
+
+	if (loggingLevel > threshold) {
+		return false;
+	}
+
+	return threshold < LOG_LEVELS_EPOCH_STEP || resolveLogSite(site, loggingLevel);
+}
+
+/** A macro that defines the usage for 'logMessage(...) API. Levels above 'LOG_COMPILE_LEVEL' are
+ * compiled out. Other levels are checked against the call site's cached effective level (global
+ * or module override), so a filtered message costs two relaxed loads and a (predicted not taken)
+ * branch at the call site and its arguments aren't evaluated */
+#define LOG_MSG(loggingLevel, msg ...) \
+	do { \
+		static LogSite logSite = { LOG_MODULE, 0 }; \
+		if ((loggingLevel) <= LOG_COMPILE_LEVEL \
+		        && __builtin_expect(isLogSiteEnabled(&logSite, loggingLevel), 0)) { \
+			logSiteMessage(loggingLevel, __FILE__, __PRETTY_FUNCTION__, __LINE__, msg); \
+		} \
+	} while (0)
+
+typedef struct LogThrottle {
+	/** Calls that passed the logging level check */
+	unsigned long long callsNum;
+	/** Messages suppressed since the last emitted message */
+	unsigned long long suppressedNum;
+	/** Messages that may be emitted before the next refill (LOG_RATE_LIMITED) */
+	long long tokens;
+	/** Time of the last refill, in nanoseconds (LOG_RATE_LIMITED) */
+	long long lastRefillNsec;
+} LogThrottle;
+
+/* The random state of the calling thread - exposed only for the inlined sampling of 'LOG_SAMPLED' */
+extern __thread unsigned long long loggerRandomState;
+
+/**
+ * Refill the tokens of an exhausted rate limited call site
+ * NOTE: 'refillLogThrottle' should be called only by 'isLogRateAllowed(...)'
+ * @param throttle The call site state of the calling thread
+ * @param perSec Maximal rate of emitted messages, per second (also the maximal burst)
+ * @return True if a token was refilled or false otherwise
+ */
+bool refillLogThrottle(LogThrottle* throttle, const double perSec);
+
+/**
+ * Count a call of a call site and check whether it is one of its every 'n' calls that are emitted
+ * @param throttle The call site state of the calling thread
+ * @param n Emit one of every 'n' calls (every call if 'n' is 1 or less)
+ * @return True if the message should be emitted or false if it's suppressed
+ */
+static inline bool isLogEveryNDue(LogThrottle* throttle, const unsigned long long n) {
+	if (1 >= n || 0 == throttle->callsNum++ % n) {
+		return true;
+	}
+
+	++throttle->suppressedNum;
+
+	return false;
+}
+
+/**
+ * Count a call of a call site and check whether it is one of its first 'n' calls
+ * @param throttle The call site state of the calling thread
+ * @param n Emit the first 'n' calls
+ * @return True if the message should be emitted or false if it's suppressed
+ */
+static inline bool isLogFirstNDue(LogThrottle* throttle, const unsigned long long n) {
+	if (throttle->callsNum < n) {
+		++throttle->callsNum;
+		return true;
+	}
+
+	++throttle->suppressedNum;
+
+	return false;
+}
+
+/**
+ * Take a token of a rate limited call site - the clock is read only once the tokens run out
+ * @param throttle The call site state of the calling thread
+ * @param perSec Maximal rate of emitted messages, per second (also the maximal burst)
+ * @return True if the message should be emitted or false if it's suppressed
+ */
+static inline bool isLogRateAllowed(LogThrottle* throttle, const double perSec) {
+	if (throttle->tokens > 0 || true == refillLogThrottle(throttle, perSec)) {
+		--throttle->tokens;
+		return true;
+	}
+
+	++throttle->suppressedNum;
+
+	return false;
+}
+
+/**
+ * Sample a call of a call site with a probability of 1/n (xorshift64* of the calling thread)
+ * @param throttle The call site state of the calling thread
+ * @param n Emit each call with a probability of 1/n (every call if 'n' is 1 or less)
+ * @return True if the message should be emitted or false if it's suppressed
+ */
+static inline bool isLogSampled(LogThrottle* throttle, const unsigned long long n) {
+	unsigned long long x = loggerRandomState;
+
+	if (1 >= n) {
+		return true;
+	}
+
+	if (0 == x) {
+		/* Seed by the address of the thread's variable, which differs between threads */
+		x = (unsigned long long) (size_t) &loggerRandomState | 1;
+	}
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	loggerRandomState = x;
+
+	if (0 == (x * 0x2545F4914F6CDD1DULL) % n) {
+		return true;
+	}
+
+	++throttle->suppressedNum;
+
+	return false;
+}
+
+/* Emit a message of a throttled call site, reporting the messages suppressed since the previous
+ * one - 'msg' must be a string literal */
+#define LOG_THROTTLED_MESSAGE(loggingLevel, throttle, msg, ...) \
+	do { \
+		unsigned long long logSuppressedNum = (throttle)->suppressedNum; \
+		if (0 == logSuppressedNum) { \
+			logSiteMessage(loggingLevel, __FILE__, __PRETTY_FUNCTION__, __LINE__, msg, \
+			               ##__VA_ARGS__); \
+		} else { \
+			(throttle)->suppressedNum = 0; \
+			logSiteMessage(loggingLevel, __FILE__, __PRETTY_FUNCTION__, __LINE__, \
+			               msg " [suppressed: %llu]", ##__VA_ARGS__, logSuppressedNum); \
+		} \
+	} while (0)
+
+/* Messages of a call site that pass the level check are emitted only if 'isDue' approves them.
+ * The throttling state is per thread and per call site, so no atomic operations are involved */
+#define LOG_THROTTLED(loggingLevel, isDue, param, msg, ...) \
+	do { \
+		static LogSite logSite = { LOG_MODULE, 0 }; \
+		static __thread LogThrottle logThrottle; \
+		if ((loggingLevel) <= LOG_COMPILE_LEVEL \
+		        && __builtin_expect(isLogSiteEnabled(&logSite, loggingLevel), 0) \
+		        && true == isDue(&logThrottle, param)) { \
+			LOG_THROTTLED_MESSAGE(loggingLevel, &logThrottle, msg, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+/** Like 'LOG_MSG', but emit only one of every 'n' messages of the call site (per thread) - the
+ * first message of each 'n' reports how many were suppressed ('n' of 1 or less emits all of them).
+ * 'msg' must be a string literal */
+#define LOG_EVERY_N(loggingLevel, n, msg, ...) \
+	LOG_THROTTLED(loggingLevel, isLogEveryNDue, n, msg, ##__VA_ARGS__)
+
+/** Like 'LOG_MSG', but emit only the first 'n' messages of the call site (per thread). 'msg' must
+ * be a string literal */
+#define LOG_FIRST_N(loggingLevel, n, msg, ...) \
+	LOG_THROTTLED(loggingLevel, isLogFirstNDue, n, msg, ##__VA_ARGS__)
+
+/** Like 'LOG_MSG', but emit at most 'perSec' messages per second of the call site (per thread,
+ * with bursts of up to 'perSec' messages) - the next emitted message reports how many were
+ * suppressed. 'msg' must be a string literal */
+#define LOG_RATE_LIMITED(loggingLevel, perSec, msg, ...) \
+	LOG_THROTTLED(loggingLevel, isLogRateAllowed, perSec, msg, ##__VA_ARGS__)
+
+/** Like 'LOG_MSG', but emit each message of the call site with a probability of 1/n (meant for
+ * high volume TRACE messages) - the next emitted message reports how many were suppressed ('n' of
+ * 1 or less emits all of them). 'msg' must be a string literal */
+#define LOG_SAMPLED(loggingLevel, n, msg, ...) \
+	LOG_THROTTLED(loggingLevel, isLogSampled, n, msg, ##__VA_ARGS__)
+
+/**
+ * Log a structured message - its fields are stored typed, without formatting, and rendered by the
+ * write method (as text, JSON or binary)
+ * NOTE: 'logKeyValues' should be called only by using the macro 'LOG_KV'
+ * @param loggingLevel Logging level of the message (must be one of the levels at 'logLevels')
+ * @param file File name that originated the call
+ * @param func Method that originated the call
+ * @param line Line that originated the call
+ * @param event The event the message describes (must outlive the logger - a string literal)
+ * @param kvs The fields of the message
+ * @param kvsNum The number of fields
+ */
+void logKeyValues(const int loggingLevel, char* file, const char* func,
+                  const int line, const char* event, const KeyValue* kvs,
+                  const int kvsNum);
+
+/** A macro that defines the usage for 'logKeyValues(...)' API, e.g.
+ * LOG_KV(LOG_LEVEL_INFO, "send", KV_INT("bytes", n), KV_STR("peer", peer)) - at least one field is
+ * required. The level check is the same as 'LOG_MSG' */
+#define LOG_KV(loggingLevel, event, ...) \
+	do { \
+		static LogSite logSite = { LOG_MODULE, 0 }; \
+		if ((loggingLevel) <= LOG_COMPILE_LEVEL \
+		        && __builtin_expect(isLogSiteEnabled(&logSite, loggingLevel), 0)) { \
+			const KeyValue logKvs[] = { __VA_ARGS__ }; \
+			logKeyValues(loggingLevel, __FILE__, __PRETTY_FUNCTION__, __LINE__, event, logKvs, \
+			             sizeof(logKvs) / sizeof(logKvs[0])); \
+		} \
+	} while (0)
+
+/**
+ * Reserve room for a binary payload directly at the calling thread's private buffer, to be built
+ * in place (without formatting or copying) and published by 'logCommit(...)'. If the private
+ * buffer is full or unavailable, a per-thread scratch buffer is returned instead, and the commit
+ * copies the payload to the shared buffer (or writes it directly), like any other message
+ * NOTE: 'logReserve' should be called only by using the macro 'LOG_RESERVE'
+ * NOTE: A single reservation may be pending per thread - the thread mustn't log anything else (or
+ * unregister) until it commits
+ * @param loggingLevel Logging level of the message (must be one of the levels at 'logLevels')
+ * @param file File name that originated the call
+ * @param func Method that originated the call
+ * @param line Line that originated the call
+ * @param size The maximal size of the payload (at most the maximal arguments length of
+ * 'initLogger(...)' API)
+ * @return A buffer of at least 'size' bytes to build the payload at, or NULL if nothing was
+ * reserved (too large, a reservation is already pending or the logger is terminating) - then
+ * 'logCommit(...)' must not be called
+ */
+char* logReserve(const int loggingLevel, char* file, const char* func,
+                 const int line, const int size);
+
+/**
+ * Publish the payload built at the buffer returned by 'logReserve(...)'
+ * @param size The actual size of the payload (at most the reserved size)
+ */
+void logCommit(const int size);
+
+/** A macro that defines the usage for 'logReserve(...)' API, e.g.
+ * char* p = LOG_RESERVE(LOG_LEVEL_DEBUG, sizeof(hdr));
+ * if (NULL != p) { memcpy(p, &hdr, sizeof(hdr)); logCommit(sizeof(hdr)); }
+ * The level check is the same as 'LOG_MSG', and a filtered message yields NULL */
+#define LOG_RESERVE(loggingLevel, size) \
+	({ \
+		static LogSite logSite = { LOG_MODULE, 0 }; \
+		((loggingLevel) <= LOG_COMPILE_LEVEL \
+		        && __builtin_expect(isLogSiteEnabled(&logSite, loggingLevel), 0)) ? \
+		        logReserve(loggingLevel, __FILE__, __PRETTY_FUNCTION__, __LINE__, size) : \
+		        (char*) NULL; \
+	})
 
 /**
  * Terminate the logger thread and release resources
@@ -119,6 +759,26 @@ void terminateLogger();
  */
 void setLoggingLevel(const int loggingLevel);
 
+/**
+ * Override the logging level of a module - 'LOG_MSG' call sites of the module use this level
+ * instead of the global logging level. A module is a '/' separated path: a module tag (see
+ * 'LOG_MODULE') or a source file path. An override applies to every module that contains its name
+ * as whole path components, so "net" covers "net/tcp" and "logger.c" covers any file named
+ * "logger.c". When several overrides apply, the longest one wins
+ * NOTE: this API may be called at any time - call sites pick up the change at their next call
+ * @param module The module name
+ * @param loggingLevel The logging level of the module (one of the levels at 'logLevels')
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+int setModuleLoggingLevel(const char* module, const int loggingLevel);
+
+/**
+ * Remove the logging level override of a module (see 'setModuleLoggingLevel(...)' API)
+ * @param module The module name
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the module had no override
+ */
+int clearModuleLoggingLevel(const char* module);
+
 /**
  * Return the defined max message length
  * @return The defined max message length
@@ -131,16 +791,119 @@ int getMaxMsgLen();
  */
 void setDynamicAllocation(const bool isDynamicAllocationArg);
 
+/**
+ * Set whether or not the buffered messages are written to the log file when the process is killed
+ * by a fatal signal (SIGSEGV, SIGABRT, SIGBUS, SIGFPE or SIGILL). The signal handler writes the
+ * undrained messages of all buffers in ascii format (whatever the write method is), using only
+ * async-signal-safe operations and within the given time budget, and then passes the signal on to
+ * the previously installed handler (or the default action). The handler can't flush the log file's
+ * stream, so while enabled the logger threads flush it before they release drained messages, and
+ * direct writes are flushed right away - the stream's pending output is always still at the
+ * buffers. No lock is taken, so messages being drained at the time of the crash may be written
+ * twice. The handler runs on the crashing thread's alternate signal stack, if it has one (see
+ * sigaltstack(2)). Disabled by default
+ * NOTE: this API may be called only after calling 'initLogger(...) API, and not concurrently
+ * with itself
+ * @param isEnabledArg Whether or not to write the buffered messages on a fatal signal
+ * @param budgetMsecArg Maximal time (in milliseconds) to spend writing the buffered messages
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the signal handlers couldn't be
+ * installed (or in shared memory mode or flight recorder mode)
+ */
+int setCrashDrain(const bool isEnabledArg, const int budgetMsecArg);
+
+/**
+ * Set whether or not the logger thread suppresses duplicate messages. Consecutive messages of a
+ * thread with the same location, level and arguments are collapsed while draining - the first one
+ * is written, followed by a "last message repeated N times over S sec" summary line. Producers are
+ * unaffected. Disabled by default
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param isEnabledArg Whether or not to suppress duplicate messages
+ */
+void setDuplicatesSuppression(const bool isEnabledArg);
+
 /**
  * Change the size of the internal buffers of the private buffers
- * @param newSize The new size of the internal buffers of the private buffers
+ * NOTE: The change is performed by the logger thread without disabling private buffers - each
+ * registered thread switches to a buffer of the new size at its next log call
+ * @param newSize The new size of the internal buffers of the private buffers (at least 2)
  */
 void changePrivateBuffersSize(const int newSize);
 
 /**
  * Change the number of private buffers
+ * NOTE: The change is performed by the logger thread without disabling private buffers - each
+ * registered thread switches to a buffer of the new layout at its next log call
  * @param newNumber The new number of private buffers
  */
 void changePrivateBuffersNumber(const int newNumber);
 
+/**
+ * Get a snapshot of the logger statistics.
+ * Counters are kept per thread and summed on read without locking, so concurrent activity may be
+ * partially reflected
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param stats The struct to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+int getLoggerStats(LoggerStats* stats);
+
+/**
+ * Get the occupancy high-water mark (the highest number of messages found by the logger thread)
+ * of each private buffer of the current layout
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param marks An array to fill, in private buffers order
+ * @param marksNum Number of elements in 'marks' (excess private buffers aren't reported)
+ * @return The number of private buffers in the current layout
+ */
+int getPrivateBuffersHighWaterMarks(int* marks, const int marksNum);
+
+/**
+ * Set the sampling rate of the latency histograms. One of every 'sampleRateArg' messages of each
+ * thread is timed - both the duration of its 'logMessage(...)' call and the time from its
+ * timestamp until the logger finished writing it. Sampling is enabled by default (1 of every 256
+ * messages)
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param sampleRateArg The sampling rate (rounded up to a power of 2), 0 disables sampling
+ */
+void setLatencySampling(const int sampleRateArg);
+
+/**
+ * Set whether or not the logger periodically logs a summary of the latency histograms (as
+ * LOG_LEVEL_INFO records). Summaries are logged by the logger thread, only while there's
+ * logging activity
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param intervalMsecArg The interval (in milliseconds) between summaries, 0 disables them
+ */
+void setLatencySelfLog(const int intervalMsecArg);
+
+/**
+ * Get a summary of the sampled 'logMessage(...)' call latency
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param loggingLevel Summarize only messages of this level (one of the levels at 'logLevels'),
+ * or LOG_LEVEL_NONE to summarize messages of all levels
+ * @param logMethod Summarize only messages written by this logging method (one of 'logMethods'),
+ * or LM_METHODS_NUM to summarize messages of all logging methods
+ * @param summary The struct to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+int getCallLatency(const int loggingLevel, const int logMethod,
+                   LatencySummary* summary);
+
+/**
+ * Get a summary of the sampled end-to-end latency - the time from a message's timestamp until
+ * the logger finished writing it to the log file
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ * @param logMethod Summarize only messages written by this logging method (one of 'logMethods'),
+ * or LM_METHODS_NUM to summarize messages of all logging methods
+ * @param summary The struct to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+int getEndToEndLatency(const int logMethod, LatencySummary* summary);
+
+/**
+ * Discard all values sampled by the latency histograms so far
+ * NOTE: this API may be called only after calling 'initLogger(...) API
+ */
+void resetLatencyHistograms();
+
 #endif /* LOGGER_H */
@@ -0,0 +1,470 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file arena.c
+ * @author Barak Sason Rofman
+ * @brief This module provides a memory arena - a single mmap'ed region that is reserved once and
+ * from which allocations are carved with a lock-free bump pointer.
+ * By default, pages are committed lazily as they're touched. The region may optionally be backed
+ * by huge pages (explicit huge pages where available, falling back to transparent huge pages),
+ * prefaulted and locked in memory.
+ * Memory is never returned to the arena - it's released all at once when the arena is destroyed.
+ * An arena may also be backed by a named POSIX shared memory segment, which other processes attach
+ * to at the same address, so pointers into the arena are valid in all of them - or by a regular
+ * file, whose contents outlive the process that created it.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024) /* Default huge page size on x86-64 */
+#define ARENA_ALIGNMENT 64 /* Allocations are cache line aligned to avoid false sharing */
+#define SHARED_ARENA_MAGIC 0x4c4c5348415245ULL /* Identifies a segment (or file) header */
+#define SHARED_ARENA_ROOT_OFFSET 64 /* The header takes the first aligned block of a segment */
+
+typedef struct SharedArenaHeader {
+	/** SHARED_ARENA_MAGIC */
+	unsigned long long magic;
+	/** The address the segment is mapped at */
+	char* base;
+	/** Size of the segment */
+	size_t size;
+} SharedArenaHeader;
+
+typedef struct Arena {
+	/** Start of the mapped region */
+	char* base;
+	/** Size of the mapped region */
+	size_t size;
+	/** Number of bytes carved so far */
+	atomic_size_t used;
+	/** Whether the region is backed by explicit huge pages */
+	bool isHugePagesBacked;
+	/** Whether the region is locked in memory */
+	bool isLocked;
+	/** Whether the region is a shared memory segment or a file */
+	bool isShared;
+} Arena;
+
+static inline size_t roundUp(const size_t value, const size_t alignment);
+static char* mapRegion(const size_t size, const bool isHugePages,
+                       const bool isReserveOnly);
+static void prefaultRegion(char* base, const size_t size);
+static Arena* newArenaOfRegion(char* base, const size_t size, const int flags,
+                               const bool isHugePagesBacked);
+static Arena* newArenaOfFile(const int fd, const size_t size, const int flags,
+                             const bool isBlocksReserved);
+static Arena* attachArenaOfFile(const int fd, const int mapFlags);
+
+/* API method - Description located at .h file */
+Arena* newArena(const size_t size, const int flags) {
+	Arena* arena;
+	char* base;
+	size_t mappedSize;
+	bool isHugePagesBacked;
+	bool isReserveOnly;
+
+	if (0 == size) {
+		return NULL;
+	}
+
+	base = NULL;
+
+	/* Unless the pages are committed up-front, only reserve address space - pages are committed
+	 * as they're touched */
+	isReserveOnly = (0 == (flags & (ARENA_FLAG_PREFAULT | ARENA_FLAG_LOCK)));
+
+	/* Prefer explicit huge pages, which requires a pre-reserved huge pages pool */
+	if (0 != (flags & ARENA_FLAG_HUGEPAGES)) {
+		mappedSize = roundUp(size, HUGEPAGE_SIZE);
+		base = mapRegion(mappedSize, true, false);
+	}
+
+	isHugePagesBacked = (NULL != base);
+
+	if (NULL == base) {
+		mappedSize = roundUp(size, sysconf(_SC_PAGESIZE));
+		base = mapRegion(mappedSize, false, isReserveOnly);
+
+		if (NULL == base) {
+			return NULL;
+		}
+
+		/* Fall back to transparent huge pages (best-effort, the hint is ignored if THP is
+		 * disabled) */
+		if (0 != (flags & ARENA_FLAG_HUGEPAGES)) {
+			madvise(base, mappedSize, MADV_HUGEPAGE);
+		}
+	}
+
+	arena = newArenaOfRegion(base, mappedSize, flags, isHugePagesBacked);
+	if (NULL == arena) {
+		munmap(base, mappedSize);
+	}
+
+	return arena;
+}
+
+/* API method - Description located at .h file */
+Arena* newSharedArena(const char* name, const size_t size, const int flags) {
+	Arena* arena;
+	int fd;
+
+	if (0 == size) {
+		return NULL;
+	}
+
+	/* An existing segment may hold records of a previous run that weren't collected yet */
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	/* The segment's pages are allocated as they're touched */
+	arena = newArenaOfFile(fd, size, flags, false);
+	close(fd);
+	if (NULL == arena) {
+		shm_unlink(name);
+	}
+
+	return arena;
+}
+
+/* API method - Description located at .h file */
+Arena* attachSharedArena(const char* name) {
+	Arena* arena;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	arena = attachArenaOfFile(fd, MAP_SHARED);
+	close(fd);
+
+	return arena;
+}
+
+/* API method - Description located at .h file */
+void unlinkSharedArena(const char* name) {
+	shm_unlink(name);
+}
+
+/* API method - Description located at .h file */
+Arena* newFileArena(const char* path, const size_t size, const int flags) {
+	Arena* arena;
+	int fd;
+
+	if (0 == size) {
+		return NULL;
+	}
+
+	/* An existing file may hold records of a previous run that weren't recovered yet */
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	arena = newArenaOfFile(fd, size, flags, true);
+	close(fd);
+	if (NULL == arena) {
+		unlink(path);
+	}
+
+	return arena;
+}
+
+/* API method - Description located at .h file */
+Arena* attachFileArena(const char* path) {
+	Arena* arena;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	/* A private mapping - whatever the attaching process changes never reaches the file */
+	arena = attachArenaOfFile(fd, MAP_PRIVATE);
+	close(fd);
+
+	return arena;
+}
+
+/* API method - Description located at .h file */
+void unlinkFileArena(const char* path) {
+	unlink(path);
+}
+
+/* API method - Description located at .h file */
+void* getSharedArenaRoot(const Arena* arena) {
+	return arena->base + SHARED_ARENA_ROOT_OFFSET;
+}
+
+/**
+ * Creates an Arena backed by a (newly created, empty) shared memory segment or file, and writes
+ * the header through which other processes attach to it
+ * @param fd The file descriptor of the segment or file
+ * @param size Desired size of the arena
+ * @param flags A combination of 'ArenaFlags'
+ * @param isBlocksReserved Whether or not to allocate the storage of the whole file up-front
+ * @return The newly allocated Arena, or NULL on failure
+ */
+static Arena* newArenaOfFile(const int fd, const size_t size, const int flags,
+                             const bool isBlocksReserved) {
+	SharedArenaHeader* header;
+	Arena* arena;
+	char* base;
+	size_t mappedSize;
+
+	mappedSize = roundUp(SHARED_ARENA_ROOT_OFFSET + size, sysconf(_SC_PAGESIZE));
+
+	if (0 != ftruncate(fd, mappedSize)) {
+		return NULL;
+	}
+
+	/* A write to a page of a sparse file whose block can't be allocated on the disk raises
+	 * SIGBUS */
+	if (true == isBlocksReserved && 0 != posix_fallocate(fd, 0, mappedSize)) {
+		return NULL;
+	}
+
+	base = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == base) {
+		return NULL;
+	}
+
+	arena = newArenaOfRegion(base, mappedSize, flags, false);
+	if (NULL == arena) {
+		munmap(base, mappedSize);
+		return NULL;
+	}
+
+	header = (SharedArenaHeader*) base;
+	header->base = base;
+	header->size = mappedSize;
+	header->magic = SHARED_ARENA_MAGIC;
+	arena->isShared = true;
+	__atomic_store_n(&arena->used, SHARED_ARENA_ROOT_OFFSET, __ATOMIC_SEQ_CST);
+
+	return arena;
+}
+
+/**
+ * Attaches to an Arena created by another process with 'newArenaOfFile(...)', at the address
+ * it's mapped at by its creator
+ * @param fd The file descriptor of the segment or file
+ * @param mapFlags MAP_SHARED or MAP_PRIVATE
+ * @return The attached Arena, or NULL on failure
+ */
+static Arena* attachArenaOfFile(const int fd, const int mapFlags) {
+	SharedArenaHeader header;
+	SharedArenaHeader* mappedHeader;
+	struct stat st;
+	Arena* arena;
+	char* base;
+
+	/* The header tells where the creator mapped the segment */
+	if (0 != fstat(fd, &st) || (size_t) st.st_size < sizeof(header)) {
+		return NULL;
+	}
+
+	mappedHeader = mmap(NULL, sizeof(header), PROT_READ, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == mappedHeader) {
+		return NULL;
+	}
+
+	header = *mappedHeader;
+	munmap(mappedHeader, sizeof(header));
+
+	if (SHARED_ARENA_MAGIC != header.magic
+	        || header.size != (size_t) st.st_size) {
+		return NULL;
+	}
+
+	/* Pointers within the segment are only valid at the creator's address - never map over
+	 * anything that is already mapped there */
+	base = mmap(header.base, header.size, PROT_READ | PROT_WRITE,
+	            mapFlags | MAP_FIXED_NOREPLACE, fd, 0);
+	if (MAP_FAILED == base) {
+		return NULL;
+	}
+
+	/* Kernels that don't know MAP_FIXED_NOREPLACE treat the address as a hint */
+	if (header.base != base) {
+		munmap(base, header.size);
+		return NULL;
+	}
+
+	arena = newArenaOfRegion(base, header.size, ARENA_FLAG_NONE, false);
+	if (NULL == arena) {
+		munmap(base, header.size);
+		return NULL;
+	}
+
+	arena->isShared = true;
+	__atomic_store_n(&arena->used, header.size, __ATOMIC_SEQ_CST);
+
+	return arena;
+}
+
+/**
+ * Creates the Arena object of a mapped region, locking or prefaulting the region as requested
+ * @param base Start of the region
+ * @param size Size of the region
+ * @param flags A combination of 'ArenaFlags'
+ * @param isHugePagesBacked Whether the region is backed by explicit huge pages
+ * @return The newly allocated Arena, or NULL on failure
+ */
+static Arena* newArenaOfRegion(char* base, const size_t size, const int flags,
+                               const bool isHugePagesBacked) {
+	Arena* arena;
+
+	//TODO: think if malloc failures need to be handled
+	arena = malloc(sizeof(*arena));
+	if (NULL == arena) {
+		return NULL;
+	}
+
+	arena->base = base;
+	arena->size = size;
+	arena->isHugePagesBacked = isHugePagesBacked;
+	arena->isShared = false;
+	__atomic_store_n(&arena->used, 0, __ATOMIC_SEQ_CST);
+
+	/* Locking and prefaulting are best-effort - an arena that can't be locked (e.g due to
+	 * RLIMIT_MEMLOCK) is still usable */
+	arena->isLocked = (0 != (flags & ARENA_FLAG_LOCK))
+	        && (0 == mlock(base, size));
+	if (0 != (flags & ARENA_FLAG_PREFAULT) && false == arena->isLocked) {
+		prefaultRegion(base, size);
+	}
+
+	return arena;
+}
+
+/**
+ * Maps an anonymous private region
+ * @param size Size of the region
+ * @param isHugePages Whether or not to back the region by explicit huge pages
+ * @param isReserveOnly Whether or not to skip swap space reservation for the region
+ * @return The mapped region or NULL on failure
+ */
+static char* mapRegion(const size_t size, const bool isHugePages,
+                       const bool isReserveOnly) {
+	void* base;
+	int flags;
+
+	flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	if (true == isHugePages) {
+		flags |= MAP_HUGETLB;
+	}
+
+	if (true == isReserveOnly) {
+		flags |= MAP_NORESERVE;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+	return (MAP_FAILED == base) ? NULL : base;
+}
+
+/**
+ * Faults in all pages of a region by writing to each page
+ * @param base Start of the region
+ * @param size Size of the region
+ */
+static void prefaultRegion(char* base, const size_t size) {
+	size_t pageSize;
+	size_t offset;
+
+	pageSize = sysconf(_SC_PAGESIZE);
+	for (offset = 0; offset < size; offset += pageSize) {
+		((volatile char*) base)[offset] = 0;
+	}
+}
+
+/* API method - Description located at .h file */
+void* arenaAlloc(Arena* arena, const size_t size) {
+	size_t alignedSize;
+	size_t offset;
+
+	if (NULL == arena) {
+		return NULL;
+	}
+
+	alignedSize = roundUp(size, ARENA_ALIGNMENT);
+	offset = __atomic_fetch_add(&arena->used, alignedSize, __ATOMIC_SEQ_CST);
+
+	/* An allocation that doesn't fit leaves 'used' beyond the arena size, so every following
+	 * allocation fails as well - the arena is exhausted at this point anyway */
+	if (offset + alignedSize > arena->size) {
+		return NULL;
+	}
+
+	return arena->base + offset;
+}
+
+/* API method - Description located at .h file */
+size_t getArenaRemainder(const Arena* arena, const void* ptr) {
+	const char* p = ptr;
+
+	if (p < arena->base || p >= arena->base + arena->size) {
+		return 0;
+	}
+
+	return arena->base + arena->size - p;
+}
+
+/* API method - Description located at .h file */
+bool isArenaHugePagesBacked(const Arena* arena) {
+	return arena->isHugePagesBacked;
+}
+
+/* API method - Description located at .h file */
+void arenaDestroy(Arena* arena) {
+	if (NULL != arena) {
+		if (true == arena->isLocked) {
+			munlock(arena->base, arena->size);
+		}
+
+		munmap(arena->base, arena->size);
+		free(arena);
+	}
+}
+
+/**
+ * Rounds a value up to a multiple of a given alignment
+ * @param value The value to round
+ * @param alignment The alignment
+ * @return The rounded value
+ */
+static inline size_t roundUp(const size_t value, const size_t alignment) {
+	return ((value + alignment - 1) / alignment) * alignment;
+}
@@ -0,0 +1,153 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file arena.h
+ * @author Barak Sason Rofman
+ * @brief This module provides a memory arena - a single mmap'ed region that is reserved once and
+ * from which allocations are carved with a lock-free bump pointer.
+ * By default, pages are committed lazily as they're touched. The region may optionally be backed
+ * by huge pages (explicit huge pages where available, falling back to transparent huge pages),
+ * prefaulted and locked in memory.
+ * Memory is never returned to the arena - it's released all at once when the arena is destroyed.
+ * An arena may also be backed by a named POSIX shared memory segment, which other processes attach
+ * to at the same address, so pointers into the arena are valid in all of them - or by a regular
+ * file, whose contents outlive the process that created it.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+enum ArenaFlags {
+	ARENA_FLAG_NONE = 0, /* Pages are faulted lazily */
+	ARENA_FLAG_PREFAULT = 1 << 0, /* Fault all pages in when the arena is created */
+	ARENA_FLAG_LOCK = 1 << 1, /* Lock all pages in memory (mlock) */
+	ARENA_FLAG_HUGEPAGES = 1 << 2, /* Back the arena by huge pages */
+};
+
+struct Arena;
+
+/**
+ * Creates a new Arena
+ * @param size Desired size of the arena (rounded up to a whole number of pages)
+ * @param flags A combination of 'ArenaFlags'
+ * @return The newly allocated Arena, or NULL on failure
+ */
+struct Arena* newArena(const size_t size, const int flags);
+
+/**
+ * Creates a new Arena backed by a named POSIX shared memory segment (the segment must not exist)
+ * NOTE: Huge pages aren't supported for shared memory segments, the flag is ignored
+ * @param name Name of the segment (as accepted by shm_open, e.g. "/name")
+ * @param size Desired size of the arena (rounded up to a whole number of pages)
+ * @param flags A combination of 'ArenaFlags'
+ * @return The newly allocated Arena, or NULL on failure
+ */
+struct Arena* newSharedArena(const char* name, const size_t size,
+                             const int flags);
+
+/**
+ * Attaches to an Arena created by another process with 'newSharedArena(...)'. The segment is
+ * mapped at the address it's mapped at by its creator. Nothing can be allocated from an attached
+ * arena
+ * @param name Name of the segment
+ * @return The attached Arena, or NULL on failure (including if the address is taken in this
+ * process)
+ */
+struct Arena* attachSharedArena(const char* name);
+
+/**
+ * Removes the name of a shared memory segment - the memory is released once all processes have
+ * destroyed their Arena of it
+ * @param name Name of the segment
+ */
+void unlinkSharedArena(const char* name);
+
+/**
+ * Creates a new Arena backed by a regular file (the file must not exist). The file's storage is
+ * allocated up-front, and its pages stay at the page cache (and are written back to the file) if
+ * the process dies
+ * NOTE: Huge pages aren't supported for files, the flag is ignored
+ * @param path Path of the file
+ * @param size Desired size of the arena (rounded up to a whole number of pages)
+ * @param flags A combination of 'ArenaFlags'
+ * @return The newly allocated Arena, or NULL on failure
+ */
+struct Arena* newFileArena(const char* path, const size_t size, const int flags);
+
+/**
+ * Attaches to an Arena created (by any process) with 'newFileArena(...)', for reading. The file is
+ * mapped privately at the address it was mapped at by its creator - changes to the attached arena
+ * never reach the file. Nothing can be allocated from an attached arena
+ * @param path Path of the file
+ * @return The attached Arena, or NULL on failure (including if the address is taken in this
+ * process)
+ */
+struct Arena* attachFileArena(const char* path);
+
+/**
+ * Removes a file created with 'newFileArena(...)'
+ * @param path Path of the file
+ */
+void unlinkFileArena(const char* path);
+
+/**
+ * Returns the first allocation carved from a shared memory or file backed arena, through which the
+ * processes that attach to it may find everything else
+ * @param arena The relevant Arena
+ * @return The first allocation of the arena
+ */
+void* getSharedArenaRoot(const struct Arena* arena);
+
+/**
+ * Carves a cache line aligned allocation from the arena
+ * NOTE: This API is thread-safe
+ * @param arena The Arena to allocate from
+ * @param size Size of the allocation
+ * @return A pointer to the allocation, or NULL if the arena is exhausted
+ */
+void* arenaAlloc(struct Arena* arena, const size_t size);
+
+/**
+ * Returns the number of bytes of the arena from a given address up to the arena's end
+ * @param arena The relevant Arena
+ * @param ptr The address
+ * @return The number of bytes from 'ptr' to the end of the arena, or 0 if 'ptr' isn't within the
+ * arena
+ */
+size_t getArenaRemainder(const struct Arena* arena, const void* ptr);
+
+/**
+ * Checks whether or not the arena is backed by explicit huge pages
+ * @param arena The relevant Arena
+ * @return True if the arena is backed by explicit huge pages or false otherwise
+ */
+bool isArenaHugePagesBacked(const struct Arena* arena);
+
+/**
+ * Releases all resources associated with the given Arena (including all allocations carved
+ * from it)
+ * @param arena The Arena to destroy
+ */
+void arenaDestroy(struct Arena* arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,181 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file numa.c
+ * @author Barak Sason Rofman
+ * @brief This module provides NUMA topology queries and thread placement helpers.
+ * Topology is read from sysfs, so no external NUMA library is required - on systems that don't
+ * expose NUMA information a single node is assumed.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <syscall.h>
+
+#include "numa.h"
+
+#define NODES_ONLINE_PATH "/sys/devices/system/node/online"
+#define NODE_CPULIST_PATH_FORMAT "/sys/devices/system/node/node%d/cpulist"
+#define PATH_LEN 64
+#define MAX_NUMA_NODES 64 /* Nodes with higher ids are ignored */
+
+static pthread_once_t nodesDiscoveryOnce = PTHREAD_ONCE_INIT;
+static int nodeIds[MAX_NUMA_NODES]; /* The sysfs ids of the usable nodes, by their number */
+static int nodesNum;
+
+static void discoverNodes();
+static int readNodeCpus(const int nodeId, cpu_set_t* cpuSet);
+
+/* API method - Description located at .h file */
+int getNumaNodesNum() {
+	pthread_once(&nodesDiscoveryOnce, discoverNodes);
+
+	return nodesNum;
+}
+
+/* API method - Description located at .h file */
+int getCurrentNumaNode() {
+	unsigned int cpu;
+	unsigned int nodeId;
+	int node;
+
+	pthread_once(&nodesDiscoveryOnce, discoverNodes);
+
+	if (0 != syscall(SYS_getcpu, &cpu, &nodeId, NULL)) {
+		return 0;
+	}
+
+	for (node = 0; node < nodesNum; ++node) {
+		if ((int) nodeId == nodeIds[node]) {
+			return node;
+		}
+	}
+
+	return 0;
+}
+
+/* API method - Description located at .h file */
+int setThreadNumaAffinity(pthread_t thread, const int node) {
+	cpu_set_t cpuSet;
+
+	pthread_once(&nodesDiscoveryOnce, discoverNodes);
+
+	if (0 > node || nodesNum <= node || 0 == readNodeCpus(nodeIds[node], &cpuSet)
+	        || 0 != pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet)) {
+		return NUMA_STATUS_FAILURE;
+	}
+
+	return NUMA_STATUS_SUCCESS;
+}
+
+/**
+ * Discover the usable NUMA nodes - the online nodes that have CPUs (memory-only nodes, and nodes
+ * that are possible but not online, have no threads to serve). If none is found, a single node is
+ * assumed
+ */
+static void discoverNodes() {
+	FILE* f;
+	int first;
+
+	nodesNum = 0;
+	f = fopen(NODES_ONLINE_PATH, "r");
+
+	if (NULL != f) {
+		/* The format is a comma separated list of nodes and node ranges, e.g "0-1,3" */
+		while (1 == fscanf(f, "%d", &first)) {
+			cpu_set_t cpuSet;
+			int last;
+			int nodeId;
+
+			if (1 != fscanf(f, "-%d", &last)) {
+				last = first;
+			}
+
+			for (nodeId = first; nodeId <= last && nodesNum < MAX_NUMA_NODES;
+			        ++nodeId) {
+				if (0 != readNodeCpus(nodeId, &cpuSet)) {
+					nodeIds[nodesNum++] = nodeId;
+				}
+			}
+
+			if (',' != fgetc(f)) {
+				break;
+			}
+		}
+
+		fclose(f);
+	}
+
+	if (0 == nodesNum) {
+		nodeIds[0] = 0;
+		nodesNum = 1;
+	}
+}
+
+/**
+ * Read the CPUs of a NUMA node
+ * @param nodeId The sysfs id of the node
+ * @param cpuSet The CPUs of the node (output)
+ * @return Number of CPUs of the node (0 if it has none, or they can't be read)
+ */
+static int readNodeCpus(const int nodeId, cpu_set_t* cpuSet) {
+	char path[PATH_LEN];
+	FILE* f;
+	int first;
+	int cpusNum;
+
+	CPU_ZERO(cpuSet);
+	snprintf(path, sizeof(path), NODE_CPULIST_PATH_FORMAT, nodeId);
+	f = fopen(path, "r");
+
+	if (NULL == f) {
+		return 0;
+	}
+
+	cpusNum = 0;
+
+	/* The format is a comma separated list of CPUs and CPU ranges, e.g "0-3,8-11" (empty if the
+	 * node has no CPUs) */
+	while (1 == fscanf(f, "%d", &first)) {
+		int last;
+		int cpu;
+
+		if (1 != fscanf(f, "-%d", &last)) {
+			last = first;
+		}
+
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+			CPU_SET(cpu, cpuSet);
+			++cpusNum;
+		}
+
+		if (',' != fgetc(f)) {
+			break;
+		}
+	}
+
+	fclose(f);
+
+	return cpusNum;
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file numa.h
+ * @author Barak Sason Rofman
+ * @brief This module provides NUMA topology queries and thread placement helpers.
+ * Topology is read from sysfs, so no external NUMA library is required - on systems that don't
+ * expose NUMA information a single node is assumed.
+ * Only the usable nodes (online, with CPUs) are counted, and they are numbered consecutively from
+ * 0 in the order of their ids, so node numbers may be used as indexes even if the ids are sparse.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <pthread.h>
+
+enum NumaStatusCodes {
+	NUMA_STATUS_FAILURE = -1, NUMA_STATUS_SUCCESS
+};
+
+/**
+ * Returns the number of usable NUMA nodes in the system (online nodes that have CPUs)
+ * @return The number of usable NUMA nodes in the system (at least 1)
+ */
+int getNumaNodesNum();
+
+/**
+ * Returns the NUMA node of the CPU the calling thread is currently running on
+ * @return The number of the NUMA node of the calling thread (0 if unknown)
+ */
+int getCurrentNumaNode();
+
+/**
+ * Restricts a thread to run only on the CPUs of a given NUMA node
+ * @param thread The thread to restrict
+ * @param node The number of the NUMA node to restrict the thread to
+ * @return NUMA_STATUS_SUCCESS on success, NUMA_STATUS_FAILURE on failure
+ */
+int setThreadNumaAffinity(pthread_t thread, const int node);
+
+#endif /* NUMA_H */
@@ -140,10 +140,51 @@ void* dequeue(Queue* queue) {
 	return NULL;
 }
 
+/* API method - Description located at .h file */
+int changeQueueCapacity(Queue* queue, int newCapacity) {
+	if (NULL != queue && 0 < newCapacity) {
+		int res;
+
+		pthread_mutex_lock(&queue->queueLock); /* Lock */
+		{
+			void** elements;
+
+			//TODO: think if malloc failures need to be handled
+			if (queue->size <= newCapacity
+			        && NULL
+			                != (elements = malloc(
+			                        newCapacity * sizeof(*elements)))) {
+				int i;
+
+				/* Re-lay the elements from position 0, keeping their order */
+				for (i = 0; i < queue->size; ++i) {
+					elements[i] = queue->elements[queue->head];
+					queue->head = getNextPos(queue->head, queue->capacity);
+				}
+
+				free(queue->elements);
+				queue->elements = elements;
+				queue->capacity = newCapacity;
+				queue->head = 0;
+				queue->tail = getNextPos(queue->size - 1, newCapacity);
+				res = Q_STATUS_SUCCESS;
+			} else {
+				res = Q_STATUS_FAILURE;
+			}
+		}
+		pthread_mutex_unlock(&queue->queueLock); /* Unlock */
+
+		return res;
+	}
+
+	return Q_STATUS_FAILURE;
+}
+
 /* API method - Description located at .h file */
 void queueDestroy(Queue* queue) {
 	if (NULL != queue) {
 		pthread_mutex_destroy(&queue->queueLock);
+		free(queue->elements);
 		free(queue);
 	}
 }
@@ -52,6 +52,15 @@ int enqueue(struct Queue* queue, void* element);
  */
 void* dequeue();
 
+/**
+ * Changes the capacity of the queue, keeping the elements it currently holds
+ * @param queue The Queue to change
+ * @param newCapacity The desired capacity
+ * @return Q_STATUS_SUCCESS on success, Q_STATUS_FAILURE on failure (if the queue holds more
+ * elements than the desired capacity)
+ */
+int changeQueueCapacity(struct Queue* queue, int newCapacity);
+
 /**
  * Releases all resources associated with the given Queue
  * @param queue The Queue to destroy
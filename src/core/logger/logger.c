@@ -29,6 +29,15 @@
  * Level 3 - In case the shared buffer is also full and not yet
  * 			drained, a worker thread will fall to the lowest (and slowest) form of writing - direct
  * 			file write.
+ * In shared memory mode, all buffers are carved from a POSIX shared memory segment and drained by a
+ * separate collector process (see 'runLoggerCollector(...)'), so the application neither formats
+ * records nor writes the log file, and the buffered messages outlive the application.
+ * With persistent buffers, all buffers are carved from a file mapping instead and drained as usual,
+ * so the messages not yet drained when the process dies may be recovered from the file (see
+ * 'recoverPersistentBuffers(...)').
+ * In flight recorder mode, the buffers aren't drained - their oldest messages are overwritten, and
+ * the recent messages of all buffers are written only when a trigger fires (see
+ * 'setFlightRecorderMode(...)').
  * @license Apache License, Version 2.0
  * @copywrite (C) [2019] [Barak Sason Rofman]
  */
@@ -42,82 +51,298 @@
 #include <stdatomic.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <syscall.h>
 
 #include "../api/logger.h"
 #include "messageQueue/messageQueue.h"
 #include "messageQueue/messageData.h"
 #include "../common/linkedList/linkedList.h"
 #include "../common/queue/queue.h"
+#include "../common/numa/numa.h"
+#include "../common/arena/arena.h"
+#include "stats/threadStats.h"
+#include "stats/latencyHistogram.h"
+#include "moduleLevels/moduleLevels.h"
+#include "sharedStrings/sharedStrings.h"
+#include "sinks/sinks.h"
 #include "../../writeMethods/writeMethods.h"
 
-enum logMethod {
-	LM_PRIVATE_BUFFER, LM_SHARED_BUFFER, LM_DIRECT_WRITE
-};
-
 #define BUFFSIZE 65536 /* Used for buffering for the IO of log file */
 #define LOGGERTHREADNAME "LoggerThread" /* Name of the logger thread */
+#define LOGGERTHREADNAMELEN 16 /* Maximum length of a thread name (including terminator) */
+#define ALL_NUMA_NODES -1 /* Used by a drainer that drains the private buffers of all nodes */
+#define DEFAULT_IDLE_RELEASE_MSEC 10000 /* Idle time after which a buffer's memory is released */
+#define MIN_IDLE_CHECK_INTERVAL_MSEC 100 /* Minimal interval between idle buffers checks */
+#define DEFAULT_LATENCY_SAMPLE_RATE 256 /* One of every 256 messages of a thread is timed */
+#define LOG_LEVELS_NUM (LOG_LEVEL_TRACE + 1)
+#define MAX_LARGE_ARGS_SIZE 65536 /* Arguments of large messages are truncated to this size */
+#define CRASH_SIGNALS_NUM (sizeof(crashSignals) / sizeof(crashSignals[0]))
+#define CRASH_MARKER_LEN 64 /* Room for the arguments of the crash drain marker records */
+#define SHARED_SEGMENT_NAME_LEN 256 /* Maximum length of a segment name (including terminator) */
+#define SHARED_SEGMENT_ALIGNMENT 64 /* Allocations from the segment's arena are cache line aligned */
+#define SHARED_STRINGS_NUM 4096 /* Maximum number of distinct names copied into the segment */
+#define SHARED_STRINGS_MEMORY_SIZE (1024 * 1024) /* Room for the names copied into the segment */
+#define COLLECTOR_POLL_INTERVAL_MSEC 100 /* Interval of the collector's application liveness checks */
+#define DETACH_TIMEOUT_MSEC 10000 /* Time the application waits for the collector's final drain */
+#define FLIGHT_RECORDER_CHECK_INTERVAL_MSEC 100 /* Maximal delay of a dump whose wake up was missed */
+
+typedef struct LoggerDrainer {
+	/** The NUMA node whose private buffers are drained (or ALL_NUMA_NODES) */
+	int numaNode;
+	/** Whether new data was written since the drainer last checked */
+	atomic_bool isNewData;
+	/** Whether urgent messages were added to priority lanes since the drainer last drained them */
+	atomic_bool isPriorityData;
+	/** The draining thread */
+	pthread_t thread;
+	/** Posted in order to wake the draining thread up */
+	sem_t loopSem;
+	/** Posted by the draining thread when it's waiting for new data */
+	sem_t waitingSem;
+} LoggerDrainer;
+
+typedef struct PrivateBuffersAllocation {
+	/** The NUMA node to allocate buffers on */
+	int numaNode;
+	/** Size of each buffer */
+	int size;
+	/** Number of buffers in the layout */
+	int number;
+	/** The layout to fill - only indices that belong to 'numaNode' are allocated */
+	struct MessageQueue** buffers;
+	/** Size of the node's arena to create before allocating (0 if it already exists) */
+	size_t arenaSize;
+} PrivateBuffersAllocation;
+
+typedef struct LogReservation {
+	/** Whether a reservation is pending a commit */
+	bool isActive;
+	/** The private buffer the slot was reserved at, or NULL if the payload is built at the
+	 * thread's scratch buffer */
+	struct MessageQueue* mq;
+	/** The reserved message slot (private buffer reservations only) */
+	struct MessageData* md;
+	/** The logging level of the message */
+	int loggingLevel;
+	/** File name that originated the call */
+	char* file;
+	/** Method that originated the call */
+	const char* func;
+	/** Line that originated the call */
+	int line;
+} LogReservation;
+
+/* The root of a shared memory segment or of a persistent buffers file (where only the buffers and
+ * the process of the application are relevant) */
+typedef struct SharedSegment {
+	/** Set once the segment is fully initialized */
+	atomic_bool isReady;
+	/** The process of the application */
+	pid_t applicationPid;
+	/** The process of the collector (0 if no collector has attached yet) */
+	atomic_int collectorPid;
+	/** Set when the application terminates the logger */
+	atomic_bool isDetached;
+	/** Posted by the application when it terminates the logger */
+	sem_t detachSem;
+	/** Posted by the collector once it drained all buffers after the application detached */
+	sem_t drainedSem;
+	/** The drainer of all buffers - its semaphores are shared by both processes */
+	LoggerDrainer drainer;
+	/** Maximum message length */
+	int maxMsgLen;
+	/** Maximum additional arguments length */
+	int maxArgsLen;
+	/** Number of private buffers */
+	int privateBuffersNum;
+	/** The private buffers (carved from the segment) */
+	struct MessageQueue** privateBuffers;
+	/** The shared buffer (carved from the segment) */
+	struct MessageQueue* sharedBuffer;
+} SharedSegment;
 
 static char* logFileBuff;
 static int privateBuffersNum;
 static int maxMsgLen;
 static int maxArgsLen;
-static int privateBuffSize;
-static int newPrivateBuffSize;
-static int newPrivateBuffersNumber;
+static atomic_int privateBuffSize;
+static atomic_int newPrivateBuffSize;
+static atomic_int newPrivateBuffersNumber;
 static atomic_bool isTerminate;
-static atomic_bool isNewData;
 static atomic_bool isDynamicAllocation;
-static atomic_bool arePrivateBuffersActive;
-static atomic_bool arePrivateBuffersChangingSize;
-static atomic_bool arePrivateBuffersChangingNumber;
+static atomic_bool isLayoutChangeRequested;
+static atomic_bool isIdleReleaseEnabled;
+static atomic_bool isDuplicatesSuppressed;
+static atomic_int idleReleaseThresholdMsec;
 static atomic_int logLevel;
+long long loggerLevelsEpoch = LOG_LEVELS_EPOCH_STEP; /* Exposed for the call site check of 'LOG_MSG' */
+static atomic_int dynamicBuffersNum;
+static atomic_int latencySampleRate; /* 0 (disabled) or a power of 2 */
+static atomic_int latencySelfLogIntervalMsec;
+static long long lastLatencySelfLogMsec;
+static struct LatencyHistogram* callLatencyHistograms[LOG_LEVELS_NUM][LM_METHODS_NUM];
+static struct LatencyHistogram* endToEndLatencyHistograms[LM_METHODS_NUM];
 static FILE* logFile;
 static pthread_mutex_t loggerLock;
 static pthread_mutex_t sharedBufferlock;
 static pthread_mutex_t dynamicllyAllocaedLock;
-static pthread_t loggerThread;
-static struct Queue* privateBuffersQueue; /* Threads take and return buffers from this */
-static struct MessageQueue** privateBuffers; /* Logger thread iterated over this */
+static pthread_rwlock_t privateBuffersLayoutLock; /* Guards layout changes from drainers */
+static struct Queue** privateBuffersQueues; /* Per NUMA node - threads take and return buffers from these */
+static struct MessageQueue** privateBuffers; /* Logger threads iterate over this */
 static struct MessageQueue* sharedBuffer;
 __thread struct MessageQueue* tlmq; /* Thread Local Message Queue */
+__thread LoggerDrainer* tlDrainer; /* The drainer of the thread local message queue */
+__thread struct ThreadStats* tlStats; /* Thread Local statistics counters */
+__thread unsigned int tlCallSampleCounter; /* Thread Local call latency sampling counter */
+__thread unsigned int tlWriteSampleCounter; /* Thread Local end-to-end latency sampling counter */
+__thread unsigned long long loggerRandomState; /* Exposed for the sampling of 'LOG_SAMPLED' */
+__thread LogReservation tlReservation; /* Thread Local reservation of 'logReserve(...)' */
+__thread char* tlReserveScratch; /* Thread Local payload buffer when a slot can't be reserved */
 static struct LinkedList* dynamicllyAllocaedPrivateBuffers;
-static sem_t loggerLoopSem;
-static sem_t loggerWaitingSem;
+static LoggerDrainer* drainers; /* The first drainer is the main logger thread */
+static int drainersNum;
+static int numaNodesNum;
+static bool isNumaAware;
+static bool isPerNodeDraining;
+static struct Arena** arenas; /* Per NUMA node - all pre-allocated buffers are carved from these */
+static int arenaFlags;
 static void (*writeMethod)();
+static const int crashSignals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+static struct sigaction prevCrashActions[CRASH_SIGNALS_NUM]; /* Restored when the drain is done */
+static bool isCrashDrainInstalled;
+static atomic_bool isCrashDraining;
+static int crashDrainBudgetMsec;
+static int logFileFd; /* The log file is written directly by the crash drain */
+static char sharedSegmentName[SHARED_SEGMENT_NAME_LEN]; /* Empty unless shared memory mode is set */
+static char persistentBuffersPath[PATH_MAX]; /* Empty unless persistent buffers are set */
+static SharedSegment* sharedSegment; /* Set if the buffers are at a segment or a file */
+static struct Arena* sharedSegmentArena; /* All buffers are carved from it if it's set */
+static struct SharedStrings* sharedStrings; /* Copies of names at the segment (application only) */
+static bool isSharedMemoryMode; /* Set in the application if the buffers are drained by a collector */
+static bool isCollector; /* Set in the collector process */
+static struct Arena* recoveryArena; /* The file whose buffers are being recovered */
+static bool isFlightRecorderMode; /* Set if the buffers are overwritten and only dumped on triggers */
+static int flightRecorderWindowMsec; /* How far back a dump goes */
+static int flightRecorderTriggerLevel; /* LOG_LEVEL_NONE unless messages trigger a dump */
+static int flightRecorderTriggerSignal; /* 0 unless a signal triggers a dump */
+static struct sigaction prevFlightRecorderAction; /* Restored when the logger is terminated */
+static atomic_bool isFlightRecorderTriggered;
+static MessageRef* flightRecorderRefs; /* Allocated up-front - dumps happen under error pressure */
+static char* flightRecorderArgsBuf; /* Room for the arguments of the largest message */
+static int flightRecorderArgsBufLen;
+static int priorityLaneLevel; /* LOG_LEVEL_NONE unless urgent messages take a priority lane */
+static int priorityLaneSize; /* Size of the priority lane of each private buffer */
+static bool isPriorityLanes; /* Set if the private buffers of the logger have priority lanes */
+static struct LogSinks* logSinks; /* NULL unless sinks were added - the log file is one of them */
 
 static bool isValitInitConditions(const int threadsNumArg,
                                   const int privateBuffSize,
                                   const int sharedBuffSize,
-                                  const int loggingLevel);
+                                  const int loggingLevel,
+                                  const int maxArgsLenArg);
 static void setStaticValues(int privateBuffSizeArg, const int threadsNumArg,
                             const int maxArgsLenArg, const int maxMsgLenArg,
                             const int loggingLevel, void (*writeMethodArg)(),
                             const bool isDynamicAllocation);
 static void initSynchronizationElements();
+static void initDrainers();
 static void initMessageQueues(const int sharedBuffSize, const int maxArgsLenArg);
-static void startLoggerThread();
+static void startLoggerThreads();
+static void stopLoggerThreads();
 static int createLogFile();
-static void* runLogger();
+static int createSharedSegment(const int threadsNumArg,
+                               const int privateBuffSize,
+                               const int sharedBuffSize,
+                               const int maxArgsLenArg);
+static void destroySharedSegment();
+static void publishSharedSegment();
+static void detachSharedSegment();
+static int claimSharedSegment(SharedSegment* segment);
+static void releaseSharedSegment(SharedSegment* segment);
+static void waitForApplicationDetach(SharedSegment* segment);
+static inline bool isProcessAlive(const pid_t pid);
+static int recoverQueue(struct MessageQueue* mq, const int maxArgsLenArg,
+                        FILE* outFile, void (*writeMethodArg)());
+static bool isRecoverableString(const char* str);
+static inline void internMessageLocation(char** file, const char** func);
+static void* runLogger(void* drainerArg);
 static void freeResources();
 static void initsharedBuffer(const int sharedBuffSize);
-static void initPrivateBuffers(const int privateBuffSize);
+static void initPrivateBuffers(const int privateBuffSize,
+                               const int sharedBuffSize);
 static int writeTosharedBuffer(const int loggingLevel, char* file,
                                const char* func, const int line, va_list* args,
                                const char* msg);
-static inline void drainPrivateBuffers();
+static inline void drainPrivateBuffers(LoggerDrainer* drainer);
+static void drainPriorityLanes(LoggerDrainer* drainer);
+static inline void drainPrivateBuffer(struct MessageQueue* mq);
 static inline void drainSharedBuffer();
-static inline bool isLoggingValid(const int loggingLevel, char* msg);
+static inline void drainQueue(struct MessageQueue* mq);
+static inline bool isLoggingLevelValid(const int loggingLevel);
+static inline bool isLoggingValid(char* msg);
+static inline void logMessageList(const int loggingLevel, char* file,
+                                  const char* func, const int line,
+                                  va_list* args, char* msg);
+static int logMessageArgs(const int loggingLevel, char* file, const char* func,
+                          const int line, va_list* args, char* msg);
+static inline int writeToPriorityLane(const int loggingLevel, char* file,
+                                      const char* func, const int line,
+                                      va_list* args, const char* msg);
+static void logLargeMessageArgs(const int loggingLevel, char* file,
+                                const char* func, const int line, va_list* args,
+                                char* msg, int argsSize);
+static inline void advanceLevelsEpoch();
 static inline char* getFileName(char* filePath);
 static void drainDynamicllyAllocaedPrivateBuffers();
 static void destroyDynamicallyAllocatedBuffers();
-static void setArePrivateBuffersActive(const bool arePrivateBuffersActiveArg);
-static inline bool arePrivateBuffersUsed();
-static void doChangePrivateBuffersSize();
-static inline void setArePrivateBuffersChangingSize(
-        const bool arePrivateBuffersChangingSizeArg);
-static void doChangePrivateBuffersNumber();
-static inline void setArePrivateBuffersChangingNumber(
-        const bool arePrivateBuffersChangingNumberArg);
+static void requestPrivateBuffersLayoutChange(const int newSize,
+                                              const int newNumber);
+static void doChangePrivateBuffersLayout();
+static void retirePrivateBuffers();
+static inline void wakeLoggerThread(LoggerDrainer* drainer);
+static struct MessageQueue** allocatePrivateBuffers(const int size,
+                                                    const int number,
+                                                    const int sharedBuffSize);
+static void* allocateNodePrivateBuffers(void* allocationArg);
+static struct MessageQueue* newPrivateBuffer(const int size,
+                                             const bool isDynamicallyAllocated,
+                                             struct Arena* arena);
+static inline size_t getPrivateBufferMemorySize(const int size);
+static int enqueuePrivateBuffers(struct MessageQueue** buffers,
+                                 const int number);
+static struct MessageQueue* takePrivateBuffer(const int numaNode);
+static inline LoggerDrainer* getDrainer(const int numaNode);
+static void releaseIdlePrivateBuffers(const int numaNode);
+static void waitForNewData(LoggerDrainer* drainer);
+static inline long long getMonotonicTimeMsec();
+static inline long long getMonotonicTimeNsec();
+static void getRealtimeDeadline(struct timespec* deadline, const int timeoutMsec);
+static void writeAndCount(const struct MessageData* md, FILE* logFile);
+static inline void flushLogFile();
+static inline void lockSharedBuffer();
+static inline void countStat(const int counter, const unsigned long long value);
+static void initLatencyHistograms();
+static void destroyLatencyHistograms();
+static inline bool isLatencySampled(unsigned int* sampleCounter);
+static void selfLogLatency();
+static void selfLogLatencySummary(const char* name, const int logMethod,
+                                  LatencySummary* summary);
+static void selfLog(const char* func, const int line, const char* msg, ...);
+static void crashDrainHandler(int sig);
+static void restoreCrashHandlers();
+static void crashDrain(const int sig);
+static void writeCrashMarker(const char* msg, unsigned long long value);
+static inline void checkFlightRecorderTrigger(const int loggingLevel);
+static void flightRecorderSignalHandler(int sig);
+static void dumpFlightRecorder();
+static void allocateFlightRecorderDump();
+static int compareMessageRefs(const void* ref1, const void* ref2);
+static int getLatencySummary(struct LatencyHistogram** histograms,
+                             const int histogramsNum, LatencySummary* summary);
 
 /* API method - Description located at .h file */
 int initLogger(const int threadsNumArg, const int privateBuffSize,
@@ -126,13 +351,42 @@ int initLogger(const int threadsNumArg, const int privateBuffSize,
                const bool isDynamicAllocationArg, void (*writeMethod)()) {
 	if (true
 	        == isValitInitConditions(threadsNumArg, privateBuffSize,
-	                                 sharedBuffSize, loggingLevel)) {
+	                                 sharedBuffSize, loggingLevel, maxArgsLenArg)) {
 		setStaticValues(privateBuffSize, threadsNumArg, maxArgsLenArg,
 		                maxMsgLenArg, loggingLevel, writeMethod,
 		                isDynamicAllocationArg);
 		initSynchronizationElements();
+		initDrainers();
+		initLatencyHistograms();
 		initMessageQueues(sharedBuffSize, maxArgsLenArg);
-		startLoggerThread();
+
+		if (true == isFlightRecorderMode) {
+			allocateFlightRecorderDump();
+		}
+
+		if (NULL != sharedSegment) {
+			publishSharedSegment();
+		}
+
+		if (NULL != logSinks) {
+			startLogSinks(logSinks, logFile, writeMethod);
+		}
+
+		/* In shared memory mode, the buffers are drained by the collector process */
+		if (false == isSharedMemoryMode) {
+			startLoggerThreads();
+		}
+
+		if (true == isFlightRecorderMode && 0 != flightRecorderTriggerSignal) {
+			struct sigaction action;
+
+			memset(&action, 0, sizeof(action));
+			action.sa_handler = flightRecorderSignalHandler;
+			action.sa_flags = SA_RESTART;
+			sigemptyset(&action.sa_mask);
+			sigaction(flightRecorderTriggerSignal, &action,
+			          &prevFlightRecorderAction);
+		}
 
 		return LOG_STATUS_SUCCESS;
 	}
@@ -146,16 +400,52 @@ int initLogger(const int threadsNumArg, const int privateBuffSize,
  * @param privateBuffSize Size of private buffers
  * @param sharedBuffSize Size of shared buffer
  * @param loggingLevel Logging level (one of the levels at 'logLevels')
+ * @param maxArgsLenArg Maximum message arguments length
  * @return True of conditions are valid of false otherwise
  */
 static bool isValitInitConditions(const int threadsNumArg,
                                   const int privateBuffSize,
                                   const int sharedBuffSize,
-                                  const int loggingLevel) {
+                                  const int loggingLevel,
+                                  const int maxArgsLenArg) {
 	if ((threadsNumArg < 0) || (privateBuffSize < 2) || (sharedBuffSize < 2)
 	        || (loggingLevel < LOG_LEVEL_NONE)
-	        || (loggingLevel > LOG_LEVEL_TRACE)
-	        || (LOG_STATUS_SUCCESS != createLogFile())) {
+	        || (loggingLevel > LOG_LEVEL_TRACE)) {
+		return false;
+	}
+
+	/* The buffers are either at a shared memory segment or at a file, and neither is meant for
+	 * buffers that are overwritten rather than drained */
+	if (('\0' != sharedSegmentName[0] && '\0' != persistentBuffersPath[0])
+	        || (true == isFlightRecorderMode
+	                && ('\0' != sharedSegmentName[0]
+	                        || '\0' != persistentBuffersPath[0]))) {
+		return false;
+	}
+
+	/* In shared memory mode, the log file (and the sinks) are written by the collector process */
+	if ('\0' != sharedSegmentName[0] && NULL != logSinks) {
+		return false;
+	}
+
+	if ('\0' != sharedSegmentName[0]) {
+		isSharedMemoryMode = (LOG_STATUS_SUCCESS
+		        == createSharedSegment(threadsNumArg, privateBuffSize,
+		                               sharedBuffSize, maxArgsLenArg));
+		return isSharedMemoryMode;
+	}
+
+	if ('\0' != persistentBuffersPath[0]
+	        && LOG_STATUS_SUCCESS
+	                != createSharedSegment(threadsNumArg, privateBuffSize,
+	                                       sharedBuffSize, maxArgsLenArg)) {
+		return false;
+	}
+
+	if (LOG_STATUS_SUCCESS != createLogFile()) {
+		if (NULL != sharedSegment) {
+			destroySharedSegment();
+		}
 		return false;
 	}
 
@@ -176,17 +466,36 @@ static void setStaticValues(int privateBuffSizeArg, const int threadsNumArg,
                             const int maxArgsLenArg, const int maxMsgLenArg,
                             const int loggingLevel, void (*writeMethodArg)(),
                             const bool isDynamicAllocation) {
-	privateBuffSize = privateBuffSizeArg;
+	__atomic_store_n(&privateBuffSize, privateBuffSizeArg, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&newPrivateBuffSize, privateBuffSizeArg, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&newPrivateBuffersNumber, threadsNumArg, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&isLayoutChangeRequested, false, __ATOMIC_SEQ_CST);
 	privateBuffersNum = threadsNumArg;
 	maxMsgLen = maxMsgLenArg;
 	maxArgsLen = maxArgsLenArg;
 	setLoggingLevel(loggingLevel);
 	writeMethod = writeMethodArg;
 	setDynamicAllocation(isDynamicAllocation);
-	setArePrivateBuffersActive(true);
-	setArePrivateBuffersChangingSize(false);
-	setArePrivateBuffersChangingNumber(false);
 	dynamicllyAllocaedPrivateBuffers = newLinkedList();
+	/* A shared memory segment is a single arena, drained by a single collector */
+	numaNodesNum = (true == isNumaAware && NULL == sharedSegment) ?
+	        getNumaNodesNum() : 1;
+	/* The flight recorder's buffers aren't drained, the main logger thread dumps them all */
+	drainersNum = (true == isPerNodeDraining && false == isFlightRecorderMode) ?
+	        numaNodesNum : 1;
+	__atomic_store_n(&isFlightRecorderTriggered, false, __ATOMIC_SEQ_CST);
+	/* The segment is sized for the buffers alone, and the flight recorder's buffers aren't
+	 * drained */
+	isPriorityLanes = (LOG_LEVEL_NONE != priorityLaneLevel && NULL == sharedSegment
+	        && false == isFlightRecorderMode);
+
+	/* Releasing memory defeats the purpose of committing it up-front, so idle buffers release is
+	 * enabled by default only if the arena is committed lazily */
+	setIdleBuffersRelease(ARENA_FLAG_NONE == arenaFlags,
+	                      DEFAULT_IDLE_RELEASE_MSEC);
+	setLatencySampling(DEFAULT_LATENCY_SAMPLE_RATE);
+	setLatencySelfLog(0);
+	setDuplicatesSuppression(false);
 }
 
 /**
@@ -196,9 +505,33 @@ static void initSynchronizationElements() {
 	pthread_mutex_init(&loggerLock, NULL);
 	pthread_mutex_init(&sharedBufferlock, NULL);
 	pthread_mutex_init(&dynamicllyAllocaedLock, NULL);
+	pthread_rwlock_init(&privateBuffersLayoutLock, NULL);
 	initDirectWriteLock();
-	sem_init(&loggerLoopSem, 0, 0);
-	sem_init(&loggerWaitingSem, 0, 0);
+}
+
+/**
+ * Initialize the drainers of the buffers. In shared memory mode, the drainer lives in the segment,
+ * and its semaphores are shared with the collector process, which waits on them
+ */
+static void initDrainers() {
+	int i;
+
+	if (true == isSharedMemoryMode) {
+		drainers = &sharedSegment->drainer;
+	} else {
+		//TODO: think if malloc failures need to be handled
+		drainers = malloc(drainersNum * sizeof(*drainers));
+	}
+
+	for (i = 0; i < drainersNum; ++i) {
+		LoggerDrainer* drainer = &drainers[i];
+
+		drainer->numaNode = (true == isPerNodeDraining) ? i : ALL_NUMA_NODES;
+		__atomic_store_n(&drainer->isNewData, false, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&drainer->isPriorityData, false, __ATOMIC_SEQ_CST);
+		sem_init(&drainer->loopSem, isSharedMemoryMode, 0);
+		sem_init(&drainer->waitingSem, isSharedMemoryMode, 0);
+	}
 }
 
 /**
@@ -208,506 +541,2213 @@ static void initSynchronizationElements() {
  */
 static void initMessageQueues(const int sharedBuffSize, const int maxArgsLenArg) {
 	//TODO: add an option to dynamically change all of these:
-	initPrivateBuffers(privateBuffSize);
+	initPrivateBuffers(privateBuffSize, sharedBuffSize);
 	initsharedBuffer(sharedBuffSize);
 }
 
 /**
- * Starts (and names) the internal logger threads which drains buffers
- * to the log file
+ * Starts (and names) the internal logger threads which drain buffers
+ * to the log file. With per-node draining, each logger thread is pinned to its NUMA node
+ */
+static void startLoggerThreads() {
+	int i;
+
+	for (i = 0; i < drainersNum; ++i) {
+		LoggerDrainer* drainer = &drainers[i];
+		char threadName[LOGGERTHREADNAMELEN];
+
+		if (0 == i) {
+			snprintf(threadName, sizeof(threadName), "%s", LOGGERTHREADNAME);
+		} else {
+			snprintf(threadName, sizeof(threadName), "%s%hhu",
+			         LOGGERTHREADNAME, (unsigned char) i);
+		}
+
+		pthread_create(&drainer->thread, NULL, runLogger, drainer);
+		pthread_setname_np(drainer->thread, threadName);
+
+		if (ALL_NUMA_NODES != drainer->numaNode) {
+			setThreadNumaAffinity(drainer->thread, drainer->numaNode);
+		}
+	}
+}
+
+/**
+ * Wake the internal logger threads up for their last iteration and wait for them to finish
+ * NOTE: 'isTerminate' must be set beforehand
  */
-static void startLoggerThread() {
-	pthread_create(&loggerThread, NULL, runLogger, NULL);
-	pthread_setname_np(loggerThread, LOGGERTHREADNAME);
+static void stopLoggerThreads() {
+	int i;
+
+	for (i = 0; i < drainersNum; ++i) {
+		sem_post(&drainers[i].loopSem);
+	}
+
+	for (i = 0; i < drainersNum; ++i) {
+		pthread_join(drainers[i].thread, NULL);
+	}
 }
 
 /* API method - Description located at .h file */
 inline void setLoggingLevel(const int loggingLevel) {
 	__atomic_store_n(&logLevel, loggingLevel, __ATOMIC_SEQ_CST);
+	advanceLevelsEpoch();
 }
 
 /* API method - Description located at .h file */
-inline void setDynamicAllocation(const bool isDynamicAllocationArg) {
-	__atomic_store_n(&isDynamicAllocation, isDynamicAllocationArg,
-	__ATOMIC_SEQ_CST);
-}
+int setModuleLoggingLevel(const char* module, const int loggingLevel) {
+	if (NULL == module || loggingLevel < LOG_LEVEL_NONE
+	        || loggingLevel > LOG_LEVEL_TRACE
+	        || LOG_STATUS_SUCCESS != setModuleLevel(module, loggingLevel)) {
+		return LOG_STATUS_FAILURE;
+	}
 
-/**
- * Set whether private buffers are active or not
- * @param arePrivateBuffersActiveArg Whether private buffers are active or not
- */
-static inline void setArePrivateBuffersActive(
-        const bool arePrivateBuffersActiveArg) {
-	__atomic_store_n(&arePrivateBuffersActive, arePrivateBuffersActiveArg,
-	__ATOMIC_SEQ_CST);
-}
+	advanceLevelsEpoch();
 
-/**
- * Set whether private buffers are changing size
- * @param arePrivateBuffersChangingSizeArg Whether private buffers are changing size
- */
-static inline void setArePrivateBuffersChangingSize(
-        const bool arePrivateBuffersChangingSizeArg) {
-	__atomic_store_n(&arePrivateBuffersChangingSize,
-	                 arePrivateBuffersChangingSizeArg,
-	                 __ATOMIC_SEQ_CST);
+	return LOG_STATUS_SUCCESS;
 }
 
-/**
- * Set whether private buffers are changing number
- * @param arePrivateBuffersChangingNumberArg Whether private buffers are changing number
- */
-static inline void setArePrivateBuffersChangingNumber(
-        const bool arePrivateBuffersChangingNumberArg) {
-	__atomic_store_n(&arePrivateBuffersChangingNumber,
-	                 arePrivateBuffersChangingNumberArg,
-	                 __ATOMIC_SEQ_CST);
+/* API method - Description located at .h file */
+int clearModuleLoggingLevel(const char* module) {
+	if (NULL == module || LOG_STATUS_SUCCESS != removeModuleLevel(module)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	advanceLevelsEpoch();
+
+	return LOG_STATUS_SUCCESS;
 }
 
 /**
- * Initialize private buffers parameters
- * @param privateBuffSize Number of buffers
+ * Invalidate the cached effective logging levels of all 'LOG_MSG' call sites
+ * NOTE: Must be called after the change of the levels is visible
  */
-static void initPrivateBuffers(const int privateBuffSize) {
-	int i;
+static inline void advanceLevelsEpoch() {
+	__atomic_add_fetch(&loggerLevelsEpoch, LOG_LEVELS_EPOCH_STEP,
+	                   __ATOMIC_SEQ_CST);
+}
 
-	privateBuffersQueue = newQueue(privateBuffersNum);
-	//TODO: think if malloc failures need to be handled
-	privateBuffers = malloc(privateBuffersNum * sizeof(*privateBuffers));
+/* API method - Description located at .h file */
+bool resolveLogSite(LogSite* site, const int loggingLevel) {
+	long long epoch;
+	int effectiveLevel;
+
+	/* The epoch is read before the levels, so if the levels change meanwhile the call site is
+	 * cached as stale and resolved again at its next call */
+	epoch = __atomic_load_n(&loggerLevelsEpoch, __ATOMIC_SEQ_CST);
+	effectiveLevel = getModuleLevel(site->module,
+	                                __atomic_load_n(&logLevel, __ATOMIC_SEQ_CST));
+	__atomic_store_n(&site->levelOffset, effectiveLevel - epoch,
+	                 __ATOMIC_RELAXED);
+
+	return LOG_LEVEL_NONE != effectiveLevel && loggingLevel <= effectiveLevel;
+}
 
-	for (i = 0; i < privateBuffersNum; ++i) {
-		struct MessageQueue* mq;
+/* API method - Description located at .h file */
+bool refillLogThrottle(LogThrottle* throttle, const double perSec) {
+	long long burst = (perSec < 1) ? 1 : (long long) perSec;
+	long long accrued;
+	long long nowNsec;
+	struct timespec ts;
+
+	/* Suppressed calls read the clock each time, so the coarse (tick resolution) clock is used */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	nowNsec = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+	if (0 == throttle->lastRefillNsec) {
+		/* First call of the call site by this thread - start with a full burst */
+		throttle->tokens = burst;
+		throttle->lastRefillNsec = nowNsec;
+		return true;
+	}
 
-		mq = newMessageQueue(privateBuffSize, maxArgsLen, false);
-		privateBuffers[i] = mq;
+	accrued = (long long) ((nowNsec - throttle->lastRefillNsec) * perSec / 1e9);
+	if (accrued <= 0) {
+		return false;
+	}
 
-		/* Add a reference of this MessageQueue to privateBuffersQueue so threads may
-		 * register and take it */
-		enqueue(privateBuffersQueue, mq);
+	if (accrued >= burst) {
+		throttle->tokens = burst;
+		throttle->lastRefillNsec = nowNsec;
+	} else {
+		/* Advance by the time the accrued tokens took, so the fraction of a token is kept */
+		throttle->tokens = accrued;
+		throttle->lastRefillNsec += (long long) (accrued * 1e9 / perSec);
 	}
-}
 
-/**
- * Initialize shared buffer data parameters
- * @param sharedBuffSize Size of buffer
- */
-static void initsharedBuffer(const int sharedBuffSize) {
-	sharedBuffer = newMessageQueue(sharedBuffSize, maxArgsLen, false);
+	return true;
 }
 
-/**
- * Creates a log file and set a buffer for it
- * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
- */
-static int createLogFile() {
-	//TODO: implement rotating log
-	logFile = fopen("logFile.txt", "w+");
-
-	/* Set a big buffer to avoid frequent flushing */
-	if (NULL != logFile) {
-		//TODO: think if malloc failures need to be handled
-		logFileBuff = malloc(BUFFSIZE);
-		setvbuf(logFile, logFileBuff, _IOFBF, BUFFSIZE);
-		return LOG_STATUS_SUCCESS;
-	}
+/* API method - Description located at .h file */
+inline void setDynamicAllocation(const bool isDynamicAllocationArg) {
+	__atomic_store_n(&isDynamicAllocation, isDynamicAllocationArg,
+	__ATOMIC_SEQ_CST);
+}
 
-	return LOG_STATUS_FAILURE;
+/* API method - Description located at .h file */
+inline void setDuplicatesSuppression(const bool isEnabledArg) {
+	__atomic_store_n(&isDuplicatesSuppressed, isEnabledArg, __ATOMIC_SEQ_CST);
 }
 
 /* API method - Description located at .h file */
-int registerThread() {
-	tlmq = dequeue(privateBuffersQueue);
+void setIdleBuffersRelease(const bool isEnabledArg,
+                           const int idleThresholdMsecArg) {
+	__atomic_store_n(&idleReleaseThresholdMsec,
+	                 idleThresholdMsecArg < 0 ? 0 : idleThresholdMsecArg,
+	                 __ATOMIC_SEQ_CST);
+	__atomic_store_n(&isIdleReleaseEnabled, isEnabledArg, __ATOMIC_SEQ_CST);
+}
 
-	/* No more pre-allocated buffers available. If dynamic allocation is enabled, allocate a buffer*/
-	if (NULL == tlmq) {
-		bool isDynamicAllocationLoc;
+/* API method - Description located at .h file */
+int setCrashDrain(const bool isEnabledArg, const int budgetMsecArg) {
+	struct sigaction action;
+	size_t i;
+
+	crashDrainBudgetMsec = budgetMsecArg < 0 ? 0 : budgetMsecArg;
+
+	/* There's no log file in shared memory mode - the buffered messages outlive a crash at the
+	 * segment anyway, and the collector writes them. The flight recorder's buffers are never
+	 * drained, so there's no position to write them from */
+	if (true == isEnabledArg
+	        && (true == isSharedMemoryMode || true == isFlightRecorderMode)) {
+		return LOG_STATUS_FAILURE;
+	}
 
-		__atomic_load(&isDynamicAllocation, &isDynamicAllocationLoc,
-		__ATOMIC_SEQ_CST);
-		if (true == isDynamicAllocationLoc) {
-			struct LinkedListNode* node;
-			struct MessageQueue* mq;
+	if (isEnabledArg == isCrashDrainInstalled) {
+		return LOG_STATUS_SUCCESS;
+	}
 
-			mq = newMessageQueue(privateBuffSize, maxArgsLen, true);
-			node = newLinkedListNode(mq);
+	if (false == isEnabledArg) {
+		restoreCrashHandlers();
+		return LOG_STATUS_SUCCESS;
+	}
 
-			pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
-			{
-				addNode(dynamicllyAllocaedPrivateBuffers, node);
+	logFileFd = fileno(logFile);
+	__atomic_store_n(&isCrashDraining, false, __ATOMIC_SEQ_CST);
+
+	/* The handler runs on an alternate signal stack if the crashing thread set one up (required
+	 * to survive a stack overflow) */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = crashDrainHandler;
+	action.sa_flags = SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+
+	for (i = 0; i < CRASH_SIGNALS_NUM; ++i) {
+		if (0 != sigaction(crashSignals[i], &action, &prevCrashActions[i])) {
+			/* Roll back the handlers installed so far */
+			while (0 < i--) {
+				sigaction(crashSignals[i], &prevCrashActions[i], NULL);
 			}
-			pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
-			tlmq = mq;
+			return LOG_STATUS_FAILURE;
 		}
-	} else {
-		setIsTaken(tlmq, true);
 	}
 
-	return (NULL != tlmq) ? LOG_STATUS_SUCCESS : LOG_STATUS_FAILURE;
+	isCrashDrainInstalled = true;
+
+	return LOG_STATUS_SUCCESS;
 }
 
-/* API method - Description located at .h file */
-void unregisterThread() {
-	if (NULL != tlmq) {
-		if (false == getIsDynamicallyAllocated(tlmq)) {
-			enqueue(privateBuffersQueue, tlmq);
-		} else {
-			decommisionBuffer(tlmq);
-		}
+/**
+ * Restore the signal handlers that were installed before the crash drain's
+ * NOTE: Async-signal-safe
+ */
+static void restoreCrashHandlers() {
+	size_t i;
 
-		setIsTaken(tlmq, false);
-		tlmq = NULL;
+	for (i = 0; i < CRASH_SIGNALS_NUM; ++i) {
+		sigaction(crashSignals[i], &prevCrashActions[i], NULL);
 	}
+
+	isCrashDrainInstalled = false;
 }
 
 /**
- * Logger thread loop - At each iteration, go over all the buffers and drain them to the log file,
- * flush buffer and sleep for a while
+ * Fatal signals handler - write the buffered messages to the log file, then pass the signal on
+ * to the previous handler (or the default action, which terminates the process)
+ * @param sig The signal
  */
-static void* runLogger() {
-	bool isTerminateLoc;
-	bool isNewDataLoc;
-	bool isFirstLevelActiveLoc;
-
-	isTerminateLoc = false;
-	isNewDataLoc = false;
-
-	do {
-		__atomic_load(&arePrivateBuffersActive, &isFirstLevelActiveLoc,
-		__ATOMIC_SEQ_CST);
-		if (true == arePrivateBuffersActive) {
-			__atomic_store_n(&isNewData, false, __ATOMIC_SEQ_CST);
-			__atomic_load(&isTerminate, &isTerminateLoc, __ATOMIC_SEQ_CST);
-			drainPrivateBuffers();
-			drainDynamicllyAllocaedPrivateBuffers();
-			drainSharedBuffer();
-			fflush(logFile); /* Flush buffer at the end of the iteration to avoid data staying in buffer long */
-
-			/* The following is done to avoid wasting CPU in case no logging is being done
-			 * (the main concern are 1-core CPU's and the current mechanism solves the issue) */
-			//TODO: At the current state, it's enough that just 1 thread will try to log data
-			// on order to prevent the logger thread from sleeping, need to think about
-			// changing it so maybe some % of the threads need to log data instead.
-			// On the other hand, in a real application, logging is performed constantly,
-			// so this may not be a concern.
-			__atomic_load(&isNewData, &isNewDataLoc, __ATOMIC_SEQ_CST);
-			if (false == isNewDataLoc && false == isTerminateLoc) {
-				sem_post(&loggerWaitingSem);
-				sem_wait(&loggerLoopSem);
-			}
-		} else {
-			bool arePrivateBuffersChangingSizeLoc;
+static void crashDrainHandler(int sig) {
+	int savedErrno = errno;
 
-			while (true == arePrivateBuffersUsed()) {
-				/* Sleeping is not the optimal solution, but as buffer-changing events should be rare,
-				 * in this case simplicity is probably preferable to efficiency */
-				sleep(1);
-			}
+	/* Restored first, so that a fault while draining (or a crash of another thread) goes
+	 * straight to the previous handlers */
+	restoreCrashHandlers();
 
-			__atomic_load(&arePrivateBuffersChangingSize,
-			              &arePrivateBuffersChangingSizeLoc,
-			              __ATOMIC_SEQ_CST);
+	if (false == __atomic_exchange_n(&isCrashDraining, true, __ATOMIC_SEQ_CST)) {
+		crashDrain(sig);
+	}
 
-			if (true == arePrivateBuffersChangingSizeLoc) {
-				doChangePrivateBuffersSize();
-				setArePrivateBuffersChangingSize(false);
-			} else {
-				bool arePrivateBuffersChangingNumberLoc;
-
-				__atomic_load(&arePrivateBuffersChangingNumber,
-				              &arePrivateBuffersChangingNumberLoc,
-				              __ATOMIC_SEQ_CST);
-				if (true == arePrivateBuffersChangingNumberLoc) {
-					/* Waiting for 1 second in order to allow threads to unregister (will be
-					 * performed automatically the next time they try to log a message).
-					 * The buffer of any thread that doesn't unregister and release it's buffer
-					 * will be moved to the dynamically allocated list in order not to lose
-					 * it's pointer or caused seg-fault when the worker thread tries to use
-					 * deleted buffer */
-
-					sleep(1);
-					doChangePrivateBuffersNumber();
-					setArePrivateBuffersChangingNumber(false);
-				}
-			}
-		}
-	} while (!isTerminateLoc);
+	errno = savedErrno;
 
-	return NULL;
+	/* The signal is blocked until the handler returns, then delivered to the previous handler. A
+	 * fault is also raised again by the faulting instruction itself */
+	raise(sig);
 }
 
 /**
- * Initiates the process of changing private buffers size
+ * Write the undrained messages of all buffers to the log file, within the crash drain budget. The
+ * stream's pending output is left alone - while the crash drain is installed, the log file is
+ * flushed before drained messages are released (and after each direct write), so whatever it
+ * holds is still in the buffers. Only async-signal-safe operations are used, and no lock is taken
+ * (buffers are read while other threads may still be using them)
+ * @param sig The fatal signal
  */
-static void doChangePrivateBuffersSize() {
+static void crashDrain(const int sig) {
+	struct LinkedListNode* node;
+	struct timespec now;
+	long long deadlineNsec;
+	unsigned long long messagesNum = 0;
 	int i;
 
-	/* Changing private buffers size only affects buffers that are pre-allocated and not buffers
-	 * that were dynamically allocated.
-	 * In order to modify the size of dynamically allocated buffers, merge the layout and
-	 * then modify buffers size */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	deadlineNsec = now.tv_sec * 1000000000LL + now.tv_nsec
+	        + crashDrainBudgetMsec * 1000000LL;
+
+	writeCrashMarker("fatal signal ", sig);
+
+	/* Urgent messages are written first, in case the budget runs out */
 	for (i = 0; i < privateBuffersNum; ++i) {
-		struct MessageQueue* mq = privateBuffers[i];
+		if (NULL != getPriorityQueue(privateBuffers[i])) {
+			messagesNum += emergencyDrainMessages(
+			        getPriorityQueue(privateBuffers[i]), logFileFd,
+			        emergencyWrite, deadlineNsec);
+		}
+	}
+
+	for (i = 0; i < privateBuffersNum; ++i) {
+		messagesNum += emergencyDrainMessages(privateBuffers[i], logFileFd,
+		                                      emergencyWrite, deadlineNsec);
+	}
 
-		drainMessages(mq, logFile, maxMsgLen, writeMethod);
-		changeBufferSize(mq, newPrivateBuffSize, maxArgsLen);
+	for (node = getHead(dynamicllyAllocaedPrivateBuffers); NULL != node;
+	        node = getNext(node)) {
+		if (NULL != getPriorityQueue(getData(node))) {
+			messagesNum += emergencyDrainMessages(
+			        getPriorityQueue(getData(node)), logFileFd, emergencyWrite,
+			        deadlineNsec);
+		}
+		messagesNum += emergencyDrainMessages(getData(node), logFileFd,
+		                                      emergencyWrite, deadlineNsec);
 	}
 
-	privateBuffSize = newPrivateBuffSize;
-	setArePrivateBuffersActive(true);
+	messagesNum += emergencyDrainMessages(sharedBuffer, logFileFd,
+	                                      emergencyWrite, deadlineNsec);
+
+	writeCrashMarker("buffered messages written: ", messagesNum);
 }
 
 /**
- * Initiates the process of changing private buffers number
+ * Write a marker record of the crash drain to the log file
+ * NOTE: Async-signal-safe
+ * @param msg The text of the record
+ * @param value A number to append to the text
  */
-static void doChangePrivateBuffersNumber() {
-	int i;
-
-	/* Changing private buffers number only affects buffers that are pre-allocated and not buffers
-	 * that were dynamically allocated */
-	for (i = 0; i < privateBuffersNum; ++i) {
-		struct MessageQueue* mq = privateBuffers[i];
+static void writeCrashMarker(const char* msg, unsigned long long value) {
+	MessageData md;
+	struct timespec now;
+	char argsBuf[CRASH_MARKER_LEN];
+	char digits[24];
+	int digitsNum = 0;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	md.tv.tv_sec = now.tv_sec;
+	md.tv.tv_usec = now.tv_nsec / 1000;
+	md.file = getFileName(__FILE__);
+	md.func = __func__;
+	md.line = __LINE__;
+	md.logLevel = LOG_LEVEL_EMERG;
+	md.logMethod = LM_DIRECT_WRITE;
+	md.tid = syscall(SYS_gettid);
+	md.argsFormat = MSG_ARGS_TEXT;
+	md.slotsNum = 1;
+	md.argsBuf = argsBuf;
+
+	/* snprintf isn't async-signal-safe */
+	do {
+		digits[digitsNum++] = '0' + value % 10;
+		value /= 10;
+	} while (0 != value);
 
-		drainMessages(mq, logFile, maxMsgLen, writeMethod);
+	for (md.argsLen = 0; '\0' != *msg && md.argsLen < CRASH_MARKER_LEN - 24; ++msg) {
+		argsBuf[md.argsLen++] = *msg;
 	}
+	while (0 < digitsNum) {
+		argsBuf[md.argsLen++] = digits[--digitsNum];
+	}
+	argsBuf[md.argsLen] = '\0';
 
-	queueDestroy(privateBuffersQueue);
-	privateBuffersQueue = newQueue(newPrivateBuffersNumber);
-
-	for (i = 0; i < privateBuffersNum; ++i) {
-		struct MessageQueue* mq;
-
-		mq = privateBuffers[i];
+	emergencyWrite(&md, logFileFd);
+}
 
-		if (false == getIsPrivateBufferTaken(mq)) {
-			messageDataQueueDestroy(mq);
-		} else {
-			enqueue(privateBuffersQueue, mq);
-			setIsDynamicallyAllocated(mq, true);
-		}
+/* API method - Description located at .h file */
+int setFlightRecorderMode(const bool isEnabledArg, const int windowMsecArg,
+                          const int triggerLevelArg,
+                          const int triggerSignalArg) {
+	if (true == isEnabledArg
+	        && (0 >= windowMsecArg || LOG_LEVEL_NONE > triggerLevelArg
+	                || LOG_LEVEL_TRACE < triggerLevelArg || 0 > triggerSignalArg
+	                || SIGRTMAX < triggerSignalArg || SIGKILL == triggerSignalArg
+	                || SIGSTOP == triggerSignalArg)) {
+		return LOG_STATUS_FAILURE;
 	}
 
-	free(privateBuffers);
-	privateBuffers = malloc(newPrivateBuffersNumber * sizeof(*privateBuffers));
-
-	for (i = 0; i < newPrivateBuffersNumber; ++i) {
-		struct MessageQueue* mq;
+	isFlightRecorderMode = isEnabledArg;
+	flightRecorderWindowMsec = windowMsecArg;
+	flightRecorderTriggerLevel = (true == isEnabledArg) ? triggerLevelArg : LOG_LEVEL_NONE;
+	flightRecorderTriggerSignal = (true == isEnabledArg) ? triggerSignalArg : 0;
 
-		mq = newMessageQueue(privateBuffSize, maxArgsLen, false);
-		privateBuffers[i] = mq;
+	return LOG_STATUS_SUCCESS;
+}
 
-		/* Add a reference of this MessageQueue to privateBuffersQueue so threads may
-		 * register and take it */
-		enqueue(privateBuffersQueue, mq);
+/* API method - Description located at .h file */
+void triggerFlightRecorderDump() {
+	if (true == isFlightRecorderMode && NULL != drainers) {
+		__atomic_store_n(&isFlightRecorderTriggered, true, __ATOMIC_SEQ_CST);
+		if (0 == sem_trywait(&drainers[0].waitingSem)) {
+			sem_post(&drainers[0].loopSem);
+		}
 	}
+}
 
-	privateBuffersNum = newPrivateBuffersNumber;
-	setArePrivateBuffersActive(true);
+/**
+ * Trigger a flight recorder dump if a message that was just logged is severe enough
+ * @param loggingLevel The logging level of the message
+ */
+static inline void checkFlightRecorderTrigger(const int loggingLevel) {
+	/* The trigger level is LOG_LEVEL_NONE (which is below every message) unless messages trigger
+	 * dumps */
+	if (__builtin_expect(loggingLevel <= flightRecorderTriggerLevel, 0)) {
+		triggerFlightRecorderDump();
+	}
 }
 
 /**
- * Checks if any of the private buffers is currently being used
- * @return True if any of the private buffers is currently being used of flase otherwise
+ * Trigger signal handler - let the main logger thread know a dump is due
+ * NOTE: Async-signal-safe
+ * @param sig The signal
  */
-static inline bool arePrivateBuffersUsed() {
-	int i;
+static void flightRecorderSignalHandler(int sig) {
+	(void) sig;
 
-	for (i = 0; i < privateBuffersNum; ++i) {
-		if (true == getIsPrivateBufferBeingUsed(privateBuffers[i])) {
-			return true;
-		}
-	}
+	__atomic_store_n(&isFlightRecorderTriggered, true, __ATOMIC_SEQ_CST);
 
-	return false;
+	/* The wake up handshake can't be taken part in from a signal handler - if the logger thread
+	 * isn't waiting, this only causes an extra iteration */
+	sem_post(&drainers[0].loopSem);
 }
 
 /**
- * Iterate private buffers and drain them to file
+ * Allocate the buffers a flight recorder dump uses - a reference per slot of all buffers (whose
+ * layout doesn't change in flight recorder mode), and room for the arguments of the largest message
  */
-static inline void drainPrivateBuffers() {
+static void allocateFlightRecorderDump() {
+	int slotsNum;
 	int i;
 
+	slotsNum = sharedBuffer->size;
 	for (i = 0; i < privateBuffersNum; ++i) {
-		drainMessages(privateBuffers[i], logFile, maxMsgLen, writeMethod);
+		slotsNum += privateBuffers[i]->size;
 	}
-}
 
-/**
- * Drain shared buffer to file
- */
-static inline void drainSharedBuffer() {
-	drainMessages(sharedBuffer, logFile, maxMsgLen, writeMethod);
+	/* A large message may run over as many slots as its truncated arguments need */
+	flightRecorderArgsBufLen = MAX_LARGE_ARGS_SIZE + maxArgsLen;
+
+	//TODO: think if malloc failures need to be handled
+	flightRecorderRefs = malloc(slotsNum * sizeof(*flightRecorderRefs));
+	flightRecorderArgsBuf = malloc(flightRecorderArgsBufLen);
 }
 
 /**
- * Drain data from the dynamically allocated buffers to the log file
+ * Write the messages of the last 'flightRecorderWindowMsec' milliseconds from all buffers to the
+ * log file, in time order (messages with the same time keep their order within a buffer). Messages
+ * already written by a previous dump aren't written again. The writers aren't stopped, so messages
+ * overwritten before they are copied are skipped. Nothing is allocated - the references and the
+ * arguments buffer were allocated when the logger was initialized
  */
-static void drainDynamicllyAllocaedPrivateBuffers() {
-	struct LinkedListNode* node = getHead(dynamicllyAllocaedPrivateBuffers);
+static void dumpFlightRecorder() {
+	struct timeval now;
+	struct timeval window;
+	struct timeval since;
+	MessageRef* refs = flightRecorderRefs;
+	MessageData md;
+	int refsNum = 0;
+	int overwrittenNum = 0;
+	int i;
 
-	/* Check if it's worth locking the mutex */
-	if (NULL != node) {
-		pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
-		{
-			while (NULL != node) {
-				struct MessageQueue* mq = getData(node);
-				struct LinkedListNode* nextNode;
+	if (NULL == refs || NULL == flightRecorderArgsBuf) {
+		selfLog(__func__, __LINE__,
+		        "Flight recorder dump skipped - its buffers couldn't be allocated");
+		return;
+	}
 
-				drainMessages(mq, logFile, maxMsgLen, writeMethod);
-				nextNode = getNext(node);
+	gettimeofday(&now, NULL);
+	window.tv_sec = flightRecorderWindowMsec / 1000;
+	window.tv_usec = (flightRecorderWindowMsec % 1000) * 1000;
+	timersub(&now, &window, &since);
 
-				if (true == isDecommisionedBuffer(mq)) {
-					drainMessages(mq, logFile, maxMsgLen, writeMethod);
-					free(removeNode(dynamicllyAllocaedPrivateBuffers, mq));
-					free(mq);
-				}
+	for (i = 0; i < privateBuffersNum; ++i) {
+		refsNum += collectMessages(privateBuffers[i], &since, refs + refsNum);
+	}
+	refsNum += collectMessages(sharedBuffer, &since, refs + refsNum);
 
-				node = nextNode;
-			}
+	qsort(refs, refsNum, sizeof(*refs), compareMessageRefs);
+
+	selfLog(__func__, __LINE__,
+	        "Flight recorder dump: %d messages of the last %d msec", refsNum,
+	        flightRecorderWindowMsec);
+
+	for (i = 0; i < refsNum; ++i) {
+		if (true
+		        == readCollectedMessage(&refs[i], &md, flightRecorderArgsBuf,
+		                                flightRecorderArgsBufLen)) {
+			writeAndCount(&md, logFile);
+		} else {
+			++overwrittenNum;
 		}
 	}
-	pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
-}
 
-/* API method - Description located at .h file */
-void terminateLogger() {
-	__atomic_store_n(&isTerminate, true, __ATOMIC_SEQ_CST);
-	sem_post(&loggerLoopSem);
-	pthread_join(loggerThread, NULL);
-	freeResources();
+	if (0 != overwrittenNum) {
+		selfLog(__func__, __LINE__,
+		        "Flight recorder dump: %d messages were overwritten before they were written",
+		        overwrittenNum);
+	}
+
+	flushLogFile();
 }
 
 /**
- * Release all malloc'ed resources, destroy mutexs and close the open file
+ * Order references to collected messages by time, and by their order within their buffer
+ * @param ref1 The first MessageRef
+ * @param ref2 The second MessageRef
+ * @return A negative value, 0 or a positive value if the first message is older, the same or newer
  */
-static void freeResources() {
-	int i;
+static int compareMessageRefs(const void* ref1, const void* ref2) {
+	const MessageRef* messageRef1 = ref1;
+	const MessageRef* messageRef2 = ref2;
 
-	for (i = 0; i < privateBuffersNum; ++i) {
-		messageDataQueueDestroy(privateBuffers[i]);
+	if (messageRef1->tv.tv_sec != messageRef2->tv.tv_sec) {
+		return (messageRef1->tv.tv_sec < messageRef2->tv.tv_sec) ? -1 : 1;
 	}
 
-	free(privateBuffers);
-	destroyDynamicallyAllocatedBuffers();
-	sem_destroy(&loggerLoopSem);
-	pthread_mutex_destroy(&dynamicllyAllocaedLock);
+	if (messageRef1->tv.tv_usec != messageRef2->tv.tv_usec) {
+		return (messageRef1->tv.tv_usec < messageRef2->tv.tv_usec) ? -1 : 1;
+	}
+
+	if (messageRef1->mq != messageRef2->mq) {
+		return (messageRef1->mq < messageRef2->mq) ? -1 : 1;
+	}
+
+	if (messageRef1->seq != messageRef2->seq) {
+		return (0 > (int) (messageRef1->seq - messageRef2->seq)) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* API method - Description located at .h file */
+int setPriorityLanes(const int levelArg, const int sizeArg) {
+	if (LOG_LEVEL_NONE > levelArg || LOG_LEVEL_TRACE < levelArg
+	        || (LOG_LEVEL_NONE != levelArg && 2 > sizeArg)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	priorityLaneLevel = levelArg;
+	priorityLaneSize = sizeArg;
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+int addFileSink(const char* path, const int loggingLevel,
+                void (*writeMethodArg)(), const int queueSize) {
+	FILE* file;
+	int sinkId;
+
+	if (NULL == logSinks) {
+		logSinks = newLogSinks();
+	}
+
+	file = fopen(path, "w");
+	if (NULL == logSinks || NULL == file) {
+		if (NULL != file) {
+			fclose(file);
+		}
+		return LOG_STATUS_FAILURE;
+	}
+
+	sinkId = addStreamLogSink(logSinks, file, true, loggingLevel,
+	                          writeMethodArg, queueSize);
+	if (LS_STATUS_FAILURE == sinkId) {
+		fclose(file);
+		return LOG_STATUS_FAILURE;
+	}
+
+	return sinkId;
+}
+
+/* API method - Description located at .h file */
+int addStreamSink(FILE* stream, const int loggingLevel,
+                  void (*writeMethodArg)(), const int queueSize) {
+	if (NULL == logSinks) {
+		logSinks = newLogSinks();
+	}
+
+	if (NULL == logSinks) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return addStreamLogSink(logSinks, stream, false, loggingLevel,
+	                        writeMethodArg, queueSize);
+}
+
+/* API method - Description located at .h file */
+int addMemorySink(const int size, const int loggingLevel,
+                  void (*writeMethodArg)()) {
+	if (NULL == logSinks) {
+		logSinks = newLogSinks();
+	}
+
+	if (NULL == logSinks) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return addMemoryLogSink(logSinks, size, loggingLevel, writeMethodArg);
+}
+
+/* API method - Description located at .h file */
+int addSocketSink(const char* socketPath, const bool isSeqPacket,
+                  const int loggingLevel, void (*writeMethodArg)(),
+                  const int queueSize, const char* spoolPath) {
+	if (NULL == logSinks) {
+		logSinks = newLogSinks();
+	}
+
+	if (NULL == logSinks) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return addSocketLogSink(logSinks, socketPath, isSeqPacket, loggingLevel,
+	                        writeMethodArg, queueSize, spoolPath);
+}
+
+/* API method - Description located at .h file */
+int readMemorySink(const int sinkId, char* buf, const int len) {
+	if (NULL == logSinks) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return readMemoryLogSink(logSinks, sinkId, buf, len);
+}
+
+/* API method - Description located at .h file */
+int getSinkDrops(const int sinkId, unsigned long long* dropsNum) {
+	if (NULL == logSinks) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return getLogSinkDrops(logSinks, sinkId, dropsNum);
+}
+
+/* API method - Description located at .h file */
+void setBuffersArenaOptions(const bool isHugePagesArg,
+                            const bool isPrefaultArg, const bool isLockedArg) {
+	arenaFlags = ARENA_FLAG_NONE;
+
+	if (true == isHugePagesArg) {
+		arenaFlags |= ARENA_FLAG_HUGEPAGES;
+	}
+
+	if (true == isPrefaultArg) {
+		arenaFlags |= ARENA_FLAG_PREFAULT;
+	}
+
+	if (true == isLockedArg) {
+		arenaFlags |= ARENA_FLAG_LOCK;
+	}
+}
+
+/* API method - Description located at .h file */
+void setNumaAwareness(const bool isNumaAwareArg,
+                      const bool isPerNodeDrainingArg) {
+	isNumaAware = isNumaAwareArg;
+	isPerNodeDraining = isNumaAwareArg && isPerNodeDrainingArg;
+}
+
+/**
+ * Initialize private buffers parameters
+ * @param privateBuffSize Size of buffers
+ * @param sharedBuffSize Size of shared buffer (which is carved from the first node's arena)
+ */
+static void initPrivateBuffers(const int privateBuffSize,
+                               const int sharedBuffSize) {
+	int i;
+
+	//TODO: think if malloc failures need to be handled
+	privateBuffersQueues = malloc(
+	        numaNodesNum * sizeof(*privateBuffersQueues));
+	arenas = calloc(numaNodesNum, sizeof(*arenas));
+	for (i = 0; i < numaNodesNum; ++i) {
+		privateBuffersQueues[i] = newQueue(privateBuffersNum);
+	}
+
+	/* The shared memory segment was sized to fit all buffers when it was created */
+	if (NULL != sharedSegment) {
+		arenas[0] = sharedSegmentArena;
+	}
+
+	privateBuffers = allocatePrivateBuffers(privateBuffSize, privateBuffersNum,
+	                                        sharedBuffSize);
+	enqueuePrivateBuffers(privateBuffers, privateBuffersNum);
+}
+
+/**
+ * Allocate a private buffers layout. When NUMA awareness is enabled, the buffers are distributed
+ * evenly across NUMA nodes and each node's share is allocated (and first-touched) by a thread
+ * pinned to that node, so the memory is placed locally to the threads that will take it.
+ * Buffers are carved from the node's arena - the arenas are created by the first allocation
+ * (at initialization) and sized to fit it, later layouts use whatever space is left and fall
+ * back to malloc once it's exhausted
+ * @param size Size of each buffer
+ * @param number Number of buffers
+ * @param sharedBuffSize Size of the shared buffer to reserve room for in the first node's arena
+ * when the arenas are created
+ * @return The newly allocated layout
+ */
+static struct MessageQueue** allocatePrivateBuffers(const int size,
+                                                    const int number,
+                                                    const int sharedBuffSize) {
+	struct MessageQueue** buffers;
+	PrivateBuffersAllocation allocations[numaNodesNum];
+	pthread_t allocationThreads[numaNodesNum];
+	int i;
+
+	/* The collector process finds the buffers through the layout, so it's at the segment too */
+	if (NULL != sharedSegment) {
+		buffers = arenaAlloc(arenas[0], number * sizeof(*buffers));
+	} else {
+		//TODO: think if malloc failures need to be handled
+		buffers = malloc(number * sizeof(*buffers));
+	}
+
+	for (i = 0; i < numaNodesNum; ++i) {
+		allocations[i].numaNode = i;
+		allocations[i].size = size;
+		allocations[i].number = number;
+		allocations[i].buffers = buffers;
+		allocations[i].arenaSize = 0;
+
+		if (NULL == arenas[i]) {
+			/* Node 'i' gets every 'numaNodesNum'-th buffer, starting at index 'i' */
+			allocations[i].arenaSize = (number / numaNodesNum
+			        + (i < number % numaNodesNum ? 1 : 0))
+			        * getPrivateBufferMemorySize(size);
+
+			if (0 == i) {
+				allocations[i].arenaSize += getMessageQueueMemorySize(
+				        sharedBuffSize, maxArgsLen);
+			}
+		}
+	}
+
+	if (1 == numaNodesNum) {
+		allocateNodePrivateBuffers(&allocations[0]);
+	} else {
+		for (i = 0; i < numaNodesNum; ++i) {
+			pthread_create(&allocationThreads[i], NULL,
+			               allocateNodePrivateBuffers, &allocations[i]);
+		}
+
+		for (i = 0; i < numaNodesNum; ++i) {
+			pthread_join(allocationThreads[i], NULL);
+		}
+	}
+
+	return buffers;
+}
+
+/**
+ * Allocate the share of a private buffers layout that belongs to a single NUMA node
+ * @param allocationArg The PrivateBuffersAllocation to perform
+ * @return NULL
+ */
+static void* allocateNodePrivateBuffers(void* allocationArg) {
+	PrivateBuffersAllocation* allocation = allocationArg;
+	int i;
+
+	/* Run on the target node so the buffers are first-touched there (placement is best-effort,
+	 * if the affinity can't be set the buffers are still allocated and assigned to the node) */
+	if (1 < numaNodesNum) {
+		setThreadNumaAffinity(pthread_self(), allocation->numaNode);
+	}
+
+	/* The arena is created (and prefaulted, if requested) by the node's thread as well */
+	if (0 < allocation->arenaSize) {
+		arenas[allocation->numaNode] = newArena(allocation->arenaSize,
+		                                        arenaFlags);
+	}
+
+	for (i = allocation->numaNode; i < allocation->number; i += numaNodesNum) {
+		struct MessageQueue* mq;
+
+		mq = newPrivateBuffer(allocation->size, false,
+		                      arenas[allocation->numaNode]);
+		setNumaNode(mq, allocation->numaNode);
+		setIsOverwriting(mq, isFlightRecorderMode);
+		allocation->buffers[i] = mq;
+	}
+
+	return NULL;
+}
+
+/**
+ * Create a private buffer, along with its priority lane if priority lanes are enabled
+ * @param size Size of the buffer
+ * @param isDynamicallyAllocated Whether or not the buffer is dynamically allocated
+ * @param arena An Arena to carve the buffer from (see 'newMessageQueue(...)')
+ * @return The newly allocated private buffer
+ */
+static struct MessageQueue* newPrivateBuffer(const int size,
+                                             const bool isDynamicallyAllocated,
+                                             struct Arena* arena) {
+	struct MessageQueue* mq;
+
+	mq = newMessageQueue(size, maxArgsLen, isDynamicallyAllocated, arena);
+	if (true == isPriorityLanes) {
+		setPriorityQueue(mq, newMessageQueue(priorityLaneSize, maxArgsLen,
+		                                     isDynamicallyAllocated, arena));
+	}
+
+	return mq;
+}
+
+/**
+ * Returns the amount of memory a private buffer occupies (including its priority lane)
+ * @param size Size of the buffer
+ * @return The amount of memory a private buffer of the given size occupies
+ */
+static inline size_t getPrivateBufferMemorySize(const int size) {
+	return getMessageQueueMemorySize(size, maxArgsLen)
+	        + ((true == isPriorityLanes) ?
+	                getMessageQueueMemorySize(priorityLaneSize, maxArgsLen) : 0);
+}
+
+/**
+ * Add a reference of each MessageQueue in a layout to the queue of its NUMA node so threads may
+ * register and take it
+ * @param buffers The layout
+ * @param number Number of buffers in the layout
+ * @return Number of buffers that couldn't be added since their queue was full (such a buffer is
+ * still drained, but never taken)
+ */
+static int enqueuePrivateBuffers(struct MessageQueue** buffers,
+                                 const int number) {
+	int failuresNum = 0;
+	int i;
+
+	for (i = 0; i < number; ++i) {
+		if (Q_STATUS_SUCCESS
+		        != enqueue(privateBuffersQueues[getNumaNode(buffers[i])],
+		                   buffers[i])) {
+			++failuresNum;
+		}
+	}
+
+	return failuresNum;
+}
+
+/**
+ * Initialize shared buffer data parameters
+ * @param sharedBuffSize Size of buffer
+ */
+static void initsharedBuffer(const int sharedBuffSize) {
+	sharedBuffer = newMessageQueue(sharedBuffSize, maxArgsLen, false,
+	                               arenas[0]);
+	setIsOverwriting(sharedBuffer, isFlightRecorderMode);
+}
+
+/**
+ * Creates a log file and set a buffer for it
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+static int createLogFile() {
+	//TODO: implement rotating log
+	logFile = fopen("logFile.txt", "w+");
+
+	/* Set a big buffer to avoid frequent flushing */
+	if (NULL != logFile) {
+		//TODO: think if malloc failures need to be handled
+		logFileBuff = malloc(BUFFSIZE);
+		setvbuf(logFile, logFileBuff, _IOFBF, BUFFSIZE);
+		return LOG_STATUS_SUCCESS;
+	}
+
+	return LOG_STATUS_FAILURE;
+}
+
+/* API method - Description located at .h file */
+int setSharedMemoryMode(const char* segmentName) {
+	if (NULL == segmentName) {
+		sharedSegmentName[0] = '\0';
+		return LOG_STATUS_SUCCESS;
+	}
+
+	if (SHARED_SEGMENT_NAME_LEN <= strlen(segmentName)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	strcpy(sharedSegmentName, segmentName);
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+int setPersistentBuffers(const char* path) {
+	if (NULL == path) {
+		persistentBuffersPath[0] = '\0';
+		return LOG_STATUS_SUCCESS;
+	}
+
+	if (PATH_MAX <= strlen(path)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	strcpy(persistentBuffersPath, path);
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Creates the shared memory segment (or the persistent buffers file) all buffers are carved from.
+ * The segment is sized to fit the initial layout of the private buffers, the shared buffer and the
+ * names copied for the collector (or the recovery)
+ * @param threadsNumArg Numbers of threads (available buffers)
+ * @param privateBuffSize Size of private buffers
+ * @param sharedBuffSize Size of shared buffer
+ * @param maxArgsLenArg Maximum message arguments length
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure (including if the segment
+ * already exists - it may hold messages of a previous run that weren't collected yet)
+ */
+static int createSharedSegment(const int threadsNumArg,
+                               const int privateBuffSize,
+                               const int sharedBuffSize,
+                               const int maxArgsLenArg) {
+	size_t size;
+
+	size = sizeof(*sharedSegment)
+	        + threadsNumArg * sizeof(struct MessageQueue*)
+	        + threadsNumArg
+	                * getMessageQueueMemorySize(privateBuffSize, maxArgsLenArg)
+	        + getMessageQueueMemorySize(sharedBuffSize, maxArgsLenArg)
+	        + SHARED_STRINGS_MEMORY_SIZE
+	        + (threadsNumArg + 3) * SHARED_SEGMENT_ALIGNMENT;
+
+	sharedSegmentArena = ('\0' != sharedSegmentName[0]) ?
+	        newSharedArena(sharedSegmentName, size, arenaFlags) :
+	        newFileArena(persistentBuffersPath, size, arenaFlags);
+	if (NULL == sharedSegmentArena) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* The first allocation is the segment's root, where the collector finds everything else */
+	sharedSegment = arenaAlloc(sharedSegmentArena, sizeof(*sharedSegment));
+	sharedStrings = newSharedStrings(sharedSegmentArena, SHARED_STRINGS_NUM);
+	if (NULL == sharedStrings) {
+		destroySharedSegment();
+		return LOG_STATUS_FAILURE;
+	}
+
+	sharedSegment->applicationPid = getpid();
+	__atomic_store_n(&sharedSegment->collectorPid, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&sharedSegment->isDetached, false, __ATOMIC_SEQ_CST);
+	sem_init(&sharedSegment->detachSem, 1, 0);
+	sem_init(&sharedSegment->drainedSem, 1, 0);
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Destroy the shared memory segment (or the persistent buffers file) of a logger that failed to
+ * initialize
+ */
+static void destroySharedSegment() {
+	sharedStringsDestroy(sharedStrings);
+	arenaDestroy(sharedSegmentArena);
+	if ('\0' != sharedSegmentName[0]) {
+		unlinkSharedArena(sharedSegmentName);
+	} else {
+		unlinkFileArena(persistentBuffersPath);
+	}
+
+	sharedStrings = NULL;
+	sharedSegmentArena = NULL;
+	sharedSegment = NULL;
+}
+
+/**
+ * Publish the buffers at the shared memory segment, so a collector may attach to it (or the
+ * recovery may find them at the persistent buffers file)
+ */
+static void publishSharedSegment() {
+	sharedSegment->maxMsgLen = maxMsgLen;
+	sharedSegment->maxArgsLen = maxArgsLen;
+	sharedSegment->privateBuffersNum = privateBuffersNum;
+	sharedSegment->privateBuffers = privateBuffers;
+	sharedSegment->sharedBuffer = sharedBuffer;
+	__atomic_store_n(&sharedSegment->isReady, true, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Let the collector know no more messages are coming, and wait (for a bounded time) for it to
+ * write everything out. If no collector is attached, the messages stay at the segment until one
+ * attaches
+ */
+static void detachSharedSegment() {
+	struct timespec deadline;
+	pid_t collectorPid;
+
+	__atomic_store_n(&sharedSegment->isDetached, true, __ATOMIC_SEQ_CST);
+	sem_post(&sharedSegment->detachSem);
+
+	collectorPid = __atomic_load_n(&sharedSegment->collectorPid, __ATOMIC_SEQ_CST);
+	if (0 != collectorPid && true == isProcessAlive(collectorPid)) {
+		getRealtimeDeadline(&deadline, DETACH_TIMEOUT_MSEC);
+		while (0 != sem_timedwait(&sharedSegment->drainedSem, &deadline)
+		        && EINTR == errno) {
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+int runLoggerCollector(const char* segmentName, void (*writeMethodArg)()) {
+	struct Arena* arena;
+	SharedSegment* segment;
+
+	arena = attachSharedArena(segmentName);
+	if (NULL == arena) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	segment = getSharedArenaRoot(arena);
+	if (false == __atomic_load_n(&segment->isReady, __ATOMIC_SEQ_CST)
+	        || LOG_STATUS_SUCCESS != claimSharedSegment(segment)) {
+		arenaDestroy(arena);
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* The log file is created only once the segment is claimed, so the file of a collector that
+	 * is already attached isn't truncated - a failure hands the segment back */
+	if (LOG_STATUS_SUCCESS != createLogFile()) {
+		releaseSharedSegment(segment);
+		arenaDestroy(arena);
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* The logger thread drains the application's buffers exactly as it would in the application
+	 * itself - everything it needs is found through the segment's root */
+	isCollector = true;
+	sharedSegment = segment;
+	maxMsgLen = segment->maxMsgLen;
+	maxArgsLen = segment->maxArgsLen;
+	privateBuffersNum = segment->privateBuffersNum;
+	privateBuffers = segment->privateBuffers;
+	sharedBuffer = segment->sharedBuffer;
+	writeMethod = writeMethodArg;
+	if (NULL != logSinks) {
+		startLogSinks(logSinks, logFile, writeMethod);
+	}
+	numaNodesNum = 1;
+	drainersNum = 1;
+	drainers = &segment->drainer;
+	//TODO: think if malloc failures need to be handled
+	arenas = calloc(numaNodesNum, sizeof(*arenas));
+	arenas[0] = arena;
+	dynamicllyAllocaedPrivateBuffers = newLinkedList();
+
+	/* Pages of a shared memory segment aren't returned to the OS by releasing them */
+	setIdleBuffersRelease(false, 0);
+	setLatencySampling(DEFAULT_LATENCY_SAMPLE_RATE);
+	initSynchronizationElements();
+	initLatencyHistograms();
+	startLoggerThreads();
+
+	waitForApplicationDetach(segment);
+
+	/* The last iteration of the logger thread drains everything the application wrote */
+	__atomic_store_n(&isTerminate, true, __ATOMIC_SEQ_CST);
+	stopLoggerThreads();
+
+	unlinkSharedArena(segmentName);
+	sem_post(&segment->drainedSem);
+	freeResources();
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Register the calling process as the collector of a shared memory segment - a single collector
+ * may drain a segment at a time, a collector that exited is replaced
+ * @param segment The segment
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if another collector is attached
+ */
+static int claimSharedSegment(SharedSegment* segment) {
+	pid_t collectorPid;
+
+	collectorPid = __atomic_load_n(&segment->collectorPid, __ATOMIC_SEQ_CST);
+	if (0 != collectorPid && true == isProcessAlive(collectorPid)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return (true
+	        == __atomic_compare_exchange_n(&segment->collectorPid, &collectorPid,
+	                                       getpid(), false, __ATOMIC_SEQ_CST,
+	                                       __ATOMIC_SEQ_CST)) ?
+	        LOG_STATUS_SUCCESS : LOG_STATUS_FAILURE;
+}
+
+/**
+ * Give up the claim of the calling process on a shared memory segment, so another collector may
+ * claim it right away (rather than once the pid of the calling process is no longer in use)
+ * @param segment The segment
+ */
+static void releaseSharedSegment(SharedSegment* segment) {
+	pid_t collectorPid = getpid();
+
+	__atomic_compare_exchange_n(&segment->collectorPid, &collectorPid, 0, false,
+	                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Wait until the application of a shared memory segment terminates the logger, or exits without
+ * doing so (e.g. crashes)
+ * @param segment The segment
+ */
+static void waitForApplicationDetach(SharedSegment* segment) {
+	struct timespec deadline;
+
+	while (false == __atomic_load_n(&segment->isDetached, __ATOMIC_SEQ_CST)
+	        && true == isProcessAlive(segment->applicationPid)) {
+		getRealtimeDeadline(&deadline, COLLECTOR_POLL_INTERVAL_MSEC);
+		sem_timedwait(&segment->detachSem, &deadline);
+	}
+}
+
+/**
+ * Check whether or not a process exists
+ * @param pid The process id
+ * @return True if the process exists or false otherwise
+ */
+static inline bool isProcessAlive(const pid_t pid) {
+	return 0 == kill(pid, 0) || EPERM == errno;
+}
+
+/* API method - Description located at .h file */
+int recoverPersistentBuffers(const char* path, FILE* outFile,
+                             void (*writeMethodArg)()) {
+	SharedSegment* segment;
+	int messagesNum;
+	int i;
+
+	recoveryArena = attachFileArena(path);
+	if (NULL == recoveryArena) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* Nothing was logged before the buffers were published */
+	segment = getSharedArenaRoot(recoveryArena);
+	if (false == __atomic_load_n(&segment->isReady, __ATOMIC_SEQ_CST)
+	        || 0 > segment->privateBuffersNum || 1 > segment->maxMsgLen
+	        || getArenaRemainder(recoveryArena, segment->privateBuffers)
+	                < segment->privateBuffersNum * sizeof(*segment->privateBuffers)) {
+		arenaDestroy(recoveryArena);
+		recoveryArena = NULL;
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* The write methods format messages up to the application's maximal length */
+	maxMsgLen = segment->maxMsgLen;
+	messagesNum = 0;
+	for (i = 0; i < segment->privateBuffersNum; ++i) {
+		messagesNum += recoverQueue(segment->privateBuffers[i],
+		                            segment->maxArgsLen, outFile,
+		                            writeMethodArg);
+	}
+
+	messagesNum += recoverQueue(segment->sharedBuffer, segment->maxArgsLen,
+	                            outFile, writeMethodArg);
+	fflush(outFile);
+
+	arenaDestroy(recoveryArena);
+	recoveryArena = NULL;
+
+	return messagesNum;
+}
+
+/**
+ * Write the messages of a buffer of a persistent buffers file that weren't drained. A buffer that
+ * doesn't lie within the file is skipped
+ * @param mq The buffer
+ * @param maxArgsLenArg Maximum message arguments length of the application
+ * @param outFile The file to write the messages to
+ * @param writeMethodArg A pointer to a method that writes a message to a file
+ * @return The number of messages written
+ */
+static int recoverQueue(struct MessageQueue* mq, const int maxArgsLenArg,
+                        FILE* outFile, void (*writeMethodArg)()) {
+	size_t remainder = getArenaRemainder(recoveryArena, mq);
+
+	if (sizeof(*mq) > remainder || 2 > mq->size || maxArgsLenArg != mq->maxArgsLen
+	        || getMessageQueueMemorySize(mq->size, mq->maxArgsLen) > remainder) {
+		return 0;
+	}
+
+	return recoverMessages(mq, outFile, writeMethodArg, isRecoverableString);
+}
+
+/**
+ * Check whether a name a recovered message refers to is a terminated string within the
+ * persistent buffers file
+ * @param str The name
+ * @return True if the name may be read or false otherwise
+ */
+static bool isRecoverableString(const char* str) {
+	size_t remainder = getArenaRemainder(recoveryArena, str);
+
+	return 0 != remainder && NULL != memchr(str, '\0', remainder);
+}
+
+/* API method - Description located at .h file */
+int registerThread() {
+	int numaNode;
+
+	numaNode = (1 < numaNodesNum) ? getCurrentNumaNode() % numaNodesNum : 0;
+	tlmq = takePrivateBuffer(numaNode);
+
+	/* No more pre-allocated buffers available. If dynamic allocation is enabled, allocate a buffer*/
+	if (NULL == tlmq) {
+		bool isDynamicAllocationLoc;
+
+		__atomic_load(&isDynamicAllocation, &isDynamicAllocationLoc,
+		__ATOMIC_SEQ_CST);
+
+		/* Dynamically allocated buffers are private to this process, so the collector process
+		 * couldn't drain them (and the flight recorder dumps the pre-allocated buffers only) */
+		if (true == isDynamicAllocationLoc && NULL == sharedSegment
+		        && false == isFlightRecorderMode) {
+			struct LinkedListNode* node;
+			struct MessageQueue* mq;
+
+			/* Dynamically allocated buffers come and go, so they aren't carved from an arena
+			 * (arena memory is never reclaimed) */
+			mq = newPrivateBuffer(
+			        __atomic_load_n(&privateBuffSize, __ATOMIC_SEQ_CST), true,
+			        NULL);
+			node = newLinkedListNode(mq);
+
+			pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
+			{
+				addNode(dynamicllyAllocaedPrivateBuffers, node);
+			}
+			pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
+			__atomic_add_fetch(&dynamicBuffersNum, 1, __ATOMIC_SEQ_CST);
+			tlmq = mq;
+		}
+	} else {
+		setIsTaken(tlmq, true);
+	}
+
+	/* Dynamically allocated buffers are drained by the main logger thread */
+	tlDrainer = (NULL != tlmq && false == getIsDynamicallyAllocated(tlmq)) ?
+	        getDrainer(getNumaNode(tlmq)) : &drainers[0];
+
+	if (NULL == tlmq) {
+		countStat(TS_REGISTRATION_FAILURES, 1);
+		return LOG_STATUS_FAILURE;
+	}
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Take a pre-allocated private buffer, preferring buffers of the given NUMA node and falling
+ * back to other nodes' buffers
+ * @param numaNode The preferred NUMA node
+ * @return A private buffer, or NULL if no pre-allocated buffer is available
+ */
+static struct MessageQueue* takePrivateBuffer(const int numaNode) {
+	int i;
+
+	for (i = 0; i < numaNodesNum; ++i) {
+		struct Queue* queue = privateBuffersQueues[(numaNode + i) % numaNodesNum];
+		struct MessageQueue* mq;
+
+		mq = dequeue(queue);
+
+		/* Buffers of an outdated layout may still be found in the queue (returned by threads
+		 * that unregistered during a layout change) - hand them over to the logger thread to
+		 * be freed */
+		while (NULL != mq && true == isRetiredBuffer(mq)) {
+			decommisionBuffer(mq);
+			mq = dequeue(queue);
+		}
+
+		if (NULL != mq) {
+			return mq;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the drainer of the private buffers of a given NUMA node
+ * @param numaNode The NUMA node
+ * @return The drainer of the private buffers of the NUMA node
+ */
+static inline LoggerDrainer* getDrainer(const int numaNode) {
+	return (true == isPerNodeDraining) ? &drainers[numaNode] : &drainers[0];
+}
+
+/* API method - Description located at .h file */
+void unregisterThread() {
+	if (NULL != tlmq) {
+		setIsTaken(tlmq, false);
+
+		/* Pre-allocated buffers of the current layout are returned to the queue, any other buffer
+		 * is handed over to the logger thread, which drains and frees it. The layout can't change
+		 * between the check and the enqueue, otherwise a retired buffer could take the place of a
+		 * buffer of the new layout in the queue */
+		pthread_rwlock_rdlock(&privateBuffersLayoutLock); /* Lock */
+		{
+			if (true == getIsDynamicallyAllocated(tlmq)
+			        || true == isRetiredBuffer(tlmq)
+			        || Q_STATUS_SUCCESS
+			                != enqueue(privateBuffersQueues[getNumaNode(tlmq)],
+			                           tlmq)) {
+				decommisionBuffer(tlmq);
+			}
+		}
+		pthread_rwlock_unlock(&privateBuffersLayoutLock); /* Unlock */
+
+		tlmq = NULL;
+		tlDrainer = NULL;
+	}
+
+	free(tlReserveScratch);
+	tlReserveScratch = NULL;
+	tlReservation.isActive = false;
+
+	/* The counters are kept, the next thread to need a block adopts them */
+	releaseThreadStats(tlStats);
+	tlStats = NULL;
+}
+
+/**
+ * Logger thread loop - At each iteration, go over all the buffers and drain them to the log file,
+ * flush buffer and sleep for a while.
+ * The main logger thread (first drainer) also drains the shared buffer and the dynamically
+ * allocated buffers and carries out layout changes. With per-node draining, every other logger
+ * thread only drains the private buffers of its own NUMA node
+ * @param drainerArg The LoggerDrainer of this thread
+ * @return NULL
+ */
+static void* runLogger(void* drainerArg) {
+	LoggerDrainer* drainer = drainerArg;
+	bool isMainDrainer;
+	bool isTerminateLoc;
+	bool isNewDataLoc;
+
+	isMainDrainer = (drainer == &drainers[0]);
+	isTerminateLoc = false;
+	isNewDataLoc = false;
+
+	do {
+		__atomic_store_n(&drainer->isNewData, false, __ATOMIC_SEQ_CST);
+		__atomic_load(&isTerminate, &isTerminateLoc, __ATOMIC_SEQ_CST);
+
+		/* Layout changes are carried out by the main logger thread, other logger threads are
+		 * kept out of the private buffers meanwhile by the layout lock */
+		if (true == isMainDrainer
+		        && true
+		                == __atomic_exchange_n(&isLayoutChangeRequested, false,
+		                __ATOMIC_SEQ_CST)) {
+			doChangePrivateBuffersLayout();
+		}
+
+		if (false == isFlightRecorderMode) {
+			pthread_rwlock_rdlock(&privateBuffersLayoutLock); /* Lock */
+			{
+				drainPrivateBuffers(drainer);
+				releaseIdlePrivateBuffers(drainer->numaNode);
+			}
+			pthread_rwlock_unlock(&privateBuffersLayoutLock); /* Unlock */
+		}
+
+		if (true == isMainDrainer) {
+			/* The flight recorder's buffers aren't drained, they're dumped when a trigger fires */
+			if (true == isFlightRecorderMode) {
+				if (true
+				        == __atomic_exchange_n(&isFlightRecorderTriggered, false,
+				        __ATOMIC_SEQ_CST)) {
+					dumpFlightRecorder();
+				}
+			} else {
+				drainDynamicllyAllocaedPrivateBuffers();
+				drainSharedBuffer();
+			}
+			selfLogLatency();
+		}
+		flushLogFile(); /* Flush buffer at the end of the iteration to avoid data staying in buffer long */
+
+		/* The following is done to avoid wasting CPU in case no logging is being done
+		 * (the main concern are 1-core CPU's and the current mechanism solves the issue) */
+		//TODO: At the current state, it's enough that just 1 thread will try to log data
+		// on order to prevent the logger thread from sleeping, need to think about
+		// changing it so maybe some % of the threads need to log data instead.
+		// On the other hand, in a real application, logging is performed constantly,
+		// so this may not be a concern.
+		if (true == isFlightRecorderMode) {
+			/* Only a trigger is new data to the flight recorder */
+			__atomic_load(&isFlightRecorderTriggered, &isNewDataLoc,
+			__ATOMIC_SEQ_CST);
+		} else {
+			__atomic_load(&drainer->isNewData, &isNewDataLoc, __ATOMIC_SEQ_CST);
+		}
+		if (false == isNewDataLoc && false == isTerminateLoc) {
+			waitForNewData(drainer);
+		}
+	} while (!isTerminateLoc);
+
+	releaseThreadStats(tlStats);
+	tlStats = NULL;
+
+	return NULL;
+}
+
+/**
+ * Wait until a worker thread signals new data. When idle buffers release is enabled, the wait is
+ * bounded, so idle buffers are checked even if no data arrives. In flight recorder mode, the wait
+ * is bounded as well, so a trigger whose wake up raced with the start of the wait isn't missed
+ * @param drainer The LoggerDrainer of the calling thread
+ */
+static void waitForNewData(LoggerDrainer* drainer) {
+	bool isIdleReleaseEnabledLoc;
+
+	__atomic_load(&isIdleReleaseEnabled, &isIdleReleaseEnabledLoc,
+	__ATOMIC_SEQ_CST);
+
+	sem_post(&drainer->waitingSem);
+
+	if (false == isIdleReleaseEnabledLoc && false == isFlightRecorderMode) {
+		sem_wait(&drainer->loopSem);
+	} else {
+		struct timespec deadline;
+		int intervalMsec;
+
+		intervalMsec = __atomic_load_n(&idleReleaseThresholdMsec,
+		__ATOMIC_SEQ_CST);
+		if (intervalMsec < MIN_IDLE_CHECK_INTERVAL_MSEC) {
+			intervalMsec = MIN_IDLE_CHECK_INTERVAL_MSEC;
+		}
+		if (true == isFlightRecorderMode) {
+			intervalMsec = FLIGHT_RECORDER_CHECK_INTERVAL_MSEC;
+		}
+
+		getRealtimeDeadline(&deadline, intervalMsec);
+		if (0 != sem_timedwait(&drainer->loopSem, &deadline)) {
+			/* Nobody woke us up - take back the waiting indication (if a worker took it
+			 * meanwhile, it also posted 'loopSem', which only causes an extra iteration) */
+			sem_trywait(&drainer->waitingSem);
+		}
+	}
+}
+
+/**
+ * Release the memory of private buffers that have been idle for longer than the configured
+ * threshold, once they are drained - unregistered buffers too, as they may be taken by a newly
+ * registered thread at any moment. Their pages are committed again on demand when they are
+ * written to
+ * @param numaNode Check only the buffers of this NUMA node (or ALL_NUMA_NODES)
+ */
+static void releaseIdlePrivateBuffers(const int numaNode) {
+	bool isIdleReleaseEnabledLoc;
+	long long nowMsec;
+	long long thresholdMsec;
+	int i;
+
+	__atomic_load(&isIdleReleaseEnabled, &isIdleReleaseEnabledLoc,
+	__ATOMIC_SEQ_CST);
+	if (false == isIdleReleaseEnabledLoc) {
+		return;
+	}
+
+	nowMsec = getMonotonicTimeMsec();
+	thresholdMsec = __atomic_load_n(&idleReleaseThresholdMsec,
+	__ATOMIC_SEQ_CST);
+
+	for (i = 0; i < privateBuffersNum; ++i) {
+		struct MessageQueue* mq = privateBuffers[i];
+
+		if (ALL_NUMA_NODES == numaNode || numaNode == getNumaNode(mq)) {
+			releaseIdleBufferMemory(mq, nowMsec, thresholdMsec);
+		}
+	}
+}
+
+/**
+ * Returns the current monotonic time in milliseconds
+ * @return The current monotonic time in milliseconds
+ */
+static inline long long getMonotonicTimeMsec() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Returns the current monotonic time in nanoseconds
+ * @return The current monotonic time in nanoseconds
+ */
+static inline long long getMonotonicTimeNsec() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Returns the deadline of a wait that times out after a given time (as expected by
+ * 'sem_timedwait')
+ * @param deadline The deadline to set
+ * @param timeoutMsec The time to wait (in milliseconds)
+ */
+static void getRealtimeDeadline(struct timespec* deadline, const int timeoutMsec) {
+	clock_gettime(CLOCK_REALTIME, deadline);
+	deadline->tv_sec += timeoutMsec / 1000;
+	deadline->tv_nsec += (long) (timeoutMsec % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		++deadline->tv_sec;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+/**
+ * Replace the private buffers with a new layout, according to the latest requested size and
+ * number of buffers.
+ * The change is hitless - private buffers stay active throughout: the buffers of the old layout
+ * are retired and moved to the dynamically allocated list, each owner thread switches to a buffer
+ * of the new layout at its next log call and the old buffer is freed once it has been released
+ * by its owner and drained.
+ */
+static void doChangePrivateBuffersLayout() {
+	struct MessageQueue** newPrivateBuffers;
+	struct MessageQueue* mq;
+	int newSize;
+	int newNumber;
+	int failuresNum;
+	int i;
+
+	newSize = __atomic_load_n(&newPrivateBuffSize, __ATOMIC_SEQ_CST);
+	newNumber = __atomic_load_n(&newPrivateBuffersNumber, __ATOMIC_SEQ_CST);
+
+	newPrivateBuffers = allocatePrivateBuffers(newSize, newNumber, 0);
+
+	pthread_rwlock_wrlock(&privateBuffersLayoutLock); /* Lock */
+	{
+		retirePrivateBuffers();
+
+		/* Buffers that are still in the queues have no owner, so they can be released right
+		 * away */
+		for (i = 0; i < numaNodesNum; ++i) {
+			do {
+				while (NULL != (mq = dequeue(privateBuffersQueues[i]))) {
+					decommisionBuffer(mq);
+				}
+			} while (Q_STATUS_SUCCESS
+			        != changeQueueCapacity(privateBuffersQueues[i], newNumber));
+		}
+
+		/* Dynamically allocated buffers from now on will be allocated with the new size */
+		__atomic_store_n(&privateBuffSize, newSize, __ATOMIC_SEQ_CST);
+
+		failuresNum = enqueuePrivateBuffers(newPrivateBuffers, newNumber);
+
+		free(privateBuffers);
+		privateBuffers = newPrivateBuffers;
+		privateBuffersNum = newNumber;
+	}
+	pthread_rwlock_unlock(&privateBuffersLayoutLock); /* Unlock */
+
+	if (0 != failuresNum) {
+		selfLog(__func__, __LINE__,
+		        "Private buffers layout change: %d buffers couldn't be queued for registration",
+		        failuresNum);
+	}
+}
+
+/**
+ * Retire all current private buffers (pre-allocated and dynamically allocated) and move the
+ * pre-allocated ones to the dynamically allocated list, which is drained by the logger thread
+ * until each buffer is decommissioned
+ */
+static void retirePrivateBuffers() {
+	struct LinkedListNode* node;
+	int i;
+
+	pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
+	{
+		for (i = 0; i < privateBuffersNum; ++i) {
+			addNode(dynamicllyAllocaedPrivateBuffers,
+			        newLinkedListNode(privateBuffers[i]));
+		}
+
+		for (node = getHead(dynamicllyAllocaedPrivateBuffers); NULL != node;
+		        node = getNext(node)) {
+			retireBuffer(getData(node));
+		}
+	}
+	pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
+}
+
+/**
+ * Iterate private buffers and drain them to file. Priority lanes are drained first, and again
+ * before each buffer if urgent messages were added meanwhile
+ * @param drainer The LoggerDrainer of the calling thread (only the buffers of its NUMA node are
+ * drained)
+ */
+static inline void drainPrivateBuffers(LoggerDrainer* drainer) {
+	int i;
+
+	for (i = 0; i < privateBuffersNum; ++i) {
+		struct MessageQueue* mq = privateBuffers[i];
+
+		if (ALL_NUMA_NODES == drainer->numaNode
+		        || drainer->numaNode == getNumaNode(mq)) {
+			drainPriorityLanes(drainer);
+			drainPrivateBuffer(mq);
+		}
+	}
+}
+
+/**
+ * Drain the priority lanes of the private buffers and flush them to file right away, if urgent
+ * messages were added since they were last drained. The main logger thread drains the priority
+ * lanes of the dynamically allocated buffers as well
+ * @param drainer The LoggerDrainer of the calling thread (only the priority lanes of its NUMA node
+ * are drained)
+ */
+static void drainPriorityLanes(LoggerDrainer* drainer) {
+	struct LinkedListNode* node;
+	int i;
+
+	if (false == __atomic_exchange_n(&drainer->isPriorityData, false,
+	__ATOMIC_SEQ_CST)) {
+		return;
+	}
+
+	for (i = 0; i < privateBuffersNum; ++i) {
+		struct MessageQueue* mq = privateBuffers[i];
+
+		if ((ALL_NUMA_NODES == drainer->numaNode
+		        || drainer->numaNode == getNumaNode(mq))
+		        && NULL != getPriorityQueue(mq)) {
+			drainQueue(getPriorityQueue(mq));
+		}
+	}
+
+	/* Check if it's worth locking the mutex */
+	if (drainer == &drainers[0]
+	        && NULL != getHead(dynamicllyAllocaedPrivateBuffers)) {
+		pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
+		{
+			for (node = getHead(dynamicllyAllocaedPrivateBuffers); NULL != node;
+			        node = getNext(node)) {
+				if (NULL != getPriorityQueue(getData(node))) {
+					drainQueue(getPriorityQueue(getData(node)));
+				}
+			}
+		}
+		pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
+	}
+
+	flushLogFile();
+}
+
+/**
+ * Drain a private buffer to file, its priority lane first
+ * @param mq The private buffer
+ */
+static inline void drainPrivateBuffer(struct MessageQueue* mq) {
+	if (NULL != getPriorityQueue(mq)) {
+		drainQueue(getPriorityQueue(mq));
+	}
+
+	drainQueue(mq);
+}
+
+/**
+ * Drain shared buffer to file
+ */
+static inline void drainSharedBuffer() {
+	drainQueue(sharedBuffer);
+}
+
+/**
+ * Drain a MessageQueue to file, suppressing duplicates if enabled
+ * @param mq The MessageQueue to drain
+ */
+static inline void drainQueue(struct MessageQueue* mq) {
+	int duplicatesNum;
+
+	/* A buffer at a segment (or a file) outlives the process that drains it, so its messages may
+	 * be drained again (or recovered) up to its last read position - but not the messages at the
+	 * log file's stream buffer. The same goes for the crash drain, which can't flush the stream */
+	duplicatesNum = drainMessages(
+	        mq, logFile, maxMsgLen, writeAndCount,
+	        __atomic_load_n(&isDuplicatesSuppressed, __ATOMIC_RELAXED),
+	        NULL != sharedSegment
+	                || true == __atomic_load_n(&isCrashDrainInstalled, __ATOMIC_RELAXED));
+	if (0 != duplicatesNum) {
+		countStat(TS_DUPLICATES, duplicatesNum);
+	}
+}
+
+/**
+ * Drain data from the dynamically allocated buffers to the log file
+ */
+static void drainDynamicllyAllocaedPrivateBuffers() {
+	struct LinkedListNode* node = getHead(dynamicllyAllocaedPrivateBuffers);
+
+	/* Check if it's worth locking the mutex */
+	if (NULL != node) {
+		pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
+		{
+			while (NULL != node) {
+				struct MessageQueue* mq = getData(node);
+				struct LinkedListNode* nextNode;
+
+				drainPrivateBuffer(mq);
+				nextNode = getNext(node);
+
+				if (true == isDecommisionedBuffer(mq)) {
+					drainPrivateBuffer(mq);
+					if (true == getIsDynamicallyAllocated(mq)) {
+						__atomic_sub_fetch(&dynamicBuffersNum, 1, __ATOMIC_SEQ_CST);
+					}
+					free(removeNode(dynamicllyAllocaedPrivateBuffers, mq));
+					messageDataQueueDestroy(mq);
+				}
+
+				node = nextNode;
+			}
+		}
+		pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
+	}
+}
+
+/* API method - Description located at .h file */
+void terminateLogger() {
+	__atomic_store_n(&isTerminate, true, __ATOMIC_SEQ_CST);
+
+	if (true == isSharedMemoryMode) {
+		detachSharedSegment();
+	} else {
+		stopLoggerThreads();
+
+		/* Everything was drained, there's nothing to recover from the persistent buffers file */
+		if (NULL != sharedSegment) {
+			unlinkFileArena(persistentBuffersPath);
+		}
+	}
+
+	freeResources();
+}
+
+/**
+ * Release all malloc'ed resources, destroy mutexs and close the open file
+ */
+static void freeResources() {
+	int i;
+
+	/* Buffers are about to be freed, the crash drain mustn't reach them anymore */
+	if (true == isCrashDrainInstalled) {
+		restoreCrashHandlers();
+	}
+
+	if (true == isFlightRecorderMode && 0 != flightRecorderTriggerSignal) {
+		sigaction(flightRecorderTriggerSignal, &prevFlightRecorderAction, NULL);
+	}
+
+	free(flightRecorderRefs);
+	flightRecorderRefs = NULL;
+	free(flightRecorderArgsBuf);
+	flightRecorderArgsBuf = NULL;
+
+	/* The buffers of a shared memory segment (and their layout) are carved from the segment, and
+	 * their reader state belongs to the collector process */
+	if (false == isSharedMemoryMode) {
+		for (i = 0; i < privateBuffersNum; ++i) {
+			messageDataQueueDestroy(privateBuffers[i]);
+		}
+
+		messageDataQueueDestroy(sharedBuffer);
+	}
+
+	if (NULL == sharedSegment) {
+		free(privateBuffers);
+	}
+
+	destroyDynamicallyAllocatedBuffers();
+	sharedStringsDestroy(sharedStrings);
+	sharedStrings = NULL;
+
+	/* Arenas are destroyed only after all buffers that may have been carved from them */
+	for (i = 0; i < numaNodesNum; ++i) {
+		arenaDestroy(arenas[i]);
+	}
+
+	free(arenas);
+
+	/* The drainer of a shared memory segment was unmapped with it */
+	if (false == isSharedMemoryMode && false == isCollector) {
+		for (i = 0; i < drainersNum; ++i) {
+			sem_destroy(&drainers[i].loopSem);
+			sem_destroy(&drainers[i].waitingSem);
+		}
+
+		free(drainers);
+	}
+
+	drainers = NULL;
+
+	sharedSegment = NULL;
+	sharedSegmentArena = NULL;
+	isSharedMemoryMode = false;
+	isCollector = false;
+	destroyThreadStats();
+	destroyModuleLevels();
+	destroyLatencyHistograms();
+	pthread_rwlock_destroy(&privateBuffersLayoutLock);
+	pthread_mutex_destroy(&dynamicllyAllocaedLock);
 	pthread_mutex_destroy(&sharedBufferlock);
 	pthread_mutex_destroy(&loggerLock);
 	destroyDirectWriteLock();
-	queueDestroy(privateBuffersQueue);
-	fclose(logFile);
+
+	/* The collector process has neither the queues of the buffers, nor does the application have
+	 * a log file in shared memory mode */
+	if (NULL != privateBuffersQueues) {
+		for (i = 0; i < numaNodesNum; ++i) {
+			queueDestroy(privateBuffersQueues[i]);
+		}
+	}
+
+	free(privateBuffersQueues);
+
+	/* The queues of the sinks are drained to their files before the log file is closed */
+	logSinksDestroy(logSinks);
+	logSinks = NULL;
+	if (NULL != logFile) {
+		fclose(logFile);
+	}
 	free(logFileBuff);
 }
 
-/* API method - Description located at .h file */
-void logMessage(const int loggingLevel, char* file, const char* func,
-                const int line, char* msg, ...) {
-	if (true == isLoggingValid(loggingLevel, msg)) {
-		bool arePrivateBuffersActiveLoc;
+/* API method - Description located at .h file */
+void logMessage(const int loggingLevel, char* file, const char* func,
+                const int line, char* msg, ...) {
+	if (true == isLoggingLevelValid(loggingLevel)) {
+		va_list args;
+
+		va_start(args, msg);
+		logMessageList(loggingLevel, file, func, line, &args, msg);
+		va_end(args);
+	}
+}
+
+/* API method - Description located at .h file */
+void logSiteMessage(const int loggingLevel, char* file, const char* func,
+                    const int line, char* msg, ...) {
+	va_list args;
+
+	va_start(args, msg);
+	logMessageList(loggingLevel, file, func, line, &args, msg);
+	va_end(args);
+}
+
+/**
+ * Log a message whose level was already checked - through the private buffer, the shared buffer
+ * or a direct write (see 'logMessageArgs(...)'), or over several slots if its arguments are too
+ * long for a single one
+ * @param loggingLevel Logging level of the message (one of the levels at 'logLevels')
+ * @param file File name that originated the call
+ * @param func Method that originated the call
+ * @param line Line that originated the call
+ * @param args Additional arguments of the message
+ * @param msg Message data (must be a null-terminated string)
+ */
+static inline void logMessageList(const int loggingLevel, char* file,
+                                  const char* func, const int line,
+                                  va_list* args, char* msg) {
+	va_list argsCopy;
+	int argsSize;
+
+	/* The arguments are consumed finding out whether they fit a slot, so a copy of them is used -
+	 * the original ones are restarted if they don't */
+	va_copy(argsCopy, *args);
+	argsSize = logMessageArgs(loggingLevel, file, func, line, &argsCopy, msg);
+	va_end(argsCopy);
+
+	if (__builtin_expect(LOG_STATUS_SUCCESS != argsSize, 0)) {
+		logLargeMessageArgs(loggingLevel, file, func, line, args, msg, argsSize);
+	}
+
+	checkFlightRecorderTrigger(loggingLevel);
+}
+
+/* API method - Description located at .h file */
+void logKeyValues(const int loggingLevel, char* file, const char* func,
+                  const int line, const char* event, const KeyValue* kvs,
+                  const int kvsNum) {
+	/* The event and the keys are encoded as pointers - if the buffers are at a segment, to their
+	 * copies the collector process (or the recovery) may read */
+	if (NULL != sharedStrings && 0 < kvsNum) {
+		KeyValue sharedKvs[kvsNum];
+		int i;
+
+		for (i = 0; i < kvsNum; ++i) {
+			sharedKvs[i] = kvs[i];
+			sharedKvs[i].key = internSharedString(sharedStrings, kvs[i].key);
+		}
+
+		logSiteMessage(loggingLevel, file, func, line, (char*) keyValuesFormat,
+		               internSharedString(sharedStrings, event), sharedKvs,
+		               kvsNum);
+		return;
+	}
+
+	/* The fields travel as the arguments of the structured message format, so they take the
+	 * same path as any message and are encoded straight into the buffer */
+	logSiteMessage(loggingLevel, file, func, line, (char*) keyValuesFormat,
+	               event, kvs, kvsNum);
+}
+
+/* API method - Description located at .h file */
+char* logReserve(const int loggingLevel, char* file, const char* func,
+                 const int line, const int size) {
+	LogReservation* reservation = &tlReservation;
+
+	/* A single reservation may be pending, and the payload must fit a message slot */
+	if (true == reservation->isActive || 0 > size || maxArgsLen < size
+	        || false == isLoggingValid((char*) binaryPayloadFormat)) {
+		return NULL;
+	}
+
+	reservation->loggingLevel = loggingLevel;
+	reservation->file = file;
+	reservation->func = func;
+	reservation->line = line;
+	reservation->mq = NULL;
+
+	if (NULL != tlmq && true == isRetiredBuffer(tlmq)) {
+		decommisionBuffer(tlmq);
+		tlmq = NULL;
+	}
+
+	if (NULL != tlmq || LOG_STATUS_SUCCESS == registerThread()) {
+		reservation->md = reserveMessage(tlmq);
+		if (NULL != reservation->md) {
+			file = getFileName(file);
+			internMessageLocation(&file, &func);
+			setMsgHeader(reservation->md, loggingLevel, file, func, line,
+			             LM_PRIVATE_BUFFER);
+			reservation->md->argsFormat = MSG_ARGS_BINARY;
+			reservation->mq = tlmq;
+			reservation->isActive = true;
+
+			return reservation->md->argsBuf;
+		}
+	}
+
+	/* No room at the private buffer - the payload is built aside and copied by the commit */
+	if (NULL == tlReserveScratch) {
+		//TODO: think if malloc failures need to be handled
+		tlReserveScratch = malloc(maxArgsLen);
+		if (NULL == tlReserveScratch) {
+			countStat(TS_DROPS, 1);
+			return NULL;
+		}
+	}
+	reservation->isActive = true;
+
+	return tlReserveScratch;
+}
+
+/* API method - Description located at .h file */
+void logCommit(const int size) {
+	LogReservation* reservation = &tlReservation;
+	int len;
+
+	if (false == reservation->isActive) {
+		return;
+	}
+
+	reservation->isActive = false;
+	len = (0 > size) ? 0 : (maxArgsLen < size) ? maxArgsLen : size;
+
+	if (NULL != reservation->mq) {
+		reservation->md->argsLen = len;
+		commitMessage(reservation->mq);
+		wakeLoggerThread(tlDrainer);
+		checkFlightRecorderTrigger(reservation->loggingLevel);
+	} else {
+		/* The payload travels as the arguments of the binary payload format, so it takes the
+		 * same fallback path as any message */
+		logSiteMessage(reservation->loggingLevel, reservation->file,
+		               reservation->func, reservation->line,
+		               (char*) binaryPayloadFormat, tlReserveScratch, len);
+	}
+}
+
+/**
+ * Add a message to a private buffer (or write it directly to file if a private buffer is
+ * unavailable) - the logging level of the message was already checked
+ * @param loggingLevel Logging level of the message (one of the levels at 'logLevels')
+ * @param file File name that originated the call
+ * @param func Method that originated the call
+ * @param line Line that originated the call
+ * @param args Additional arguments of the message
+ * @param msg Message data (must be a null-terminated string)
+ * @return LOG_STATUS_SUCCESS, or the space the arguments need if they are too long for a buffer
+ * slot (nothing was logged and the arguments were consumed - see 'logLargeMessageArgs(...)')
+ */
+static int logMessageArgs(const int loggingLevel, char* file, const char* func,
+                          const int line, va_list* args, char* msg) {
+	if (true == isLoggingValid(msg)) {
 		int writeToPrivateBuffer;
-		va_list arg;
-
-		/* Don't use private buffer if first level is disabled */
-		__atomic_load(&arePrivateBuffersActive, &arePrivateBuffersActiveLoc,
-		__ATOMIC_SEQ_CST);
+		int writeToSharedBuffer;
+		int logMethod;
+		bool isSampled;
+		long long startNsec;
 
+		isSampled = isLatencySampled(&tlCallSampleCounter);
+		startNsec = (true == isSampled) ? getMonotonicTimeNsec() : 0;
 		writeToPrivateBuffer = LOG_STATUS_FAILURE;
+		logMethod = LM_PRIVATE_BUFFER;
 		file = getFileName(file);
-		va_start(arg, msg);
-
-		if (true == arePrivateBuffersActiveLoc) {
-			/* Try each level of writing. If a level fails (buffer full), fall back to a
-			 * lower & slower level.
-			 * First, try private buffer writing. If private buffer doesn't exist
-			 * (unregistered thread) or unable to write in this method, fall to
-			 * next methods */
-			if (NULL != tlmq) {
-				setIsBeingUsed(tlmq, true);
+		internMessageLocation(&file, &func);
+
+		/* If the private buffers layout has changed, release the current private buffer to the
+		 * logger thread (which frees it once drained) and switch to a buffer of the new layout */
+		if (NULL != tlmq && true == isRetiredBuffer(tlmq)) {
+			decommisionBuffer(tlmq);
+			tlmq = NULL;
+		}
+
+		/* Try each level of writing. If a level fails (buffer full), fall back to a
+		 * lower & slower level.
+		 * First, try private buffer writing. If private buffer doesn't exist
+		 * (unregistered thread) try to register, if unable to write in this method, fall to
+		 * next methods */
+		if (NULL != tlmq || LOG_STATUS_SUCCESS == registerThread()) {
+			/* Urgent messages take the priority lane, unless it's full */
+			if (__builtin_expect(loggingLevel <= priorityLaneLevel, 0)) {
+				writeToPrivateBuffer = writeToPriorityLane(loggingLevel, file,
+				                                           func, line, args, msg);
 			}
 
-			if (NULL != tlmq) {
-				if (false == isDecommisionedBuffer(tlmq)) {
-					writeToPrivateBuffer = addMessage(tlmq, loggingLevel, file,
-					                                  func, line, &arg, msg,
-					                                  LM_PRIVATE_BUFFER,
-					                                  maxArgsLen);
-				}
-				setIsBeingUsed(tlmq, false);
-			} else {
-				/* The current thread doesn't have a private buffer - Try to register */
-				if (LOG_STATUS_SUCCESS == registerThread()) {
-					setIsBeingUsed(tlmq, true);
-
-					/* Managed to get a private buffer - write to it */
-					writeToPrivateBuffer = addMessage(tlmq, loggingLevel, file,
-					                                  func, line, &arg, msg,
-					                                  LM_PRIVATE_BUFFER,
-					                                  maxArgsLen);
-					setIsBeingUsed(tlmq, false);
-				}
+			if (LOG_STATUS_FAILURE == writeToPrivateBuffer) {
+				writeToPrivateBuffer = addMessage(tlmq, loggingLevel, file, func,
+				                                  line, args, msg,
+				                                  LM_PRIVATE_BUFFER, maxArgsLen);
 			}
 		}
 
 		if (LOG_STATUS_SUCCESS == writeToPrivateBuffer) {
 			/* Communicate with logger thread */
-			__atomic_store_n(&isNewData, true, __ATOMIC_SEQ_CST);
-			if (0 == sem_trywait(&loggerWaitingSem)) {
-				sem_post(&loggerLoopSem);
-			}
+			wakeLoggerThread(tlDrainer);
+		} else if (LOG_STATUS_FAILURE != writeToPrivateBuffer) {
+			/* Too long for a slot */
+			return writeToPrivateBuffer;
 		} else {
-			bool arePrivateBuffersChangingNumberLoc;
-
 			/* Unable to write to private buffer
 			 * Recommended not to get here - Register all threads and/or increase
 			 * private buffers size */
-			if (MQ_STATUS_SUCCESS
-			        != writeTosharedBuffer(loggingLevel, file, func, line, &arg,
-			                               msg)) {
+			logMethod = LM_SHARED_BUFFER;
+			writeToSharedBuffer = writeTosharedBuffer(loggingLevel, file, func,
+			                                          line, args, msg);
+			if (MQ_STATUS_FAILURE == writeToSharedBuffer
+			        && (true == isSharedMemoryMode || true == isFlightRecorderMode)) {
+				/* There's no log file to write to in shared memory mode, and the flight
+				 * recorder writes it only when a trigger fires */
+				countStat(TS_DROPS, 1);
+				return LOG_STATUS_SUCCESS;
+			} else if (MQ_STATUS_FAILURE == writeToSharedBuffer) {
 				/* Unable to write to shared buffer
 				 * Recommended not to get here - Increase private and shared buffers sizes */
-				directWriteToFile(loggingLevel, file, func, line, &arg, msg,
-				                  logFile, maxMsgLen, maxArgsLen,
-				                  LM_DIRECT_WRITE, writeMethod);
-				++cnt; //TODO: remove
+				logMethod = LM_DIRECT_WRITE;
+				writeToSharedBuffer = directWriteToFile(loggingLevel, file, func,
+				                                        line, args, msg, logFile,
+				                                        maxMsgLen, maxArgsLen,
+				                                        LM_DIRECT_WRITE,
+				                                        writeAndCount, false);
 			}
 
-			__atomic_load(&arePrivateBuffersChangingNumber,
-			              &arePrivateBuffersChangingNumberLoc,
-			              __ATOMIC_SEQ_CST);
-
-			if (true == arePrivateBuffersChangingNumberLoc) {
-				unregisterThread();
+			if (MQ_STATUS_SUCCESS != writeToSharedBuffer) {
+				/* Too long for a slot */
+				return writeToSharedBuffer;
 			}
 		}
-		va_end(arg);
+
+		if (true == isSampled) {
+			recordLatency(callLatencyHistograms[loggingLevel][logMethod],
+			              getMonotonicTimeNsec() - startNsec);
+		}
 	}
+
+	return LOG_STATUS_SUCCESS;
 }
 
 /**
- * Check whether or not the logging conditions of the current message are valid
+ * Log a message whose arguments are too long for a buffer slot - it's added over several
+ * consecutive slots of the private buffer, or of the shared buffer, or written directly (formatted
+ * on the stack), whichever has room first. Nothing is allocated
+ * @param loggingLevel Logging level of the message (one of the levels at 'logLevels')
+ * @param file File name that originated the call
+ * @param func Method that originated the call
+ * @param line Line that originated the call
+ * @param args Additional arguments of the message
+ * @param msg Message data (must be a null-terminated string)
+ * @param argsSize The space the arguments need (as returned by 'logMessageArgs(...)')
+ */
+static void logLargeMessageArgs(const int loggingLevel, char* file,
+                                const char* func, const int line, va_list* args,
+                                char* msg, int argsSize) {
+	int ret = MQ_STATUS_FAILURE;
+
+	if (MAX_LARGE_ARGS_SIZE < argsSize) {
+		argsSize = MAX_LARGE_ARGS_SIZE;
+	}
+	file = getFileName(file);
+	internMessageLocation(&file, &func);
+	countStat(TS_LARGE_MESSAGES, 1);
+
+	if (NULL != tlmq && loggingLevel <= priorityLaneLevel
+	        && NULL != getPriorityQueue(tlmq)) {
+		ret = addLargeMessage(getPriorityQueue(tlmq), loggingLevel, file, func,
+		                      line, args, msg, LM_PRIVATE_BUFFER, argsSize);
+		if (MQ_STATUS_SUCCESS == ret) {
+			__atomic_store_n(&tlDrainer->isPriorityData, true, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	if (NULL != tlmq && MQ_STATUS_SUCCESS != ret) {
+		ret = addLargeMessage(tlmq, loggingLevel, file, func, line, args, msg,
+		                      LM_PRIVATE_BUFFER, argsSize);
+	}
+
+	if (MQ_STATUS_SUCCESS == ret) {
+		wakeLoggerThread(tlDrainer);
+		return;
+	}
+
+	lockSharedBuffer(); /* Lock */
+	{
+		ret = addLargeMessage(sharedBuffer, loggingLevel, file, func, line, args,
+		                      msg, LM_SHARED_BUFFER, argsSize);
+	}
+	pthread_mutex_unlock(&sharedBufferlock); /* Unlock */
+
+	if (MQ_STATUS_SUCCESS == ret) {
+		__atomic_store_n(&drainers[0].isNewData, true, __ATOMIC_SEQ_CST);
+	} else if (true == isSharedMemoryMode || true == isFlightRecorderMode) {
+		/* There's no log file to write to in shared memory mode, and the flight recorder writes
+		 * it only when a trigger fires */
+		countStat(TS_DROPS, 1);
+	} else {
+		directWriteToFile(loggingLevel, file, func, line, args, msg, logFile,
+		                  maxMsgLen, argsSize, LM_DIRECT_WRITE, writeAndCount, true);
+	}
+}
+
+/**
+ * If the buffers are at a segment, replace the file and function names of a message with their
+ * copies at the segment, which the collector process (or the recovery) may read (otherwise,
+ * nothing is done)
+ * @param file The file name to replace
+ * @param func The function name to replace
+ */
+static inline void internMessageLocation(char** file, const char** func) {
+	if (NULL != sharedStrings) {
+		*file = (char*) internSharedString(sharedStrings, *file);
+		*func = internSharedString(sharedStrings, *func);
+	}
+}
+
+/**
+ * Check whether or not the logging level of the current message is valid
  * @param loggingLevel The logging level of the current message
- * @param msg The message itself
- * @return True of conditions are valid of false otherwise
+ * @return True if the level is valid or false otherwise
  */
-static inline bool isLoggingValid(const int loggingLevel, char* msg) {
-	bool isTerminateLoc;
+static inline bool isLoggingLevelValid(const int loggingLevel) {
 	int loggingLevelLoc;
 
 	/* Don't log if trying to log messages with higher level than requested
 	 * of log level was set to LOG_LEVEL_NONE */
-	__atomic_load(&logLevel, &loggingLevelLoc, __ATOMIC_SEQ_CST);
-	if (LOG_LEVEL_NONE == loggingLevelLoc || loggingLevel > loggingLevelLoc) {
-		return false;
-	}
+	__atomic_load(&logLevel, &loggingLevelLoc, __ATOMIC_RELAXED);
+
+	return LOG_LEVEL_NONE != loggingLevelLoc && loggingLevel <= loggingLevelLoc;
+}
+
+/**
+ * Check whether or not the logging conditions of the current message are valid
+ * @param msg The message itself
+ * @return True of conditions are valid of false otherwise
+ */
+static inline bool isLoggingValid(char* msg) {
+	bool isTerminateLoc;
 
 	__atomic_load(&isTerminate, &isTerminateLoc, __ATOMIC_SEQ_CST);
 	/* Don't log if logger is terminating or msg' has an invalid value */
 	if (true == isTerminateLoc || NULL == msg) {
+		countStat(TS_DROPS, 1);
 		return false;
 	}
 
 	return true;
 }
 
+/**
+ * Adds a message to the priority lane of the thread's private buffer
+ * @param loggingLevel Log level (one of the levels at 'logLevels')
+ * @param file Filename to log
+ * @param func Function name to log
+ * @param line Line number to log
+ * @param args Additional arguments to log message
+ * @param msg The message
+ * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE if there's no priority lane or it's full,
+ * or the space the arguments need if they are too long for a slot (see 'addMessage(...)')
+ */
+static inline int writeToPriorityLane(const int loggingLevel, char* file,
+                                      const char* func, const int line,
+                                      va_list* args, const char* msg) {
+	struct MessageQueue* priorityQueue = getPriorityQueue(tlmq);
+	int ret = MQ_STATUS_FAILURE;
+
+	if (NULL != priorityQueue) {
+		ret = addMessage(priorityQueue, loggingLevel, file, func, line, args,
+		                 msg, LM_PRIVATE_BUFFER, maxArgsLen);
+
+		/* Communicate with logger thread (which is woken up by the caller) */
+		if (MQ_STATUS_SUCCESS == ret) {
+			__atomic_store_n(&tlDrainer->isPriorityData, true, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	return ret;
+}
+
 /**
  * Adds a message to the shared buffer
  * @param loggingLevel Log level (one of the levels at 'logLevels')
@@ -716,14 +2756,15 @@ static inline bool isLoggingValid(const int loggingLevel, char* msg) {
  * @param line Line number to log
  * @param args Additional arguments to log message
  * @param msg The message
- * @return
+ * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE if the shared buffer is full, or the
+ * space the arguments need if they are too long for a slot (see 'addMessage(...)')
  */
 static int writeTosharedBuffer(const int loggingLevel, char* file,
                                const char* func, const int line, va_list* args,
                                const char* msg) {
 	int ret;
 
-	pthread_mutex_lock(&sharedBufferlock); /* Lock */
+	lockSharedBuffer(); /* Lock */
 	{
 		ret = addMessage(sharedBuffer, loggingLevel, file, func, line, args,
 		                 msg, LM_SHARED_BUFFER, maxArgsLen);
@@ -732,12 +2773,26 @@ static int writeTosharedBuffer(const int loggingLevel, char* file,
 
 	/* Communicate with logger thread */
 	if (MQ_STATUS_SUCCESS == ret) {
-		__atomic_store_n(&isNewData, true, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&drainers[0].isNewData, true, __ATOMIC_SEQ_CST);
 	}
 
 	return ret;
 }
 
+/**
+ * Lock the shared buffer, accounting the time spent waiting for the lock
+ */
+static inline void lockSharedBuffer() {
+	/* Time is measured only when the lock is contended, to keep the uncontended path cheap */
+	if (0 != pthread_mutex_trylock(&sharedBufferlock)) {
+		long long startNsec = getMonotonicTimeNsec();
+
+		pthread_mutex_lock(&sharedBufferlock);
+		countStat(TS_SHARED_BUFFER_LOCK_WAIT_NSEC,
+		          getMonotonicTimeNsec() - startNsec);
+	}
+}
+
 /* API method - Description located at .h file */
 int getMaxMsgLen() {
 	return maxMsgLen;
@@ -767,7 +2822,7 @@ static void destroyDynamicallyAllocatedBuffers() {
 
 			nextNode = getNext(node);
 			free(removeNode(dynamicllyAllocaedPrivateBuffers, mq));
-			free(mq);
+			messageDataQueueDestroy(mq);
 			node = nextNode;
 		}
 	}
@@ -776,20 +2831,403 @@ static void destroyDynamicallyAllocatedBuffers() {
 
 /* API method - Description located at .h file */
 void changePrivateBuffersSize(const int newSize) {
-	if (2 > newSize) {
-		setArePrivateBuffersChangingSize(true);
-		setArePrivateBuffersActive(false);
-		sem_post(&loggerLoopSem);
-		newPrivateBuffSize = newSize;
+	if (2 <= newSize) {
+		requestPrivateBuffersLayoutChange(
+		        newSize, __atomic_load_n(&newPrivateBuffersNumber, __ATOMIC_SEQ_CST));
 	}
 }
 
 /* API method - Description located at .h file */
 void changePrivateBuffersNumber(const int newNumber) {
 	if (newNumber > 0) {
-		setArePrivateBuffersChangingNumber(true);
-		setArePrivateBuffersActive(false);
-		sem_post(&loggerLoopSem);
-		newPrivateBuffersNumber = newNumber;
+		requestPrivateBuffersLayoutChange(
+		        __atomic_load_n(&newPrivateBuffSize, __ATOMIC_SEQ_CST), newNumber);
+	}
+}
+
+/**
+ * Record the desired private buffers layout and let the logger thread apply it
+ * @param newSize The new size of the internal buffers of the private buffers
+ * @param newNumber The new number of private buffers
+ */
+static void requestPrivateBuffersLayoutChange(const int newSize,
+                                              const int newNumber) {
+	/* The shared memory segment is sized for the initial layout only, and the flight recorder
+	 * dumps the buffers of a single layout */
+	if (NULL != sharedSegment || true == isFlightRecorderMode) {
+		return;
+	}
+
+	__atomic_store_n(&newPrivateBuffSize, newSize, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&newPrivateBuffersNumber, newNumber, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&isLayoutChangeRequested, true, __ATOMIC_SEQ_CST);
+	wakeLoggerThread(&drainers[0]);
+}
+
+/**
+ * Wake a logger thread up in case it's waiting for new data
+ * @param drainer The LoggerDrainer of the logger thread to wake up
+ */
+static inline void wakeLoggerThread(LoggerDrainer* drainer) {
+	/* The flight recorder is woken up by triggers only */
+	if (__builtin_expect(true == isFlightRecorderMode, 0)) {
+		return;
+	}
+
+	__atomic_store_n(&drainer->isNewData, true, __ATOMIC_SEQ_CST);
+	if (0 == sem_trywait(&drainer->waitingSem)) {
+		sem_post(&drainer->loopSem);
+	}
+}
+
+/**
+ * Write a message to the log file using the configured write method (or to the sinks, if sinks
+ * were added) and count it
+ * @param md The message to write
+ * @param logFile The file to write the message to
+ */
+static void writeAndCount(const struct MessageData* md, FILE* logFile) {
+	if (NULL == logSinks) {
+		writeMethod(md, logFile);
+	} else {
+		writeToLogSinks(logSinks, md);
+	}
+
+	if (true == isLatencySampled(&tlWriteSampleCounter)) {
+		struct timeval now;
+
+		gettimeofday(&now, NULL);
+		recordLatency(endToEndLatencyHistograms[md->logMethod],
+		              (now.tv_sec - md->tv.tv_sec) * 1000000000LL
+		                      + (now.tv_usec - md->tv.tv_usec) * 1000LL);
+	}
+
+	countStat(TS_MESSAGES + md->logMethod, 1);
+	countStat(TS_BYTES + md->logMethod, md->argsLen);
+
+	/* A direct write isn't kept at any buffer the crash drain could write it from */
+	if (LM_DIRECT_WRITE == md->logMethod
+	        && true == __atomic_load_n(&isCrashDrainInstalled, __ATOMIC_RELAXED)) {
+		fflush(logFile);
+	}
+}
+
+/**
+ * Flush the log file and the sinks that are written by the logger threads
+ */
+static inline void flushLogFile() {
+	fflush(logFile);
+	flushLogSinks(logSinks);
+}
+
+/**
+ * Add a value to a statistics counter of the calling thread
+ * @param counter The counter (one of 'ThreadStatsCounters')
+ * @param value The value to add
+ */
+static inline void countStat(const int counter, const unsigned long long value) {
+	if (NULL == tlStats) {
+		tlStats = acquireThreadStats();
+	}
+
+	if (NULL != tlStats) {
+		addThreadStat(tlStats, counter, value);
+	}
+}
+
+/* API method - Description located at .h file */
+int getLoggerStats(LoggerStats* stats) {
+	unsigned long long sums[TS_COUNTERS_NUM];
+	struct LinkedListNode* node;
+	int i;
+
+	if (NULL == stats) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	sumThreadStats(sums);
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		stats->messages[i] = sums[TS_MESSAGES + i];
+		stats->bytes[i] = sums[TS_BYTES + i];
+	}
+
+	stats->drops = sums[TS_DROPS];
+	stats->duplicates = sums[TS_DUPLICATES];
+	stats->largeMessages = sums[TS_LARGE_MESSAGES];
+	stats->registrationFailures = sums[TS_REGISTRATION_FAILURES];
+	stats->sharedBufferLockWaitNsec = sums[TS_SHARED_BUFFER_LOCK_WAIT_NSEC];
+	stats->dynamicBuffersNum = __atomic_load_n(&dynamicBuffersNum,
+	__ATOMIC_SEQ_CST);
+	stats->committedMemory = getMessageQueueCommittedMemory(sharedBuffer);
+	stats->privateBuffersHighWaterMark = 0;
+
+	pthread_rwlock_rdlock(&privateBuffersLayoutLock); /* Lock */
+	{
+		stats->privateBuffersNum = privateBuffersNum;
+		for (i = 0; i < privateBuffersNum; ++i) {
+			int highWaterMark = getHighWaterMark(privateBuffers[i]);
+
+			if (highWaterMark > stats->privateBuffersHighWaterMark) {
+				stats->privateBuffersHighWaterMark = highWaterMark;
+			}
+
+			stats->committedMemory += getMessageQueueCommittedMemory(
+			        privateBuffers[i]);
+		}
+	}
+	pthread_rwlock_unlock(&privateBuffersLayoutLock); /* Unlock */
+
+	/* Both dynamically allocated buffers and retired buffers of previous layouts */
+	pthread_mutex_lock(&dynamicllyAllocaedLock); /* Lock */
+	{
+		for (node = getHead(dynamicllyAllocaedPrivateBuffers); NULL != node;
+		        node = getNext(node)) {
+			stats->committedMemory += getMessageQueueCommittedMemory(
+			        getData(node));
+		}
+	}
+	pthread_mutex_unlock(&dynamicllyAllocaedLock); /* Unlock */
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+int getPrivateBuffersHighWaterMarks(int* marks, const int marksNum) {
+	int number;
+	int i;
+
+	pthread_rwlock_rdlock(&privateBuffersLayoutLock); /* Lock */
+	{
+		number = privateBuffersNum;
+		for (i = 0; i < number && i < marksNum; ++i) {
+			marks[i] = getHighWaterMark(privateBuffers[i]);
+		}
+	}
+	pthread_rwlock_unlock(&privateBuffersLayoutLock); /* Unlock */
+
+	return number;
+}
+
+/**
+ * Allocate the latency histograms
+ */
+static void initLatencyHistograms() {
+	int i;
+	int j;
+
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		for (j = 0; j < LOG_LEVELS_NUM; ++j) {
+			callLatencyHistograms[j][i] = newLatencyHistogram();
+		}
+
+		endToEndLatencyHistograms[i] = newLatencyHistogram();
+	}
+
+	lastLatencySelfLogMsec = getMonotonicTimeMsec();
+}
+
+/**
+ * Release the latency histograms
+ */
+static void destroyLatencyHistograms() {
+	int i;
+	int j;
+
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		for (j = 0; j < LOG_LEVELS_NUM; ++j) {
+			latencyHistogramDestroy(callLatencyHistograms[j][i]);
+		}
+
+		latencyHistogramDestroy(endToEndLatencyHistograms[i]);
+	}
+}
+
+/**
+ * Check whether the current message of the calling thread should be timed
+ * @param sampleCounter A thread local counter of the messages seen by the calling site (direct
+ * writes are seen by both the call and the write sites, so each site keeps its own counter)
+ * @return True if the message should be timed or false otherwise
+ */
+static inline bool isLatencySampled(unsigned int* sampleCounter) {
+	unsigned int sampleRate;
+
+	sampleRate = __atomic_load_n(&latencySampleRate, __ATOMIC_RELAXED);
+
+	return 0 != sampleRate && 0 == (++*sampleCounter & (sampleRate - 1));
+}
+
+/* API method - Description located at .h file */
+void setLatencySampling(const int sampleRateArg) {
+	int sampleRate = 0;
+
+	if (0 < sampleRateArg) {
+		for (sampleRate = 1; sampleRate < sampleRateArg && 0 < (sampleRate << 1);
+		        sampleRate <<= 1) {
+		}
+	}
+
+	__atomic_store_n(&latencySampleRate, sampleRate, __ATOMIC_SEQ_CST);
+}
+
+/* API method - Description located at .h file */
+void setLatencySelfLog(const int intervalMsecArg) {
+	__atomic_store_n(&latencySelfLogIntervalMsec,
+	                 intervalMsecArg < 0 ? 0 : intervalMsecArg, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Log a summary of the latency histograms if the self-log interval has elapsed
+ * NOTE: This method may be called only by the main logger thread
+ */
+static void selfLogLatency() {
+	LatencySummary summary;
+	long long nowMsec;
+	int intervalMsec;
+	int i;
+
+	intervalMsec = __atomic_load_n(&latencySelfLogIntervalMsec, __ATOMIC_SEQ_CST);
+	nowMsec = getMonotonicTimeMsec();
+	if (0 == intervalMsec || nowMsec - lastLatencySelfLogMsec < intervalMsec) {
+		return;
+	}
+
+	lastLatencySelfLogMsec = nowMsec;
+
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		getCallLatency(LOG_LEVEL_NONE, i, &summary);
+		selfLogLatencySummary("call", i, &summary);
+		getEndToEndLatency(i, &summary);
+		selfLogLatencySummary("end-to-end", i, &summary);
+	}
+}
+
+/**
+ * Log a single latency summary (summaries without samples aren't logged)
+ * @param name The name of the summarized latency
+ * @param logMethod The logging method the summary refers to (one of 'logMethods')
+ * @param summary The summary
+ */
+static void selfLogLatencySummary(const char* name, const int logMethod,
+                                  LatencySummary* summary) {
+	static const char* logMethodsNames[LM_METHODS_NUM] = { "pb", "sb", "dw" };
+
+	if (0 < summary->count) {
+		selfLog(__func__, __LINE__,
+		        "%s latency [%s] n=%llu p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu ns",
+		        name, logMethodsNames[logMethod], summary->count,
+		        summary->p50Nsec, summary->p90Nsec, summary->p99Nsec,
+		        summary->p999Nsec, summary->maxNsec);
+	}
+}
+
+/**
+ * Write a record of the logger itself directly to the log file (it isn't counted by the logger
+ * statistics)
+ * @param func Function name to log
+ * @param line Line number to log
+ * @param msg The message
+ */
+static void selfLog(const char* func, const int line, const char* msg, ...) {
+	va_list arg;
+
+	va_start(arg, msg);
+	directWriteToFile(LOG_LEVEL_INFO, getFileName(__FILE__), func, line,
+	                  &arg, (char*) msg, logFile, maxMsgLen, maxArgsLen,
+	                  LM_DIRECT_WRITE, writeMethod, true);
+	va_end(arg);
+
+	/* Not kept at any buffer the crash drain could write it from */
+	if (true == __atomic_load_n(&isCrashDrainInstalled, __ATOMIC_RELAXED)) {
+		fflush(logFile);
+	}
+}
+
+/* API method - Description located at .h file */
+int getCallLatency(const int loggingLevel, const int logMethod,
+                   LatencySummary* summary) {
+	struct LatencyHistogram* histograms[LOG_LEVELS_NUM * LM_METHODS_NUM];
+	int histogramsNum = 0;
+	int i;
+	int j;
+
+	if (loggingLevel < LOG_LEVEL_NONE || loggingLevel > LOG_LEVEL_TRACE
+	        || logMethod < 0 || logMethod > LM_METHODS_NUM) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	for (i = LOG_LEVEL_EMERG; i < LOG_LEVELS_NUM; ++i) {
+		for (j = 0; j < LM_METHODS_NUM; ++j) {
+			if ((LOG_LEVEL_NONE == loggingLevel || i == loggingLevel)
+			        && (LM_METHODS_NUM == logMethod || j == logMethod)) {
+				histograms[histogramsNum++] = callLatencyHistograms[i][j];
+			}
+		}
+	}
+
+	return getLatencySummary(histograms, histogramsNum, summary);
+}
+
+/* API method - Description located at .h file */
+int getEndToEndLatency(const int logMethod, LatencySummary* summary) {
+	if (logMethod < 0 || logMethod > LM_METHODS_NUM) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	if (LM_METHODS_NUM == logMethod) {
+		return getLatencySummary(endToEndLatencyHistograms, LM_METHODS_NUM,
+		                         summary);
+	}
+
+	return getLatencySummary(&endToEndLatencyHistograms[logMethod], 1,
+	                         summary);
+}
+
+/**
+ * Summarize the values recorded at a number of latency histograms
+ * @param histograms The latency histograms
+ * @param histogramsNum Number of latency histograms
+ * @param summary The struct to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+static int getLatencySummary(struct LatencyHistogram** histograms,
+                             const int histogramsNum, LatencySummary* summary) {
+	struct LatencyHistogram* merged;
+	int i;
+
+	if (NULL == summary) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	if (1 == histogramsNum) {
+		getLatencyHistogramSummary(histograms[0], summary);
+		return LOG_STATUS_SUCCESS;
+	}
+
+	merged = newLatencyHistogram();
+	if (NULL == merged) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	for (i = 0; i < histogramsNum; ++i) {
+		mergeLatencyHistogram(merged, histograms[i]);
+	}
+
+	getLatencyHistogramSummary(merged, summary);
+	latencyHistogramDestroy(merged);
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+void resetLatencyHistograms() {
+	int i;
+	int j;
+
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		for (j = 0; j < LOG_LEVELS_NUM; ++j) {
+			resetLatencyHistogram(callLatencyHistograms[j][i]);
+		}
+
+		resetLatencyHistogram(endToEndLatencyHistograms[i]);
 	}
 }
@@ -26,24 +26,61 @@
 
 #include <unistd.h>
 #include <syscall.h>
+#include <string.h>
 
 #include "messageData.h"
 
-/**
- * Saves message information
- * @param md MessageData struct to save info in
- * @param loggingLevel Log level (one of the levels at 'logLevels')
- * @param file Filename to log
- * @param func Function name to log
- * @param line Line number to log
- * @param args Additional arguments to log message
- * @param msg The message
- * @param logMethod Logging method (private buffer, shared buffer or direct write)
- * @param maxArgsLen Maximum length of additional message arguments
- */
-void setMsgValues(struct MessageData* md, const int loggingLevel, char* file, const char* func,
-                         const int line, va_list* args, const char* msg, const int logMethod,
-                         const int maxArgsLen) {
+/* The contents are irrelevant, the addresses identify structured and binary payload messages */
+const char keyValuesFormat[] = "%s";
+const char binaryPayloadFormat[] = "%s";
+
+static int encodeKeyValues(char* buf, const int bufLen, const char* event,
+                           const KeyValue* kvs, const int kvsNum);
+
+/* API method - Description located at .h file */
+int setMsgValues(struct MessageData* md, const int loggingLevel, char* file, const char* func,
+                 const int line, va_list* args, const char* msg, const int logMethod,
+                 const int maxArgsLen) {
+	int argsLen;
+
+	setMsgHeader(md, loggingLevel, file, func, line, logMethod);
+
+	if (keyValuesFormat == msg) {
+		const char* event = va_arg(*args, const char*);
+		const KeyValue* kvs = va_arg(*args, const KeyValue*);
+		int kvsNum = va_arg(*args, int);
+
+		md->argsFormat = MSG_ARGS_KEY_VALUES;
+		md->argsLen = encodeKeyValues(md->argsBuf, maxArgsLen, event, kvs, kvsNum);
+		return md->argsLen;
+	}
+
+	if (binaryPayloadFormat == msg) {
+		const char* payload = va_arg(*args, const char*);
+		int payloadLen = va_arg(*args, int);
+
+		md->argsFormat = MSG_ARGS_BINARY;
+		md->argsLen = (payloadLen > maxArgsLen) ? maxArgsLen : payloadLen;
+		memcpy(md->argsBuf, payload, md->argsLen);
+		return md->argsLen;
+	}
+
+	md->argsFormat = MSG_ARGS_TEXT;
+	argsLen = vsnprintf(md->argsBuf, maxArgsLen, msg, *args);
+
+	/* vsnprintf returns the length the message would have had, clamp to what was stored */
+	if (0 > argsLen) {
+		argsLen = 0;
+		md->argsBuf[0] = '\0';
+	}
+	md->argsLen = (maxArgsLen <= argsLen) ? maxArgsLen - 1 : argsLen;
+
+	return argsLen + 1;
+}
+
+/* API method - Description located at .h file */
+void setMsgHeader(struct MessageData* md, const int loggingLevel, char* file,
+                  const char* func, const int line, const int logMethod) {
 	gettimeofday(&md->tv, NULL);
 	md->file = file;
 	md->func = func;
@@ -51,5 +88,140 @@ void setMsgValues(struct MessageData* md, const int loggingLevel, char* file, co
 	md->logLevel = loggingLevel;
 	md->logMethod = logMethod;
 	md->tid = syscall(SYS_gettid);
-	vsnprintf(md->argsBuf, maxArgsLen, msg, *args);
+}
+
+/**
+ * Encode the fields of a structured message, as is - the event and the keys are kept as pointers
+ * and the values in their native representation (strings are copied with their terminator). The
+ * encoding is: event pointer, then per field: type (1 byte), key pointer, value
+ * @param buf The buffer to encode to
+ * @param bufLen The length of the buffer
+ * @param event The event
+ * @param kvs The fields
+ * @param kvsNum The number of fields
+ * @return The length of the encoded fields
+ */
+static int encodeKeyValues(char* buf, const int bufLen, const char* event,
+                           const KeyValue* kvs, const int kvsNum) {
+	const int fieldHeaderLen = 1 + sizeof(kvs->key);
+	int len = 0;
+	int i;
+
+	if (bufLen < (int) sizeof(event)) {
+		return 0;
+	}
+
+	memcpy(buf, &event, sizeof(event));
+	len += sizeof(event);
+
+	for (i = 0; i < kvsNum; ++i) {
+		const KeyValue* kv = &kvs[i];
+		int valueLen;
+
+		if (KV_TYPE_STR == kv->type) {
+			/* At least the terminator, the string is truncated to what fits */
+			valueLen = 1;
+		} else {
+			valueLen = sizeof(kv->value);
+		}
+
+		if (len + fieldHeaderLen + valueLen > bufLen) {
+			break;
+		}
+
+		buf[len] = kv->type;
+		memcpy(buf + len + 1, &kv->key, sizeof(kv->key));
+		len += fieldHeaderLen;
+
+		if (KV_TYPE_STR == kv->type) {
+			int strLen = (NULL != kv->value.s) ? strnlen(kv->value.s, bufLen - len - 1) : 0;
+
+			if (0 != strLen) {
+				memcpy(buf + len, kv->value.s, strLen);
+			}
+			buf[len + strLen] = '\0';
+			len += strLen + 1;
+		} else {
+			memcpy(buf + len, &kv->value, sizeof(kv->value));
+			len += sizeof(kv->value);
+		}
+	}
+
+	return len;
+}
+
+/* API method - Description located at .h file */
+const char* getKeyValuesEvent(const struct MessageData* md) {
+	const char* event = NULL;
+
+	if (md->argsLen >= (int) sizeof(event)) {
+		memcpy(&event, md->argsBuf, sizeof(event));
+	}
+
+	return event;
+}
+
+/* API method - Description located at .h file */
+int getNextKeyValue(const struct MessageData* md, const int pos, KeyValue* kv) {
+	int nextPos = (0 == pos) ? sizeof(const char*) : pos;
+
+	if (nextPos + 1 + (int) sizeof(kv->key) > md->argsLen) {
+		return -1;
+	}
+
+	kv->type = (unsigned char) md->argsBuf[nextPos];
+	memcpy(&kv->key, md->argsBuf + nextPos + 1, sizeof(kv->key));
+	nextPos += 1 + sizeof(kv->key);
+
+	if (KV_TYPE_STR == kv->type) {
+		kv->value.s = md->argsBuf + nextPos;
+		nextPos += strlen(kv->value.s) + 1;
+	} else {
+		memcpy(&kv->value, md->argsBuf + nextPos, sizeof(kv->value));
+		nextPos += sizeof(kv->value);
+	}
+
+	return nextPos;
+}
+
+/* API method - Description located at .h file */
+bool isValidKeyValues(const struct MessageData* md, bool (*isValidString)(const char*)) {
+	const char* event = getKeyValuesEvent(md);
+	int pos = sizeof(event);
+
+	if (md->argsLen < pos || (NULL != event && false == isValidString(event))) {
+		return false;
+	}
+
+	/* Mirrors 'getNextKeyValue(...)', checking each field before it's decoded */
+	while (pos < md->argsLen) {
+		KeyValue kv;
+
+		if (pos + 1 + (int) sizeof(kv.key) > md->argsLen) {
+			return false;
+		}
+
+		kv.type = (unsigned char) md->argsBuf[pos];
+		memcpy(&kv.key, md->argsBuf + pos + 1, sizeof(kv.key));
+		pos += 1 + sizeof(kv.key);
+
+		if (NULL == kv.key || false == isValidString(kv.key)) {
+			return false;
+		}
+
+		if (KV_TYPE_STR == kv.type) {
+			const char* end = memchr(md->argsBuf + pos, '\0', md->argsLen - pos);
+
+			if (NULL == end) {
+				return false;
+			}
+			pos = end - md->argsBuf + 1;
+		} else if (KV_TYPE_INT == kv.type || KV_TYPE_DOUBLE == kv.type) {
+			pos += sizeof(kv.value);
+		} else {
+			return false;
+		}
+	}
+
+	return pos == md->argsLen;
 }
@@ -26,9 +26,19 @@
 #define MESSAGEDATA_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <sys/time.h>
 #include <stdarg.h>
 
+#include "../../api/logger.h"
+
+enum MessageArgsFormats {
+	MSG_ARGS_TEXT, /* Formatted text */
+	MSG_ARGS_KEY_VALUES, /* Encoded key-value fields (see 'getKeyValuesEvent(...)') */
+	MSG_ARGS_BINARY, /* An opaque binary payload (see 'logReserve(...)' API) */
+	MSG_ARGS_PADDING /* Not a message - buffer slots skipped so a large message won't wrap around */
+};
+
 typedef struct MessageData {
 	/** Line number to log */
 	int line;
@@ -36,10 +46,20 @@ typedef struct MessageData {
 	int logLevel;
 	/** Logging method (private buffer, shared buffer or direct write) */
 	int logMethod;
+	/** Sequence number of the message within its queue (stored last when the message is added, so
+	 * a message that carries the expected number is whole) */
+	unsigned int seq;
 	/** Filename to log */
 	char* file;
 	/** Additional arguments to log message */
 	char* argsBuf;
+	/** Length of the additional arguments stored at 'argsBuf' */
+	int argsLen;
+	/** The format of the additional arguments stored at 'argsBuf' (one of 'MessageArgsFormats') */
+	int argsFormat;
+	/** Number of consecutive buffer slots the message occupies (more than one for large messages,
+	 * whose arguments run on into the arguments buffers of the following slots) */
+	int slotsNum;
 	/** Function name to log */
 	const char* func;
 	/** Thread id */
@@ -48,9 +68,71 @@ typedef struct MessageData {
 	struct timeval tv;
 } MessageData;
 
-/* API method - Description located at .h file */
-void setMsgValues(struct MessageData* md, const int loggingLevel, char* file, const char* func,
+/* The message format that marks a structured message - its arguments are the event (a string
+ * literal), a 'KeyValue' array and the number of its elements, which are encoded into 'argsBuf' */
+extern const char keyValuesFormat[];
+
+/* The message format that marks a binary payload message - its arguments are the payload and its
+ * length (at most the maximal arguments length), which are copied into 'argsBuf' */
+extern const char binaryPayloadFormat[];
+
+/**
+ * Saves message information, except for the additional arguments
+ * @param md MessageData struct to save info in
+ * @param loggingLevel Log level (one of the levels at 'logLevels')
+ * @param file Filename to log
+ * @param func Function name to log
+ * @param line Line number to log
+ * @param logMethod Logging method (private buffer, shared buffer or direct write)
+ */
+void setMsgHeader(struct MessageData* md, const int loggingLevel, char* file,
+                  const char* func, const int line, const int logMethod);
+
+/**
+ * Saves message information
+ * @param md MessageData struct to save info in
+ * @param loggingLevel Log level (one of the levels at 'logLevels')
+ * @param file Filename to log
+ * @param func Function name to log
+ * @param line Line number to log
+ * @param args Additional arguments to log message
+ * @param msg The message ('keyValuesFormat' for a structured message, 'binaryPayloadFormat' for a
+ * binary payload)
+ * @param logMethod Logging method (private buffer, shared buffer or direct write)
+ * @param maxArgsLen Maximum length of additional message arguments
+ * @return The space the arguments need at 'argsBuf' (including the terminator of text) - more than
+ * 'maxArgsLen' if text arguments were truncated
+ */
+int setMsgValues(struct MessageData* md, const int loggingLevel, char* file, const char* func,
                   const int line, va_list* args, const char* msg, const int logMethod,
                   const int maxArgsLen);
 
+/**
+ * Return the event of a structured message
+ * @param md A structured message ('argsFormat' is MSG_ARGS_KEY_VALUES)
+ * @return The event
+ */
+const char* getKeyValuesEvent(const struct MessageData* md);
+
+/**
+ * Decode a field of a structured message. Fields that didn't fit in the arguments buffer were
+ * dropped, and a string value that didn't fit whole was truncated
+ * @param md A structured message ('argsFormat' is MSG_ARGS_KEY_VALUES)
+ * @param pos The position of the field - 0 for the first field, otherwise the position returned
+ * for the previous field
+ * @param kv The decoded field (string values point into the message)
+ * @return The position of the next field, or -1 if there are no more fields
+ */
+int getNextKeyValue(const struct MessageData* md, const int pos, KeyValue* kv);
+
+/**
+ * Check whether the encoded fields of a structured message are well-formed - every field lies
+ * within the message, string values are terminated within it and the event (if any) and the keys
+ * are valid strings
+ * @param md A structured message ('argsFormat' is MSG_ARGS_KEY_VALUES)
+ * @param isValidString A method that checks whether a pointer is a readable, terminated string
+ * @return True if the fields are well-formed or false otherwise
+ */
+bool isValidKeyValues(const struct MessageData* md, bool (*isValidString)(const char*));
+
 #endif /* MESSAGEDATA_H */
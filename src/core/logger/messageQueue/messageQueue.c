@@ -22,65 +22,90 @@
  * @copywrite (C) [2019] [Barak Sason Rofman]
  */
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
-#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "messageData.h"
 #include "messageQueue.h"
-
-typedef struct MessageQueue {
-	/** The position which data was last read from */
-	atomic_int lastRead;
-	/** The position which data was last written to */
-	atomic_int lastWrite;
-	/** The size of the buffer */
-	int size;
-	/** Whether this buffer was dynamically allocated */
-	bool isDynamicallyAllocated;
-	/** Whether this buffer has been taken by a worker thread */
-	atomic_bool isTaken;
-	/** Whether this buffer should be freed */
-	atomic_bool isDecomossioned;
-	/** Whether this buffer is currently being used by a worker thread */
-	atomic_bool isBeingUsed;
-	/** Pointer to the internal buffer */
-	MessageData* messagesData;
-} MessageQueue;
+#include "../../common/arena/arena.h"
 
 static void initMessageQueue(MessageQueue* mq, const int size,
                              const int maxArgsLen,
-                             const bool isDynamicallyAllocated);
-static inline int getNextPos(int curPos, const int queueSize);
+                             const bool isDynamicallyAllocated,
+                             const bool isArenaAllocated);
 static void prepareMessageQueue(MessageQueue* mq, const int size,
                                 const int maxArgsLen);
+static void releaseRange(char* start, char* end, char* excludedStart,
+                         char* excludedEnd);
+static bool isDuplicateMessage(MessageQueue* mq, const MessageData* md);
+static void rememberMessage(MessageQueue* mq, const MessageData* md);
+static void writeDuplicatesSummary(MessageQueue* mq, FILE* logFile,
+                                   const void (*writeMethod)());
+static bool isRecoverableMessage(const MessageQueue* mq, const MessageData* md,
+                                 const int pos,
+                                 bool (*isValidString)(const char*));
 
 /* API method - Description located at .h file */
 MessageQueue* newMessageQueue(const int size, const int maxArgsLen,
-                              const bool isDynamicallyAllocated) {
+                              const bool isDynamicallyAllocated,
+                              struct Arena* arena) {
 	MessageQueue* mq;
+	size_t memorySize;
+	bool isArenaAllocated;
+
+	/* The queue, its messages and their arguments buffers are laid out in a single allocation */
+	memorySize = getMessageQueueMemorySize(size, maxArgsLen);
+	mq = arenaAlloc(arena, memorySize);
+	isArenaAllocated = (NULL != mq);
+
+	if (NULL == mq) {
+		//TODO: think if malloc failures need to be handled
+		mq = malloc(memorySize);
+	}
 
-	//TODO: think if malloc failures need to be handled
-	mq = malloc(sizeof(*mq));
 	if (NULL != mq) {
-		initMessageQueue(mq, size, maxArgsLen, isDynamicallyAllocated);
+		initMessageQueue(mq, size, maxArgsLen, isDynamicallyAllocated,
+		                 isArenaAllocated);
 	}
 
 	return mq;
 }
 
+/* API method - Description located at .h file */
+size_t getMessageQueueMemorySize(const int size, const int maxArgsLen) {
+	return sizeof(MessageQueue) + size * sizeof(MessageData)
+	        + (size_t) size * maxArgsLen;
+}
+
 /**
  * Initializes MessageQueue
  * @param mq MessageQueue struct to initialize
  * @param size The of the queue
  * @param maxArgsLen Maximum length of message arguments
  * @param isDynamicallyAllocated Whether or not to enable dynamic buffers allocation
+ * @param isArenaAllocated Whether or not the MessageQueue was carved from an arena
  */
 static void initMessageQueue(MessageQueue* mq, const int size,
                              const int maxArgsLen,
-                             const bool isDynamicallyAllocated) {
+                             const bool isDynamicallyAllocated,
+                             const bool isArenaAllocated) {
 	mq->isDynamicallyAllocated = isDynamicallyAllocated;
+	mq->isArenaAllocated = isArenaAllocated;
+	mq->numaNode = 0;
+	mq->isOverwriting = false;
+	mq->priorityQueue = NULL;
+	mq->lastWritten = NULL;
+	mq->isLastWrittenValid = false;
+	mq->duplicatesNum = 0;
+	__atomic_store_n(&mq->isTaken, false, __ATOMIC_SEQ_CST);
 	__atomic_store_n(&mq->isDecomossioned, false, __ATOMIC_SEQ_CST);
-	__atomic_store_n(&mq->isBeingUsed, false, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&mq->isRetired, false, __ATOMIC_SEQ_CST);
 	prepareMessageQueue(mq, size, maxArgsLen);
 }
 
@@ -92,117 +117,501 @@ static void initMessageQueue(MessageQueue* mq, const int size,
  */
 static void prepareMessageQueue(MessageQueue* mq, const int size,
                                 const int maxArgsLen) {
-	int i;
-
 	mq->size = size;
-
-	//TODO: think if malloc failures need to be handled
-	mq->messagesData = malloc(size * sizeof(*mq->messagesData));
-
-	for (i = 0; i < size; ++i) {
-		MessageData* md;
-
-		md = &mq->messagesData[i];
-		md->argsBuf = malloc(maxArgsLen);
-	}
-
+	mq->maxArgsLen = maxArgsLen;
+
+	/* The messages follow the queue struct and the arguments buffers follow the messages.
+	 * Neither is touched here - their pages are committed as the writer advances */
+	mq->messagesData = (MessageData*) (mq + 1);
+	mq->argsBufs = (char*) (mq->messagesData + size);
+
+	__atomic_store_n(&mq->isWritingLargeMessage, false, __ATOMIC_SEQ_CST);
+	mq->lastActiveWrite = 1;
+	mq->lastActiveTimeMsec = 0;
+	mq->isMemoryReleased = true;
+	__atomic_store_n(&mq->highWaterMark, 0, __ATOMIC_RELAXED);
+
+	/* The zeroed message slots carry sequence number 0, which never follows 'drainedSeq' */
+	mq->nextSeq = 1;
+	mq->drainedSeq = 0;
 	mq->lastRead = 0;
 	mq->lastWrite = 1; // Advance to 1, as an empty buffer is defined by having a difference of 1 between
 	                   // lastWrite and lastRead
 }
 
 /* API method - Description located at .h file */
-int addMessage(MessageQueue* mq, const int loggingLevel, char* file,
-               const char* func, const int line, va_list* args, const char* msg,
-               const int logMethod, const int maxArgsLen) {
+int addLargeMessage(MessageQueue* mq, const int loggingLevel, char* file,
+                    const char* func, const int line, va_list* args,
+                    const char* msg, const int logMethod, const int argsSize) {
+	int slotsNum = (argsSize + mq->maxArgsLen - 1) / mq->maxArgsLen;
+	int paddingSlotsNum = 0;
+	int freeSlotsNum;
 	int lastRead;
 	int lastWrite;
-	int nextLastWrite;
+	int pos;
+	int i;
+	MessageData* md;
+
+	/* Announced before 'lastRead' is loaded - the slots are written ahead of 'lastWrite', so a
+	 * reader fencing the queue to release its memory must learn about them */
+	__atomic_store_n(&mq->isWritingLargeMessage, true, __ATOMIC_SEQ_CST);
 
 	/* Atomic load lastRead, as it's written by a different thread */
 	__atomic_load(&mq->lastRead, &lastRead, __ATOMIC_SEQ_CST);
 	lastWrite = mq->lastWrite;
-	nextLastWrite = getNextPos(lastWrite, mq->size);
 
-	if (nextLastWrite != lastRead) {
-		setMsgValues(&mq->messagesData[lastWrite], loggingLevel, file, func,
-		             line, args, msg, logMethod, maxArgsLen);
+	/* 'lastWrite' never reaches 'lastRead', so one of the free slots always stays unused */
+	freeSlotsNum = lastRead - lastWrite;
+	if (0 >= freeSlotsNum) {
+		freeSlotsNum += mq->size;
+	}
 
-		/* Atomic store lastWrite, as it's read by a different thread */
-		__atomic_store_n(&mq->lastWrite, nextLastWrite, __ATOMIC_SEQ_CST);
+	/* An overwriting queue only needs to be large enough for the message */
+	if (true == mq->isOverwriting) {
+		freeSlotsNum = mq->size;
+	}
 
-		return MQ_STATUS_SUCCESS;
+	pos = lastWrite;
+	if (lastWrite + slotsNum > mq->size) {
+		paddingSlotsNum = mq->size - lastWrite;
+		pos = 0;
 	}
 
-	return MQ_STATUS_FAILURE;
+	if (paddingSlotsNum + slotsNum >= freeSlotsNum) {
+		__atomic_store_n(&mq->isWritingLargeMessage, false, __ATOMIC_SEQ_CST);
+		return MQ_STATUS_FAILURE;
+	}
+
+	if (0 != paddingSlotsNum) {
+		md = &mq->messagesData[lastWrite];
+		invalidateMessage(md);
+		md->argsFormat = MSG_ARGS_PADDING;
+		md->slotsNum = paddingSlotsNum;
+		__atomic_store_n(&md->seq, mq->nextSeq, __ATOMIC_RELEASE);
+		__atomic_store_n(&mq->nextSeq, mq->nextSeq + 1, __ATOMIC_RELAXED);
+	}
+
+	/* The slots the arguments run over may hold older messages - they stay invalid, since their
+	 * arguments are overwritten */
+	for (i = pos; i < pos + slotsNum; ++i) {
+		invalidateMessage(&mq->messagesData[i]);
+	}
+
+	md = &mq->messagesData[pos];
+	md->argsBuf = mq->argsBufs + (size_t) pos * mq->maxArgsLen;
+	md->slotsNum = slotsNum;
+	setMsgValues(md, loggingLevel, file, func, line, args, msg, logMethod,
+	             argsSize);
+	__atomic_store_n(&md->seq, mq->nextSeq, __ATOMIC_RELEASE);
+	__atomic_store_n(&mq->nextSeq, mq->nextSeq + 1, __ATOMIC_RELAXED);
+
+	/* Atomic store lastWrite, as it's read by a different thread (this publishes the padding
+	 * record too) */
+	__atomic_store_n(&mq->lastWrite, (pos + slotsNum) % mq->size,
+	                 __ATOMIC_SEQ_CST);
+	__atomic_store_n(&mq->isWritingLargeMessage, false, __ATOMIC_SEQ_CST);
+
+	return MQ_STATUS_SUCCESS;
 }
 
 /* API method - Description located at .h file */
-void drainMessages(MessageQueue* mq, FILE* logFile, const int maxMsgLen,
-                   const void (*writeMethod)()) {
+int drainMessages(MessageQueue* mq, FILE* logFile, const int maxMsgLen,
+                  const void (*writeMethod)(), const bool isDuplicatesSuppressed,
+                  const bool isFlushedBeforeRelease) {
 	int lastRead;
 	int lastWrite;
 	int nextLastRead;
+	unsigned int lastSeq = 0;
+	int duplicatesNum = 0;
+
+	if (false == isDuplicatesSuppressed) {
+		/* Messages written while suppression was disabled separate earlier messages from later ones */
+		mq->isLastWrittenValid = false;
+	}
 
 	/* Atomic load lastWrite, as it's read by a different thread */
 	__atomic_load(&mq->lastWrite, &lastWrite, __ATOMIC_SEQ_CST);
 	lastRead = mq->lastRead;
-	nextLastRead = getNextPos(lastRead, mq->size);
+	nextLastRead = getNextMessagePos(lastRead, mq->size);
 
 	if (nextLastRead != lastWrite) {
 		int prevNextLastRead;
+		int occupancy;
+
+		occupancy = lastWrite - nextLastRead;
+		if (0 > occupancy) {
+			occupancy += mq->size;
+		}
+		if (occupancy > mq->highWaterMark) {
+			__atomic_store_n(&mq->highWaterMark, occupancy, __ATOMIC_RELAXED);
+		}
+
 		do {
 			MessageData* md;
 
 			md = &mq->messagesData[nextLastRead];
-			writeMethod(md, logFile);
-
-			prevNextLastRead = nextLastRead;
+			if (MSG_ARGS_PADDING == md->argsFormat) {
+				/* Skipped slots, nothing to write */
+			} else if (false == isDuplicatesSuppressed) {
+				writeMethod(md, logFile);
+			} else if (true == isDuplicateMessage(mq, md)) {
+				++mq->duplicatesNum;
+				mq->lastDuplicateTv = md->tv;
+				++duplicatesNum;
+			} else {
+				writeDuplicatesSummary(mq, logFile, writeMethod);
+				writeMethod(md, logFile);
+				rememberMessage(mq, md);
+			}
+
+			lastSeq = md->seq;
+
+			/* A large message occupies several slots, the last of which is the last one read */
+			prevNextLastRead = nextLastRead + md->slotsNum - 1;
+			if (prevNextLastRead >= mq->size) {
+				prevNextLastRead -= mq->size;
+			}
 			nextLastRead =
-			        (nextLastRead + 1) >= mq->size ? 0 : (nextLastRead + 1);
+			        (prevNextLastRead + 1) >= mq->size ? 0 : (prevNextLastRead + 1);
 		} while (nextLastRead != lastWrite);
 
+		if (true == isFlushedBeforeRelease) {
+			fflush(logFile);
+		}
+
 		/* Atomic store lastRead, as it's read by a different thread */
 		__atomic_store_n(&mq->lastRead, prevNextLastRead, __ATOMIC_SEQ_CST);
+		mq->drainedSeq = lastSeq;
+
+		/* Report the duplicates at the end of each drain, so a summary is never held back until
+		 * the thread logs again (later duplicates are still suppressed - 'lastWritten' is kept) */
+		writeDuplicatesSummary(mq, logFile, writeMethod);
 	}
+
+	return duplicatesNum;
+}
+
+/**
+ * Check whether a message duplicates the last message written from a MessageQueue
+ * @param mq The MessageQueue
+ * @param md The message
+ * @return True if the message is a duplicate or false otherwise
+ */
+static bool isDuplicateMessage(MessageQueue* mq, const MessageData* md) {
+	const MessageData* lastWritten = mq->lastWritten;
+
+	/* Locations are compared by address - file and function names are string literals */
+	return true == mq->isLastWrittenValid && md->line == lastWritten->line
+	        && md->file == lastWritten->file && md->func == lastWritten->func
+	        && md->logLevel == lastWritten->logLevel && md->tid == lastWritten->tid
+	        && md->argsFormat == lastWritten->argsFormat && md->argsLen == lastWritten->argsLen
+	        && 0 == memcmp(md->argsBuf, lastWritten->argsBuf, md->argsLen);
+}
+
+/**
+ * Keep a copy of the last message written from a MessageQueue, as its buffer slot is reused
+ * @param mq The MessageQueue
+ * @param md The written message
+ */
+static void rememberMessage(MessageQueue* mq, const MessageData* md) {
+	/* Large messages aren't copied (nor suppressed) - nothing is remembered to compare against */
+	if (md->argsLen > mq->maxArgsLen) {
+		mq->isLastWrittenValid = false;
+		return;
+	}
+
+	if (NULL == mq->lastWritten) {
+		//TODO: think if malloc failures need to be handled
+		mq->lastWritten = malloc(sizeof(*mq->lastWritten) + mq->maxArgsLen + 1);
+		if (NULL == mq->lastWritten) {
+			return;
+		}
+	}
+
+	/* The copy's arguments buffer follows it (binary arguments may fill the whole buffer, so the
+	 * terminator of text arguments is added rather than copied) */
+	*mq->lastWritten = *md;
+	mq->lastWritten->argsBuf = (char*) (mq->lastWritten + 1);
+	memcpy(mq->lastWritten->argsBuf, md->argsBuf, md->argsLen);
+	mq->lastWritten->argsBuf[md->argsLen] = '\0';
+	mq->isLastWrittenValid = true;
+}
+
+/**
+ * Write a summary line of the duplicates suppressed since the last message written from a
+ * MessageQueue, if there are any
+ * @param mq The MessageQueue
+ * @param logFile The file to write the summary to
+ * @param writeMethod A pointer to a method that writes a message to a file
+ */
+static void writeDuplicatesSummary(MessageQueue* mq, FILE* logFile,
+                                   const void (*writeMethod)()) {
+	if (0 != mq->duplicatesNum) {
+		MessageData summary;
+		char argsBuf[mq->maxArgsLen];
+		int argsLen;
+
+		/* The summary carries the location of the repeated message and the time of its last
+		 * repetition */
+		summary = *mq->lastWritten;
+		summary.argsBuf = argsBuf;
+		summary.argsFormat = MSG_ARGS_TEXT;
+		summary.tv = mq->lastDuplicateTv;
+		argsLen = snprintf(argsBuf, mq->maxArgsLen,
+		                   "last message repeated %llu times over %.6f sec",
+		                   mq->duplicatesNum,
+		                   (mq->lastDuplicateTv.tv_sec - mq->lastWritten->tv.tv_sec)
+		                           + (mq->lastDuplicateTv.tv_usec
+		                                   - mq->lastWritten->tv.tv_usec) / 1e6);
+		summary.argsLen = (argsLen >= mq->maxArgsLen) ? mq->maxArgsLen - 1 : argsLen;
+		writeMethod(&summary, logFile);
+
+		mq->duplicatesNum = 0;
+	}
+}
+
+/* API method - Description located at .h file */
+int emergencyDrainMessages(MessageQueue* mq, const int fd,
+                           void (*writeMethod)(const MessageData*, const int),
+                           const long long deadlineNsec) {
+	int lastWrite;
+	int pos;
+	int slotsLeft;
+	int messagesNum = 0;
+
+	/* Atomic load lastWrite, as it's written by a different thread */
+	__atomic_load(&mq->lastWrite, &lastWrite, __ATOMIC_SEQ_CST);
+	pos = getNextMessagePos(__atomic_load_n(&mq->lastRead, __ATOMIC_SEQ_CST), mq->size);
+
+	/* A corrupted record can't make the walk go around the queue more than once */
+	for (slotsLeft = mq->size; pos != lastWrite && 0 < slotsLeft;) {
+		const MessageData* md = &mq->messagesData[pos];
+		struct timespec now;
+		int slotsNum = md->slotsNum;
+
+		if (0 != clock_gettime(CLOCK_MONOTONIC, &now)
+		        || deadlineNsec <= now.tv_sec * 1000000000LL + now.tv_nsec) {
+			break;
+		}
+
+		if (1 > slotsNum || slotsLeft < slotsNum) {
+			break;
+		}
+
+		if (MSG_ARGS_PADDING != md->argsFormat && LOG_LEVEL_NONE < md->logLevel
+		        && LOG_LEVEL_TRACE >= md->logLevel && 0 <= md->logMethod
+		        && LM_METHODS_NUM > md->logMethod && NULL != md->file && NULL != md->func
+		        && 0 <= md->argsLen && (long long) slotsNum * mq->maxArgsLen >= md->argsLen) {
+			writeMethod(md, fd);
+			++messagesNum;
+		}
+
+		slotsLeft -= slotsNum;
+		pos = (pos + slotsNum) % mq->size;
+	}
+
+	return messagesNum;
+}
+
+/* API method - Description located at .h file */
+int recoverMessages(MessageQueue* mq, FILE* logFile, const void (*writeMethod)(),
+                    bool (*isValidString)(const char*)) {
+	unsigned int expectedSeq;
+	int pos;
+	int slotsLeft;
+	int recordsNum = 0;
+	int messagesNum = 0;
+
+	if (2 > mq->size || 1 > mq->maxArgsLen || 0 > mq->lastRead || mq->size <= mq->lastRead
+	        || (MessageData*) (mq + 1) != mq->messagesData
+	        || (char*) (mq->messagesData + mq->size) != mq->argsBufs) {
+		return 0;
+	}
+
+	expectedSeq = mq->drainedSeq + 1;
+	pos = getNextMessagePos(mq->lastRead, mq->size);
+
+	/* A walk can't go around the queue more than once */
+	for (slotsLeft = mq->size; 0 < slotsLeft;) {
+		const MessageData* md = &mq->messagesData[pos];
+
+		/* If the process died between storing 'lastRead' and 'drainedSeq', the first message
+		 * follows a later number than 'drainedSeq' (older messages precede it) */
+		if ((0 == recordsNum) ? (0 > (int) (md->seq - expectedSeq))
+		        : (md->seq != expectedSeq)) {
+			break;
+		}
+
+		if (1 > md->slotsNum || slotsLeft < md->slotsNum
+		        || mq->size - pos < md->slotsNum
+		        || false == isRecoverableMessage(mq, md, pos, isValidString)) {
+			break;
+		}
+
+		if (MSG_ARGS_PADDING != md->argsFormat) {
+			writeMethod(md, logFile);
+			++messagesNum;
+		}
+
+		++recordsNum;
+		expectedSeq = md->seq + 1;
+		slotsLeft -= md->slotsNum;
+		pos = (pos + md->slotsNum) % mq->size;
+	}
+
+	return messagesNum;
+}
+
+/**
+ * Check whether a message of a recovered queue looks sane enough to be written
+ * @param mq The MessageQueue
+ * @param md The message (its slots are within the queue)
+ * @param pos The position of the message
+ * @param isValidString A method that checks whether a pointer is a readable, terminated string
+ * @return True if the message may be written or false otherwise
+ */
+static bool isRecoverableMessage(const MessageQueue* mq, const MessageData* md,
+                                 const int pos,
+                                 bool (*isValidString)(const char*)) {
+	long long argsSpace = (long long) md->slotsNum * mq->maxArgsLen;
+
+	/* Padding slots run up to the end of the queue */
+	if (MSG_ARGS_PADDING == md->argsFormat) {
+		return mq->size == pos + md->slotsNum;
+	}
+
+	if (LOG_LEVEL_NONE >= md->logLevel || LOG_LEVEL_TRACE < md->logLevel
+	        || 0 > md->logMethod || LM_METHODS_NUM <= md->logMethod
+	        || mq->argsBufs + (size_t) pos * mq->maxArgsLen != md->argsBuf
+	        || 0 > md->argsLen || argsSpace < md->argsLen || NULL == md->file
+	        || NULL == md->func || false == isValidString(md->file)
+	        || false == isValidString(md->func)) {
+		return false;
+	}
+
+	if (MSG_ARGS_TEXT == md->argsFormat) {
+		/* The terminator follows the text */
+		return argsSpace > md->argsLen && '\0' == md->argsBuf[md->argsLen];
+	} else if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+		return isValidKeyValues(md, isValidString);
+	}
+
+	return MSG_ARGS_BINARY == md->argsFormat;
 }
 
 /* API method - Description located at .h file */
-void directWriteToFile(const int loggingLevel, char* file, const char* func,
-                       const int line, va_list* args, char* msg, FILE* logFile,
-                       const int maxMsgLen, const int maxArgsLen,
-                       const int logMethod, const void (*writeMethod)()) {
+int collectMessages(MessageQueue* mq, const struct timeval* since,
+                    MessageRef* refs) {
+	unsigned int limitSeq;
+	int refsNum = 0;
+	int pos;
+
+	limitSeq = __atomic_load_n(&mq->nextSeq, __ATOMIC_ACQUIRE);
+
+	for (pos = 0; pos < mq->size; ++pos) {
+		MessageData* md = &mq->messagesData[pos];
+		struct timeval tv;
+		unsigned int seq;
+		int argsFormat;
+
+		/* Slots being written carry sequence number 0 */
+		seq = __atomic_load_n(&md->seq, __ATOMIC_ACQUIRE);
+		if (0 == seq || 0 >= (int) (seq - mq->drainedSeq)
+		        || 0 <= (int) (seq - limitSeq)) {
+			continue;
+		}
+
+		tv = md->tv;
+		argsFormat = md->argsFormat;
+
+		/* The fields are whole only if the writer hasn't invalidated the slot meanwhile */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (seq != __atomic_load_n(&md->seq, __ATOMIC_RELAXED)) {
+			continue;
+		}
+
+		if (MSG_ARGS_PADDING != argsFormat && false == timercmp(&tv, since, <)) {
+			refs[refsNum].mq = mq;
+			refs[refsNum].pos = pos;
+			refs[refsNum].seq = seq;
+			refs[refsNum].tv = tv;
+			++refsNum;
+		}
+	}
+
+	mq->drainedSeq = limitSeq - 1;
+
+	return refsNum;
+}
+
+/* API method - Description located at .h file */
+bool readCollectedMessage(const MessageRef* ref, MessageData* md,
+                          char* argsBuf, const int argsBufLen) {
+	MessageQueue* mq = ref->mq;
+	const MessageData* src = &mq->messagesData[ref->pos];
+	size_t argsSpace;
+
+	*md = *src;
+
+	/* A torn copy is discarded below, but it mustn't lead the arguments copy astray meanwhile */
+	if (1 > md->slotsNum || mq->size - ref->pos < md->slotsNum) {
+		return false;
+	}
+
+	argsSpace = (size_t) md->slotsNum * mq->maxArgsLen;
+	if ((size_t) argsBufLen < argsSpace) {
+		return false;
+	}
+
+	memcpy(argsBuf, mq->argsBufs + (size_t) ref->pos * mq->maxArgsLen,
+	       argsSpace);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (ref->seq != md->seq
+	        || ref->seq != __atomic_load_n(&src->seq, __ATOMIC_RELAXED)) {
+		return false;
+	}
+
+	md->argsBuf = argsBuf;
+
+	return true;
+}
+
+/* API method - Description located at .h file */
+int directWriteToFile(const int loggingLevel, char* file, const char* func,
+                      const int line, va_list* args, char* msg, FILE* logFile,
+                      const int maxMsgLen, const int maxArgsLen,
+                      const int logMethod, const void (*writeMethod)(),
+                      const bool isTruncationAllowed) {
 	MessageData md;
 	char argsBuf[maxArgsLen];
+	int argsSize;
 
 	md.argsBuf = argsBuf;
-	setMsgValues(&md, loggingLevel, file, func, line, args, msg, logMethod,
-	             maxArgsLen);
+	md.slotsNum = 1;
+	argsSize = setMsgValues(&md, loggingLevel, file, func, line, args, msg,
+	                        logMethod, maxArgsLen);
+	if (argsSize > maxArgsLen && false == isTruncationAllowed) {
+		return argsSize;
+	}
 
 	writeMethod(&md, logFile);
+
+	return MQ_STATUS_SUCCESS;
 }
 
 /* API method - Description located at .h file */
 void messageDataQueueDestroy(MessageQueue* mq) {
-	int i;
-
-	for (i = 0; i < mq->size; ++i) {
-		MessageData* md = (&mq->messagesData[i]);
-		free(md->argsBuf);
+	if (NULL != mq->priorityQueue) {
+		messageDataQueueDestroy(mq->priorityQueue);
 	}
 
-	free(mq->messagesData);
-	free(mq);
-}
+	free(mq->lastWritten);
 
-/**
- * Return the next position in a queue
- * @param curPos Current position
- * @param queueSize Queue size
- * @return The next position in a queue
- */
-static inline int getNextPos(int curPos, const int queueSize) {
-	return ++curPos >= queueSize ? 0 : curPos;
+	/* Arena memory is released when the arena is destroyed */
+	if (false == mq->isArenaAllocated) {
+		free(mq);
+	}
 }
 
 /* API method - Description located at .h file */
@@ -230,43 +639,193 @@ bool inline isDecommisionedBuffer(MessageQueue* mq) {
 }
 
 /* API method - Description located at .h file */
-void inline setIsBeingUsed(MessageQueue* mq, bool state) {
-	__atomic_store_n(&mq->isBeingUsed, state, __ATOMIC_SEQ_CST);
+void inline retireBuffer(MessageQueue* mq) {
+	__atomic_store_n(&mq->isRetired, true, __ATOMIC_SEQ_CST);
 }
 
 /* API method - Description located at .h file */
-bool inline getIsPrivateBufferBeingUsed(MessageQueue* mq) {
-	bool isBeingUsed;
+bool inline isRetiredBuffer(MessageQueue* mq) {
+	bool isRetiredLoc;
+
+	__atomic_load(&mq->isRetired, &isRetiredLoc, __ATOMIC_SEQ_CST);
 
-	__atomic_load(&mq->isBeingUsed, &isBeingUsed, __ATOMIC_SEQ_CST);
+	return isRetiredLoc;
+}
+
+/* API method - Description located at .h file */
+void inline setIsTaken(MessageQueue* mq, bool state) {
+	__atomic_store_n(&mq->isTaken, state, __ATOMIC_SEQ_CST);
+}
+
+/* API method - Description located at .h file */
+bool inline getIsPrivateBufferTaken(MessageQueue* mq) {
+	bool isTaken;
+
+	__atomic_load(&mq->isTaken, &isTaken, __ATOMIC_SEQ_CST);
+
+	return isTaken;
+}
 
-	return isBeingUsed;
+/* API method - Description located at .h file */
+void inline setNumaNode(MessageQueue* mq, const int node) {
+	mq->numaNode = node;
 }
 
 /* API method - Description located at .h file */
-void changeBufferSize(MessageQueue* mq, const int newSize, const int maxArgsLen) {
+void setIsOverwriting(MessageQueue* mq, const bool state) {
 	int i;
 
-	for (i = 0; i < mq->size; ++i) {
-		MessageData* md = (&mq->messagesData[i]);
-		free(md->argsBuf);
+	/* The slots of a malloc'ed buffer may carry any sequence number, and collecting messages
+	 * relies on it */
+	if (true == state) {
+		for (i = 0; i < mq->size; ++i) {
+			mq->messagesData[i].seq = 0;
+		}
 	}
 
-	free(mq->messagesData);
-	prepareMessageQueue(mq, newSize, maxArgsLen);
+	mq->isOverwriting = state;
+}
 
+/* API method - Description located at .h file */
+void setPriorityQueue(MessageQueue* mq, MessageQueue* priorityQueue) {
+	mq->priorityQueue = priorityQueue;
 }
 
 /* API method - Description located at .h file */
-void inline setIsTaken(MessageQueue* mq, bool state) {
-	__atomic_store_n(&mq->isTaken, state, __ATOMIC_SEQ_CST);
+MessageQueue* getPriorityQueue(MessageQueue* mq) {
+	return mq->priorityQueue;
 }
 
 /* API method - Description located at .h file */
-bool inline getIsPrivateBufferTaken(MessageQueue* mq) {
-	bool isTaken;
+int inline getNumaNode(MessageQueue* mq) {
+	return mq->numaNode;
+}
 
-	__atomic_load(&mq->isTaken, &isTaken, __ATOMIC_SEQ_CST);
+/* API method - Description located at .h file */
+int inline getHighWaterMark(MessageQueue* mq) {
+	return __atomic_load_n(&mq->highWaterMark, __ATOMIC_RELAXED);
+}
 
-	return isTaken;
+/* API method - Description located at .h file */
+size_t getMessageQueueCommittedMemory(MessageQueue* mq) {
+	size_t pageSize;
+	uintptr_t start;
+	uintptr_t end;
+	size_t pagesNum;
+	unsigned char* residency;
+	size_t committed = 0;
+
+	pageSize = sysconf(_SC_PAGESIZE);
+	start = (uintptr_t) mq & ~((uintptr_t) pageSize - 1);
+	end = (uintptr_t) mq + getMessageQueueMemorySize(mq->size, mq->maxArgsLen);
+	pagesNum = (end - start + pageSize - 1) / pageSize;
+
+	//TODO: think if malloc failures need to be handled
+	residency = malloc(pagesNum);
+	if (NULL != residency) {
+		if (0 == mincore((void*) start, pagesNum * pageSize, residency)) {
+			size_t i;
+
+			for (i = 0; i < pagesNum; ++i) {
+				if (residency[i] & 1) {
+					committed += pageSize;
+				}
+			}
+		}
+
+		free(residency);
+	}
+
+	return committed;
+}
+
+/* API method - Description located at .h file */
+int releaseIdleBufferMemory(MessageQueue* mq, const long long nowMsec,
+                            const long long idleThresholdMsec) {
+	int lastRead;
+	int lastWrite;
+	int fenceLastRead;
+	bool isWritingLargeMessageLoc;
+
+	/* Atomic load lastWrite, as it's written by a different thread */
+	__atomic_load(&mq->lastWrite, &lastWrite, __ATOMIC_SEQ_CST);
+	lastRead = mq->lastRead;
+
+	if (lastWrite != mq->lastActiveWrite) {
+		mq->lastActiveWrite = lastWrite;
+		mq->lastActiveTimeMsec = nowMsec;
+		mq->isMemoryReleased = false;
+
+		return MQ_STATUS_FAILURE;
+	}
+
+	if (true == mq->isMemoryReleased
+	        || nowMsec - mq->lastActiveTimeMsec < idleThresholdMsec
+	        || getNextMessagePos(lastRead, mq->size) != lastWrite) {
+		return MQ_STATUS_FAILURE;
+	}
+
+	/* The writer may resume at any moment, so fence it first: make the queue look full with
+	 * room for exactly one more message (at 'lastWrite'). A writer that checked for room before
+	 * the fence was stored may still write past 'lastWrite' - after committing a message at
+	 * 'lastWrite' (which advances it) or while adding a message over several slots (which it
+	 * announces). Both are checked after the fence, in the reverse order of the writer's stores,
+	 * and the release is abandoned if the writer got that far */
+	fenceLastRead = getNextMessagePos(getNextMessagePos(lastWrite, mq->size),
+	                                  mq->size);
+	__atomic_store_n(&mq->lastRead, fenceLastRead, __ATOMIC_SEQ_CST);
+
+	__atomic_load(&mq->isWritingLargeMessage, &isWritingLargeMessageLoc,
+	__ATOMIC_SEQ_CST);
+	if (true == isWritingLargeMessageLoc
+	        || lastWrite != __atomic_load_n(&mq->lastWrite, __ATOMIC_SEQ_CST)) {
+		/* Lift the fence, the writer's activity is noticed at the next check */
+		__atomic_store_n(&mq->lastRead, lastRead, __ATOMIC_SEQ_CST);
+
+		return MQ_STATUS_FAILURE;
+	}
+
+	/* Release everything but the header and the slot that may still be written */
+	releaseRange((char*) mq->messagesData, (char*) (mq->messagesData + mq->size),
+	             (char*) &mq->messagesData[lastWrite],
+	             (char*) &mq->messagesData[lastWrite + 1]);
+	releaseRange(mq->argsBufs, mq->argsBufs + (size_t) mq->size * mq->maxArgsLen,
+	             mq->argsBufs + (size_t) lastWrite * mq->maxArgsLen,
+	             mq->argsBufs + (size_t) (lastWrite + 1) * mq->maxArgsLen);
+
+	/* Lift the fence - a message written meanwhile (at 'lastWrite') is drained as usual */
+	__atomic_store_n(&mq->lastRead, lastRead, __ATOMIC_SEQ_CST);
+	mq->isMemoryReleased = true;
+
+	return MQ_STATUS_SUCCESS;
+}
+
+/**
+ * Release the whole pages in a memory range, except for pages overlapping an excluded sub-range
+ * @param start Start of the range
+ * @param end End of the range
+ * @param excludedStart Start of the excluded sub-range
+ * @param excludedEnd End of the excluded sub-range
+ */
+static void releaseRange(char* start, char* end, char* excludedStart,
+                         char* excludedEnd) {
+	uintptr_t pageMask;
+	char* pagesStart;
+	char* pagesEnd;
+
+	pageMask = ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+
+	/* Pages before the excluded sub-range */
+	pagesStart = (char*) (((uintptr_t) start + ~pageMask) & pageMask);
+	pagesEnd = (char*) ((uintptr_t) excludedStart & pageMask);
+	if (pagesStart < pagesEnd) {
+		madvise(pagesStart, pagesEnd - pagesStart, MADV_DONTNEED);
+	}
+
+	/* Pages after the excluded sub-range */
+	pagesStart = (char*) (((uintptr_t) excludedEnd + ~pageMask) & pageMask);
+	pagesEnd = (char*) ((uintptr_t) end & pageMask);
+	if (pagesStart < pagesEnd) {
+		madvise(pagesStart, pagesEnd - pagesStart, MADV_DONTNEED);
+	}
 }
@@ -27,22 +27,174 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#include "messageData.h"
 
 enum MessageQueueStatusCodes {
 	MQ_STATUS_FAILURE = -1, MQ_STATUS_SUCCESS
 };
 
-struct MessageQueue;
+struct Arena;
+
+/* The struct is exposed so that adding a message (the logging fast path) may be inlined */
+typedef struct MessageQueue {
+	/** The position which data was last read from */
+	atomic_int lastRead;
+	/** The position which data was last written to */
+	atomic_int lastWrite;
+	/** The size of the buffer */
+	int size;
+	/** Whether this buffer was dynamically allocated */
+	bool isDynamicallyAllocated;
+	/** Whether this buffer was carved from an arena (and therefore mustn't be freed) */
+	bool isArenaAllocated;
+	/** Whether this buffer has been taken by a worker thread */
+	atomic_bool isTaken;
+	/** Whether this buffer should be freed */
+	atomic_bool isDecomossioned;
+	/** Whether this buffer belongs to an outdated private buffers layout */
+	atomic_bool isRetired;
+	/** The NUMA node this buffer was allocated on */
+	int numaNode;
+	/** Whether the writer overwrites the oldest messages rather than failing if the buffer is full
+	 * (the buffer isn't drained - see 'collectMessages(...)') */
+	bool isOverwriting;
+	/** A small buffer of the same writer for urgent messages, which is drained ahead of this one
+	 * (NULL if there's none) */
+	struct MessageQueue* priorityQueue;
+	/** Pointer to the internal buffer */
+	MessageData* messagesData;
+	/** Pointer to the arguments buffers of the messages (one per message) */
+	char* argsBufs;
+	/** Maximum length of message arguments */
+	int maxArgsLen;
+	/** Whether the writer is adding a message over several slots, which it writes ahead of
+	 * 'lastWrite' (see 'releaseIdleBufferMemory(...)') */
+	atomic_bool isWritingLargeMessage;
+	/** The value of 'lastWrite' when the reader last noticed writer activity (reader only) */
+	int lastActiveWrite;
+	/** The time (in milliseconds) the reader last noticed writer activity (reader only) */
+	long long lastActiveTimeMsec;
+	/** Whether the memory of this buffer has been released since it was last written (reader only) */
+	bool isMemoryReleased;
+	/** The maximal number of messages found in the buffer by the reader */
+	atomic_int highWaterMark;
+	/** The sequence number of the next message added (writer only) */
+	unsigned int nextSeq;
+	/** The sequence number of the last message drained (reader only, stored after 'lastRead') */
+	unsigned int drainedSeq;
+	/** A copy of the last message written by the reader, to detect duplicates of it (reader only,
+	 * allocated once duplicates are first suppressed) */
+	MessageData* lastWritten;
+	/** Whether 'lastWritten' holds a message (reader only) */
+	bool isLastWrittenValid;
+	/** Number of duplicates of 'lastWritten' suppressed and not yet reported (reader only) */
+	unsigned long long duplicatesNum;
+	/** The time of the last suppressed duplicate (reader only) */
+	struct timeval lastDuplicateTv;
+} MessageQueue;
+
+/* A reference to a message collected from a queue that isn't drained (see 'collectMessages(...)') */
+typedef struct MessageRef {
+	/** The MessageQueue the message is at */
+	struct MessageQueue* mq;
+	/** The position of the message in the queue */
+	int pos;
+	/** The sequence number of the message when it was collected */
+	unsigned int seq;
+	/** The time of the message */
+	struct timeval tv;
+} MessageRef;
 
 /**
  * Creates a new MessageQueue object
  * @param size desired MessageQueue size
  * @param maxArgsLen Maximum length of additional arguments of the log message
  * @param isDynamicallyAllocated Whether or not to enable dynamic buffers allocation
+ * @param arena An Arena to carve the MessageQueue from (if NULL or exhausted, the MessageQueue
+ * is malloc'ed)
  * @return The newly allocated MessageQueue
  */
 struct MessageQueue* newMessageQueue(const int size, const int maxArgsLen,
-                                    const bool isDynamicallyAllocated);
+                                    const bool isDynamicallyAllocated,
+                                    struct Arena* arena);
+
+/**
+ * Returns the amount of memory a MessageQueue occupies
+ * @param size MessageQueue size
+ * @param maxArgsLen Maximum length of additional arguments of the log message
+ * @return The amount of memory a MessageQueue of the given dimensions occupies
+ */
+size_t getMessageQueueMemorySize(const int size, const int maxArgsLen);
+
+/**
+ * Return the next position in a MessageQueue
+ * @param curPos Current position
+ * @param queueSize Queue size
+ * @return The next position in a MessageQueue
+ */
+static inline int getNextMessagePos(int curPos, const int queueSize) {
+	return ++curPos >= queueSize ? 0 : curPos;
+}
+
+/**
+ * Marks a message slot as being written, so a reader that doesn't synchronize with the writer
+ * through 'lastWrite' (see 'collectMessages(...)') discards whatever it copies from it meanwhile
+ * @param md The message to invalidate
+ */
+static inline void invalidateMessage(MessageData* md) {
+	__atomic_store_n(&md->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Reserves the next message slot of a queue, to be filled by the worker and then published with
+ * 'commitMessage(...)'
+ * NOTE: The reserved slot is invisible to the reader until committed, and only a single slot may
+ * be reserved at a time
+ * @param mq The MessageQueue to reserve a slot at
+ * @return The reserved message (its 'argsBuf' set to the slot's arguments buffer), or NULL if the
+ * queue is full (an overwriting queue is never full - its oldest message is overwritten)
+ */
+static inline MessageData* reserveMessage(struct MessageQueue* mq) {
+	int lastRead;
+	int lastWrite;
+	MessageData* md;
+
+	/* Atomic load lastRead, as it's written by a different thread */
+	__atomic_load(&mq->lastRead, &lastRead, __ATOMIC_SEQ_CST);
+	lastWrite = mq->lastWrite;
+
+	if (__builtin_expect(getNextMessagePos(lastWrite, mq->size) == lastRead, 0)
+	        && false == mq->isOverwriting) {
+		return NULL;
+	}
+
+	md = &mq->messagesData[lastWrite];
+	invalidateMessage(md);
+	md->argsBuf = mq->argsBufs + (size_t) lastWrite * mq->maxArgsLen;
+	md->slotsNum = 1;
+
+	return md;
+}
+
+/**
+ * Publishes the slot reserved by 'reserveMessage(...)' to the reader
+ * @param mq The MessageQueue the slot was reserved at
+ */
+static inline void commitMessage(struct MessageQueue* mq) {
+	unsigned int seq = mq->nextSeq;
+
+	/* The sequence number is stored after the rest of the message */
+	__atomic_store_n(&mq->messagesData[mq->lastWrite].seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&mq->nextSeq, seq + 1, __ATOMIC_RELAXED);
+
+	/* Atomic store lastWrite, as it's read by a different thread */
+	__atomic_store_n(&mq->lastWrite, getNextMessagePos(mq->lastWrite, mq->size),
+	                 __ATOMIC_SEQ_CST);
+}
 
 /**
  * Adds a message from worker to queue
@@ -55,21 +207,131 @@ struct MessageQueue* newMessageQueue(const int size, const int maxArgsLen,
  * @param msg The message
  * @param logMethod Logging method (private buffer, shared buffer or direct write)
  * @param maxArgsLen Maximum length of additional arguments to log message
- * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE on failure
+ * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE if the queue is full, or the space the
+ * arguments need if it's more than a slot has (nothing was added - see 'addLargeMessage(...)')
+ */
+static inline int addMessage(struct MessageQueue* mq, const int loggingLevel,
+                             char* file, const char* func, const int line,
+                             va_list* args, const char* msg,
+                             const int logMethod, const int maxArgsLen) {
+	MessageData* md = reserveMessage(mq);
+
+	if (__builtin_expect(NULL != md, 1)) {
+		int argsSize = setMsgValues(md, loggingLevel, file, func, line, args,
+		                            msg, logMethod, maxArgsLen);
+
+		/* The slot is left uncommitted, the message is added again over several slots */
+		if (__builtin_expect(argsSize > maxArgsLen, 0)) {
+			return argsSize;
+		}
+
+		commitMessage(mq);
+
+		return MQ_STATUS_SUCCESS;
+	}
+
+	return MQ_STATUS_FAILURE;
+}
+
+/**
+ * Adds a message whose arguments are too long for a single slot, over as many consecutive slots as
+ * needed (their arguments buffers are contiguous). If the slots would wrap around the end of the
+ * queue, the slots up to the end are skipped (by a padding record) and the message is added at the
+ * beginning of the queue
+ * @param mq The MessageQueue to add the message to
+ * @param loggingLevel Log level (one of the levels at 'logLevels')
+ * @param file Filename to log
+ * @param func Function name to log
+ * @param line Line number to log
+ * @param args Additional arguments to log message (not consumed on failure)
+ * @param msg The message
+ * @param logMethod Logging method (private buffer, shared buffer or direct write)
+ * @param argsSize The space the arguments need (as returned by 'addMessage(...)') - longer
+ * arguments are truncated
+ * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE if the queue hasn't enough free slots
+ * (or, if it's an overwriting queue, if it's too small for the message)
  */
-int addMessage(struct MessageQueue* mq, const int loggingLevel, char* file,
-               const char* func, const int line, va_list* args, const char* msg,
-               const int logMethod, const int maxArgsLen);
+int addLargeMessage(struct MessageQueue* mq, const int loggingLevel, char* file,
+                    const char* func, const int line, va_list* args,
+                    const char* msg, const int logMethod, const int argsSize);
 
 /**
  * Drains all the message from a given queue
+ * NOTE: When suppressing duplicates, consecutive messages of the same thread with the same
+ * location, level and arguments as the last written message aren't written - the last written
+ * message is followed by a summary line with their count and time span instead. The summary is
+ * written before the next different message, or at the end of the drain
  * @param mq The MessageQueue to drain messages from
  * @param logFile The file to drain messages to
  * @param maxMsgLen Maximum length of a message
  * @param formatMethod A method to format the message
+ * @param isDuplicatesSuppressed Whether or not to suppress duplicate messages
+ * @param isFlushedBeforeRelease Whether or not to flush the file before the slots of the drained
+ * messages are released to the writer, so a message is lost neither if the reader process dies nor
+ * if the writer process does (the buffer outlives them)
+ * @return The number of suppressed duplicate messages
  */
-void drainMessages(struct MessageQueue* mq, FILE* logFile, const int maxMsgLen,
-                   const void (*formatMethod)());
+int drainMessages(struct MessageQueue* mq, FILE* logFile, const int maxMsgLen,
+                  const void (*formatMethod)(), const bool isDuplicatesSuppressed,
+                  const bool isFlushedBeforeRelease);
+
+/**
+ * Writes the messages of a given queue that haven't been drained yet, from a fatal signal handler.
+ * Only async-signal-safe operations are used and the queue isn't modified (a concurrent drain may
+ * write some of the messages as well). Records that don't look sane are skipped, and the walk is
+ * bounded by the size of the queue and by a deadline
+ * @param mq The MessageQueue to write messages from
+ * @param fd The file descriptor to write messages to
+ * @param writeMethod An async-signal-safe method that writes a message to a file descriptor
+ * @param deadlineNsec Time (monotonic, in nanoseconds) after which no more messages are written
+ * @return The number of messages written
+ */
+int emergencyDrainMessages(struct MessageQueue* mq, const int fd,
+                           void (*writeMethod)(const MessageData*, const int),
+                           const long long deadlineNsec);
+
+/**
+ * Writes the messages of a given queue that haven't been drained, from a copy of the queue left
+ * behind by a process that died (see 'recoverPersistentBuffers(...)' API). 'lastWrite' isn't
+ * trusted - the walk starts after 'lastRead' and goes on as long as each message carries the
+ * sequence number that follows the previous one's (the first one must follow 'drainedSeq'), so
+ * messages overwritten, partially added or added before the last drain are never written.
+ * Messages that don't look sane end the walk as well
+ * @param mq The MessageQueue to write messages from (its layout within its memory is checked)
+ * @param logFile The file to write messages to
+ * @param writeMethod A pointer to a method that writes a message to a file
+ * @param isValidString A method that checks whether a pointer (a name a message refers to) is a
+ * readable, terminated string
+ * @return The number of messages written
+ */
+int recoverMessages(struct MessageQueue* mq, FILE* logFile,
+                    const void (*writeMethod)(),
+                    bool (*isValidString)(const char*));
+
+/**
+ * Collects references to the messages of an overwriting queue that were added since its previous
+ * collection, at or after a given time. Messages added during the collection are left for the next
+ * one. The writer isn't stopped, so the messages must be copied by 'readCollectedMessage(...)'
+ * NOTE: This API may be called only by a single reader of the MessageQueue
+ * @param mq The MessageQueue to collect messages from
+ * @param since The time of the oldest message to collect
+ * @param refs The array to store the references at (room for 'size' references is needed)
+ * @return The number of references stored
+ */
+int collectMessages(struct MessageQueue* mq, const struct timeval* since,
+                    MessageRef* refs);
+
+/**
+ * Copies a message collected by 'collectMessages(...)', unless the writer has overwritten it since
+ * @param ref The reference to the message
+ * @param md The MessageData to copy the message to (its 'argsBuf' is set to 'argsBuf')
+ * @param argsBuf The buffer to copy the arguments of the message to
+ * @param argsBufLen The length of 'argsBuf' (the arguments of a large message run over several
+ * slots)
+ * @return True if the message was copied whole or false if it was overwritten
+ */
+bool readCollectedMessage(const MessageRef* ref, MessageData* md,
+                          char* argsBuf, const int argsBufLen);
 
 /**
  * Directly write to a file
@@ -84,14 +346,19 @@ void drainMessages(struct MessageQueue* mq, FILE* logFile, const int maxMsgLen,
  * @param maxArgsLen Maximum length of additional arguments to log message
  * @param logMethod Specifies the way logging is done
  * @param writeMethod A pointer to a method that writes a message to a file
+ * @param isTruncationAllowed Whether to write arguments that need more than 'maxArgsLen'
+ * truncated, or not to write them at all
+ * @return MQ_STATUS_SUCCESS on success, or the space the arguments need if it's more than
+ * 'maxArgsLen' and truncation isn't allowed (nothing was written)
  */
-void directWriteToFile(const int loggingLevel, char* file, const char* func,
-                       const int line, va_list* args, char* msg, FILE* logFile,
-                       const int maxMsgLen, const int maxArgsLen,
-                       const int logMethod, const void (*writeMethod)());
+int directWriteToFile(const int loggingLevel, char* file, const char* func,
+                      const int line, va_list* args, char* msg, FILE* logFile,
+                      const int maxMsgLen, const int maxArgsLen,
+                      const int logMethod, const void (*writeMethod)(),
+                      const bool isTruncationAllowed);
 
 /**
- * Releases all resources associated with a given  MessageQueue
+ * Releases all resources associated with a given  MessageQueue (including its priority queue)
  * @param mq The MessageQueue to destroy
  */
 void messageDataQueueDestroy(struct MessageQueue* mq);
@@ -124,26 +391,18 @@ void decommisionBuffer(struct MessageQueue* mq);
 bool isDecommisionedBuffer(struct MessageQueue* mq);
 
 /**
- * Set whether a private buffer is being used
- * @param mq The relevant MessageQueue
- * @param state Whether a private buffer is being used or not
+ * Retire the given MessageQueue - it belongs to an outdated private buffers layout and its owner
+ * should switch to a new buffer (and decommission this one) at its next log call
+ * @param mq The MessageQueue to retire
  */
-void setIsBeingUsed(struct MessageQueue* mq, bool state);
+void retireBuffer(struct MessageQueue* mq);
 
 /**
- * Get whether a private buffer is being used
+ * Checks whether or not this buffer has been retired
  * @param mq The relevant MessageQueue
- * @return True if private buffer is being used or false otherwise
- */
-bool getIsPrivateBufferBeingUsed(struct MessageQueue* mq);
-
-/**
- * Change the size of the internal buffer in a MessageQueue
- * @param mq The MessageQueue to change
- * @param newSize The new size of the internal buffer
- * @param maxArgsLen Maximum length of additional arguments to log message
+ * @return True if this buffer has been retired or false otherwise
  */
-void changeBufferSize(struct MessageQueue* mq, const int newSize, const int maxArgsLen);
+bool isRetiredBuffer(struct MessageQueue* mq);
 
 /**
  * Set whether a private buffer has been taken by a worker thread
@@ -159,4 +418,70 @@ void setIsTaken(struct MessageQueue* mq, bool state);
  */
 bool getIsPrivateBufferTaken(struct MessageQueue* mq);
 
+/**
+ * Sets the NUMA node this buffer was allocated on
+ * @param mq The relevant MessageQueue
+ * @param node The NUMA node this buffer was allocated on
+ */
+void setNumaNode(struct MessageQueue* mq, const int node);
+
+/**
+ * Sets whether the writer overwrites the oldest messages of a buffer rather than failing if it's
+ * full. The buffer mustn't be in use yet
+ * @param mq The relevant MessageQueue
+ * @param state True if the oldest messages are overwritten or false otherwise
+ */
+void setIsOverwriting(struct MessageQueue* mq, const bool state);
+
+/**
+ * Sets the priority queue of a buffer - a buffer of the same writer for urgent messages, which is
+ * destroyed along with it
+ * @param mq The relevant MessageQueue
+ * @param priorityQueue The priority queue
+ */
+void setPriorityQueue(struct MessageQueue* mq,
+                      struct MessageQueue* priorityQueue);
+
+/**
+ * Gets the priority queue of a buffer
+ * NOTE: Async-signal-safe
+ * @param mq The relevant MessageQueue
+ * @return The priority queue, or NULL if the buffer has none
+ */
+struct MessageQueue* getPriorityQueue(struct MessageQueue* mq);
+
+/**
+ * Gets the NUMA node this buffer was allocated on
+ * @param mq The relevant MessageQueue
+ * @return The NUMA node this buffer was allocated on
+ */
+int getNumaNode(struct MessageQueue* mq);
+
+/**
+ * Gets the maximal number of messages the reader has found in the buffer
+ * @param mq The relevant MessageQueue
+ * @return The high-water mark of the buffer occupancy
+ */
+int getHighWaterMark(struct MessageQueue* mq);
+
+/**
+ * Gets the amount of memory of a MessageQueue that is currently committed (resident)
+ * @param mq The relevant MessageQueue
+ * @return The amount of committed memory, in bytes
+ */
+size_t getMessageQueueCommittedMemory(struct MessageQueue* mq);
+
+/**
+ * Release the memory pages of an idle, empty MessageQueue back to the OS (they are committed
+ * again on demand as the writer advances). The writer may keep writing meanwhile.
+ * NOTE: This API may be called only by the thread that drains the MessageQueue
+ * @param mq The MessageQueue to release
+ * @param nowMsec Current time in milliseconds (monotonic)
+ * @param idleThresholdMsec Minimum time (in milliseconds) without writer activity
+ * @return MQ_STATUS_SUCCESS if the memory was released, MQ_STATUS_FAILURE otherwise (the
+ * MessageQueue isn't empty, hasn't been idle long enough or was already released)
+ */
+int releaseIdleBufferMemory(struct MessageQueue* mq, const long long nowMsec,
+                            const long long idleThresholdMsec);
+
 #endif /* MESSAGE_QUEUE_H */
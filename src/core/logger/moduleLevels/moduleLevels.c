@@ -0,0 +1,204 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+/**
+ * @file moduleLevels.c
+ * @author Barak Sason Rofman
+ * @brief This module provides a table of logging level overrides, keyed by module.
+ * A module is a '/' separated path - a module tag (e.g. "net/tcp") or a source file path. An
+ * override applies to every module that contains its name as a sequence of whole path components,
+ * so "net" covers "net/tcp" and "logger.c" covers "../src/core/logger/logger.c". When several
+ * overrides apply, the longest one wins.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "moduleLevels.h"
+#include "../../api/logger.h"
+#include "../../common/linkedList/linkedList.h"
+
+typedef struct ModuleLevel {
+	/** The module name */
+	char* module;
+	/** The logging level of the module */
+	int loggingLevel;
+} ModuleLevel;
+
+static struct LinkedList* moduleLevels; /* Created with the first override */
+static pthread_mutex_t moduleLevelsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ModuleLevel* findModuleLevel(const char* module);
+static bool isModuleCovered(const char* module, const char* overrideModule);
+
+/* API method - Description located at .h file */
+int setModuleLevel(const char* module, const int loggingLevel) {
+	int status = LOG_STATUS_SUCCESS;
+	ModuleLevel* ml;
+
+	pthread_mutex_lock(&moduleLevelsLock); /* Lock */
+	{
+		ml = findModuleLevel(module);
+		if (NULL == ml) {
+			//TODO: think if malloc failures need to be handled
+			if (NULL == moduleLevels) {
+				moduleLevels = newLinkedList();
+			}
+			ml = malloc(sizeof(*ml));
+			if (NULL != ml) {
+				ml->module = malloc(strlen(module) + 1);
+			}
+			if (NULL != moduleLevels && NULL != ml && NULL != ml->module) {
+				strcpy(ml->module, module);
+				addNode(moduleLevels, newLinkedListNode(ml));
+			} else {
+				if (NULL != ml) {
+					free(ml->module);
+				}
+				free(ml);
+				ml = NULL;
+				status = LOG_STATUS_FAILURE;
+			}
+		}
+
+		if (NULL != ml) {
+			ml->loggingLevel = loggingLevel;
+		}
+	}
+	pthread_mutex_unlock(&moduleLevelsLock); /* Unlock */
+
+	return status;
+}
+
+/* API method - Description located at .h file */
+int removeModuleLevel(const char* module) {
+	ModuleLevel* ml;
+
+	pthread_mutex_lock(&moduleLevelsLock); /* Lock */
+	{
+		ml = findModuleLevel(module);
+		if (NULL != ml) {
+			free(removeNode(moduleLevels, ml));
+		}
+	}
+	pthread_mutex_unlock(&moduleLevelsLock); /* Unlock */
+
+	if (NULL == ml) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	free(ml->module);
+	free(ml);
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+int getModuleLevel(const char* module, const int defaultLevel) {
+	int loggingLevel = defaultLevel;
+	size_t longestLen = 0;
+	struct LinkedListNode* node;
+
+	pthread_mutex_lock(&moduleLevelsLock); /* Lock */
+	{
+		for (node = (NULL != moduleLevels) ? getHead(moduleLevels) : NULL;
+		        NULL != node; node = getNext(node)) {
+			ModuleLevel* ml = getData(node);
+			size_t len = strlen(ml->module);
+
+			if (len > longestLen && true == isModuleCovered(module, ml->module)) {
+				loggingLevel = ml->loggingLevel;
+				longestLen = len;
+			}
+		}
+	}
+	pthread_mutex_unlock(&moduleLevelsLock); /* Unlock */
+
+	return loggingLevel;
+}
+
+/* API method - Description located at .h file */
+void destroyModuleLevels() {
+	pthread_mutex_lock(&moduleLevelsLock); /* Lock */
+	{
+		if (NULL != moduleLevels) {
+			struct LinkedListNode* node;
+
+			while (NULL != (node = getHead(moduleLevels))) {
+				ModuleLevel* ml = getData(node);
+
+				free(removeNode(moduleLevels, ml));
+				free(ml->module);
+				free(ml);
+			}
+
+			free(moduleLevels);
+			moduleLevels = NULL;
+		}
+	}
+	pthread_mutex_unlock(&moduleLevelsLock); /* Unlock */
+}
+
+/**
+ * Find the override of a module
+ * NOTE: Must be called with 'moduleLevelsLock' held
+ * @param module The module name
+ * @return The override of the module, or NULL if there is none
+ */
+static ModuleLevel* findModuleLevel(const char* module) {
+	struct LinkedListNode* node;
+
+	for (node = (NULL != moduleLevels) ? getHead(moduleLevels) : NULL;
+	        NULL != node; node = getNext(node)) {
+		ModuleLevel* ml = getData(node);
+
+		if (0 == strcmp(ml->module, module)) {
+			return ml;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Check whether an override applies to a module, i.e. the override name appears in the module as
+ * a sequence of whole path components
+ * @param module The module (of a call site)
+ * @param overrideModule The module name of the override
+ * @return True if the override applies to the module or false otherwise
+ */
+static bool isModuleCovered(const char* module, const char* overrideModule) {
+	size_t len = strlen(overrideModule);
+	const char* match;
+
+	if (0 == len) {
+		return false;
+	}
+
+	for (match = strstr(module, overrideModule); NULL != match;
+	        match = strstr(match + 1, overrideModule)) {
+		if ((match == module || '/' == match[-1])
+		        && ('\0' == match[len] || '/' == match[len])) {
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+/**
+ * @file moduleLevels.h
+ * @author Barak Sason Rofman
+ * @brief This module provides a table of logging level overrides, keyed by module.
+ * A module is a '/' separated path - a module tag (e.g. "net/tcp") or a source file path. An
+ * override applies to every module that contains its name as a sequence of whole path components,
+ * so "net" covers "net/tcp" and "logger.c" covers "../src/core/logger/logger.c". When several
+ * overrides apply, the longest one wins.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef MODULELEVELS_H
+#define MODULELEVELS_H
+
+/**
+ * Set the logging level override of a module (replacing an existing override of the module)
+ * @param module The module name
+ * @param loggingLevel The logging level of the module
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+int setModuleLevel(const char* module, const int loggingLevel);
+
+/**
+ * Remove the logging level override of a module
+ * @param module The module name
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the module had no override
+ */
+int removeModuleLevel(const char* module);
+
+/**
+ * Get the effective logging level of a module
+ * @param module The module (of a call site)
+ * @param defaultLevel The logging level to return if no override applies to the module
+ * @return The logging level of the longest override that applies, or 'defaultLevel'
+ */
+int getModuleLevel(const char* module, const int defaultLevel);
+
+/**
+ * Remove all the overrides and release their resources
+ */
+void destroyModuleLevels();
+
+#endif /* MODULELEVELS_H */
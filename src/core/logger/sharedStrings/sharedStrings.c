@@ -0,0 +1,191 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file sharedStrings.c
+ * @author Barak Sason Rofman
+ * @brief This module provides a table of strings copied into a shared memory arena, keyed by the
+ * address of the original string. Messages only keep pointers to their file and function names
+ * (string literals), which another process can't read - the copies can be read by any process
+ * that attaches to the arena. Lookups are lock-free, adding a string is synchronized.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sharedStrings.h"
+#include "../../common/arena/arena.h"
+
+#define PLACEHOLDER_STRING "?"
+
+typedef struct SharedStringsEntry {
+	/** The original string (published last, so a found entry is complete) */
+	const char* str;
+	/** The copy at the arena */
+	const char* copy;
+} SharedStringsEntry;
+
+typedef struct SharedStrings {
+	/** The arena strings are copied into */
+	struct Arena* arena;
+	/** Open addressing hash table of the strings */
+	SharedStringsEntry* entries;
+	/** Number of entries minus 1 (the number of entries is a power of 2) */
+	size_t mask;
+	/** Number of strings in the table */
+	size_t stringsNum;
+	/** Returned once the table or the arena is full */
+	const char* placeholder;
+	/** Synchronizes adding strings */
+	pthread_mutex_t lock;
+} SharedStrings;
+
+static inline size_t hashString(const SharedStrings* ss, const char* str);
+static const char* addSharedString(SharedStrings* ss, const char* str);
+static const char* copyString(SharedStrings* ss, const char* str);
+
+/* API method - Description located at .h file */
+SharedStrings* newSharedStrings(struct Arena* arena, const int capacity) {
+	SharedStrings* ss;
+	size_t entriesNum;
+
+	//TODO: think if malloc failures need to be handled
+	ss = malloc(sizeof(*ss));
+	if (NULL == ss) {
+		return NULL;
+	}
+
+	for (entriesNum = 1; entriesNum < (size_t) capacity; entriesNum <<= 1) {
+	}
+
+	ss->arena = arena;
+	ss->entries = calloc(entriesNum, sizeof(*ss->entries));
+	ss->mask = entriesNum - 1;
+	ss->stringsNum = 0;
+	ss->placeholder = copyString(ss, PLACEHOLDER_STRING);
+	if (NULL == ss->entries || NULL == ss->placeholder) {
+		free(ss->entries);
+		free(ss);
+		return NULL;
+	}
+
+	pthread_mutex_init(&ss->lock, NULL);
+
+	return ss;
+}
+
+/* API method - Description located at .h file */
+const char* internSharedString(SharedStrings* ss, const char* str) {
+	size_t i;
+
+	if (NULL == str) {
+		return NULL;
+	}
+
+	for (i = hashString(ss, str);; i = (i + 1) & ss->mask) {
+		const char* entryStr = __atomic_load_n(&ss->entries[i].str,
+		__ATOMIC_ACQUIRE);
+
+		if (str == entryStr) {
+			return ss->entries[i].copy;
+		}
+
+		/* Not in the table */
+		if (NULL == entryStr) {
+			return addSharedString(ss, str);
+		}
+	}
+}
+
+/**
+ * Add a string to the table (unless another thread added it meanwhile)
+ * @param ss The relevant SharedStrings
+ * @param str The string
+ * @return The copy of the string, or the placeholder if the table or the arena is full
+ */
+static const char* addSharedString(SharedStrings* ss, const char* str) {
+	const char* copy = ss->placeholder;
+	size_t i;
+
+	pthread_mutex_lock(&ss->lock); /* Lock */
+	{
+		for (i = hashString(ss, str); NULL != ss->entries[i].str;
+		        i = (i + 1) & ss->mask) {
+			if (str == ss->entries[i].str) {
+				break;
+			}
+		}
+
+		if (NULL != ss->entries[i].str) {
+			copy = ss->entries[i].copy;
+		} else if (ss->stringsNum < ss->mask) {
+			/* At least one entry is always left empty, so lookups of missing strings end */
+			copy = copyString(ss, str);
+			if (NULL != copy) {
+				ss->entries[i].copy = copy;
+				__atomic_store_n(&ss->entries[i].str, str, __ATOMIC_RELEASE);
+				++ss->stringsNum;
+			} else {
+				copy = ss->placeholder;
+			}
+		}
+	}
+	pthread_mutex_unlock(&ss->lock); /* Unlock */
+
+	return copy;
+}
+
+/**
+ * Copy a string into the arena
+ * @param ss The relevant SharedStrings
+ * @param str The string
+ * @return The copy of the string, or NULL if the arena is full
+ */
+static const char* copyString(SharedStrings* ss, const char* str) {
+	size_t len = strlen(str) + 1;
+	char* copy = arenaAlloc(ss->arena, len);
+
+	if (NULL != copy) {
+		memcpy(copy, str, len);
+	}
+
+	return copy;
+}
+
+/**
+ * Returns the entry at which the lookup of a string starts
+ * @param ss The relevant SharedStrings
+ * @param str The string
+ * @return The index of the first entry to check
+ */
+static inline size_t hashString(const SharedStrings* ss, const char* str) {
+	/* Keyed by address - the low bits of string literals' addresses carry little entropy */
+	return (((uintptr_t) str * 0x9E3779B97F4A7C15ULL) >> 32) & ss->mask;
+}
+
+/* API method - Description located at .h file */
+void sharedStringsDestroy(SharedStrings* ss) {
+	if (NULL != ss) {
+		pthread_mutex_destroy(&ss->lock);
+		free(ss->entries);
+		free(ss);
+	}
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file sharedStrings.h
+ * @author Barak Sason Rofman
+ * @brief This module provides a table of strings copied into a shared memory arena, keyed by the
+ * address of the original string. Messages only keep pointers to their file and function names
+ * (string literals), which another process can't read - the copies can be read by any process
+ * that attaches to the arena. Lookups are lock-free, adding a string is synchronized.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef SHAREDSTRINGS_H
+#define SHAREDSTRINGS_H
+
+struct Arena;
+struct SharedStrings;
+
+/**
+ * Creates a new SharedStrings table
+ * @param arena The (shared memory backed) Arena to copy strings into
+ * @param capacity Maximum number of strings (rounded up to a power of 2)
+ * @return The newly allocated SharedStrings, or NULL on failure
+ */
+struct SharedStrings* newSharedStrings(struct Arena* arena, const int capacity);
+
+/**
+ * Returns the copy of a string at the arena, copying it first if needed
+ * NOTE: This API is thread-safe
+ * @param ss The relevant SharedStrings
+ * @param str The string (must outlive the table - a string literal)
+ * @return The copy of the string, or a "?" placeholder if the table or the arena is full (NULL if
+ * the string is NULL)
+ */
+const char* internSharedString(struct SharedStrings* ss, const char* str);
+
+/**
+ * Releases all resources associated with the given SharedStrings (the copies are released with
+ * the arena)
+ * @param ss The SharedStrings to destroy
+ */
+void sharedStringsDestroy(struct SharedStrings* ss);
+
+#endif /* SHAREDSTRINGS_H */
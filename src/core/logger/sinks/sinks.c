@@ -0,0 +1,1031 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file sinks.c
+ * @author Barak Sason Rofman
+ * @brief This module provides fan-out of records to several sinks (streams, files, in-memory rings
+ * and Unix domain sockets), each with its own level filter and write method. A record is formatted
+ * once per distinct write method, not once per sink. Sinks with a queue are written by a thread of
+ * their own, so a slow sink drops (or spools) records instead of stalling the others.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "sinks.h"
+#include "../../api/logger.h"
+#include "../messageQueue/messageData.h"
+
+#define RECORD_HEADER_SIZE sizeof(uint32_t) /* Length of a record at the queue of a socket sink */
+#define SOCKET_SINK_IOV_NUM 128 /* Maximal number of pieces of records gathered into a single send */
+#define SOCKET_SINK_BATCH_SIZE 32768 /* Maximal length of the records batched into a single send */
+#define SOCKET_SINK_POLL_MSEC 10 /* Time a socket that isn't writable is waited for */
+#define SOCKET_SINK_RECONNECT_MSEC 1000 /* Minimal interval between connection attempts */
+
+enum LogSinkTypes {
+	LOG_SINK_STREAM, LOG_SINK_MEMORY, LOG_SINK_SOCKET
+};
+
+typedef struct LogSink {
+	/** The type of the sink (one of 'LogSinkTypes') */
+	int type;
+	/** Records of this level or a more severe one are written to the sink */
+	int loggingLevel;
+	/** A pointer to a method that writes a message to a file */
+	void (*writeMethod)();
+	/** Index of the sink's format at the formats of the sinks */
+	int formatIndex;
+	/** Set if the record is written straight to the stream, rather than copied from its format */
+	bool isDirect;
+	/** The stream the sink writes to (NULL unless it's a stream sink) */
+	FILE* stream;
+	/** Whether the stream is closed when the sinks are destroyed */
+	bool isOwned;
+	/** The queue of a queued sink, or the ring of a memory sink (NULL for a synchronous sink) - at
+	 * the queue of a socket sink, each record is preceded by its length */
+	char* buf;
+	/** Size of 'buf' */
+	size_t size;
+	/** Number of bytes ever written to 'buf' */
+	size_t head;
+	/** Number of bytes ever taken from the queue by the sink's thread */
+	size_t tail;
+	/** Number of records dropped since the queue was full */
+	unsigned long long dropsNum;
+	/** The thread that writes the queue to the stream */
+	pthread_t thread;
+	/** Set if the sink's thread was started */
+	bool isThreadStarted;
+	/** Set when the sink's thread should exit once the queue is empty */
+	bool isStopping;
+	/** Synchronizes the queue between the writers and the sink's thread */
+	pthread_mutex_t lock;
+	/** Signaled when records are added to the queue */
+	pthread_cond_t cond;
+	/** The address of the agent a socket sink sends to */
+	struct sockaddr_un addr;
+	/** The type of the socket (SOCK_STREAM or SOCK_SEQPACKET) */
+	int socketType;
+	/** The connected socket, or -1 (used by the sink's thread only) */
+	int fd;
+	/** Number of bytes of the oldest record at the queue that were already sent (a stream socket
+	 * may take part of a record) */
+	size_t sentLen;
+	/** Time (monotonic, in msec) of the next connection attempt */
+	long long nextConnectMsec;
+	/** The file records are spooled to while the agent can't take them (may be NULL) */
+	FILE* spool;
+} LogSink;
+
+typedef struct LogFormat {
+	/** A pointer to a method that writes a message to a file */
+	void (*writeMethod)();
+	/** Number of sinks with this format */
+	int sinksNum;
+	/** Set if the record is formatted once for all sinks of this format (rather than written
+	 * straight to the stream of its single sink) */
+	bool isFormatted;
+} LogFormat;
+
+typedef struct LogFormatBuffers {
+	/** The LogSinks the buffers belong to */
+	struct LogSinks* sinks;
+	/** Memory streams the record is formatted into, one per format (NULL for a format that isn't
+	 * formatted) */
+	FILE* streams[MAX_LOG_SINKS + 1];
+	/** The buffers of the memory streams */
+	char* bufs[MAX_LOG_SINKS + 1];
+	/** Lengths of the formatted records */
+	size_t lens[MAX_LOG_SINKS + 1];
+	/** The format buffers of the other threads */
+	struct LogFormatBuffers* next;
+	/** Previous at the format buffers of the other threads */
+	struct LogFormatBuffers* prev;
+} LogFormatBuffers;
+
+typedef struct LogSinks {
+	/** The sinks (room is left for the main sink) */
+	LogSink sinks[MAX_LOG_SINKS + 1];
+	/** Number of sinks */
+	int sinksNum;
+	/** The distinct formats of the sinks */
+	LogFormat formats[MAX_LOG_SINKS + 1];
+	/** Number of formats */
+	int formatsNum;
+	/** Set once the sinks are started (no sinks may be added afterwards, so the sinks are read
+	 * without a lock) */
+	bool isStarted;
+	/** The format buffers of the calling thread - each writer formats records into its own
+	 * buffers, so writers only contend on the sinks themselves */
+	pthread_key_t formatBuffersKey;
+	/** Set if 'formatBuffersKey' was created */
+	bool isFormatBuffersKeyCreated;
+	/** The format buffers of all threads (freed when a thread exits or the sinks are destroyed) */
+	LogFormatBuffers* formatBuffers;
+	/** Synchronizes the list of format buffers */
+	pthread_mutex_t lock;
+} LogSinks;
+
+static LogSink* addLogSink(LogSinks* sinks, const int type, FILE* stream,
+                           const bool isOwned, const int loggingLevel,
+                           void (*writeMethod)(), const size_t size);
+static void initFormats(LogSinks* sinks);
+static LogFormatBuffers* getFormatBuffers(LogSinks* sinks);
+static void freeFormatBuffers(void* formatBuffersArg);
+static void* runLogSink(void* sinkArg);
+static size_t writeQueueToStream(LogSink* sink, const size_t tail,
+                                 const size_t head);
+static size_t writeQueueToSocket(LogSink* sink, const size_t tail,
+                                 const size_t head);
+static size_t consumeSentRecords(LogSink* sink, const size_t tail,
+                                 size_t sentLen);
+static size_t spoolQueue(LogSink* sink, const size_t tail, const size_t head);
+static void connectSocketSink(LogSink* sink);
+static inline int setRingIovecs(const LogSink* sink, const size_t pos,
+                                const size_t len, struct iovec* iov);
+static inline uint32_t getRecordLen(const LogSink* sink, const size_t pos);
+static void countDrops(LogSink* sink, const int dropsNum);
+static inline long long getMonotonicTimeMsec();
+static void enqueueRecord(LogSink* sink, const char* record, size_t len);
+static void writeToMemory(LogSink* sink, const char* record, size_t len);
+static void copyToRing(char* ring, const size_t size, const size_t pos,
+                       const char* src, const size_t len);
+static void copyFromRing(const char* ring, const size_t size, const size_t pos,
+                         char* dst, const size_t len);
+
+/* API method - Description located at .h file */
+LogSinks* newLogSinks() {
+	LogSinks* sinks;
+
+	//TODO: think if malloc failures need to be handled
+	sinks = calloc(1, sizeof(*sinks));
+	if (NULL == sinks) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&sinks->lock, NULL);
+	sinks->isFormatBuffersKeyCreated = (0
+	        == pthread_key_create(&sinks->formatBuffersKey, freeFormatBuffers));
+
+	return sinks;
+}
+
+/* API method - Description located at .h file */
+int addStreamLogSink(LogSinks* sinks, FILE* stream, const bool isOwned,
+                     const int loggingLevel, void (*writeMethod)(),
+                     const int queueSize) {
+	LogSink* sink;
+
+	if (true == sinks->isStarted || MAX_LOG_SINKS <= sinks->sinksNum
+	        || NULL == stream || queueSize < 0) {
+		return LS_STATUS_FAILURE;
+	}
+
+	sink = addLogSink(sinks, LOG_SINK_STREAM, stream, isOwned, loggingLevel,
+	                  writeMethod, queueSize);
+
+	return (NULL == sink) ? LS_STATUS_FAILURE : sink - sinks->sinks;
+}
+
+/* API method - Description located at .h file */
+int addMemoryLogSink(LogSinks* sinks, const int size, const int loggingLevel,
+                     void (*writeMethod)()) {
+	LogSink* sink;
+
+	if (true == sinks->isStarted || MAX_LOG_SINKS <= sinks->sinksNum
+	        || size <= 0) {
+		return LS_STATUS_FAILURE;
+	}
+
+	sink = addLogSink(sinks, LOG_SINK_MEMORY, NULL, false, loggingLevel,
+	                  writeMethod, size);
+
+	return (NULL == sink) ? LS_STATUS_FAILURE : sink - sinks->sinks;
+}
+
+/* API method - Description located at .h file */
+int addSocketLogSink(LogSinks* sinks, const char* path, const bool isSeqPacket,
+                     const int loggingLevel, void (*writeMethod)(),
+                     const int queueSize, const char* spoolPath) {
+	LogSink* sink;
+	FILE* spool = NULL;
+
+	if (true == sinks->isStarted || MAX_LOG_SINKS <= sinks->sinksNum
+	        || NULL == path || strlen(path) >= sizeof(sink->addr.sun_path)
+	        || queueSize <= (int) RECORD_HEADER_SIZE) {
+		return LS_STATUS_FAILURE;
+	}
+
+	/* Records spooled by an earlier run may not have been collected yet */
+	if (NULL != spoolPath) {
+		spool = fopen(spoolPath, "a");
+		if (NULL == spool) {
+			return LS_STATUS_FAILURE;
+		}
+	}
+
+	sink = addLogSink(sinks, LOG_SINK_SOCKET, NULL, false, loggingLevel,
+	                  writeMethod, queueSize);
+	if (NULL == sink) {
+		if (NULL != spool) {
+			fclose(spool);
+		}
+		return LS_STATUS_FAILURE;
+	}
+
+	sink->addr.sun_family = AF_UNIX;
+	strcpy(sink->addr.sun_path, path);
+	sink->socketType = (true == isSeqPacket) ? SOCK_SEQPACKET : SOCK_STREAM;
+	sink->spool = spool;
+
+	return sink - sinks->sinks;
+}
+
+/**
+ * Adds a sink
+ * @param sinks The relevant LogSinks
+ * @param type The type of the sink (one of 'LogSinkTypes')
+ * @param stream The stream to write to (NULL unless it's a stream sink)
+ * @param isOwned Whether the stream is closed when the sinks are destroyed
+ * @param loggingLevel Records of this level or a more severe one are written to the sink
+ * @param writeMethod A pointer to a method that writes a message to a file
+ * @param size Size of the sink's queue or ring, or 0 for a synchronous sink
+ * @return The added sink, or NULL on failure
+ */
+static LogSink* addLogSink(LogSinks* sinks, const int type, FILE* stream,
+                           const bool isOwned, const int loggingLevel,
+                           void (*writeMethod)(), const size_t size) {
+	LogSink* sink;
+
+	if (NULL == writeMethod || loggingLevel < LOG_LEVEL_NONE
+	        || loggingLevel > LOG_LEVEL_TRACE) {
+		return NULL;
+	}
+
+	sink = &sinks->sinks[sinks->sinksNum];
+	memset(sink, 0, sizeof(*sink));
+	if (0 != size) {
+		//TODO: think if malloc failures need to be handled
+		sink->buf = malloc(size);
+		if (NULL == sink->buf) {
+			return NULL;
+		}
+	}
+
+	sink->type = type;
+	sink->loggingLevel = loggingLevel;
+	sink->writeMethod = writeMethod;
+	sink->stream = stream;
+	sink->fd = -1;
+	sink->isOwned = isOwned;
+	sink->size = size;
+	pthread_mutex_init(&sink->lock, NULL);
+	pthread_cond_init(&sink->cond, NULL);
+	++sinks->sinksNum;
+
+	return sink;
+}
+
+/* API method - Description located at .h file */
+void startLogSinks(LogSinks* sinks, FILE* stream, void (*writeMethod)()) {
+	int i;
+
+	/* Room for the main sink is left past the other sinks */
+	addLogSink(sinks, LOG_SINK_STREAM, stream, false, LOG_LEVEL_TRACE,
+	           writeMethod, 0);
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+
+		if (LOG_SINK_MEMORY == sink->type || NULL == sink->buf) {
+			continue;
+		}
+
+		sink->isThreadStarted = (0
+		        == pthread_create(&sink->thread, NULL, runLogSink, sink));
+		if (false == sink->isThreadStarted && LOG_SINK_STREAM == sink->type) {
+			free(sink->buf);
+			sink->buf = NULL;
+			sink->size = 0;
+		} else if (false == sink->isThreadStarted) {
+			/* Nothing but its thread writes to a socket */
+			sink->loggingLevel = LOG_LEVEL_NONE;
+		}
+	}
+
+	initFormats(sinks);
+	sinks->isStarted = true;
+}
+
+/**
+ * Groups the sinks by their write method - a record is formatted once for all sinks of a format,
+ * unless it's the format of a single synchronous sink, which is written to directly
+ * @param sinks The relevant LogSinks
+ */
+static void initFormats(LogSinks* sinks) {
+	int i;
+	int j;
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+
+		for (j = 0; j < sinks->formatsNum; ++j) {
+			if (sink->writeMethod == sinks->formats[j].writeMethod) {
+				break;
+			}
+		}
+
+		if (j == sinks->formatsNum) {
+			sinks->formats[j].writeMethod = sink->writeMethod;
+			++sinks->formatsNum;
+		}
+
+		sink->formatIndex = j;
+		++sinks->formats[j].sinksNum;
+	}
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+
+		sink->isDirect = (LOG_SINK_STREAM == sink->type && NULL == sink->buf
+		        && 1 == sinks->formats[sink->formatIndex].sinksNum);
+	}
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+
+		if (false == sink->isDirect) {
+			sinks->formats[sink->formatIndex].isFormatted = true;
+		}
+	}
+}
+
+/**
+ * Returns the format buffers of the calling thread, creating them on its first record
+ * @param sinks The relevant LogSinks
+ * @return The format buffers of the calling thread, or NULL if they couldn't be created
+ */
+static LogFormatBuffers* getFormatBuffers(LogSinks* sinks) {
+	LogFormatBuffers* formatBuffers;
+	int i;
+
+	if (false == sinks->isFormatBuffersKeyCreated) {
+		return NULL;
+	}
+
+	formatBuffers = pthread_getspecific(sinks->formatBuffersKey);
+	if (NULL != formatBuffers) {
+		return formatBuffers;
+	}
+
+	//TODO: think if malloc failures need to be handled
+	formatBuffers = calloc(1, sizeof(*formatBuffers));
+	if (NULL == formatBuffers) {
+		return NULL;
+	}
+
+	formatBuffers->sinks = sinks;
+	for (i = 0; i < sinks->formatsNum; ++i) {
+		if (true == sinks->formats[i].isFormatted) {
+			//TODO: think if malloc failures need to be handled
+			formatBuffers->streams[i] = open_memstream(&formatBuffers->bufs[i],
+			                                           &formatBuffers->lens[i]);
+		}
+	}
+
+	pthread_mutex_lock(&sinks->lock); /* Lock */
+	{
+		formatBuffers->next = sinks->formatBuffers;
+		if (NULL != sinks->formatBuffers) {
+			sinks->formatBuffers->prev = formatBuffers;
+		}
+		sinks->formatBuffers = formatBuffers;
+	}
+	pthread_mutex_unlock(&sinks->lock); /* Unlock */
+
+	pthread_setspecific(sinks->formatBuffersKey, formatBuffers);
+
+	return formatBuffers;
+}
+
+/**
+ * Releases the format buffers of a thread (called when the thread exits)
+ * @param formatBuffersArg The format buffers to release
+ */
+static void freeFormatBuffers(void* formatBuffersArg) {
+	LogFormatBuffers* formatBuffers = formatBuffersArg;
+	LogSinks* sinks = formatBuffers->sinks;
+	int i;
+
+	pthread_mutex_lock(&sinks->lock); /* Lock */
+	{
+		if (NULL != formatBuffers->prev) {
+			formatBuffers->prev->next = formatBuffers->next;
+		} else {
+			sinks->formatBuffers = formatBuffers->next;
+		}
+
+		if (NULL != formatBuffers->next) {
+			formatBuffers->next->prev = formatBuffers->prev;
+		}
+	}
+	pthread_mutex_unlock(&sinks->lock); /* Unlock */
+
+	for (i = 0; i < sinks->formatsNum; ++i) {
+		if (NULL != formatBuffers->streams[i]) {
+			fclose(formatBuffers->streams[i]);
+		}
+
+		free(formatBuffers->bufs[i]);
+	}
+
+	free(formatBuffers);
+}
+
+/* API method - Description located at .h file */
+void writeToLogSinks(LogSinks* sinks, const MessageData* md) {
+	LogFormatBuffers* formatBuffers = NULL;
+	bool isFormatted[MAX_LOG_SINKS + 1] = { false };
+	FILE* stream;
+	int i;
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+		int formatIndex = sink->formatIndex;
+
+		if (md->logLevel > sink->loggingLevel) {
+			continue;
+		}
+
+		/* The stream's own lock keeps the record whole if the write method writes it in pieces */
+		if (true == sink->isDirect) {
+			flockfile(sink->stream);
+			sink->writeMethod(md, sink->stream);
+			funlockfile(sink->stream);
+			continue;
+		}
+
+		if (NULL == formatBuffers) {
+			formatBuffers = getFormatBuffers(sinks);
+		}
+
+		if (NULL == formatBuffers || NULL == formatBuffers->streams[formatIndex]) {
+			continue;
+		}
+
+		/* The stream is rewound rather than truncated - once flushed, its length is that of the
+		 * last record */
+		stream = formatBuffers->streams[formatIndex];
+		if (false == isFormatted[formatIndex]) {
+			rewind(stream);
+			sink->writeMethod(md, stream);
+			fflush(stream);
+			isFormatted[formatIndex] = true;
+		}
+
+		if (LOG_SINK_MEMORY == sink->type) {
+			writeToMemory(sink, formatBuffers->bufs[formatIndex],
+			              formatBuffers->lens[formatIndex]);
+		} else if (NULL != sink->buf) {
+			enqueueRecord(sink, formatBuffers->bufs[formatIndex],
+			              formatBuffers->lens[formatIndex]);
+		} else {
+			fwrite(formatBuffers->bufs[formatIndex], 1,
+			       formatBuffers->lens[formatIndex], sink->stream);
+		}
+	}
+}
+
+/**
+ * Adds a record to the queue of a sink (preceded by its length if it's a socket sink), or drops it
+ * if the queue is full
+ * @param sink The relevant sink
+ * @param record The formatted record
+ * @param len Length of the record
+ */
+static void enqueueRecord(LogSink* sink, const char* record, size_t len) {
+	size_t headerLen = (LOG_SINK_SOCKET == sink->type) ? RECORD_HEADER_SIZE : 0;
+	uint32_t recordLen = len;
+
+	if (0 == len) {
+		return;
+	}
+
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		if (sink->size - (sink->head - sink->tail) < headerLen + len) {
+			++sink->dropsNum;
+		} else {
+			copyToRing(sink->buf, sink->size, sink->head, (char*) &recordLen,
+			           headerLen);
+			copyToRing(sink->buf, sink->size, sink->head + headerLen, record,
+			           len);
+			sink->head += headerLen + len;
+			pthread_cond_signal(&sink->cond);
+		}
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+}
+
+/**
+ * Adds a record to the ring of a memory sink, overwriting the oldest bytes
+ * @param sink The relevant sink
+ * @param record The formatted record
+ * @param len Length of the record
+ */
+static void writeToMemory(LogSink* sink, const char* record, size_t len) {
+	size_t skippedLen = 0;
+
+	/* Only the end of a record longer than the ring is kept */
+	if (len > sink->size) {
+		skippedLen = len - sink->size;
+		record += skippedLen;
+		len = sink->size;
+	}
+
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		copyToRing(sink->buf, sink->size, sink->head + skippedLen, record, len);
+		sink->head += skippedLen + len;
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+}
+
+/**
+ * The routine of the thread of a queued sink - writes the queue to the stream (flushing it whenever
+ * the queue is emptied) or sends it to the socket
+ * @param sinkArg The relevant sink
+ * @return NULL
+ */
+static void* runLogSink(void* sinkArg) {
+	LogSink* sink = sinkArg;
+	size_t tail;
+	size_t head;
+	size_t writtenLen;
+
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		while (true) {
+			while (sink->head == sink->tail && false == sink->isStopping) {
+				pthread_cond_wait(&sink->cond, &sink->lock);
+			}
+
+			if (sink->head == sink->tail) {
+				break;
+			}
+
+			/* Writers only add bytes past the head, so the bytes up to it are written without
+			 * the lock */
+			tail = sink->tail;
+			head = sink->head;
+			pthread_mutex_unlock(&sink->lock); /* Unlock */
+			if (LOG_SINK_SOCKET == sink->type) {
+				writtenLen = writeQueueToSocket(sink, tail, head);
+			} else {
+				writtenLen = writeQueueToStream(sink, tail, head);
+			}
+			pthread_mutex_lock(&sink->lock); /* Lock */
+
+			sink->tail = tail + writtenLen;
+			if (LOG_SINK_STREAM == sink->type && sink->head == sink->tail) {
+				pthread_mutex_unlock(&sink->lock); /* Unlock */
+				fflush(sink->stream);
+				pthread_mutex_lock(&sink->lock); /* Lock */
+			}
+		}
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+
+	return NULL;
+}
+
+/**
+ * Writes the queue of a stream sink (up to the end of the queue's buffer)
+ * @param sink The relevant sink
+ * @param tail Position of the first byte to write
+ * @param head Position past the last byte to write
+ * @return Number of bytes taken from the queue
+ */
+static size_t writeQueueToStream(LogSink* sink, const size_t tail,
+                                 const size_t head) {
+	struct iovec iov[2];
+
+	setRingIovecs(sink, tail, head - tail, iov);
+	fwrite(iov[0].iov_base, 1, iov[0].iov_len, sink->stream);
+
+	return iov[0].iov_len;
+}
+
+/**
+ * Sends a batch of records from the queue of a socket sink with a single non-blocking send -
+ * whole records are gathered straight from the queue (without their lengths). While the agent
+ * doesn't take them, the records are waited for briefly as long as the queue is less than half
+ * full, and are spooled (or dropped) otherwise. Records are spooled (or dropped) while the agent
+ * is disconnected as well
+ * @param sink The relevant sink
+ * @param tail Position of the first record
+ * @param head Position past the last record
+ * @return Number of bytes taken from the queue
+ */
+static size_t writeQueueToSocket(LogSink* sink, const size_t tail,
+                                 const size_t head) {
+	struct iovec iov[SOCKET_SINK_IOV_NUM];
+	struct msghdr msg;
+	struct pollfd pfd;
+	size_t pos;
+	size_t skipLen;
+	size_t batchLen = 0;
+	uint32_t recordLen;
+	ssize_t sentLen;
+	int iovNum = 0;
+
+	if (-1 == sink->fd) {
+		connectSocketSink(sink);
+		if (-1 == sink->fd) {
+			return spoolQueue(sink, tail, head);
+		}
+	}
+
+	/* A record may wrap around the end of the queue, taking 2 pieces. The oldest record is sent
+	 * past the part an earlier send took */
+	skipLen = sink->sentLen;
+	for (pos = tail; pos < head && iovNum + 2 <= SOCKET_SINK_IOV_NUM;
+	        pos += RECORD_HEADER_SIZE + recordLen) {
+		recordLen = getRecordLen(sink, pos);
+		if (0 != iovNum && batchLen + recordLen > SOCKET_SINK_BATCH_SIZE) {
+			break;
+		}
+
+		iovNum += setRingIovecs(sink, pos + RECORD_HEADER_SIZE + skipLen,
+		                        recordLen - skipLen, &iov[iovNum]);
+		batchLen += recordLen - skipLen;
+		skipLen = 0;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovNum;
+	sentLen = sendmsg(sink->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (0 <= sentLen) {
+		return consumeSentRecords(sink, tail, sentLen);
+	}
+
+	if (EINTR == errno) {
+		return 0;
+	}
+
+	if (EAGAIN == errno || EWOULDBLOCK == errno) {
+		/* Part of the oldest record was sent, so the rest of it must follow it (unless the
+		 * connection is given up on) */
+		if (false == __atomic_load_n(&sink->isStopping, __ATOMIC_RELAXED)
+		        && (head - tail < sink->size / 2 || 0 != sink->sentLen)) {
+			pfd.fd = sink->fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, SOCKET_SINK_POLL_MSEC);
+			return 0;
+		}
+
+		if (0 == sink->sentLen) {
+			return spoolQueue(sink, tail, head);
+		}
+	} else if (EMSGSIZE == errno) {
+		/* The oldest record doesn't fit a packet of its own */
+		countDrops(sink, 1);
+		return RECORD_HEADER_SIZE + getRecordLen(sink, tail);
+	}
+
+	/* The connection is lost (or given up on) - the agent discards a partially sent record */
+	close(sink->fd);
+	sink->fd = -1;
+	sink->sentLen = 0;
+
+	return spoolQueue(sink, tail, head);
+}
+
+/**
+ * Takes the records a send took from the queue of a socket sink, and keeps how much of the
+ * (new) oldest record it took
+ * @param sink The relevant sink
+ * @param tail Position of the first record
+ * @param sentLen Number of bytes the send took
+ * @return Number of bytes of whole records taken from the queue
+ */
+static size_t consumeSentRecords(LogSink* sink, const size_t tail,
+                                 size_t sentLen) {
+	size_t pos = tail;
+	uint32_t recordLen;
+
+	while (0 != sentLen) {
+		recordLen = getRecordLen(sink, pos);
+		if (sentLen < recordLen - sink->sentLen) {
+			sink->sentLen += sentLen;
+			break;
+		}
+
+		sentLen -= recordLen - sink->sentLen;
+		sink->sentLen = 0;
+		pos += RECORD_HEADER_SIZE + recordLen;
+	}
+
+	return pos - tail;
+}
+
+/**
+ * Writes the records at the queue of a socket sink to its spool file, or drops them if it has no
+ * spool file
+ * @param sink The relevant sink
+ * @param tail Position of the first record
+ * @param head Position past the last record
+ * @return Number of bytes taken from the queue
+ */
+static size_t spoolQueue(LogSink* sink, const size_t tail, const size_t head) {
+	struct iovec iov[2];
+	size_t pos;
+	uint32_t recordLen;
+	int recordsNum = 0;
+	int i;
+
+	for (pos = tail; pos < head; pos += RECORD_HEADER_SIZE + recordLen) {
+		recordLen = getRecordLen(sink, pos);
+		if (NULL != sink->spool) {
+			for (i = 0; i < setRingIovecs(sink, pos + RECORD_HEADER_SIZE, recordLen, iov);
+			        ++i) {
+				fwrite(iov[i].iov_base, 1, iov[i].iov_len, sink->spool);
+			}
+		}
+		++recordsNum;
+	}
+
+	if (NULL != sink->spool) {
+		fflush(sink->spool);
+	} else {
+		countDrops(sink, recordsNum);
+	}
+
+	return head - tail;
+}
+
+/**
+ * Connects the non-blocking socket of a socket sink to the agent, unless the previous attempt was
+ * too recent
+ * @param sink The relevant sink
+ */
+static void connectSocketSink(LogSink* sink) {
+	long long nowMsec = getMonotonicTimeMsec();
+	int fd;
+
+	if (nowMsec < sink->nextConnectMsec) {
+		return;
+	}
+
+	sink->nextConnectMsec = nowMsec + SOCKET_SINK_RECONNECT_MSEC;
+	fd = socket(AF_UNIX, sink->socketType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (-1 == fd) {
+		return;
+	}
+
+	if (0 != connect(fd, (struct sockaddr*) &sink->addr, sizeof(sink->addr))) {
+		close(fd);
+		return;
+	}
+
+	sink->fd = fd;
+}
+
+/* API method - Description located at .h file */
+void flushLogSinks(LogSinks* sinks) {
+	int i;
+
+	if (NULL == sinks) {
+		return;
+	}
+
+	/* Each flush takes the stream's own lock */
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		if (LOG_SINK_STREAM == sinks->sinks[i].type
+		        && NULL == sinks->sinks[i].buf) {
+			fflush(sinks->sinks[i].stream);
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+int readMemoryLogSink(LogSinks* sinks, const int sinkId, char* buf,
+                      const int len) {
+	LogSink* sink;
+	size_t readLen;
+
+	if (sinkId < 0 || sinkId >= sinks->sinksNum || len < 0
+	        || LOG_SINK_MEMORY != sinks->sinks[sinkId].type) {
+		return LS_STATUS_FAILURE;
+	}
+
+	sink = &sinks->sinks[sinkId];
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		readLen = (sink->head < sink->size) ? sink->head : sink->size;
+		readLen = (readLen < (size_t) len) ? readLen : (size_t) len;
+		copyFromRing(sink->buf, sink->size, sink->head - readLen, buf, readLen);
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+
+	return readLen;
+}
+
+/* API method - Description located at .h file */
+int getLogSinkDrops(LogSinks* sinks, const int sinkId,
+                    unsigned long long* dropsNum) {
+	LogSink* sink;
+
+	if (sinkId < 0 || sinkId >= sinks->sinksNum) {
+		return LS_STATUS_FAILURE;
+	}
+
+	sink = &sinks->sinks[sinkId];
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		*dropsNum = sink->dropsNum;
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+
+	return LS_STATUS_SUCCESS;
+}
+
+/* API method - Description located at .h file */
+void logSinksDestroy(LogSinks* sinks) {
+	int i;
+
+	if (NULL == sinks) {
+		return;
+	}
+
+	for (i = 0; i < sinks->sinksNum; ++i) {
+		LogSink* sink = &sinks->sinks[i];
+
+		if (true == sink->isThreadStarted) {
+			pthread_mutex_lock(&sink->lock); /* Lock */
+			{
+				__atomic_store_n(&sink->isStopping, true, __ATOMIC_RELAXED);
+				pthread_cond_signal(&sink->cond);
+			}
+			pthread_mutex_unlock(&sink->lock); /* Unlock */
+			pthread_join(sink->thread, NULL);
+		}
+
+		if (true == sink->isOwned) {
+			fclose(sink->stream);
+		}
+
+		if (-1 != sink->fd) {
+			close(sink->fd);
+		}
+
+		if (NULL != sink->spool) {
+			fclose(sink->spool);
+		}
+
+		free(sink->buf);
+		pthread_cond_destroy(&sink->cond);
+		pthread_mutex_destroy(&sink->lock);
+	}
+
+	/* The format buffers of threads that are still alive */
+	if (true == sinks->isFormatBuffersKeyCreated) {
+		pthread_key_delete(sinks->formatBuffersKey);
+	}
+
+	while (NULL != sinks->formatBuffers) {
+		freeFormatBuffers(sinks->formatBuffers);
+	}
+
+	pthread_mutex_destroy(&sinks->lock);
+	free(sinks);
+}
+
+/**
+ * Copies bytes into a ring, wrapping around its end
+ * @param ring The ring
+ * @param size Size of the ring
+ * @param pos Position (not wrapped) to copy to
+ * @param src The bytes to copy
+ * @param len Number of bytes to copy (at most the size of the ring)
+ */
+static void copyToRing(char* ring, const size_t size, const size_t pos,
+                       const char* src, const size_t len) {
+	size_t offset = pos % size;
+	size_t firstLen = (len < size - offset) ? len : size - offset;
+
+	memcpy(ring + offset, src, firstLen);
+	memcpy(ring, src + firstLen, len - firstLen);
+}
+
+/**
+ * Copies bytes out of a ring, wrapping around its end
+ * @param ring The ring
+ * @param size Size of the ring
+ * @param pos Position (not wrapped) to copy from
+ * @param dst The buffer to copy to
+ * @param len Number of bytes to copy (at most the size of the ring)
+ */
+static void copyFromRing(const char* ring, const size_t size, const size_t pos,
+                         char* dst, const size_t len) {
+	size_t offset = pos % size;
+	size_t firstLen = (len < size - offset) ? len : size - offset;
+
+	memcpy(dst, ring + offset, firstLen);
+	memcpy(dst + firstLen, ring, len - firstLen);
+}
+
+/**
+ * Sets the pieces (1, or 2 if it wraps around the end of the queue) of a range of the queue of a
+ * sink
+ * @param sink The relevant sink
+ * @param pos Position (not wrapped) of the range
+ * @param len Length of the range
+ * @param iov The pieces of the range (output)
+ * @return Number of pieces
+ */
+static inline int setRingIovecs(const LogSink* sink, const size_t pos,
+                                const size_t len, struct iovec* iov) {
+	size_t offset = pos % sink->size;
+	size_t firstLen = (len < sink->size - offset) ? len : sink->size - offset;
+
+	iov[0].iov_base = sink->buf + offset;
+	iov[0].iov_len = firstLen;
+	if (firstLen == len) {
+		return 1;
+	}
+
+	iov[1].iov_base = sink->buf;
+	iov[1].iov_len = len - firstLen;
+
+	return 2;
+}
+
+/**
+ * Returns the length of a record at the queue of a socket sink
+ * @param sink The relevant sink
+ * @param pos Position (not wrapped) of the record's length
+ * @return The length of the record
+ */
+static inline uint32_t getRecordLen(const LogSink* sink, const size_t pos) {
+	uint32_t recordLen;
+
+	copyFromRing(sink->buf, sink->size, pos, (char*) &recordLen,
+	             RECORD_HEADER_SIZE);
+
+	return recordLen;
+}
+
+/**
+ * Counts records a sink dropped
+ * @param sink The relevant sink
+ * @param dropsNum Number of dropped records
+ */
+static void countDrops(LogSink* sink, const int dropsNum) {
+	pthread_mutex_lock(&sink->lock); /* Lock */
+	{
+		sink->dropsNum += dropsNum;
+	}
+	pthread_mutex_unlock(&sink->lock); /* Unlock */
+}
+
+/**
+ * Returns the monotonic time in milliseconds
+ * @return The monotonic time in milliseconds
+ */
+static inline long long getMonotonicTimeMsec() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
@@ -0,0 +1,159 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file sinks.h
+ * @author Barak Sason Rofman
+ * @brief This module provides fan-out of records to several sinks (streams, files, in-memory rings
+ * and Unix domain sockets), each with its own level filter and write method. A record is formatted
+ * once per distinct write method, not once per sink. Sinks with a queue are written by a thread of
+ * their own, so a slow sink drops (or spools) records instead of stalling the others.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef SINKS_H
+#define SINKS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define MAX_LOG_SINKS 16 /* Maximum number of sinks that may be added (besides the main one) */
+
+struct LogSinks;
+struct MessageData;
+
+enum LogSinksStatusCodes {
+	LS_STATUS_FAILURE = -1, LS_STATUS_SUCCESS
+};
+
+/**
+ * Creates a new (empty) LogSinks
+ * @return The newly allocated LogSinks, or NULL on failure
+ */
+struct LogSinks* newLogSinks();
+
+/**
+ * Adds a sink that writes to a stream
+ * NOTE: Sinks may be added only before the sinks are started
+ * @param sinks The relevant LogSinks
+ * @param stream The stream to write to
+ * @param isOwned Whether the stream is closed when the sinks are destroyed
+ * @param loggingLevel Records of this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethod A pointer to a method that writes a message to a file
+ * @param queueSize Size (in bytes) of the sink's queue, or 0 to write the sink synchronously
+ * @return The id of the sink, or LS_STATUS_FAILURE on failure
+ */
+int addStreamLogSink(struct LogSinks* sinks, FILE* stream, const bool isOwned,
+                     const int loggingLevel, void (*writeMethod)(),
+                     const int queueSize);
+
+/**
+ * Adds a sink that keeps the last records written to it in memory
+ * NOTE: Sinks may be added only before the sinks are started
+ * @param sinks The relevant LogSinks
+ * @param size Size (in bytes) of the ring the records are kept in
+ * @param loggingLevel Records of this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethod A pointer to a method that writes a message to a file
+ * @return The id of the sink, or LS_STATUS_FAILURE on failure
+ */
+int addMemoryLogSink(struct LogSinks* sinks, const int size,
+                     const int loggingLevel, void (*writeMethod)());
+
+/**
+ * Adds a sink that sends records to an agent over a Unix domain socket. The sink's thread batches
+ * queued records into non-blocking sends, gathered straight from the queue - over SOCK_SEQPACKET,
+ * a packet holds one or more whole records. While the agent doesn't keep up (the queue is half
+ * full) or isn't connected, records are appended to the spool file (or dropped without one), and
+ * the connection is retried periodically
+ * NOTE: Sinks may be added only before the sinks are started
+ * @param sinks The relevant LogSinks
+ * @param path The path of the agent's socket
+ * @param isSeqPacket Whether the socket is SOCK_SEQPACKET (SOCK_STREAM otherwise)
+ * @param loggingLevel Records of this level or a more severe one are written to the sink (one of
+ * the levels at 'logLevels')
+ * @param writeMethod A pointer to a method that writes a message to a file
+ * @param queueSize Size (in bytes) of the sink's queue
+ * @param spoolPath The path of the spool file (appended to), or NULL to drop records instead
+ * @return The id of the sink, or LS_STATUS_FAILURE on failure
+ */
+int addSocketLogSink(struct LogSinks* sinks, const char* path,
+                     const bool isSeqPacket, const int loggingLevel,
+                     void (*writeMethod)(), const int queueSize,
+                     const char* spoolPath);
+
+/**
+ * Adds the main sink (which receives all records) and starts the threads of the queued sinks -
+ * a stream sink whose thread can't be started is written synchronously (a socket sink is disabled)
+ * @param sinks The relevant LogSinks
+ * @param stream The stream of the main sink (not closed when the sinks are destroyed)
+ * @param writeMethod A pointer to a method that writes a message to a file
+ */
+void startLogSinks(struct LogSinks* sinks, FILE* stream, void (*writeMethod)());
+
+/**
+ * Writes a record to all sinks whose level it passes. Each calling thread formats records into
+ * scratch streams of its own, so concurrent writers contend only on the sinks they write to
+ * NOTE: This API is thread-safe
+ * @param sinks The relevant LogSinks
+ * @param md The record to write
+ */
+void writeToLogSinks(struct LogSinks* sinks, const struct MessageData* md);
+
+/**
+ * Flushes the streams of the synchronously written sinks (queued sinks are flushed by their
+ * threads once their queue is empty)
+ * NOTE: This API is thread-safe
+ * @param sinks The relevant LogSinks (nothing is done if it's NULL)
+ */
+void flushLogSinks(struct LogSinks* sinks);
+
+/**
+ * Copies the content of a memory sink - the newest bytes that fit in the buffer (the first record
+ * may be partial)
+ * NOTE: This API is thread-safe
+ * @param sinks The relevant LogSinks
+ * @param sinkId The id of the memory sink
+ * @param buf The buffer to copy to (not terminated)
+ * @param len Length of the buffer
+ * @return Number of bytes copied, or LS_STATUS_FAILURE if the sink isn't a memory sink
+ */
+int readMemoryLogSink(struct LogSinks* sinks, const int sinkId, char* buf,
+                      const int len);
+
+/**
+ * Returns the number of records a sink dropped since its queue was full (or, for a socket sink
+ * without a spool file, since the agent couldn't take them)
+ * NOTE: This API is thread-safe
+ * @param sinks The relevant LogSinks
+ * @param sinkId The id of the sink
+ * @param dropsNum The number of dropped records (output)
+ * @return LS_STATUS_SUCCESS on success, LS_STATUS_FAILURE if there's no such sink
+ */
+int getLogSinkDrops(struct LogSinks* sinks, const int sinkId,
+                    unsigned long long* dropsNum);
+
+/**
+ * Drains the queues of the sinks, stops their threads and releases all resources associated with
+ * the given LogSinks (owned streams are closed)
+ * @param sinks The LogSinks to destroy (nothing is done if it's NULL)
+ */
+void logSinksDestroy(struct LogSinks* sinks);
+
+#endif /* SINKS_H */
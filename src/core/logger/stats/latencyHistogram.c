@@ -0,0 +1,212 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file latencyHistogram.c
+ * @author Barak Sason Rofman
+ * @brief This module provides a log-linear (HDR-style) latency histogram.
+ * Values are grouped by powers of 2, and each power of 2 is split into equally sized sub-buckets,
+ * so the relative error of a recorded value is bounded (about 3%) across the whole range
+ * (nanoseconds up to ~18 minutes). Recording is lock-free and may be done by any thread.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "latencyHistogram.h"
+
+#define SUB_BUCKETS_BITS 5 /* Each power of 2 is split into 2^SUB_BUCKETS_BITS sub-buckets */
+#define SUB_BUCKETS_NUM (1 << SUB_BUCKETS_BITS)
+#define MAX_VALUE_BITS 40 /* Larger values are recorded as the maximal value */
+#define BUCKETS_NUM ((MAX_VALUE_BITS - SUB_BUCKETS_BITS + 1) * SUB_BUCKETS_NUM)
+
+typedef struct LatencyHistogram {
+	/** Number of recorded values per bucket */
+	unsigned long long counts[BUCKETS_NUM];
+	/** Total number of recorded values */
+	unsigned long long count;
+	/** Sum of all recorded values */
+	unsigned long long sum;
+	/** Maximal recorded value */
+	unsigned long long max;
+} LatencyHistogram;
+
+static inline int getBucketIndex(const unsigned long long value);
+static inline unsigned long long getBucketHighestValue(const int index);
+static unsigned long long getPercentile(LatencyHistogram* lh,
+                                        const double percentile);
+
+/* API method - Description located at .h file */
+LatencyHistogram* newLatencyHistogram() {
+	//TODO: think if malloc failures need to be handled
+	return calloc(1, sizeof(LatencyHistogram));
+}
+
+/* API method - Description located at .h file */
+void recordLatency(LatencyHistogram* lh, long long valueNsec) {
+	unsigned long long value;
+	unsigned long long curMax;
+
+	value = (0 > valueNsec) ? 0 : valueNsec;
+
+	__atomic_fetch_add(&lh->counts[getBucketIndex(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&lh->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&lh->sum, value, __ATOMIC_RELAXED);
+
+	curMax = __atomic_load_n(&lh->max, __ATOMIC_RELAXED);
+	while (value > curMax
+	        && false
+	                == __atomic_compare_exchange_n(&lh->max, &curMax, value,
+	                                               false, __ATOMIC_RELAXED,
+	                                               __ATOMIC_RELAXED)) {
+	}
+}
+
+/* API method - Description located at .h file */
+void mergeLatencyHistogram(LatencyHistogram* dst, LatencyHistogram* src) {
+	unsigned long long srcMax;
+	int i;
+
+	for (i = 0; i < BUCKETS_NUM; ++i) {
+		dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+	}
+
+	dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+	dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+
+	srcMax = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+	if (srcMax > dst->max) {
+		dst->max = srcMax;
+	}
+}
+
+/* API method - Description located at .h file */
+void getLatencyHistogramSummary(LatencyHistogram* lh, LatencySummary* summary) {
+	summary->count = __atomic_load_n(&lh->count, __ATOMIC_RELAXED);
+	summary->meanNsec =
+	        (0 == summary->count) ?
+	                0 : __atomic_load_n(&lh->sum, __ATOMIC_RELAXED) / summary->count;
+	summary->p50Nsec = getPercentile(lh, 50.0);
+	summary->p90Nsec = getPercentile(lh, 90.0);
+	summary->p99Nsec = getPercentile(lh, 99.0);
+	summary->p999Nsec = getPercentile(lh, 99.9);
+	summary->maxNsec = __atomic_load_n(&lh->max, __ATOMIC_RELAXED);
+}
+
+/* API method - Description located at .h file */
+void resetLatencyHistogram(LatencyHistogram* lh) {
+	int i;
+
+	for (i = 0; i < BUCKETS_NUM; ++i) {
+		__atomic_store_n(&lh->counts[i], 0, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&lh->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&lh->sum, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&lh->max, 0, __ATOMIC_RELAXED);
+}
+
+/* API method - Description located at .h file */
+void latencyHistogramDestroy(LatencyHistogram* lh) {
+	free(lh);
+}
+
+/**
+ * Returns the index of the bucket a value belongs to
+ * @param value The value
+ * @return The index of the bucket the value belongs to
+ */
+static inline int getBucketIndex(const unsigned long long value) {
+	unsigned long long clampedValue;
+	int msb;
+
+	/* Small values are recorded exactly */
+	if (value < SUB_BUCKETS_NUM) {
+		return value;
+	}
+
+	clampedValue =
+	        (value >> MAX_VALUE_BITS) ? (1ULL << MAX_VALUE_BITS) - 1 : value;
+	msb = 63 - __builtin_clzll(clampedValue);
+
+	/* The group of the power of 2 and the position within it (the bits below the MSB) */
+	return (msb - SUB_BUCKETS_BITS + 1) * SUB_BUCKETS_NUM
+	        + (int) ((clampedValue >> (msb - SUB_BUCKETS_BITS)) - SUB_BUCKETS_NUM);
+}
+
+/**
+ * Returns the highest value that belongs to a bucket
+ * @param index The index of the bucket
+ * @return The highest value that belongs to the bucket
+ */
+static inline unsigned long long getBucketHighestValue(const int index) {
+	int group = index / SUB_BUCKETS_NUM;
+	int subBucket = index % SUB_BUCKETS_NUM;
+
+	if (0 == group) {
+		return subBucket;
+	}
+
+	return ((unsigned long long) (SUB_BUCKETS_NUM + subBucket + 1) << (group - 1))
+	        - 1;
+}
+
+/**
+ * Returns the value at a given percentile of the recorded values
+ * @param lh The relevant LatencyHistogram
+ * @param percentile The percentile (0-100)
+ * @return The value at the percentile (the highest value of its bucket, bounded by the maximal
+ * recorded value), or 0 if no values were recorded
+ */
+static unsigned long long getPercentile(LatencyHistogram* lh,
+                                        const double percentile) {
+	unsigned long long total = 0;
+	unsigned long long target;
+	unsigned long long counts[BUCKETS_NUM];
+	unsigned long long max;
+	int i;
+
+	/* Take a snapshot, as values may be recorded meanwhile */
+	for (i = 0; i < BUCKETS_NUM; ++i) {
+		counts[i] = __atomic_load_n(&lh->counts[i], __ATOMIC_RELAXED);
+		total += counts[i];
+	}
+
+	if (0 == total) {
+		return 0;
+	}
+
+	max = __atomic_load_n(&lh->max, __ATOMIC_RELAXED);
+	target = (unsigned long long) (percentile / 100.0 * total + 0.5);
+	if (0 == target) {
+		target = 1;
+	}
+
+	total = 0;
+	for (i = 0; i < BUCKETS_NUM; ++i) {
+		total += counts[i];
+		if (total >= target) {
+			unsigned long long value = getBucketHighestValue(i);
+
+			return (value < max) ? value : max;
+		}
+	}
+
+	return max;
+}
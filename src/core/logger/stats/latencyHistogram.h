@@ -0,0 +1,77 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file latencyHistogram.h
+ * @author Barak Sason Rofman
+ * @brief This module provides a log-linear (HDR-style) latency histogram.
+ * Values are grouped by powers of 2, and each power of 2 is split into equally sized sub-buckets,
+ * so the relative error of a recorded value is bounded (about 3%) across the whole range
+ * (nanoseconds up to ~18 minutes). Recording is lock-free and may be done by any thread.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include "../../api/logger.h"
+
+struct LatencyHistogram;
+
+/**
+ * Creates a new, empty LatencyHistogram
+ * @return The newly allocated LatencyHistogram (or NULL on allocation failure)
+ */
+struct LatencyHistogram* newLatencyHistogram();
+
+/**
+ * Record a value
+ * @param lh The LatencyHistogram to record the value at
+ * @param valueNsec The value, in nanoseconds (negative values are recorded as 0)
+ */
+void recordLatency(struct LatencyHistogram* lh, long long valueNsec);
+
+/**
+ * Add all values recorded at a LatencyHistogram to another LatencyHistogram
+ * @param dst The LatencyHistogram to add the values to
+ * @param src The LatencyHistogram to take the values from
+ */
+void mergeLatencyHistogram(struct LatencyHistogram* dst,
+                           struct LatencyHistogram* src);
+
+/**
+ * Summarize the values recorded at a LatencyHistogram
+ * @param lh The relevant LatencyHistogram
+ * @param summary The LatencySummary to fill
+ */
+void getLatencyHistogramSummary(struct LatencyHistogram* lh,
+                                LatencySummary* summary);
+
+/**
+ * Discard all values recorded at a LatencyHistogram
+ * @param lh The LatencyHistogram to reset
+ */
+void resetLatencyHistogram(struct LatencyHistogram* lh);
+
+/**
+ * Releases all resources associated with a given LatencyHistogram
+ * @param lh The LatencyHistogram to destroy
+ */
+void latencyHistogramDestroy(struct LatencyHistogram* lh);
+
+#endif /* LATENCYHISTOGRAM_H */
@@ -0,0 +1,128 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file threadStats.c
+ * @author Barak Sason Rofman
+ * @brief This module provides per-thread statistics counters.
+ * Each thread updates its own block of counters (no atomic read-modify-write, no sharing), while
+ * readers aggregate all blocks without locking. Blocks are never freed while the logger is
+ * active - a block released by a thread is adopted by the next thread that acquires one, so
+ * aggregated counters never decrease.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "threadStats.h"
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct ThreadStats {
+	/** The counters - written only by the owner thread, read by anyone */
+	unsigned long long counters[TS_COUNTERS_NUM];
+	/** Whether this block is currently owned by a thread */
+	atomic_bool isOwned;
+	/** The next block in the list of all blocks */
+	struct ThreadStats* next;
+} __attribute__((aligned(CACHE_LINE_SIZE))) ThreadStats;
+
+static ThreadStats* threadStatsHead; /* All blocks, new blocks are pushed to the head */
+
+/* API method - Description located at .h file */
+ThreadStats* acquireThreadStats() {
+	ThreadStats* ts;
+
+	/* Adopt a released block if there is one */
+	for (ts = __atomic_load_n(&threadStatsHead, __ATOMIC_SEQ_CST); NULL != ts;
+	        ts = ts->next) {
+		bool isOwnedLoc = false;
+
+		if (true
+		        == __atomic_compare_exchange_n(&ts->isOwned, &isOwnedLoc, true,
+		                                       false, __ATOMIC_SEQ_CST,
+		                                       __ATOMIC_SEQ_CST)) {
+			return ts;
+		}
+	}
+
+	/* Blocks are cache line aligned so different threads' counters never share a line */
+	ts = aligned_alloc(CACHE_LINE_SIZE, sizeof(*ts));
+	if (NULL != ts) {
+		memset(ts, 0, sizeof(*ts));
+		__atomic_store_n(&ts->isOwned, true, __ATOMIC_SEQ_CST);
+
+		ts->next = __atomic_load_n(&threadStatsHead, __ATOMIC_SEQ_CST);
+		while (false
+		        == __atomic_compare_exchange_n(&threadStatsHead, &ts->next, ts,
+		                                       false, __ATOMIC_SEQ_CST,
+		                                       __ATOMIC_SEQ_CST)) {
+		}
+	}
+
+	return ts;
+}
+
+/* API method - Description located at .h file */
+void releaseThreadStats(ThreadStats* ts) {
+	if (NULL != ts) {
+		__atomic_store_n(&ts->isOwned, false, __ATOMIC_SEQ_CST);
+	}
+}
+
+/* API method - Description located at .h file */
+void addThreadStat(ThreadStats* ts, const int counter,
+                   const unsigned long long value) {
+	/* Only the owner writes, so a relaxed load and store suffice (readers may see a slightly
+	 * stale value, but never a torn one) */
+	__atomic_store_n(
+	        &ts->counters[counter],
+	        __atomic_load_n(&ts->counters[counter], __ATOMIC_RELAXED) + value,
+	        __ATOMIC_RELAXED);
+}
+
+/* API method - Description located at .h file */
+void sumThreadStats(unsigned long long* sums) {
+	ThreadStats* ts;
+	int i;
+
+	memset(sums, 0, TS_COUNTERS_NUM * sizeof(*sums));
+
+	for (ts = __atomic_load_n(&threadStatsHead, __ATOMIC_SEQ_CST); NULL != ts;
+	        ts = ts->next) {
+		for (i = 0; i < TS_COUNTERS_NUM; ++i) {
+			sums[i] += __atomic_load_n(&ts->counters[i], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+void destroyThreadStats() {
+	ThreadStats* ts;
+
+	ts = __atomic_exchange_n(&threadStatsHead, NULL, __ATOMIC_SEQ_CST);
+	while (NULL != ts) {
+		ThreadStats* next = ts->next;
+
+		free(ts);
+		ts = next;
+	}
+}
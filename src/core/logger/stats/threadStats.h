@@ -0,0 +1,82 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file threadStats.h
+ * @author Barak Sason Rofman
+ * @brief This module provides per-thread statistics counters.
+ * Each thread updates its own block of counters (no atomic read-modify-write, no sharing), while
+ * readers aggregate all blocks without locking. Blocks are never freed while the logger is
+ * active - a block released by a thread is adopted by the next thread that acquires one, so
+ * aggregated counters never decrease.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef THREADSTATS_H
+#define THREADSTATS_H
+
+#include "../../api/logger.h"
+
+enum ThreadStatsCounters {
+	TS_MESSAGES, /* Messages written, one counter per logging method */
+	TS_BYTES = TS_MESSAGES + LM_METHODS_NUM, /* Message bytes written, one per logging method */
+	TS_DROPS = TS_BYTES + LM_METHODS_NUM, /* Messages that were dropped */
+	TS_DUPLICATES, /* Duplicate messages suppressed by the logger thread */
+	TS_LARGE_MESSAGES, /* Messages whose arguments were too long for a buffer slot */
+	TS_REGISTRATION_FAILURES, /* Failed attempts to register for a private buffer */
+	TS_SHARED_BUFFER_LOCK_WAIT_NSEC, /* Time spent waiting for the shared buffer lock */
+	TS_COUNTERS_NUM
+};
+
+struct ThreadStats;
+
+/**
+ * Acquire a block of counters for the calling thread (a released block is adopted if available)
+ * @return A block of counters, or NULL on allocation failure
+ */
+struct ThreadStats* acquireThreadStats();
+
+/**
+ * Release a block of counters so another thread may adopt it (its counters are kept)
+ * @param ts The block to release
+ */
+void releaseThreadStats(struct ThreadStats* ts);
+
+/**
+ * Add a value to a counter
+ * NOTE: This API may be called only by the thread that acquired the block
+ * @param ts The block of counters
+ * @param counter The counter (one of 'ThreadStatsCounters')
+ * @param value The value to add
+ */
+void addThreadStat(struct ThreadStats* ts, const int counter,
+                   const unsigned long long value);
+
+/**
+ * Sum the counters of all blocks
+ * @param sums An array of TS_COUNTERS_NUM elements to store the sums in
+ */
+void sumThreadStats(unsigned long long* sums);
+
+/**
+ * Release all blocks of counters
+ * NOTE: This API may be called only when no other thread uses any block
+ */
+void destroyThreadStats();
+
+#endif /* THREADSTATS_H */
@@ -0,0 +1,65 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file loggerRecovery.c
+ * @author Barak Sason Rofman
+ * @brief A post-mortem recovery tool for applications that log with persistent buffers (see
+ * 'setPersistentBuffers(...)'). It writes the messages the application's logger thread didn't
+ * drain before the application died to the standard output, and leaves the file as is. Usage:
+ * 	LoggerRecovery FILE [ascii|binary|json]
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/api/logger.h"
+#include "../writeMethods/writeMethods.h"
+
+int main(int argc, char** argv) {
+	void (*writeMethod)() = asciiWrite;
+	int messagesNum;
+
+	if (2 > argc || 3 < argc) {
+		fprintf(stderr, "Usage: %s FILE [ascii|binary|json]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (3 == argc) {
+		if (0 == strcmp("binary", argv[2])) {
+			writeMethod = binaryWrite;
+		} else if (0 == strcmp("json", argv[2])) {
+			writeMethod = jsonWrite;
+		} else if (0 != strcmp("ascii", argv[2])) {
+			fprintf(stderr, "Unknown write method: %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	messagesNum = recoverPersistentBuffers(argv[1], stdout, writeMethod);
+	if (LOG_STATUS_FAILURE == messagesNum) {
+		fprintf(stderr, "Unable to recover file %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "Recovered %d messages from %s\n", messagesNum, argv[1]);
+
+	return EXIT_SUCCESS;
+}
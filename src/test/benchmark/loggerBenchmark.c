@@ -0,0 +1,606 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file loggerBenchmark.c
+ * @author Barak Sason Rofman
+ * @brief Parametric end-to-end benchmark of the logger.
+ * Every combination of the given parameters is run in a separate process (the logger may be
+ * initialized only once per process) and reported as a single JSON line on stdout:
+ * 	--threads N,...			Number of logging threads
+ * 	--messages N			Total number of messages per run (split evenly across threads)
+ * 	--msg-size N,...		Length of the string argument of each message
+ * 	--args MIX,...			Arguments mix: str (a string), int (integers only),
+ * 							mixed (a string, an integer, a double and a pointer) or kv
+ * 							(the integers of 'int' as structured fields, see 'LOG_KV')
+ * 	--private-size N,...	Size of the private buffers
+ * 	--shared-size N,...		Size of the shared buffer
+ * 	--arrival MODE,...		steady (back-to-back, or paced by --rate) or burst (bursts of
+ * 							--burst-size messages separated by --burst-gap-usec)
+ * 	--sink SINK,...			ascii, binary, json, null (discard) or memory (ascii into a
+ * 							memory buffer)
+ * 	--rate N				Messages per second per thread in steady mode (0 - unpaced)
+ * 	--burst-size N			Messages per burst in burst mode
+ * 	--burst-gap-usec N		Idle time between bursts in burst mode
+ * 	--sample-rate N			Latency sampling rate (1 - time every call)
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "../../core/api/logger.h"
+#include "../../writeMethods/writeMethods.h"
+
+#define MAX_PARAM_VALUES 16 /* Maximum number of values per swept parameter */
+#define MEMORY_SINK_SIZE (64 * 1024 * 1024) /* Size of the memory sink (reused cyclically) */
+#define DRAIN_TIMEOUT_MSEC 600000 /* Maximal time to wait for the logger to drain a run */
+#define DRAIN_POLL_USEC 1000 /* Interval between checks whether a run was drained */
+#define HEADER_RESERVE 256 /* Room for the record header in addition to the arguments */
+
+enum argsMixes {
+	ARGS_MIX_STR, ARGS_MIX_INT, ARGS_MIX_MIXED, ARGS_MIX_KV, ARGS_MIXES_NUM
+};
+
+enum arrivals {
+	ARRIVAL_STEADY, ARRIVAL_BURST, ARRIVALS_NUM
+};
+
+enum sinks {
+	SINK_ASCII, SINK_BINARY, SINK_JSON, SINK_NULL, SINK_MEMORY, SINKS_NUM
+};
+
+enum sweptParams {
+	SP_THREADS,
+	SP_MSG_SIZE,
+	SP_ARGS_MIX,
+	SP_PRIVATE_SIZE,
+	SP_SHARED_SIZE,
+	SP_ARRIVAL,
+	SP_SINK,
+	SWEPT_PARAMS_NUM
+};
+
+static const char* argsMixesNames[ARGS_MIXES_NUM] = { "str", "int", "mixed", "kv" };
+static const char* arrivalsNames[ARRIVALS_NUM] = { "steady", "burst" };
+static const char* sinksNames[SINKS_NUM] = { "ascii", "binary", "json", "null",
+                                             "memory" };
+static const char* sweptParamsNames[SWEPT_PARAMS_NUM] = { "threads", "msg-size",
+                                                          "args", "private-size",
+                                                          "shared-size", "arrival",
+                                                          "sink" };
+
+typedef struct SweptParam {
+	/** The values to sweep */
+	int values[MAX_PARAM_VALUES];
+	/** Number of values */
+	int valuesNum;
+	/** Names of the values (NULL for numeric parameters) */
+	const char** names;
+	/** Number of names */
+	int namesNum;
+} SweptParam;
+
+typedef struct BenchmarkConfig {
+	/** The value of each swept parameter */
+	int params[SWEPT_PARAMS_NUM];
+	/** Total number of messages */
+	long long messagesNum;
+	/** Messages per second per thread in steady mode (0 - unpaced) */
+	int rate;
+	/** Messages per burst in burst mode */
+	int burstSize;
+	/** Idle time between bursts in burst mode */
+	int burstGapUsec;
+	/** Latency sampling rate */
+	int sampleRate;
+	/** The string argument of the messages */
+	char* payload;
+	/** Synchronizes the start of the logging threads */
+	pthread_barrier_t startBarrier;
+} BenchmarkConfig;
+
+static FILE* memorySink;
+
+static void initSweptParams(SweptParam* sweptParams);
+static int parseArgs(int argc, char** argv, SweptParam* sweptParams,
+                     BenchmarkConfig* config);
+static int parseList(const char* list, SweptParam* sweptParam);
+static int runAll(SweptParam* sweptParams, BenchmarkConfig* config);
+static int runInChild(BenchmarkConfig* config);
+static int runBenchmark(BenchmarkConfig* config);
+static void* threadMethod(void* configArg);
+static inline void logOne(const BenchmarkConfig* config, const long long i);
+static int waitForDrain(const long long messagesNum);
+static void printResults(const BenchmarkConfig* config, const double elapsedSec);
+static void nullWrite(const MessageData* md, FILE* logFile);
+static void memoryWrite(const MessageData* md, FILE* logFile);
+static inline long long getMonotonicTimeNsec();
+
+int main(int argc, char** argv) {
+	SweptParam sweptParams[SWEPT_PARAMS_NUM];
+	BenchmarkConfig config;
+
+	initSweptParams(sweptParams);
+	config.messagesNum = 200000;
+	config.rate = 0;
+	config.burstSize = 1000;
+	config.burstGapUsec = 1000;
+	config.sampleRate = 64;
+
+	if (LOG_STATUS_SUCCESS != parseArgs(argc, argv, sweptParams, &config)) {
+		fprintf(stderr, "usage: %s [--threads N,...] [--messages N] [--msg-size N,...] "
+		        "[--args str|int|mixed|kv,...] [--private-size N,...] [--shared-size N,...] "
+		        "[--arrival steady|burst,...] [--sink ascii|binary|json|null|memory,...] "
+		        "[--rate N] [--burst-size N] [--burst-gap-usec N] [--sample-rate N]\n",
+		        argv[0]);
+		return LOG_STATUS_FAILURE;
+	}
+
+	return runAll(sweptParams, &config);
+}
+
+/**
+ * Set the default values of the swept parameters
+ * @param sweptParams The swept parameters
+ */
+static void initSweptParams(SweptParam* sweptParams) {
+	memset(sweptParams, 0, SWEPT_PARAMS_NUM * sizeof(*sweptParams));
+
+	parseList("1,4,16", &sweptParams[SP_THREADS]);
+	parseList("32,256", &sweptParams[SP_MSG_SIZE]);
+	parseList("1000", &sweptParams[SP_PRIVATE_SIZE]);
+	parseList("10000", &sweptParams[SP_SHARED_SIZE]);
+
+	sweptParams[SP_ARGS_MIX].names = argsMixesNames;
+	sweptParams[SP_ARGS_MIX].namesNum = ARGS_MIXES_NUM;
+	parseList("str", &sweptParams[SP_ARGS_MIX]);
+
+	sweptParams[SP_ARRIVAL].names = arrivalsNames;
+	sweptParams[SP_ARRIVAL].namesNum = ARRIVALS_NUM;
+	parseList("steady", &sweptParams[SP_ARRIVAL]);
+
+	sweptParams[SP_SINK].names = sinksNames;
+	sweptParams[SP_SINK].namesNum = SINKS_NUM;
+	parseList("ascii,null", &sweptParams[SP_SINK]);
+}
+
+/**
+ * Parse the command line arguments
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @param sweptParams The swept parameters to fill
+ * @param config The fixed parameters to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+static int parseArgs(int argc, char** argv, SweptParam* sweptParams,
+                     BenchmarkConfig* config) {
+	static const struct option options[] = {
+	        { "threads", required_argument, NULL, SP_THREADS },
+	        { "msg-size", required_argument, NULL, SP_MSG_SIZE },
+	        { "args", required_argument, NULL, SP_ARGS_MIX },
+	        { "private-size", required_argument, NULL, SP_PRIVATE_SIZE },
+	        { "shared-size", required_argument, NULL, SP_SHARED_SIZE },
+	        { "arrival", required_argument, NULL, SP_ARRIVAL },
+	        { "sink", required_argument, NULL, SP_SINK },
+	        { "messages", required_argument, NULL, 'm' },
+	        { "rate", required_argument, NULL, 'r' },
+	        { "burst-size", required_argument, NULL, 'b' },
+	        { "burst-gap-usec", required_argument, NULL, 'g' },
+	        { "sample-rate", required_argument, NULL, 's' },
+	        { "help", no_argument, NULL, 'h' },
+	        { NULL, 0, NULL, 0 } };
+	int opt;
+
+	while (-1 != (opt = getopt_long(argc, argv, "", options, NULL))) {
+		if (opt >= 0 && opt < SWEPT_PARAMS_NUM) {
+			if (LOG_STATUS_SUCCESS != parseList(optarg, &sweptParams[opt])) {
+				fprintf(stderr, "Invalid value for --%s: %s\n",
+				        sweptParamsNames[opt], optarg);
+				return LOG_STATUS_FAILURE;
+			}
+		} else if ('m' == opt) {
+			config->messagesNum = atoll(optarg);
+		} else if ('r' == opt) {
+			config->rate = atoi(optarg);
+		} else if ('b' == opt) {
+			config->burstSize = atoi(optarg);
+		} else if ('g' == opt) {
+			config->burstGapUsec = atoi(optarg);
+		} else if ('s' == opt) {
+			config->sampleRate = atoi(optarg);
+		} else {
+			return LOG_STATUS_FAILURE;
+		}
+	}
+
+	if (optind != argc || config->messagesNum <= 0 || config->rate < 0
+	        || config->burstSize <= 0 || config->burstGapUsec < 0
+	        || config->sampleRate < 0) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Parse a comma separated list of values of a swept parameter
+ * @param list The list
+ * @param sweptParam The swept parameter to fill
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+static int parseList(const char* list, SweptParam* sweptParam) {
+	char buf[strlen(list) + 1];
+	char* savePtr;
+	char* token;
+
+	strcpy(buf, list);
+	sweptParam->valuesNum = 0;
+
+	for (token = strtok_r(buf, ",", &savePtr); NULL != token;
+	        token = strtok_r(NULL, ",", &savePtr)) {
+		int value = -1;
+
+		if (MAX_PARAM_VALUES == sweptParam->valuesNum) {
+			return LOG_STATUS_FAILURE;
+		}
+
+		if (NULL != sweptParam->names) {
+			int i;
+
+			for (i = 0; i < sweptParam->namesNum; ++i) {
+				if (0 == strcmp(token, sweptParam->names[i])) {
+					value = i;
+				}
+			}
+		} else {
+			value = atoi(token);
+			value = (value > 0) ? value : -1;
+		}
+
+		if (value < 0) {
+			return LOG_STATUS_FAILURE;
+		}
+
+		sweptParam->values[sweptParam->valuesNum++] = value;
+	}
+
+	return (0 < sweptParam->valuesNum) ? LOG_STATUS_SUCCESS : LOG_STATUS_FAILURE;
+}
+
+/**
+ * Run every combination of the swept parameters
+ * @param sweptParams The swept parameters
+ * @param config The fixed parameters
+ * @return LOG_STATUS_SUCCESS if all runs succeeded, LOG_STATUS_FAILURE otherwise (the remaining
+ * runs are carried out after a failed run)
+ */
+static int runAll(SweptParam* sweptParams, BenchmarkConfig* config) {
+	int indices[SWEPT_PARAMS_NUM] = { 0 };
+	int status = LOG_STATUS_SUCCESS;
+	int i;
+
+	do {
+		for (i = 0; i < SWEPT_PARAMS_NUM; ++i) {
+			config->params[i] = sweptParams[i].values[indices[i]];
+		}
+
+		if (LOG_STATUS_SUCCESS != runInChild(config)) {
+			status = LOG_STATUS_FAILURE;
+			fprintf(stderr, "Run failed (threads=%d msg-size=%d args=%s sink=%s)\n",
+			        config->params[SP_THREADS], config->params[SP_MSG_SIZE],
+			        argsMixesNames[config->params[SP_ARGS_MIX]],
+			        sinksNames[config->params[SP_SINK]]);
+		}
+
+		/* Advance to the next combination (the last parameter changes fastest) */
+		for (i = SWEPT_PARAMS_NUM - 1; i >= 0; --i) {
+			if (++indices[i] < sweptParams[i].valuesNum) {
+				break;
+			}
+
+			indices[i] = 0;
+		}
+	} while (i >= 0);
+
+	return status;
+}
+
+/**
+ * Run a single benchmark in a child process
+ * @param config The benchmark parameters
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure
+ */
+static int runInChild(BenchmarkConfig* config) {
+	pid_t pid;
+	int status;
+
+	/* Don't let the child inherit (and print again) buffered output */
+	fflush(stdout);
+
+	pid = fork();
+	if (0 == pid) {
+		exit(LOG_STATUS_SUCCESS == runBenchmark(config) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	if (0 > pid || pid != waitpid(pid, &status, 0)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return (WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status)) ?
+	        LOG_STATUS_SUCCESS : LOG_STATUS_FAILURE;
+}
+
+/**
+ * Run a single benchmark and print its results
+ * @param config The benchmark parameters
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on failure (no results are printed if
+ * the logger didn't drain the messages in time)
+ */
+static int runBenchmark(BenchmarkConfig* config) {
+	static void (* const writeMethods[SINKS_NUM])() = { asciiWrite, binaryWrite,
+	                                                    jsonWrite, nullWrite,
+	                                                    memoryWrite };
+	int threadsNum = config->params[SP_THREADS];
+	int msgSize = config->params[SP_MSG_SIZE];
+	int maxArgsLen = msgSize + HEADER_RESERVE;
+	pthread_t threads[threadsNum];
+	long long startNsec;
+	int status;
+	int i;
+
+	remove("logFile.txt");
+
+	if (SINK_MEMORY == config->params[SP_SINK]) {
+		memorySink = fmemopen(NULL, MEMORY_SINK_SIZE, "w");
+		if (NULL == memorySink) {
+			return LOG_STATUS_FAILURE;
+		}
+	}
+
+	if (LOG_STATUS_SUCCESS
+	        != initLogger(threadsNum, config->params[SP_PRIVATE_SIZE],
+	                      config->params[SP_SHARED_SIZE], LOG_LEVEL_TRACE,
+	                      maxArgsLen + HEADER_RESERVE, maxArgsLen, false,
+	                      writeMethods[config->params[SP_SINK]])) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	setLatencySampling(config->sampleRate);
+
+	config->payload = malloc(msgSize + 1);
+	memset(config->payload, 'x', msgSize);
+	config->payload[msgSize] = '\0';
+	pthread_barrier_init(&config->startBarrier, NULL, threadsNum + 1);
+
+	for (i = 0; i < threadsNum; ++i) {
+		pthread_create(&threads[i], NULL, threadMethod, config);
+	}
+
+	pthread_barrier_wait(&config->startBarrier);
+	startNsec = getMonotonicTimeNsec();
+
+	for (i = 0; i < threadsNum; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* The run ends once everything was written - an undrained run isn't a valid data point */
+	status = waitForDrain(config->messagesNum / threadsNum * threadsNum);
+	if (LOG_STATUS_SUCCESS == status) {
+		printResults(config, (getMonotonicTimeNsec() - startNsec) / 1e9);
+	}
+
+	terminateLogger();
+	pthread_barrier_destroy(&config->startBarrier);
+	free(config->payload);
+
+	if (NULL != memorySink) {
+		fclose(memorySink);
+	}
+
+	return status;
+}
+
+/**
+ * Logging thread - logs its share of the messages according to the arrival mode
+ * @param configArg The benchmark parameters
+ * @return NULL
+ */
+static void* threadMethod(void* configArg) {
+	const BenchmarkConfig* config = configArg;
+	long long messagesNum = config->messagesNum / config->params[SP_THREADS];
+	long long intervalNsec = (0 < config->rate) ? 1000000000LL / config->rate : 0;
+	struct timespec nextTime;
+	long long i;
+
+	registerThread();
+	pthread_barrier_wait((pthread_barrier_t*) &config->startBarrier);
+	clock_gettime(CLOCK_MONOTONIC, &nextTime);
+
+	for (i = 0; i < messagesNum; ++i) {
+		if (ARRIVAL_BURST == config->params[SP_ARRIVAL]) {
+			if (0 == i % config->burstSize && 0 != i) {
+				usleep(config->burstGapUsec);
+			}
+		} else if (0 != intervalNsec) {
+			nextTime.tv_nsec += intervalNsec;
+			while (nextTime.tv_nsec >= 1000000000) {
+				++nextTime.tv_sec;
+				nextTime.tv_nsec -= 1000000000;
+			}
+
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &nextTime, NULL);
+		}
+
+		logOne(config, i);
+	}
+
+	unregisterThread();
+
+	return NULL;
+}
+
+/**
+ * Log a single message according to the arguments mix
+ * @param config The benchmark parameters
+ * @param i The index of the message
+ */
+static inline void logOne(const BenchmarkConfig* config, const long long i) {
+	switch (config->params[SP_ARGS_MIX]) {
+		case ARGS_MIX_INT:
+			LOG_MSG(LOG_LEVEL_INFO, "%lld %d %d %u", i, (int) (i * 7),
+			        -(int) i, (unsigned int) (i ^ 0x5a5a));
+			break;
+		case ARGS_MIX_KV:
+			LOG_KV(LOG_LEVEL_INFO, "benchmark", KV_INT("i", i), KV_INT("a", i * 7),
+			       KV_INT("b", -i), KV_INT("c", i ^ 0x5a5a));
+			break;
+		case ARGS_MIX_MIXED:
+			LOG_MSG(LOG_LEVEL_INFO, "%s id=%lld value=%f ptr=%p", config->payload,
+			        i, i / 3.0, (void* ) config);
+			break;
+		default:
+			LOG_MSG(LOG_LEVEL_INFO, "%s", config->payload);
+			break;
+	}
+}
+
+/**
+ * Wait until the logger has written a given number of messages
+ * @param messagesNum The number of messages
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE if the messages weren't written in time
+ */
+static int waitForDrain(const long long messagesNum) {
+	long long deadlineNsec;
+	LoggerStats stats;
+
+	deadlineNsec = getMonotonicTimeNsec() + DRAIN_TIMEOUT_MSEC * 1000000LL;
+
+	do {
+		getLoggerStats(&stats);
+		if (stats.messages[LM_PRIVATE_BUFFER] + stats.messages[LM_SHARED_BUFFER]
+		        + stats.messages[LM_DIRECT_WRITE] + stats.drops >= messagesNum) {
+			return LOG_STATUS_SUCCESS;
+		}
+
+		usleep(DRAIN_POLL_USEC);
+	} while (getMonotonicTimeNsec() < deadlineNsec);
+
+	fprintf(stderr, "Timed out waiting for the logger to drain\n");
+
+	return LOG_STATUS_FAILURE;
+}
+
+/**
+ * Print the results of a run as a single JSON line
+ * @param config The benchmark parameters
+ * @param elapsedSec The duration of the run
+ */
+static void printResults(const BenchmarkConfig* config, const double elapsedSec) {
+	LoggerStats stats;
+	LatencySummary call;
+	LatencySummary endToEnd;
+	unsigned long long messages;
+	unsigned long long bytes;
+	int i;
+
+	getLoggerStats(&stats);
+	getCallLatency(LOG_LEVEL_NONE, LM_METHODS_NUM, &call);
+	getEndToEndLatency(LM_METHODS_NUM, &endToEnd);
+
+	messages = 0;
+	bytes = 0;
+	for (i = 0; i < LM_METHODS_NUM; ++i) {
+		messages += stats.messages[i];
+		bytes += stats.bytes[i];
+	}
+
+	printf("{\"threads\": %d, \"msg_size\": %d, \"args\": \"%s\", \"private_size\": %d, "
+	       "\"shared_size\": %d, \"arrival\": \"%s\", \"sink\": \"%s\", \"rate\": %d, "
+	       "\"burst_size\": %d, \"burst_gap_usec\": %d, \"messages\": %llu, "
+	       "\"elapsed_sec\": %.6f, \"msgs_per_sec\": %.0f, \"bytes_per_sec\": %.0f, "
+	       "\"tiers\": {\"pb\": %llu, \"sb\": %llu, \"dw\": %llu}, \"drops\": %llu, "
+	       "\"registration_failures\": %llu, \"shared_lock_wait_nsec\": %llu, "
+	       "\"pb_high_water_mark\": %d, \"committed_memory\": %zu, "
+	       "\"call_latency_nsec\": {\"samples\": %llu, \"mean\": %llu, \"p50\": %llu, "
+	       "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}, "
+	       "\"e2e_latency_nsec\": {\"samples\": %llu, \"mean\": %llu, \"p50\": %llu, "
+	       "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}}\n",
+	       config->params[SP_THREADS], config->params[SP_MSG_SIZE],
+	       argsMixesNames[config->params[SP_ARGS_MIX]],
+	       config->params[SP_PRIVATE_SIZE], config->params[SP_SHARED_SIZE],
+	       arrivalsNames[config->params[SP_ARRIVAL]],
+	       sinksNames[config->params[SP_SINK]], config->rate, config->burstSize,
+	       config->burstGapUsec, messages, elapsedSec, messages / elapsedSec,
+	       bytes / elapsedSec, stats.messages[LM_PRIVATE_BUFFER],
+	       stats.messages[LM_SHARED_BUFFER], stats.messages[LM_DIRECT_WRITE],
+	       stats.drops, stats.registrationFailures, stats.sharedBufferLockWaitNsec,
+	       stats.privateBuffersHighWaterMark, stats.committedMemory, call.count,
+	       call.meanNsec, call.p50Nsec, call.p90Nsec, call.p99Nsec, call.p999Nsec,
+	       call.maxNsec, endToEnd.count, endToEnd.meanNsec, endToEnd.p50Nsec,
+	       endToEnd.p90Nsec, endToEnd.p99Nsec, endToEnd.p999Nsec,
+	       endToEnd.maxNsec);
+	fflush(stdout);
+}
+
+/**
+ * A write method that discards messages (measures the logger without formatting and IO)
+ * @param md MessageData struct containing message info
+ * @param logFile The file to write to (unused)
+ */
+static void nullWrite(const MessageData* md, FILE* logFile) {
+}
+
+/**
+ * A write method that formats messages in ascii format into a memory buffer (measures the
+ * logger with formatting but without IO). The buffer is reused cyclically
+ * @param md MessageData struct containing message info
+ * @param logFile The file to write to (unused)
+ */
+static void memoryWrite(const MessageData* md, FILE* logFile) {
+	/* Direct writes may write concurrently with the logger thread */
+	flockfile(memorySink);
+	{
+		if (ftell(memorySink) > MEMORY_SINK_SIZE - getMaxMsgLen()) {
+			rewind(memorySink);
+		}
+
+		asciiWrite(md, memorySink);
+	}
+	funlockfile(memorySink);
+}
+
+/**
+ * Returns the current monotonic time in nanoseconds
+ * @return The current monotonic time in nanoseconds
+ */
+static inline long long getMonotonicTimeNsec() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
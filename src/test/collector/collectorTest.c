@@ -0,0 +1,245 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file collectorTest.c
+ * @author Barak Sason Rofman
+ * @brief System test of shared memory mode - runs an application process that logs to a shared
+ * memory segment and the collector process ('LoggerCollector', expected next to this executable)
+ * that writes its messages to the log file, and checks all messages were written:
+ * 1. Crash - the application logs and aborts before a collector is started, then a collector
+ * 	  collects the messages the application left at the segment
+ * 2. Clean shutdown - the collector runs while worker threads log, and the application terminates
+ * 	  its logger once they are done
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../../core/api/logger.h"
+#include "../../writeMethods/writeMethods.h"
+
+#define SEGMENT_NAME "/lockless_logger_collector_test"
+#define COLLECTOR_NAME "LoggerCollector"
+#define COLLECTOR_PATH_LEN 4096
+#define NUM_THRDS 8
+#define ITERATIONS 5000 /* Messages per thread (the private buffers fit them all) */
+#define CRASH_MESSAGES 3000 /* Messages logged before the crash (the private buffer fits them all) */
+#define BUFFSIZE 8192
+#define SHAREDBUFFSIZE 1024
+#define MAX_MSG_LEN 512
+#define ARGS_BUF_SIZE 128
+#define LARGE_ARGS_LEN 1000 /* A message that spans several buffer slots */
+
+static char collectorPath[COLLECTOR_PATH_LEN];
+
+static int runCrashTest();
+static int runCleanShutdownTest();
+static int initSharedMemoryLogger();
+static void logMessages(const int messagesNum);
+static void* threadMethod(void* arg);
+static pid_t startCollector();
+static int waitForProcess(const pid_t pid);
+static int checkLogFile(const char* testName, const long long expectedLines);
+
+int main(int argc, char** argv) {
+	const char* dirEnd = strrchr(argv[0], '/');
+	int failures = 0;
+
+	(void) argc;
+	snprintf(collectorPath, sizeof(collectorPath), "%.*s%s",
+	         (NULL == dirEnd) ? 0 : (int) (dirEnd - argv[0] + 1), argv[0],
+	         COLLECTOR_NAME);
+
+	/* A segment left behind by an earlier failed run */
+	shm_unlink(SEGMENT_NAME);
+
+	/* The crash test runs first - the logger may be initialized once per process, so it's
+	 * initialized by a child process there, and by this process in the next test */
+	failures += runCrashTest();
+	failures += runCleanShutdownTest();
+
+	return (0 == failures) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runCrashTest() {
+	pid_t application;
+	int status;
+
+	remove("logFile.txt");
+
+	application = fork();
+	if (0 == application) {
+		if (LOG_STATUS_SUCCESS != initSharedMemoryLogger()) {
+			_exit(EXIT_FAILURE);
+		}
+
+		logMessages(CRASH_MESSAGES);
+		abort();
+	}
+
+	if (-1 == application || -1 == waitpid(application, &status, 0)
+	        || false == WIFSIGNALED(status)) {
+		printf("crash: FAILED (the application didn't crash)\n");
+		return 1;
+	}
+
+	/* The messages are collected after the application is gone */
+	if (0 != waitForProcess(startCollector())) {
+		printf("crash: FAILED (the collector failed)\n");
+		return 1;
+	}
+
+	return checkLogFile("crash", CRASH_MESSAGES);
+}
+
+static int runCleanShutdownTest() {
+	pthread_t threads[NUM_THRDS];
+	pid_t collector;
+	int i;
+
+	remove("logFile.txt");
+
+	if (LOG_STATUS_SUCCESS != initSharedMemoryLogger()) {
+		printf("clean shutdown: FAILED (unable to initialize the logger)\n");
+		return 1;
+	}
+
+	collector = startCollector();
+
+	for (i = 0; i < NUM_THRDS; ++i) {
+		pthread_create(&threads[i], NULL, threadMethod, NULL);
+	}
+
+	for (i = 0; i < NUM_THRDS; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	terminateLogger();
+
+	if (0 != waitForProcess(collector)) {
+		printf("clean shutdown: FAILED (the collector failed)\n");
+		return 1;
+	}
+
+	return checkLogFile("clean shutdown", (long long) NUM_THRDS * ITERATIONS);
+}
+
+static int initSharedMemoryLogger() {
+	if (LOG_STATUS_SUCCESS != setSharedMemoryMode(SEGMENT_NAME)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return initLogger(NUM_THRDS, BUFFSIZE, SHAREDBUFFSIZE, LOG_LEVEL_TRACE,
+	                  MAX_MSG_LEN, ARGS_BUF_SIZE, false, asciiWrite);
+}
+
+/* Plain, structured and large messages - each is written as a single line */
+static void logMessages(const int messagesNum) {
+	char largeArgs[LARGE_ARGS_LEN + 1];
+	int i;
+
+	memset(largeArgs, 'x', LARGE_ARGS_LEN);
+	largeArgs[LARGE_ARGS_LEN] = '\0';
+
+	for (i = 0; i < messagesNum; ++i) {
+		if (0 == i % 100) {
+			LOG_MSG(LOG_LEVEL_INFO, "A large message: %s", largeArgs);
+		} else if (0 == i % 10) {
+			LOG_KV(LOG_LEVEL_INFO, "progress", KV_INT("message", i),
+			       KV_STR("state", "logging"));
+		} else {
+			LOG_MSG(LOG_LEVEL_INFO, "A message with arguments: %d", i);
+		}
+	}
+}
+
+static void* threadMethod(void* arg) {
+	(void) arg;
+
+	logMessages(ITERATIONS);
+	unregisterThread();
+
+	return NULL;
+}
+
+static pid_t startCollector() {
+	pid_t collector = fork();
+
+	if (0 == collector) {
+		execl(collectorPath, collectorPath, SEGMENT_NAME, "ascii", (char*) NULL);
+		perror(collectorPath);
+		_exit(EXIT_FAILURE);
+	}
+
+	return collector;
+}
+
+static int waitForProcess(const pid_t pid) {
+	int status;
+
+	if (-1 == pid || -1 == waitpid(pid, &status, 0) || false == WIFEXITED(status)) {
+		return -1;
+	}
+
+	return WEXITSTATUS(status);
+}
+
+static int checkLogFile(const char* testName, const long long expectedLines) {
+	long long lines = 0;
+	long long foreignLines = 0;
+	char line[MAX_MSG_LEN * 4];
+	FILE* logFile;
+
+	logFile = fopen("logFile.txt", "r");
+	if (NULL == logFile) {
+		printf("%s: FAILED (no log file)\n", testName);
+		return 1;
+	}
+
+	while (NULL != fgets(line, sizeof(line), logFile)) {
+		if (NULL != strchr(line, '\n')) {
+			++lines;
+		}
+
+		/* The names are read by the collector from their copies at the segment */
+		if (NULL != strchr(line, '\n') && NULL == strstr(line, "collectorTest.c")) {
+			++foreignLines;
+		}
+	}
+	fclose(logFile);
+
+	if (expectedLines != lines || 0 != foreignLines) {
+		printf("%s: FAILED (%lld of %lld lines written, %lld with a wrong file name)\n",
+		       testName, lines, expectedLines, foreignLines);
+		return 1;
+	}
+
+	printf("%s: %lld lines written\n", testName, lines);
+
+	return 0;
+}
@@ -14,6 +14,8 @@
  * limitations under the License.											*
  ****************************************************************************/
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -22,6 +24,7 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <time.h>
 
 #include "../../core/api/logger.h"
 #include "../../writeMethods/writeMethods.h"
@@ -36,15 +39,37 @@
 #define BUFFSIZE 1000
 #define SHAREDBUFFSIZE 10000
 
+#define LAYOUT_THRDS 4 /* Threads logging while private buffers layout is changed */
+#define LAYOUT_PACE_NSEC 50000 /* Interval between their messages (private buffers keep up) */
+#define LAYOUT_WINDOW_USEC 200000 /* Length of each latency window */
+#define LAYOUT_MAX_P99_RATIO 4 /* Tolerated p99 increase during the change (noise included) */
+
 char chars[] = "0123456789abcdefghijklmnopqrstuvwqxy";
 char** data;
+long long maxLatencyNsec; /* Worst logging call latency across all threads */
+bool isLayoutPhaseDone; /* Set when the layout change threads should exit */
+const char* logMethodsNames[LM_METHODS_NUM] = { "Private buffer call",
+                                                "Shared buffer call",
+                                                "Direct write call" };
 
 static void createRandomData(char** data, int charsLen);
 static void* threadMethod();
+static inline long long getNsecDiff(const struct timespec* start,
+                                    const struct timespec* end);
+static void printLatencySummary(const char* name,
+                                const LatencySummary* summary);
+static int checkThrottles();
+static int checkLayoutChangeLatency();
+static void* layoutThreadMethod(void* data);
 
 int main(void) {
 	remove("logFile.txt");
 
+	if (LOG_STATUS_SUCCESS != checkThrottles()) {
+		printf("Throttling check failed\n");
+		return LOG_STATUS_FAILURE;
+	}
+
 	if (LOG_STATUS_SUCCESS
 	        == initLogger(NUM_THRDS, BUFFSIZE, SHAREDBUFFSIZE, LOG_LEVEL_TRACE,
 	        MAX_MSG_LEN,
@@ -53,6 +78,9 @@ int main(void) {
 		int charsLen;
 		pthread_t threads[NUM_THRDS];
 		struct timeval tv1, tv2;
+		LoggerStats stats;
+		LatencySummary callLatency[LM_METHODS_NUM];
+		LatencySummary endToEndLatency;
 
 		charsLen = strlen(chars);
 		data = malloc(NUM_THRDS * sizeof(*data));
@@ -72,11 +100,36 @@ int main(void) {
 			pthread_join(threads[i], NULL);
 		}
 
+		/* Worker-side statistics are complete once the workers are done (buffered messages are
+		 * counted as they are drained, so only direct writes are reported) */
+		getLoggerStats(&stats);
+		for (i = 0; i < LM_METHODS_NUM; ++i) {
+			getCallLatency(LOG_LEVEL_NONE, i, &callLatency[i]);
+		}
+		getEndToEndLatency(LM_METHODS_NUM, &endToEndLatency);
+
+		if (LOG_STATUS_SUCCESS != checkLayoutChangeLatency()) {
+			printf("Layout change check failed\n");
+			terminateLogger();
+			return LOG_STATUS_FAILURE;
+		}
+
 		terminateLogger();
 		free(data);
 		gettimeofday(&tv2, NULL);
 
-		printf("Direct writes = %llu\n", cnt);
+		printf("Direct writes = %llu\n", stats.messages[LM_DIRECT_WRITE]);
+		printf("Registration failures = %llu\n", stats.registrationFailures);
+		printf("Shared buffer lock wait = %llu nsec\n",
+		       stats.sharedBufferLockWaitNsec);
+		printf("Private buffers high-water mark = %d messages\n",
+		       stats.privateBuffersHighWaterMark);
+		printf("Committed buffers memory = %zu bytes\n", stats.committedMemory);
+		printf("Max logging call latency = %lld nsec\n", maxLatencyNsec);
+		for (i = 0; i < LM_METHODS_NUM; ++i) {
+			printLatencySummary(logMethodsNames[i], &callLatency[i]);
+		}
+		printLatencySummary("end-to-end", &endToEndLatency);
 		printf("Total time = %f seconds\n",
 		       (double) (tv2.tv_usec - tv1.tv_usec) / 1000000
 		               + (double) (tv2.tv_sec - tv1.tv_sec));
@@ -93,19 +146,153 @@ static void createRandomData(char** data, int charsLen) {
 	for (i = 0; i < NUM_THRDS; ++i) {
 		int j;
 
-		data[i] = malloc(BUF_SIZE);
+		data[i] = malloc(BUF_SIZE + 1);
 		for (j = 0; j < BUF_SIZE; ++j) {
 			data[i][j] = chars[rand() % charsLen];
 		}
+		data[i][BUF_SIZE] = '\0';
 	}
 }
 
 static void* threadMethod(void* data) {
+	long long threadMaxLatencyNsec = 0;
+	long long curMaxLatencyNsec;
+
 	for (int i = 0; i < ITERATIONS; ++i) {
+		struct timespec ts1, ts2;
+		long long latencyNsec;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
 		LOG_MSG(LOG_LEVEL_EMERG, "A message with arguments: %s", (char* )data);
+		clock_gettime(CLOCK_MONOTONIC, &ts2);
+
+		latencyNsec = getNsecDiff(&ts1, &ts2);
+		if (latencyNsec > threadMaxLatencyNsec) {
+			threadMaxLatencyNsec = latencyNsec;
+		}
+	}
+
+	unregisterThread();
+
+	curMaxLatencyNsec = __atomic_load_n(&maxLatencyNsec, __ATOMIC_SEQ_CST);
+	while (threadMaxLatencyNsec > curMaxLatencyNsec
+	        && false
+	                == __atomic_compare_exchange_n(&maxLatencyNsec,
+	                                               &curMaxLatencyNsec,
+	                                               threadMaxLatencyNsec, false,
+	                                               __ATOMIC_SEQ_CST,
+	                                               __ATOMIC_SEQ_CST)) {
+	}
+
+	return NULL;
+}
+
+static inline long long getNsecDiff(const struct timespec* start,
+                                    const struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1000000000LL
+	        + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Check the edge cases of the throttling of 'LOG_EVERY_N' and 'LOG_SAMPLED' - an 'n' of 0 or 1
+ * emits every call (and mustn't divide by zero)
+ * @return LOG_STATUS_SUCCESS if all calls were emitted, LOG_STATUS_FAILURE otherwise
+ */
+static int checkThrottles() {
+	LogThrottle throttle;
+	unsigned long long n;
+	int i;
+
+	for (n = 0; n <= 1; ++n) {
+		memset(&throttle, 0, sizeof(throttle));
+
+		for (i = 0; i < 3; ++i) {
+			if (false == isLogEveryNDue(&throttle, n)
+			        || false == isLogSampled(&throttle, n)) {
+				return LOG_STATUS_FAILURE;
+			}
+		}
+
+		if (0 != throttle.suppressedNum) {
+			return LOG_STATUS_FAILURE;
+		}
+	}
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Measure the impact of a private buffers layout change on the latency of private buffer calls -
+ * a few paced threads (so the private buffers aren't saturated) log during a window before the
+ * change and a window during it, and the latency histograms are reset between the windows
+ * @return LOG_STATUS_SUCCESS if private buffers kept serving calls during the change without
+ * a significant latency increase, LOG_STATUS_FAILURE otherwise
+ */
+static int checkLayoutChangeLatency() {
+	pthread_t threads[LAYOUT_THRDS];
+	LatencySummary before;
+	LatencySummary during;
+	int i;
+
+	setLatencySampling(1);
+	for (i = 0; i < LAYOUT_THRDS; ++i) {
+		pthread_create(&threads[i], NULL, layoutThreadMethod, data[i]);
+	}
+
+	/* Let the threads register before the first window */
+	usleep(LAYOUT_WINDOW_USEC);
+	resetLatencyHistograms();
+	usleep(LAYOUT_WINDOW_USEC);
+	getCallLatency(LOG_LEVEL_NONE, LM_PRIVATE_BUFFER, &before);
+
+	resetLatencyHistograms();
+	changePrivateBuffersSize(BUFFSIZE / 2);
+	changePrivateBuffersNumber(NUM_THRDS * 2);
+	usleep(LAYOUT_WINDOW_USEC);
+	getCallLatency(LOG_LEVEL_NONE, LM_PRIVATE_BUFFER, &during);
+
+	__atomic_store_n(&isLayoutPhaseDone, true, __ATOMIC_SEQ_CST);
+	for (i = 0; i < LAYOUT_THRDS; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	setLatencySampling(0);
+
+	printLatencySummary("Before layout change private buffer call", &before);
+	printLatencySummary("During layout change private buffer call", &during);
+	printf("Layout change private buffer call p50 diff = %lld nsec, p99 diff = %lld nsec\n",
+	       (long long) during.p50Nsec - (long long) before.p50Nsec,
+	       (long long) during.p99Nsec - (long long) before.p99Nsec);
+
+	/* Every call of the paced threads is sampled, so a change that bypassed private buffers
+	 * would show as missing calls */
+	if (0 == before.count || during.count < before.count / 2) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	if (during.p99Nsec > before.p99Nsec * LAYOUT_MAX_P99_RATIO) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	return LOG_STATUS_SUCCESS;
+}
+
+static void* layoutThreadMethod(void* data) {
+	struct timespec pace = { 0, LAYOUT_PACE_NSEC };
+
+	while (false == __atomic_load_n(&isLayoutPhaseDone, __ATOMIC_SEQ_CST)) {
+		LOG_MSG(LOG_LEVEL_EMERG, "A layout change message with arguments: %s",
+		        (char* )data);
+		nanosleep(&pace, NULL);
 	}
 
 	unregisterThread();
 
 	return NULL;
 }
+
+static void printLatencySummary(const char* name,
+                                const LatencySummary* summary) {
+	printf("%s latency (sampled): n=%llu p50=%llu p99=%llu p99.9=%llu max=%llu nsec\n",
+	       name, summary->count, summary->p50Nsec, summary->p99Nsec,
+	       summary->p999Nsec, summary->maxNsec);
+}
@@ -0,0 +1,739 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file loggerMicrobenchmark.c
+ * @author Barak Sason Rofman
+ * @brief Microbenchmarks of the logger components, for attributing regressions to a layer.
+ * Each benchmark reports ns/op along with cycles, instructions and cache misses per op and the
+ * total number of context switches of the measured thread(s), as a single JSON line on stdout
+ * (counters that can't be read are reported as null):
+ * 	spsc-add	'addMessage(...)' by a producer pinned to one CPU, drained by a consumer pinned
+ * 				to another CPU
+ * 	spsc-drain	'drainMessages(...)' by that consumer (per message)
+ * 	ascii		'asciiWrite(...)' of a message to /dev/null
+ * 	asciiprintf	The same record formatted by a single snprintf, as 'asciiWrite(...)' used to - the
+ * 				reference 'ascii' is compared to
+ * 	binary		'binaryWrite(...)' of a message to /dev/null
+ * 	queue		'enqueue(...)'/'dequeue(...)' by a number of threads on a shared Queue (per
+ * 				operation)
+ * 	setmsg		'setMsgValues(...)'
+ * 	reserve		'reserveMessage(...)'/'commitMessage(...)' of a binary payload built in place, as
+ * 				done by 'logReserve(...)'/'logCommit(...)' (the slot is consumed right away)
+ * Options:
+ * 	--bench NAME,...	Benchmarks to run (default - all)
+ * 	--iterations N		Operations per benchmark (per thread for 'queue')
+ * 	--threads N			Number of threads contending on the Queue
+ * 	--msg-size N		Length of the string argument of the messages
+ * 	--sites N			Number of distinct call sites the written messages cycle through
+ * 	--iso-timestamp		Write ascii records with an ISO-8601 timestamp (see
+ * 						'setAsciiTimestampFormat(...)') instead of the raw time
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "perfCounters.h"
+#include "../../core/api/logger.h"
+#include "../../core/logger/messageQueue/messageQueue.h"
+#include "../../core/logger/messageQueue/messageData.h"
+#include "../../core/common/queue/queue.h"
+#include "../../writeMethods/writeMethods.h"
+
+#define MAX_ARGS_LEN 1024
+#define MAX_MSG_LEN (MAX_ARGS_LEN + 256)
+#define SPSC_QUEUE_SIZE 1024
+
+enum benchmarks {
+	BM_SPSC, BM_ASCII, BM_BINARY, BM_QUEUE, BM_SETMSG, BM_DISABLED, BM_RATE_LIMITED, BM_RESERVE,
+	BM_ASCII_PRINTF, BENCHMARKS_NUM
+};
+
+static const char* benchmarksNames[BENCHMARKS_NUM] = { "spsc", "ascii", "binary",
+                                                       "queue", "setmsg", "disabled",
+                                                       "ratelimited", "reserve",
+                                                       "asciiprintf" };
+
+typedef struct Measurement {
+	/** Number of measured operations */
+	long long ops;
+	/** Measured time, in nanoseconds (summed across threads) */
+	long long elapsedNsec;
+	/** Counters values (summed across threads), PC_UNAVAILABLE if unavailable */
+	long long counters[PC_COUNTERS_NUM];
+} Measurement;
+
+typedef struct SpscPair {
+	/** The queue */
+	struct MessageQueue* mq;
+	/** Number of messages to pass */
+	long long messagesNum;
+	/** Number of messages drained so far (consumer only) */
+	long long drainedNum;
+	/** Producer measurement */
+	Measurement producer;
+	/** Consumer measurement */
+	Measurement consumer;
+} SpscPair;
+
+typedef struct QueueContention {
+	/** The contended Queue */
+	struct Queue* queue;
+	/** Number of enqueue-dequeue pairs per thread */
+	long long iterations;
+	/** Synchronizes the start of the threads */
+	pthread_barrier_t startBarrier;
+} QueueContention;
+
+static long long iterations = 1000000;
+static int queueThreadsNum = 4;
+static int sitesNum = 1;
+static char* payload;
+static __thread long long* tlDrainedNum; /* Counted by 'countingWrite' */
+
+static void runSpsc();
+static void* spscProducer(void* pairArg);
+static void* spscConsumer(void* pairArg);
+static void countingWrite(const MessageData* md, FILE* logFile);
+static int addOne(struct MessageQueue* mq, const char* msg, ...);
+static void runWrite(const char* name, void (*writeMethod)());
+static void printfAsciiWrite(const MessageData* md, FILE* logFile);
+static void runQueue();
+static void* queueThread(void* contentionArg);
+static void runSetMsg();
+static void setOne(MessageData* md, const char* msg, ...);
+static void runDisabled();
+static void runRateLimited();
+static void runReserve();
+static void pinThread(const int cpu);
+static void startMeasurement(PerfCounters* pc, long long* startNsec);
+static void stopMeasurement(PerfCounters* pc, const long long startNsec,
+                            Measurement* measurement);
+static void addMeasurement(Measurement* dst, const Measurement* src);
+static void printMeasurement(const char* name, const Measurement* measurement);
+static inline long long getMonotonicTimeNsec();
+
+int main(int argc, char** argv) {
+	static const struct option options[] = {
+	        { "bench", required_argument, NULL, 'b' },
+	        { "iterations", required_argument, NULL, 'i' },
+	        { "threads", required_argument, NULL, 't' },
+	        { "msg-size", required_argument, NULL, 'm' },
+	        { "sites", required_argument, NULL, 's' },
+	        { "iso-timestamp", no_argument, NULL, 'z' },
+	        { "help", no_argument, NULL, 'h' },
+	        { NULL, 0, NULL, 0 } };
+	bool isSelected[BENCHMARKS_NUM];
+	int msgSize = 64;
+	bool isIsoTimestamp = false;
+	int opt;
+	int i;
+
+	for (i = 0; i < BENCHMARKS_NUM; ++i) {
+		isSelected[i] = true;
+	}
+
+	while (-1 != (opt = getopt_long(argc, argv, "", options, NULL))) {
+		if ('b' == opt) {
+			char* savePtr;
+			char* token;
+
+			memset(isSelected, 0, sizeof(isSelected));
+			for (token = strtok_r(optarg, ",", &savePtr); NULL != token;
+			        token = strtok_r(NULL, ",", &savePtr)) {
+				for (i = 0; i < BENCHMARKS_NUM; ++i) {
+					isSelected[i] |= (0 == strcmp(token, benchmarksNames[i]));
+				}
+			}
+		} else if ('i' == opt) {
+			iterations = atoll(optarg);
+		} else if ('t' == opt) {
+			queueThreadsNum = atoi(optarg);
+		} else if ('m' == opt) {
+			msgSize = atoi(optarg);
+		} else if ('s' == opt) {
+			sitesNum = atoi(optarg);
+		} else if ('z' == opt) {
+			isIsoTimestamp = true;
+		} else {
+			opt = '?';
+			break;
+		}
+	}
+
+	if ('?' == opt || optind != argc || iterations <= 0 || queueThreadsNum <= 0
+	        || msgSize < 0 || msgSize >= MAX_ARGS_LEN || sitesNum <= 0) {
+		fprintf(stderr, "usage: %s [--bench spsc|ascii|binary|queue|setmsg|disabled|"
+		        "ratelimited|reserve|asciiprintf,...] [--iterations N] [--threads N] "
+		        "[--msg-size N] [--sites N] [--iso-timestamp]\n",
+		        argv[0]);
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* The write methods depend on the logger configuration (maximal message length and the
+	 * direct write lock) */
+	remove("logFile.txt");
+	if (true == isIsoTimestamp) {
+		setAsciiTimestampFormat(TIMESTAMP_FORMAT_ISO8601, 6, false, true);
+	}
+	if (LOG_STATUS_SUCCESS
+	        != initLogger(1, 2, 2, LOG_LEVEL_NONE, MAX_MSG_LEN, MAX_ARGS_LEN,
+	                      false, asciiWrite)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	payload = malloc(msgSize + 1);
+	memset(payload, 'x', msgSize);
+	payload[msgSize] = '\0';
+
+	if (isSelected[BM_SPSC]) {
+		runSpsc();
+	}
+
+	if (isSelected[BM_ASCII]) {
+		runWrite("ascii", asciiWrite);
+	}
+
+	if (isSelected[BM_ASCII_PRINTF]) {
+		runWrite("asciiprintf", printfAsciiWrite);
+	}
+
+	if (isSelected[BM_BINARY]) {
+		runWrite("binary", binaryWrite);
+	}
+
+	if (isSelected[BM_QUEUE]) {
+		runQueue();
+	}
+
+	if (isSelected[BM_SETMSG]) {
+		runSetMsg();
+	}
+
+	if (isSelected[BM_DISABLED]) {
+		runDisabled();
+	}
+
+	if (isSelected[BM_RATE_LIMITED]) {
+		runRateLimited();
+	}
+
+	if (isSelected[BM_RESERVE]) {
+		runReserve();
+	}
+
+	free(payload);
+	terminateLogger();
+
+	return LOG_STATUS_SUCCESS;
+}
+
+/**
+ * Pass messages from a producer to a consumer through a MessageQueue, each pinned to a different
+ * CPU (if there's more than one)
+ */
+static void runSpsc() {
+	SpscPair pair;
+	pthread_t producer;
+	pthread_t consumer;
+
+	memset(&pair, 0, sizeof(pair));
+	pair.mq = newMessageQueue(SPSC_QUEUE_SIZE, MAX_ARGS_LEN, false, NULL);
+	pair.messagesNum = iterations;
+
+	pthread_create(&consumer, NULL, spscConsumer, &pair);
+	pthread_create(&producer, NULL, spscProducer, &pair);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	printMeasurement("spsc-add", &pair.producer);
+	printMeasurement("spsc-drain", &pair.consumer);
+	messageDataQueueDestroy(pair.mq);
+}
+
+/**
+ * SPSC producer - adds messages, yielding whenever the queue is full
+ * @param pairArg The SpscPair
+ * @return NULL
+ */
+static void* spscProducer(void* pairArg) {
+	SpscPair* pair = pairArg;
+	PerfCounters pc;
+	long long startNsec;
+	long long i;
+
+	pinThread(0);
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < pair->messagesNum; ++i) {
+		while (MQ_STATUS_SUCCESS != addOne(pair->mq, "%s %lld", payload, i)) {
+			sched_yield();
+		}
+	}
+
+	stopMeasurement(&pc, startNsec, &pair->producer);
+	pair->producer.ops = pair->messagesNum;
+	closePerfCounters(&pc);
+
+	return NULL;
+}
+
+/**
+ * SPSC consumer - drains messages (with a write method that only counts them), yielding whenever
+ * the queue is empty
+ * @param pairArg The SpscPair
+ * @return NULL
+ */
+static void* spscConsumer(void* pairArg) {
+	SpscPair* pair = pairArg;
+	PerfCounters pc;
+	long long startNsec;
+
+	pinThread(1);
+	tlDrainedNum = &pair->drainedNum;
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	while (pair->drainedNum < pair->messagesNum) {
+		long long prevDrainedNum = pair->drainedNum;
+
+		drainMessages(pair->mq, NULL, MAX_MSG_LEN, countingWrite, false, false);
+		if (prevDrainedNum == pair->drainedNum) {
+			sched_yield();
+		}
+	}
+
+	stopMeasurement(&pc, startNsec, &pair->consumer);
+	pair->consumer.ops = pair->messagesNum;
+	closePerfCounters(&pc);
+
+	return NULL;
+}
+
+/**
+ * A write method that only counts messages
+ * @param md MessageData struct containing message info (unused)
+ * @param logFile The file to write to (unused)
+ */
+static void countingWrite(const MessageData* md, FILE* logFile) {
+	++*tlDrainedNum;
+}
+
+/**
+ * Add a message to a MessageQueue
+ * @param mq The MessageQueue
+ * @param msg The message
+ * @return MQ_STATUS_SUCCESS on success, MQ_STATUS_FAILURE if the MessageQueue is full
+ */
+static int addOne(struct MessageQueue* mq, const char* msg, ...) {
+	va_list args;
+	int ret;
+
+	va_start(args, msg);
+	ret = addMessage(mq, LOG_LEVEL_INFO, __FILE__, __func__, __LINE__, &args, msg,
+	                 LM_PRIVATE_BUFFER, MAX_ARGS_LEN);
+	va_end(args);
+
+	return ret;
+}
+
+/**
+ * Format a message with a write method to /dev/null
+ * @param name The name of the benchmark
+ * @param writeMethod The write method
+ */
+static void runWrite(const char* name, void (*writeMethod)()) {
+	Measurement measurement;
+	MessageData* mds;
+	PerfCounters pc;
+	char* argsBufs;
+	FILE* devNull;
+	long long startNsec;
+	long long i;
+	int site;
+
+	devNull = fopen("/dev/null", "w");
+	if (NULL == devNull) {
+		return;
+	}
+
+	/* The messages differ only by their line, each is a call site of its own */
+	mds = malloc(sitesNum * sizeof(*mds));
+	argsBufs = malloc(sitesNum * MAX_ARGS_LEN);
+	for (site = 0; site < sitesNum; ++site) {
+		mds[site].argsBuf = argsBufs + site * MAX_ARGS_LEN;
+		setOne(&mds[site], "%s %d", payload, 12345);
+		mds[site].line += site;
+	}
+
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0, site = 0; i < iterations; ++i) {
+		writeMethod(&mds[site], devNull);
+		site = (site + 1 == sitesNum) ? 0 : site + 1;
+	}
+
+	stopMeasurement(&pc, startNsec, &measurement);
+	measurement.ops = iterations;
+	closePerfCounters(&pc);
+	fclose(devNull);
+	free(argsBufs);
+	free(mds);
+
+	printMeasurement(name, &measurement);
+}
+
+/**
+ * Write a text message in ascii format with a single snprintf (the way 'asciiWrite(...)' used to)
+ * @param md MessageData struct containing message info
+ * @param logFile The file to write to
+ */
+static void printfAsciiWrite(const MessageData* md, FILE* logFile) {
+	static const char logLevelsIds[] = " MACEWNIDT";
+	static const char* logMethods[] = { "pb", "sb", "dw" };
+	char buf[MAX_MSG_LEN];
+	int msgLen;
+
+	msgLen = snprintf(buf, sizeof(buf),
+	                  "[mid: %x:%.5x] [ll: %c] [lm: %s] [lwp: %.5ld] [loc: %s:%s:%d] [msg: %s]\n",
+	                  (unsigned int) md->tv.tv_sec, (unsigned int) md->tv.tv_usec,
+	                  logLevelsIds[md->logLevel], logMethods[md->logMethod], md->tid,
+	                  md->file, md->func, md->line, md->argsBuf);
+	if (msgLen >= (int) sizeof(buf)) {
+		msgLen = sizeof(buf) - 1;
+	}
+
+	fwrite(buf, 1, msgLen, logFile);
+}
+
+/**
+ * Enqueue and dequeue elements of a shared Queue by a number of threads
+ */
+static void runQueue() {
+	QueueContention contention;
+	Measurement measurement;
+	Measurement threadsMeasurements[queueThreadsNum];
+	pthread_t threads[queueThreadsNum];
+	int i;
+
+	contention.queue = newQueue(queueThreadsNum);
+	contention.iterations = iterations;
+	pthread_barrier_init(&contention.startBarrier, NULL, queueThreadsNum);
+
+	/* Each thread takes an element and returns it, so the queue never runs dry */
+	for (i = 0; i < queueThreadsNum; ++i) {
+		enqueue(contention.queue, &threads[i]);
+	}
+
+	for (i = 0; i < queueThreadsNum; ++i) {
+		pthread_create(&threads[i], NULL, queueThread, &contention);
+	}
+
+	memset(&measurement, 0, sizeof(measurement));
+	for (i = 0; i < queueThreadsNum; ++i) {
+		void* threadMeasurement;
+
+		pthread_join(threads[i], &threadMeasurement);
+		threadsMeasurements[i] = *(Measurement*) threadMeasurement;
+		free(threadMeasurement);
+		addMeasurement(&measurement, &threadsMeasurements[i]);
+	}
+
+	pthread_barrier_destroy(&contention.startBarrier);
+	queueDestroy(contention.queue);
+
+	printMeasurement("queue", &measurement);
+}
+
+/**
+ * Queue contention thread - dequeues an element and enqueues it back
+ * @param contentionArg The QueueContention
+ * @return The Measurement of the thread (to be freed by the caller)
+ */
+static void* queueThread(void* contentionArg) {
+	QueueContention* contention = contentionArg;
+	Measurement* measurement;
+	PerfCounters pc;
+	long long startNsec;
+	long long i;
+
+	//TODO: think if malloc failures need to be handled
+	measurement = malloc(sizeof(*measurement));
+	openPerfCounters(&pc);
+	pthread_barrier_wait(&contention->startBarrier);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < contention->iterations; ++i) {
+		void* element;
+
+		while (NULL == (element = dequeue(contention->queue))) {
+			sched_yield();
+		}
+
+		enqueue(contention->queue, element);
+	}
+
+	stopMeasurement(&pc, startNsec, measurement);
+	measurement->ops = 2 * contention->iterations;
+	closePerfCounters(&pc);
+
+	return measurement;
+}
+
+/**
+ * Fill a MessageData, as done for every logged message
+ */
+static void runSetMsg() {
+	Measurement measurement;
+	MessageData md;
+	PerfCounters pc;
+	char argsBuf[MAX_ARGS_LEN];
+	long long startNsec;
+	long long i;
+
+	md.argsBuf = argsBuf;
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < iterations; ++i) {
+		setOne(&md, "%s %lld", payload, i);
+	}
+
+	stopMeasurement(&pc, startNsec, &measurement);
+	measurement.ops = iterations;
+	closePerfCounters(&pc);
+
+	printMeasurement("setmsg", &measurement);
+}
+
+/**
+ * Fill a MessageData
+ * @param md The MessageData to fill
+ * @param msg The message
+ */
+static void setOne(MessageData* md, const char* msg, ...) {
+	va_list args;
+
+	va_start(args, msg);
+	setMsgValues(md, LOG_LEVEL_INFO, __FILE__, __func__, __LINE__, &args, msg,
+	             LM_PRIVATE_BUFFER, MAX_ARGS_LEN);
+	va_end(args);
+}
+
+/**
+ * Log messages of a level filtered at runtime (the logger is initialized with LOG_LEVEL_NONE)
+ */
+static void runDisabled() {
+	Measurement measurement;
+	PerfCounters pc;
+	long long startNsec;
+	long long i;
+
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < iterations; ++i) {
+		LOG_MSG(LOG_LEVEL_TRACE, "%s %lld", payload, i);
+	}
+
+	stopMeasurement(&pc, startNsec, &measurement);
+	measurement.ops = iterations;
+	closePerfCounters(&pc);
+
+	printMeasurement("disabled", &measurement);
+}
+
+/**
+ * Log messages of an enabled level through a rate limited call site, so almost all of them are
+ * suppressed
+ */
+static void runRateLimited() {
+	Measurement measurement;
+	PerfCounters pc;
+	long long startNsec;
+	long long i;
+
+	setLoggingLevel(LOG_LEVEL_TRACE);
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < iterations; ++i) {
+		LOG_RATE_LIMITED(LOG_LEVEL_WARNING, 1, "%s %lld", payload, i);
+	}
+
+	stopMeasurement(&pc, startNsec, &measurement);
+	measurement.ops = iterations;
+	closePerfCounters(&pc);
+	setLoggingLevel(LOG_LEVEL_NONE);
+
+	printMeasurement("ratelimited", &measurement);
+}
+
+/**
+ * Reserve a message slot, copy a binary payload into it and commit it - the reader is emulated by
+ * consuming the slot right away, so the ring never fills up
+ */
+static void runReserve() {
+	struct MessageQueue* mq;
+	Measurement measurement;
+	PerfCounters pc;
+	int payloadLen;
+	long long startNsec;
+	long long i;
+
+	mq = newMessageQueue(SPSC_QUEUE_SIZE, MAX_ARGS_LEN, false, NULL);
+	payloadLen = strlen(payload);
+
+	openPerfCounters(&pc);
+	startMeasurement(&pc, &startNsec);
+
+	for (i = 0; i < iterations; ++i) {
+		MessageData* md = reserveMessage(mq);
+
+		setMsgHeader(md, LOG_LEVEL_INFO, __FILE__, __func__, __LINE__,
+		             LM_PRIVATE_BUFFER);
+		md->argsFormat = MSG_ARGS_BINARY;
+		memcpy(md->argsBuf, payload, payloadLen);
+		md->argsLen = payloadLen;
+		commitMessage(mq);
+
+		__atomic_store_n(&mq->lastRead, getNextMessagePos(mq->lastRead, mq->size),
+		                 __ATOMIC_SEQ_CST);
+	}
+
+	stopMeasurement(&pc, startNsec, &measurement);
+	measurement.ops = iterations;
+	closePerfCounters(&pc);
+	messageDataQueueDestroy(mq);
+
+	printMeasurement("reserve", &measurement);
+}
+
+/**
+ * Pin the calling thread to a CPU
+ * @param cpu The CPU (wrapped around the number of online CPUs)
+ */
+static void pinThread(const int cpu) {
+	cpu_set_t cpuSet;
+
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &cpuSet);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+/**
+ * Start measuring the calling thread
+ * @param pc The PerfCounters of the calling thread
+ * @param startNsec Where to store the start time
+ */
+static void startMeasurement(PerfCounters* pc, long long* startNsec) {
+	*startNsec = getMonotonicTimeNsec();
+	startPerfCounters(pc);
+}
+
+/**
+ * Stop measuring the calling thread
+ * @param pc The PerfCounters of the calling thread
+ * @param startNsec The start time
+ * @param measurement The Measurement to fill (except for the number of operations)
+ */
+static void stopMeasurement(PerfCounters* pc, const long long startNsec,
+                            Measurement* measurement) {
+	stopPerfCounters(pc);
+	measurement->elapsedNsec = getMonotonicTimeNsec() - startNsec;
+	readPerfCounters(pc, measurement->counters);
+}
+
+/**
+ * Add a Measurement to another Measurement (a counter that's unavailable in either is
+ * unavailable in the sum)
+ * @param dst The Measurement to add to
+ * @param src The Measurement to add
+ */
+static void addMeasurement(Measurement* dst, const Measurement* src) {
+	bool isFirst = (0 == dst->ops);
+	int i;
+
+	dst->ops += src->ops;
+	dst->elapsedNsec += src->elapsedNsec;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		if (true == isFirst) {
+			dst->counters[i] = src->counters[i];
+		} else if (PC_UNAVAILABLE == src->counters[i]
+		        || PC_UNAVAILABLE == dst->counters[i]) {
+			dst->counters[i] = PC_UNAVAILABLE;
+		} else {
+			dst->counters[i] += src->counters[i];
+		}
+	}
+}
+
+/**
+ * Print a Measurement as a single JSON line
+ * @param name The name of the benchmark
+ * @param measurement The Measurement
+ */
+static void printMeasurement(const char* name, const Measurement* measurement) {
+	static const char* countersNames[PC_COUNTERS_NUM] = { "cycles_per_op",
+	                                                      "instructions_per_op",
+	                                                      "cache_misses_per_op",
+	                                                      "context_switches" };
+	int i;
+
+	printf("{\"benchmark\": \"%s\", \"ops\": %lld, \"ns_per_op\": %.2f", name,
+	       measurement->ops, (double) measurement->elapsedNsec / measurement->ops);
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		if (PC_UNAVAILABLE == measurement->counters[i]) {
+			printf(", \"%s\": null", countersNames[i]);
+		} else if (PC_CONTEXT_SWITCHES == i) {
+			printf(", \"%s\": %lld", countersNames[i], measurement->counters[i]);
+		} else {
+			printf(", \"%s\": %.2f", countersNames[i],
+			       (double) measurement->counters[i] / measurement->ops);
+		}
+	}
+
+	printf("}\n");
+	fflush(stdout);
+}
+
+/**
+ * Returns the current monotonic time in nanoseconds
+ * @return The current monotonic time in nanoseconds
+ */
+static inline long long getMonotonicTimeNsec() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
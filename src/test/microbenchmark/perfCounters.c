@@ -0,0 +1,124 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file perfCounters.c
+ * @author Barak Sason Rofman
+ * @brief This module provides per-thread hardware and software counters via perf_event_open.
+ * Counters that aren't supported or permitted (e.g. in virtual machines or when
+ * perf_event_paranoid forbids them) are reported as unavailable.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "perfCounters.h"
+
+static const unsigned int countersTypes[PC_COUNTERS_NUM] = { PERF_TYPE_HARDWARE,
+                                                             PERF_TYPE_HARDWARE,
+                                                             PERF_TYPE_HARDWARE,
+                                                             PERF_TYPE_SOFTWARE };
+static const unsigned long long countersConfigs[PC_COUNTERS_NUM] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES };
+
+/* API method - Description located at .h file */
+void openPerfCounters(PerfCounters* pc) {
+	int i;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = countersTypes[i];
+		attr.config = countersConfigs[i];
+		attr.disabled = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+		        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		/* Software events (context switches) occur in the kernel, so they mustn't be excluded.
+		 * Hardware events are counted in user space only, which unprivileged users are
+		 * permitted to do by default */
+		if (PERF_TYPE_HARDWARE == attr.type) {
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+		}
+
+		/* Count the calling thread on any CPU */
+		pc->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+}
+
+/* API method - Description located at .h file */
+void startPerfCounters(PerfCounters* pc) {
+	int i;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		if (0 <= pc->fds[i]) {
+			ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+void stopPerfCounters(PerfCounters* pc) {
+	int i;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		if (0 <= pc->fds[i]) {
+			ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+void readPerfCounters(PerfCounters* pc, long long* values) {
+	int i;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		unsigned long long data[3]; /* Value, time enabled, time running */
+
+		values[i] = PC_UNAVAILABLE;
+		if (0 <= pc->fds[i]
+		        && sizeof(data) == read(pc->fds[i], data, sizeof(data))) {
+			/* Counters that weren't scheduled all the time are extrapolated */
+			values[i] = (data[2] > 0 && data[2] < data[1]) ?
+			        (long long) ((double) data[0] * data[1] / data[2]) : data[0];
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+void closePerfCounters(PerfCounters* pc) {
+	int i;
+
+	for (i = 0; i < PC_COUNTERS_NUM; ++i) {
+		if (0 <= pc->fds[i]) {
+			close(pc->fds[i]);
+			pc->fds[i] = -1;
+		}
+	}
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+ * Copyright (C) [2019] [Barak Sason Rofman]								*
+ *																			*
+ * Licensed under the Apache License, Version 2.0 (the "License");			*
+ * you may not use this file except in compliance with the License.			*
+ * You may obtain a copy of the License at:									*
+ *																			*
+ * http://www.apache.org/licenses/LICENSE-2.0								*
+ *																			*
+ * Unless required by applicable law or agreed to in writing, software		*
+ * distributed under the License is distributed on an "AS IS" BASIS,		*
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.	*
+ * See the License for the specific language governing permissions and		*
+ * limitations under the License.											*
+ ****************************************************************************/
+
+
+/**
+ * @file perfCounters.h
+ * @author Barak Sason Rofman
+ * @brief This module provides per-thread hardware and software counters via perf_event_open.
+ * Counters that aren't supported or permitted (e.g. in virtual machines or when
+ * perf_event_paranoid forbids them) are reported as unavailable.
+ * @license Apache License, Version 2.0
+ * @copywrite (C) [2019] [Barak Sason Rofman]
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+enum perfCountersTypes {
+	PC_CYCLES, PC_INSTRUCTIONS, PC_CACHE_MISSES, PC_CONTEXT_SWITCHES, PC_COUNTERS_NUM
+};
+
+#define PC_UNAVAILABLE -1 /* The value of a counter that couldn't be opened */
+
+typedef struct PerfCounters {
+	/** File descriptor of each counter (-1 if unavailable) */
+	int fds[PC_COUNTERS_NUM];
+} PerfCounters;
+
+/**
+ * Open the counters of the calling thread (counting is stopped)
+ * @param pc The PerfCounters to open
+ */
+void openPerfCounters(PerfCounters* pc);
+
+/**
+ * Reset the counters and start counting
+ * @param pc The relevant PerfCounters
+ */
+void startPerfCounters(PerfCounters* pc);
+
+/**
+ * Stop counting
+ * @param pc The relevant PerfCounters
+ */
+void stopPerfCounters(PerfCounters* pc);
+
+/**
+ * Read the counters (scaled in case the counters were multiplexed)
+ * @param pc The relevant PerfCounters
+ * @param values An array of PC_COUNTERS_NUM elements to store the values in (PC_UNAVAILABLE for
+ * counters that are unavailable)
+ */
+void readPerfCounters(PerfCounters* pc, long long* values);
+
+/**
+ * Close the counters
+ * @param pc The PerfCounters to close
+ */
+void closePerfCounters(PerfCounters* pc);
+
+#endif /* PERFCOUNTERS_H */
@@ -25,13 +25,112 @@
  * @copywrite (C) [2019] [Barak Sason Rofman]
  */
 
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "writeMethods.h"
 #include "../core/api/logger.h"
 
+#define JSON_TAIL_LEN 8 /* Room always kept for closing a JSON record */
+#define EMERGENCY_BUFFER_LEN 1024 /* Records longer than this are written in several pieces */
+#define SITE_CACHE_SIZE 256 /* Number of call sites cached per formatting thread (a power of 2) */
+#define SITE_TEXT_LEN 112 /* Room for the location text of a cached call site */
+#define ASCII_PREFIX_LEN 160 /* Room for the fields that precede the location text */
+#define TIMESTAMP_FORMAT_LEN 64 /* Maximal length of a timestamp format (including terminator) */
+#define TIMESTAMP_TEXT_LEN 64 /* Room for the date and time of a timestamp (up to the seconds) */
+#define TIMESTAMP_ZONE_LEN 8 /* Room for the time zone designator of a timestamp */
+#define TIMESTAMP_MAX_FRACTION_DIGITS 6 /* Sub-second digits are at most microseconds */
+
+typedef struct EmergencyBuffer {
+	/** The file descriptor the buffer is flushed to */
+	int fd;
+	/** The length used in the buffer */
+	int len;
+	/** The buffer */
+	char buf[EMERGENCY_BUFFER_LEN];
+} EmergencyBuffer;
+
+typedef struct SiteCacheEntry {
+	/** The file name of the call site (NULL if the entry is empty) */
+	const char* file;
+	/** The function name of the call site */
+	const char* func;
+	/** The line of the call site */
+	int line;
+	/** The length of 'text' */
+	int textLen;
+	/** The location text of the call site - "[loc: file:func:line] [msg: " */
+	char text[SITE_TEXT_LEN];
+} SiteCacheEntry;
+
+typedef struct TimestampCacheEntry {
+	/** The second the text was rendered for */
+	time_t sec;
+	/** The timestamp format epoch the text was rendered with (0 if the entry is empty) */
+	int epoch;
+	/** The length of 'text' */
+	int textLen;
+	/** The date and time up to the seconds */
+	char text[TIMESTAMP_TEXT_LEN];
+	/** The length of 'zone' */
+	int zoneLen;
+	/** The time zone designator, which follows the sub-second digits */
+	char zone[TIMESTAMP_ZONE_LEN];
+} TimestampCacheEntry;
+
 static pthread_mutex_t directWriteLock;
+static char timestampFormat[TIMESTAMP_FORMAT_LEN]; /* Empty unless records carry a formatted timestamp */
+static int timestampFractionDigits;
+static int timestampFractionDivisor; /* Microseconds are divided by it into the sub-second digits */
+static bool isTimestampUtc;
+static bool isTimestampZoneAppended;
+static int timestampFormatEpoch; /* Advanced by every format change - cached texts of older epochs are stale */
+static __thread TimestampCacheEntry tlTimestampCache[2]; /* Even and odd seconds */
+static pthread_once_t siteCacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t siteCacheKey; /* Releases the site cache of a thread when it exits */
+static __thread SiteCacheEntry* tlSiteCache;
+
+static int formatKeyValues(const MessageData* md, char* buf, int len,
+                           const int bufLen, const bool isJson);
+static int appendFormat(char* buf, const int len, const int bufLen,
+                        const char* format, ...);
+static int appendString(char* buf, int len, const int bufLen, const char* str,
+                        const bool isJson);
+static int appendHex(char* buf, int len, const int bufLen, const char* data,
+                     const int dataLen);
+static void writeKeyValuesBinary(const MessageData* md, FILE* logFile);
+static void emergencyAppendKeyValues(EmergencyBuffer* eb, const MessageData* md);
+static void emergencyAppend(EmergencyBuffer* eb, const char* data, int len);
+static void emergencyAppendString(EmergencyBuffer* eb, const char* str);
+static void emergencyAppendNumber(EmergencyBuffer* eb, unsigned long long value,
+                                  const int base, const int minDigits);
+static void emergencyFlush(EmergencyBuffer* eb);
+static inline int formatAsciiPrefix(const MessageData* md, char* buf);
+static inline int formatTimestamp(const MessageData* md, char* buf);
+static void renderTimestamp(TimestampCacheEntry* entry, const time_t sec,
+                            const int epoch);
+static const SiteCacheEntry* getSiteCacheEntry(const MessageData* md);
+static void createSiteCacheKey();
+static void destroySiteCache(void* siteCache);
+static int appendLocation(char* buf, int len, const int bufLen,
+                          const MessageData* md);
+static inline int appendBytes(char* buf, const int len, const int bufLen,
+                              const char* data, const int dataLen);
+static inline int formatHex(char* buf, unsigned int value, const int minDigits);
+static inline int formatDecimal(char* buf, const long long value,
+                                const int minDigits);
+static inline int countDecimalDigits(const unsigned long long value);
 
 /* API method - Description located at .h file */
 void initDirectWriteLock() {
@@ -56,22 +155,112 @@ static const char logLevelsIds[] = { ' ', /* NONE */
 
 static const char* logMethods[] = { "pb", "sb", "dw" };
 
+/* The two digits of each number below 100 */
+static const char decimalDigitsPairs[] =
+        "00010203040506070809101112131415161718192021222324"
+        "25262728293031323334353637383940414243444546474849"
+        "50515253545556575859606162636465666768697071727374"
+        "75767778798081828384858687888990919293949596979899";
+
+/* API method - Description located at .h file */
+int setAsciiTimestampFormat(const char* format, const int fractionDigits,
+                            const bool isUtc, const bool isZoneAppended) {
+	char text[TIMESTAMP_TEXT_LEN];
+	struct tm tm;
+	time_t now;
+
+	if (fractionDigits < 0 || fractionDigits > TIMESTAMP_MAX_FRACTION_DIGITS
+	        || (NULL != format && strlen(format) >= TIMESTAMP_FORMAT_LEN)) {
+		return LOG_STATUS_FAILURE;
+	}
+
+	/* A format whose rendering doesn't fit is rejected before anything is changed, so the
+	 * previous timestamp stays in effect */
+	if (NULL != format && '\0' != format[0]) {
+		now = time(NULL);
+		if (true == isUtc) {
+			gmtime_r(&now, &tm);
+		} else {
+			localtime_r(&now, &tm);
+		}
+
+		if (0 == strftime(text, TIMESTAMP_TEXT_LEN, format, &tm)) {
+			return LOG_STATUS_FAILURE;
+		}
+	}
+
+	strcpy(timestampFormat, (NULL != format) ? format : "");
+	timestampFractionDigits = fractionDigits;
+	timestampFractionDivisor = 1;
+	for (int i = fractionDigits; i < TIMESTAMP_MAX_FRACTION_DIGITS; ++i) {
+		timestampFractionDivisor *= 10;
+	}
+	isTimestampUtc = isUtc;
+	isTimestampZoneAppended = isZoneAppended;
+	__atomic_add_fetch(&timestampFormatEpoch, 1, __ATOMIC_RELAXED);
+
+	return LOG_STATUS_SUCCESS;
+}
+
 /* API method - Description located at .h file */
 void asciiWrite(const MessageData* md, FILE* logFile) {
 	int maxMsgLen = getMaxMsgLen();
 	int msgLen;
+	int argsLen;
 	char buf[maxMsgLen];
+	char prefix[ASCII_PREFIX_LEN];
+	const char* args = md->argsBuf;
+	const SiteCacheEntry* site;
+	char renderBuf[(MSG_ARGS_TEXT != md->argsFormat) ? maxMsgLen : 1];
+
+	if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+		formatKeyValues(md, renderBuf, 0, maxMsgLen, false);
+		args = renderBuf;
+		argsLen = strlen(renderBuf);
+	} else if (MSG_ARGS_BINARY == md->argsFormat) {
+		renderBuf[0] = '\0';
+		appendHex(renderBuf, 0, maxMsgLen, md->argsBuf, md->argsLen);
+		args = renderBuf;
+		argsLen = strlen(renderBuf);
+	} else {
+		argsLen = strnlen(md->argsBuf, md->argsLen);
+	}
+
+	/* The record is assembled as "[mid: %x:%.5x] [ll: %c] [lm: %s] [lwp: %.5ld] [loc: %s:%s:%d]
+	 * [msg: %s]\n" would be by snprintf, without parsing a format - the location text is constant
+	 * for a call site, so it's cached */
+	msgLen = appendBytes(buf, 0, maxMsgLen, prefix, formatAsciiPrefix(md, prefix));
+	site = getSiteCacheEntry(md);
+	if (NULL != site) {
+		msgLen = appendBytes(buf, msgLen, maxMsgLen, site->text, site->textLen);
+	} else {
+		msgLen = appendLocation(buf, msgLen, maxMsgLen, md);
+	}
+	msgLen = appendBytes(buf, msgLen, maxMsgLen, args, argsLen);
+	msgLen = appendBytes(buf, msgLen, maxMsgLen, "]\n", 2);
 
-	msgLen =
-	        snprintf(
-	                buf,
-	                maxMsgLen,
-	                "[mid: %x:%.5x] [ll: %c] [lm: %s] [lwp: %.5ld] [loc: %s:%s:%d] [msg: %s]\n",
-	                (unsigned int) md->tv.tv_sec, (unsigned int) md->tv.tv_usec,
-	                logLevelsIds[md->logLevel], logMethods[md->logMethod],
-	                md->tid, md->file, md->func, md->line, md->argsBuf);
+	/* msgLen is the length the message would have had. A large message (one whose arguments span
+	 * several buffer slots) is written in pieces rather than truncated */
+	if (msgLen >= maxMsgLen && MSG_ARGS_TEXT == md->argsFormat) {
+		int headerLen = msgLen - argsLen - 2;
 
-	fwrite(buf, 1, msgLen, logFile);
+		if (headerLen < maxMsgLen) {
+			flockfile(logFile);
+			fwrite(buf, 1, headerLen, logFile);
+			fwrite(md->argsBuf, 1, argsLen, logFile);
+			fwrite("]\n", 1, 2, logFile);
+			funlockfile(logFile);
+			return;
+		}
+	}
+
+	if (msgLen >= maxMsgLen) {
+		msgLen = maxMsgLen - 1;
+	}
+
+	if (msgLen > 0) {
+		fwrite(buf, 1, msgLen, logFile);
+	}
 }
 
 /* API method - Description located at .h file */
@@ -82,7 +271,13 @@ void binaryWrite(const MessageData* md, FILE* logFile) {
 
 	fileNameLen = strlen(md->file);
 	methodNameLen = strlen(md->func);
-	argsBufLen = strlen(md->argsBuf);
+	if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+		argsBufLen = -1;
+	} else if (MSG_ARGS_BINARY == md->argsFormat) {
+		argsBufLen = -2;
+	} else {
+		argsBufLen = strlen(md->argsBuf);
+	}
 
 	/* Locking is required to ensure message consistency */
 	pthread_mutex_lock(&directWriteLock); /* Lock */
@@ -98,7 +293,733 @@ void binaryWrite(const MessageData* md, FILE* logFile) {
 		fwrite(md->func, 1, methodNameLen, logFile);
 		fwrite(&md->line, 1, sizeof(md->line), logFile);
 		fwrite(&argsBufLen, sizeof(argsBufLen), 1, logFile);
-		fwrite(md->argsBuf, 1, argsBufLen, logFile);
+		if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+			writeKeyValuesBinary(md, logFile);
+		} else if (MSG_ARGS_BINARY == md->argsFormat) {
+			fwrite(&md->argsLen, sizeof(md->argsLen), 1, logFile);
+			fwrite(md->argsBuf, 1, md->argsLen, logFile);
+		} else {
+			fwrite(md->argsBuf, 1, argsBufLen, logFile);
+		}
 	}
 	pthread_mutex_unlock(&directWriteLock); /* Unlock */
 }
+
+/**
+ * Write the event and the fields of a structured message in binary format
+ * @param md A structured message
+ * @param logFile The file to write to
+ */
+static void writeKeyValuesBinary(const MessageData* md, FILE* logFile) {
+	const char* event = getKeyValuesEvent(md);
+	int eventLen = (NULL != event) ? strlen(event) : 0;
+	int kvsNum = 0;
+	KeyValue kv;
+	int pos;
+
+	for (pos = getNextKeyValue(md, 0, &kv); -1 != pos;
+	        pos = getNextKeyValue(md, pos, &kv)) {
+		++kvsNum;
+	}
+
+	fwrite(&eventLen, sizeof(eventLen), 1, logFile);
+	fwrite(event, 1, eventLen, logFile);
+	fwrite(&kvsNum, sizeof(kvsNum), 1, logFile);
+
+	for (pos = getNextKeyValue(md, 0, &kv); -1 != pos;
+	        pos = getNextKeyValue(md, pos, &kv)) {
+		char type = kv.type;
+		int keyLen = strlen(kv.key);
+
+		fwrite(&type, sizeof(type), 1, logFile);
+		fwrite(&keyLen, sizeof(keyLen), 1, logFile);
+		fwrite(kv.key, 1, keyLen, logFile);
+
+		if (KV_TYPE_STR == kv.type) {
+			int strLen = strlen(kv.value.s);
+
+			fwrite(&strLen, sizeof(strLen), 1, logFile);
+			fwrite(kv.value.s, 1, strLen, logFile);
+		} else if (KV_TYPE_INT == kv.type) {
+			fwrite(&kv.value.i, sizeof(kv.value.i), 1, logFile);
+		} else {
+			fwrite(&kv.value.d, sizeof(kv.value.d), 1, logFile);
+		}
+	}
+}
+
+/* API method - Description located at .h file */
+void jsonWrite(const MessageData* md, FILE* logFile) {
+	/* Escaping may expand the text, leave it room (large messages included) */
+	int bufLen = 2 * (getMaxMsgLen() + md->argsLen);
+	char buf[bufLen];
+	int len;
+
+	len = appendFormat(buf, 0, bufLen,
+	                   "{\"sec\":%ld,\"usec\":%ld,\"level\":\"%c\",\"method\":\"%s\","
+	                   "\"tid\":%ld,\"file\":",
+	                   (long) md->tv.tv_sec, (long) md->tv.tv_usec,
+	                   logLevelsIds[md->logLevel], logMethods[md->logMethod],
+	                   md->tid);
+	len = appendString(buf, len, bufLen, md->file, true);
+	len = appendFormat(buf, len, bufLen, ",\"func\":");
+	len = appendString(buf, len, bufLen, md->func, true);
+	len = appendFormat(buf, len, bufLen, ",\"line\":%d,", md->line);
+
+	if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+		len = formatKeyValues(md, buf, len, bufLen, true);
+	} else if (MSG_ARGS_BINARY == md->argsFormat) {
+		len = appendFormat(buf, len, bufLen, "\"payload\":\"");
+		len = appendHex(buf, len, bufLen, md->argsBuf, md->argsLen);
+		len = appendFormat(buf, len, bufLen, "\"");
+	} else {
+		len = appendFormat(buf, len, bufLen, "\"msg\":");
+		len = appendString(buf, len, bufLen, md->argsBuf, true);
+	}
+
+	/* The tail is always left room for, so the record is well formed even if truncated */
+	memcpy(buf + len, "}\n", 2);
+	fwrite(buf, 1, len + 2, logFile);
+}
+
+/* API method - Description located at .h file */
+void emergencyWrite(const MessageData* md, const int fd) {
+	EmergencyBuffer eb;
+
+	eb.fd = fd;
+	eb.len = 0;
+
+	/* Same layout as 'asciiWrite(...)' */
+	emergencyAppendString(&eb, "[mid: ");
+	emergencyAppendNumber(&eb, (unsigned int) md->tv.tv_sec, 16, 1);
+	emergencyAppendString(&eb, ":");
+	emergencyAppendNumber(&eb, (unsigned int) md->tv.tv_usec, 16, 5);
+	emergencyAppendString(&eb, "] [ll: ");
+	emergencyAppend(&eb, &logLevelsIds[md->logLevel], 1);
+	emergencyAppendString(&eb, "] [lm: ");
+	emergencyAppendString(&eb, logMethods[md->logMethod]);
+	emergencyAppendString(&eb, "] [lwp: ");
+	emergencyAppendNumber(&eb, md->tid, 10, 5);
+	emergencyAppendString(&eb, "] [loc: ");
+	emergencyAppendString(&eb, md->file);
+	emergencyAppendString(&eb, ":");
+	emergencyAppendString(&eb, md->func);
+	emergencyAppendString(&eb, ":");
+	emergencyAppendNumber(&eb, md->line, 10, 1);
+	emergencyAppendString(&eb, "] [msg: ");
+
+	if (MSG_ARGS_KEY_VALUES == md->argsFormat) {
+		emergencyAppendKeyValues(&eb, md);
+	} else if (MSG_ARGS_BINARY == md->argsFormat) {
+		int i;
+
+		for (i = 0; i < md->argsLen; ++i) {
+			emergencyAppendNumber(&eb, (unsigned char) md->argsBuf[i], 16, 2);
+		}
+	} else {
+		emergencyAppend(&eb, md->argsBuf, md->argsLen);
+	}
+
+	emergencyAppendString(&eb, "]\n");
+	emergencyFlush(&eb);
+}
+
+/**
+ * Append the event and the fields of a structured message as text ('event key=value ...') to an
+ * emergency buffer
+ * @param eb The emergency buffer
+ * @param md A structured message
+ */
+static void emergencyAppendKeyValues(EmergencyBuffer* eb, const MessageData* md) {
+	const char* event = getKeyValuesEvent(md);
+	KeyValue kv;
+	int pos;
+
+	if (NULL != event) {
+		emergencyAppendString(eb, event);
+	}
+
+	for (pos = getNextKeyValue(md, 0, &kv); -1 != pos;
+	        pos = getNextKeyValue(md, pos, &kv)) {
+		emergencyAppendString(eb, " ");
+		emergencyAppendString(eb, kv.key);
+		emergencyAppendString(eb, "=");
+
+		if (KV_TYPE_STR == kv.type) {
+			emergencyAppendString(eb, "\"");
+			emergencyAppendString(eb, kv.value.s);
+			emergencyAppendString(eb, "\"");
+		} else if (KV_TYPE_INT == kv.type) {
+			if (0 > kv.value.i) {
+				emergencyAppendString(eb, "-");
+			}
+			emergencyAppendNumber(eb, (0 > kv.value.i) ? 0ULL - kv.value.i : kv.value.i,
+			                      10, 1);
+		} else if (true == isfinite(kv.value.d) && 1e18 > fabs(kv.value.d)) {
+			double value = fabs(kv.value.d);
+			unsigned long long integral = value;
+			unsigned long long fraction = (value - integral) * 1e6;
+
+			if (0 > kv.value.d) {
+				emergencyAppendString(eb, "-");
+			}
+			emergencyAppendNumber(eb, integral, 10, 1);
+			emergencyAppendString(eb, ".");
+			emergencyAppendNumber(eb, (999999 < fraction) ? 999999 : fraction, 10, 6);
+		} else {
+			/* Not representable without the (unsafe) stdio formatting */
+			emergencyAppendString(eb, "?");
+		}
+	}
+}
+
+/**
+ * Append data to an emergency buffer, flushing it whenever it fills up
+ * @param eb The emergency buffer
+ * @param data The data
+ * @param len The length of the data
+ */
+static void emergencyAppend(EmergencyBuffer* eb, const char* data, int len) {
+	while (0 < len) {
+		int chunkLen = EMERGENCY_BUFFER_LEN - eb->len;
+
+		if (chunkLen > len) {
+			chunkLen = len;
+		}
+
+		memcpy(eb->buf + eb->len, data, chunkLen);
+		eb->len += chunkLen;
+		data += chunkLen;
+		len -= chunkLen;
+
+		if (EMERGENCY_BUFFER_LEN == eb->len) {
+			emergencyFlush(eb);
+		}
+	}
+}
+
+/**
+ * Append a null-terminated string to an emergency buffer
+ * @param eb The emergency buffer
+ * @param str The string
+ */
+static void emergencyAppendString(EmergencyBuffer* eb, const char* str) {
+	emergencyAppend(eb, str, strlen(str));
+}
+
+/**
+ * Append an unsigned number to an emergency buffer
+ * @param eb The emergency buffer
+ * @param value The number
+ * @param base The base to write the number in (10 or 16)
+ * @param minDigits Minimal number of digits (padded with zeros)
+ */
+static void emergencyAppendNumber(EmergencyBuffer* eb, unsigned long long value,
+                                  const int base, const int minDigits) {
+	static const char digits[] = "0123456789abcdef";
+	char buf[24];
+	int pos = sizeof(buf);
+
+	do {
+		buf[--pos] = digits[value % base];
+		value /= base;
+	} while (0 != value || (int) sizeof(buf) - pos < minDigits);
+
+	emergencyAppend(eb, buf + pos, sizeof(buf) - pos);
+}
+
+/**
+ * Write the contents of an emergency buffer to its file descriptor
+ * @param eb The emergency buffer
+ */
+static void emergencyFlush(EmergencyBuffer* eb) {
+	int written = 0;
+
+	while (written < eb->len) {
+		ssize_t ret = write(eb->fd, eb->buf + written, eb->len - written);
+
+		if (0 > ret && EINTR == errno) {
+			continue;
+		}
+		if (0 >= ret) {
+			/* Nothing more can be done from a crashing process */
+			break;
+		}
+
+		written += ret;
+	}
+
+	eb->len = 0;
+}
+
+/**
+ * Render the event and the fields of a structured message - as text ('event key=value ...') or as
+ * JSON members ('"event":"...","fields":{"key":value,...}')
+ * @param md A structured message
+ * @param buf The buffer to render to
+ * @param len The length already used in the buffer
+ * @param bufLen The length of the buffer
+ * @param isJson Whether to render JSON members or text
+ * @return The length used in the buffer (the rendering is null-terminated)
+ */
+static int formatKeyValues(const MessageData* md, char* buf, int len,
+                           const int bufLen, const bool isJson) {
+	const char* event = getKeyValuesEvent(md);
+	bool isFirst = true;
+	KeyValue kv;
+	int pos;
+
+	if (NULL == event) {
+		event = "";
+	}
+
+	if (true == isJson) {
+		len = appendFormat(buf, len, bufLen, "\"event\":");
+		len = appendString(buf, len, bufLen, event, true);
+		len = appendFormat(buf, len, bufLen, ",\"fields\":{");
+	} else {
+		len = appendFormat(buf, len, bufLen, "%s", event);
+	}
+
+	for (pos = getNextKeyValue(md, 0, &kv); -1 != pos;
+	        pos = getNextKeyValue(md, pos, &kv)) {
+		if (true == isJson) {
+			len = appendFormat(buf, len, bufLen, (true == isFirst) ? "" : ",");
+			isFirst = false;
+			len = appendString(buf, len, bufLen, kv.key, true);
+			len = appendFormat(buf, len, bufLen, ":");
+		} else {
+			len = appendFormat(buf, len, bufLen, " %s=", kv.key);
+		}
+
+		if (KV_TYPE_INT == kv.type) {
+			len = appendFormat(buf, len, bufLen, "%lld", kv.value.i);
+		} else if (KV_TYPE_DOUBLE == kv.type) {
+			if (true == isJson && false == isfinite(kv.value.d)) {
+				/* JSON has no representation for NaN and infinities */
+				len = appendFormat(buf, len, bufLen, "null");
+			} else {
+				len = appendFormat(buf, len, bufLen, isJson ? "%.17g" : "%g",
+				                   kv.value.d);
+			}
+		} else {
+			len = appendString(buf, len, bufLen, kv.value.s, isJson);
+		}
+	}
+
+	if (true == isJson) {
+		len = appendFormat(buf, len, bufLen, "}");
+	}
+
+	return len;
+}
+
+/**
+ * Append formatted text to a buffer, keeping room for the tail of a JSON record
+ * @param buf The buffer
+ * @param len The length already used in the buffer
+ * @param bufLen The length of the buffer (at least 'JSON_TAIL_LEN')
+ * @param format The format of the text
+ * @return The length used in the buffer (the text is truncated to what fits)
+ */
+static int appendFormat(char* buf, const int len, const int bufLen,
+                        const char* format, ...) {
+	int limit = bufLen - JSON_TAIL_LEN;
+	int appendedLen;
+	va_list args;
+
+	if (len >= limit) {
+		return len;
+	}
+
+	va_start(args, format);
+	appendedLen = vsnprintf(buf + len, limit - len, format, args);
+	va_end(args);
+
+	if (0 > appendedLen) {
+		buf[len] = '\0';
+		return len;
+	}
+
+	return (len + appendedLen >= limit) ? limit - 1 : len + appendedLen;
+}
+
+/**
+ * Append a quoted string to a buffer, keeping room for the tail of a JSON record - the string is
+ * escaped for JSON, or just its quotes and backslashes for text
+ * @param buf The buffer
+ * @param len The length already used in the buffer
+ * @param bufLen The length of the buffer (at least 'JSON_TAIL_LEN')
+ * @param str The string
+ * @param isJson Whether to escape for JSON or for text
+ * @return The length used in the buffer (the string is truncated to what fits, but always quoted)
+ */
+static int appendString(char* buf, int len, const int bufLen, const char* str,
+                        const bool isJson) {
+	/* The closing quote goes into the room kept for the tail */
+	int limit = bufLen - JSON_TAIL_LEN;
+
+	if (len >= limit) {
+		return len;
+	}
+
+	buf[len++] = '"';
+	for (; '\0' != *str; ++str) {
+		unsigned char c = *str;
+
+		if ('"' == c || '\\' == c) {
+			if (len + 2 > limit) {
+				break;
+			}
+			buf[len++] = '\\';
+			buf[len++] = c;
+		} else if (true == isJson && c < 0x20) {
+			if (len + 6 > limit) {
+				break;
+			}
+			len += snprintf(buf + len, 7, "\\u%04x", c);
+		} else {
+			if (len + 1 > limit) {
+				break;
+			}
+			buf[len++] = c;
+		}
+	}
+	buf[len++] = '"';
+	buf[len] = '\0';
+
+	return len;
+}
+
+/**
+ * Append a binary payload as hex digits to a buffer, keeping room for the tail of a JSON record
+ * @param buf The buffer
+ * @param len The length already used in the buffer
+ * @param bufLen The length of the buffer (at least 'JSON_TAIL_LEN')
+ * @param data The payload
+ * @param dataLen The length of the payload
+ * @return The length used in the buffer (the payload is truncated to the whole bytes that fit)
+ */
+static int appendHex(char* buf, int len, const int bufLen, const char* data,
+                     const int dataLen) {
+	static const char hexDigits[] = "0123456789abcdef";
+	int limit = bufLen - JSON_TAIL_LEN;
+	int i;
+
+	for (i = 0; i < dataLen && len + 2 < limit; ++i) {
+		unsigned char c = data[i];
+
+		buf[len++] = hexDigits[c >> 4];
+		buf[len++] = hexDigits[c & 0xf];
+	}
+	if (len < bufLen) {
+		buf[len] = '\0';
+	}
+
+	return len;
+}
+
+/**
+ * Format the fields of an ascii record that precede its location text
+ * @param md MessageData struct containing message info
+ * @param buf The buffer to format to (at least 'ASCII_PREFIX_LEN' long, not terminated)
+ * @return The length of the fields
+ */
+static inline int formatAsciiPrefix(const MessageData* md, char* buf) {
+	char* pos = buf;
+
+	if ('\0' != timestampFormat[0]) {
+		memcpy(pos, "[ts: ", 5);
+		pos += 5;
+		pos += formatTimestamp(md, pos);
+	} else {
+		memcpy(pos, "[mid: ", 6);
+		pos += 6;
+		pos += formatHex(pos, (unsigned int) md->tv.tv_sec, 1);
+		*pos++ = ':';
+		pos += formatHex(pos, (unsigned int) md->tv.tv_usec, 5);
+	}
+	memcpy(pos, "] [ll: ", 7);
+	pos += 7;
+	*pos++ = logLevelsIds[md->logLevel];
+	memcpy(pos, "] [lm: ", 7);
+	pos += 7;
+	memcpy(pos, logMethods[md->logMethod], 2);
+	pos += 2;
+	memcpy(pos, "] [lwp: ", 8);
+	pos += 8;
+	pos += formatDecimal(pos, md->tid, 5);
+	memcpy(pos, "] ", 2);
+	pos += 2;
+
+	return pos - buf;
+}
+
+/**
+ * Format the timestamp of a message - the date and time of its second are rendered once per
+ * second (by each formatting thread, which keeps the texts of an even and an odd second, so
+ * messages around a second's boundary don't evict each other), only the sub-second digits are
+ * formatted per message
+ * @param md MessageData struct containing message info
+ * @param buf The buffer to format to (not terminated)
+ * @return The length of the timestamp
+ */
+static inline int formatTimestamp(const MessageData* md, char* buf) {
+	TimestampCacheEntry* entry = &tlTimestampCache[md->tv.tv_sec & 1];
+	int epoch = __atomic_load_n(&timestampFormatEpoch, __ATOMIC_RELAXED);
+	char* pos = buf;
+
+	if (md->tv.tv_sec != entry->sec || epoch != entry->epoch) {
+		renderTimestamp(entry, md->tv.tv_sec, epoch);
+	}
+
+	memcpy(pos, entry->text, entry->textLen);
+	pos += entry->textLen;
+	if (0 != timestampFractionDigits) {
+		*pos++ = '.';
+		pos += formatDecimal(pos, md->tv.tv_usec / timestampFractionDivisor,
+		                     timestampFractionDigits);
+	}
+	memcpy(pos, entry->zone, entry->zoneLen);
+	pos += entry->zoneLen;
+
+	return pos - buf;
+}
+
+/**
+ * Render the date and time of a second, and the time zone designator ("Z" in UTC, "+hh:mm"
+ * otherwise) if it's appended
+ * @param entry The cache entry to render into
+ * @param sec The second
+ * @param epoch The timestamp format epoch
+ */
+static void renderTimestamp(TimestampCacheEntry* entry, const time_t sec,
+                            const int epoch) {
+	struct tm tm;
+
+	if (true == isTimestampUtc) {
+		gmtime_r(&sec, &tm);
+	} else {
+		localtime_r(&sec, &tm);
+	}
+
+	entry->textLen = strftime(entry->text, TIMESTAMP_TEXT_LEN, timestampFormat,
+	                          &tm);
+	entry->zoneLen = 0;
+	if (true == isTimestampZoneAppended && true == isTimestampUtc) {
+		entry->zone[entry->zoneLen++] = 'Z';
+	} else if (true == isTimestampZoneAppended) {
+		long offsetMin = tm.tm_gmtoff / 60;
+
+		entry->zone[entry->zoneLen++] = (0 > offsetMin) ? '-' : '+';
+		offsetMin = (0 > offsetMin) ? -offsetMin : offsetMin;
+		entry->zoneLen += formatDecimal(entry->zone + entry->zoneLen, offsetMin / 60, 2);
+		entry->zone[entry->zoneLen++] = ':';
+		entry->zoneLen += formatDecimal(entry->zone + entry->zoneLen, offsetMin % 60, 2);
+	}
+
+	entry->sec = sec;
+	entry->epoch = epoch;
+}
+
+/**
+ * Return the cached location text of the call site of a message, caching it first if needed. The
+ * cache is per thread and direct-mapped, keyed by the addresses of the file and function names
+ * (string literals, as passed by the logging macros) and the line
+ * @param md MessageData struct containing message info
+ * @return The cache entry of the call site, or NULL if its location text can't be cached
+ */
+static const SiteCacheEntry* getSiteCacheEntry(const MessageData* md) {
+	SiteCacheEntry* entry;
+	uintptr_t hash;
+	int textLen;
+
+	if (NULL == md->file || NULL == md->func) {
+		return NULL;
+	}
+
+	if (NULL == tlSiteCache) {
+		pthread_once(&siteCacheKeyOnce, createSiteCacheKey);
+		//TODO: think if malloc failures need to be handled
+		tlSiteCache = calloc(SITE_CACHE_SIZE, sizeof(*tlSiteCache));
+		if (NULL == tlSiteCache) {
+			return NULL;
+		}
+		pthread_setspecific(siteCacheKey, tlSiteCache);
+	}
+
+	hash = (((uintptr_t) md->file ^ ((uintptr_t) md->func << 2)) >> 3)
+	        ^ ((unsigned int) md->line * 0x9e3779b1u);
+	entry = &tlSiteCache[(hash ^ (hash >> 13)) & (SITE_CACHE_SIZE - 1)];
+	if (md->file == entry->file && md->func == entry->func
+	        && md->line == entry->line) {
+		return entry;
+	}
+
+	textLen = appendLocation(entry->text, 0, SITE_TEXT_LEN, md);
+	if (textLen >= SITE_TEXT_LEN) {
+		entry->file = NULL;
+		return NULL;
+	}
+
+	entry->file = md->file;
+	entry->func = md->func;
+	entry->line = md->line;
+	entry->textLen = textLen;
+
+	return entry;
+}
+
+/**
+ * Create the key that releases the site cache of a thread when it exits
+ */
+static void createSiteCacheKey() {
+	pthread_key_create(&siteCacheKey, destroySiteCache);
+}
+
+/**
+ * Release the site cache of an exiting thread
+ * @param siteCache The site cache
+ */
+static void destroySiteCache(void* siteCache) {
+	free(siteCache);
+	tlSiteCache = NULL;
+}
+
+/**
+ * Append the location text of a message ("[loc: file:func:line] [msg: ") to a buffer
+ * @param buf The buffer
+ * @param len The length already used in the buffer
+ * @param bufLen The length of the buffer
+ * @param md MessageData struct containing message info
+ * @return The length the buffer would have had if it was long enough (see 'appendBytes(...)')
+ */
+static int appendLocation(char* buf, int len, const int bufLen,
+                          const MessageData* md) {
+	const char* file = (NULL != md->file) ? md->file : "(null)";
+	const char* func = (NULL != md->func) ? md->func : "(null)";
+	char line[24];
+
+	len = appendBytes(buf, len, bufLen, "[loc: ", 6);
+	len = appendBytes(buf, len, bufLen, file, strlen(file));
+	len = appendBytes(buf, len, bufLen, ":", 1);
+	len = appendBytes(buf, len, bufLen, func, strlen(func));
+	len = appendBytes(buf, len, bufLen, ":", 1);
+	len = appendBytes(buf, len, bufLen, line, formatDecimal(line, md->line, 1));
+	len = appendBytes(buf, len, bufLen, "] [msg: ", 8);
+
+	return len;
+}
+
+/**
+ * Append bytes to a buffer as snprintf would - what doesn't fit (leaving room for a terminator) is
+ * truncated, but counted
+ * @param buf The buffer (not terminated)
+ * @param len The length already used in the buffer (may exceed its length)
+ * @param bufLen The length of the buffer
+ * @param data The bytes to append
+ * @param dataLen The number of bytes to append
+ * @return The length the buffer would have had if it was long enough
+ */
+static inline int appendBytes(char* buf, const int len, const int bufLen,
+                              const char* data, const int dataLen) {
+	if (len + dataLen < bufLen) {
+		memcpy(buf + len, data, dataLen);
+	} else if (len < bufLen - 1) {
+		memcpy(buf + len, data, bufLen - 1 - len);
+	}
+
+	return len + dataLen;
+}
+
+/**
+ * Format a number as lowercase hex digits (as "%.<minDigits>x" would)
+ * @param buf The buffer to format to (not terminated)
+ * @param value The number
+ * @param minDigits Minimal number of digits (the number is padded with zeros)
+ * @return The number of digits
+ */
+static inline int formatHex(char* buf, unsigned int value, const int minDigits) {
+	static const char hexDigits[] = "0123456789abcdef";
+	int digitsNum = (32 - __builtin_clz(value | 1) + 3) >> 2;
+	int i;
+
+	if (digitsNum < minDigits) {
+		digitsNum = minDigits;
+	}
+
+	for (i = digitsNum - 1; i >= 0; --i) {
+		buf[i] = hexDigits[value & 0xf];
+		value >>= 4;
+	}
+
+	return digitsNum;
+}
+
+/**
+ * Format a number as decimal digits (as "%.<minDigits>lld" would) - two digits at a time
+ * @param buf The buffer to format to (at least 21 long, not terminated)
+ * @param value The number
+ * @param minDigits Minimal number of digits (the number is padded with zeros, up to 20 digits)
+ * @return The length of the number
+ */
+static inline int formatDecimal(char* buf, const long long value,
+                                const int minDigits) {
+	unsigned long long absValue = (0 > value) ? 0ULL - value : (unsigned long long) value;
+	int signLen = (0 > value) ? 1 : 0;
+	int digitsNum = countDecimalDigits(absValue);
+	char* pos;
+
+	if (1 == signLen) {
+		buf[0] = '-';
+	}
+
+	if (digitsNum < minDigits) {
+		digitsNum = minDigits;
+	}
+
+	pos = buf + signLen + digitsNum;
+	while (100 <= absValue) {
+		pos -= 2;
+		memcpy(pos, &decimalDigitsPairs[(absValue % 100) * 2], 2);
+		absValue /= 100;
+	}
+
+	if (10 <= absValue) {
+		pos -= 2;
+		memcpy(pos, &decimalDigitsPairs[absValue * 2], 2);
+	} else {
+		*--pos = '0' + absValue;
+	}
+
+	while (pos > buf + signLen) {
+		*--pos = '0';
+	}
+
+	return signLen + digitsNum;
+}
+
+/**
+ * Count the decimal digits of a number without dividing it - the count is estimated from the
+ * number of its bits and corrected by a single comparison
+ * @param value The number
+ * @return The number of decimal digits (1 for 0)
+ */
+static inline int countDecimalDigits(const unsigned long long value) {
+	static const unsigned long long powersOf10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL,
+	                                                 100000ULL, 1000000ULL, 10000000ULL,
+	                                                 100000000ULL, 1000000000ULL,
+	                                                 10000000000ULL, 100000000000ULL,
+	                                                 1000000000000ULL, 10000000000000ULL,
+	                                                 100000000000000ULL,
+	                                                 1000000000000000ULL,
+	                                                 10000000000000000ULL,
+	                                                 100000000000000000ULL,
+	                                                 1000000000000000000ULL,
+	                                                 10000000000000000000ULL };
+	/* Or-ing 1 keeps 0 at 1 digit, and doesn't cross a power of 10 */
+	unsigned long long oddValue = value | 1;
+	int digitsNum = ((64 - __builtin_clzll(oddValue)) * 1233) >> 12;
+
+	return digitsNum + (oddValue >= powersOf10[digitsNum]);
+}
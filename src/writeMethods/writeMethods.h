@@ -28,22 +28,77 @@
 #ifndef WRITEMETHODS_H
 #define WRITEMETHODS_H
 
+#include <stdbool.h>
+
 #include "../core/logger/messageQueue/messageData.h"
 
+#define TIMESTAMP_FORMAT_ISO8601 "%Y-%m-%dT%H:%M:%S" /* Date and time of an ISO-8601 timestamp */
+
 /**
- * Writes a message in ascii format
+ * Sets the timestamp written by 'asciiWrite(...)'. By default a record carries the raw time of the
+ * message as "[mid: <seconds in hex>:<microseconds in hex>]", once set it carries
+ * "[ts: <date and time>[.<sub-second digits>][<time zone>]]" instead, e.g.
+ * "[ts: 2019-06-01T12:34:56.123456+03:00]" for (TIMESTAMP_FORMAT_ISO8601, 6, false, true). The date
+ * and time are rendered with strftime(3) only once per second, by each formatting thread - the
+ * sub-second digits are the only part formatted per message.
+ * 'emergencyWrite(...)' keeps the raw time, since rendering a date isn't async-signal-safe
+ * NOTE: This API should be called before 'initLogger(...)' (or before 'runLoggerCollector(...)')
+ * @param format A strftime(3) format of the date and time up to the seconds (e.g.
+ * TIMESTAMP_FORMAT_ISO8601), at most 63 characters, or NULL to restore the raw time
+ * @param fractionDigits Number of sub-second digits appended after a '.' (0 - 6, 0 for none)
+ * @param isUtc Whether the time is in UTC (the local time zone otherwise)
+ * @param isZoneAppended Whether the time zone is appended after the sub-second digits, as ISO-8601
+ * designates it - "Z" in UTC, "+hh:mm" or "-hh:mm" otherwise
+ * @return LOG_STATUS_SUCCESS on success, LOG_STATUS_FAILURE on invalid arguments or a format whose
+ * rendering exceeds 63 characters (the previous timestamp is kept then)
+ */
+int setAsciiTimestampFormat(const char* format, const int fractionDigits,
+                            const bool isUtc, const bool isZoneAppended);
+
+/**
+ * Writes a message in ascii format (binary payloads are written as hex digits). The record is
+ * assembled without a format string - numbers are rendered by hand, and the location text of each
+ * call site is cached per thread, keyed by the addresses of its file and function names (which are
+ * expected to be string literals, as the logging macros pass)
  * @param md MessageData struct containing message info
  * @param logFile The file to write to
  */
 void asciiWrite(const MessageData* md, FILE* logFile);
 
 /**
- * Writes a message in binary format
+ * Writes a message in binary format. Text messages are written as:
+ * tv, level id (1 byte), method id (2 bytes), tid, file name length (int), file name, function
+ * name length (int), function name, line (int), arguments length (int), arguments.
+ * Structured messages (see 'LOG_KV') have -1 as the arguments length, followed by:
+ * event length (int), event, number of fields (int), and per field: type (1 byte, one of
+ * 'keyValueTypes'), key length (int), key, value - long long, double, or string length (int)
+ * followed by the string.
+ * Binary payloads (see 'logReserve') have -2 as the arguments length, followed by the payload
+ * length (int) and the payload
  * @param md MessageData struct containing message info
  * @param logFile The file to write to
  */
 void binaryWrite(const MessageData* md, FILE* logFile);
 
+/**
+ * Writes a message as a JSON object, one per line. Text messages carry their text as "msg",
+ * structured messages (see 'LOG_KV') carry "event" and typed "fields", binary payloads (see
+ * 'logReserve') carry their bytes as a hex string "payload"
+ * @param md MessageData struct containing message info
+ * @param logFile The file to write to
+ */
+void jsonWrite(const MessageData* md, FILE* logFile);
+
+/**
+ * Writes a message in ascii format (the same as 'asciiWrite(...)', floating point values of
+ * structured messages are written with 6 decimal digits) using only async-signal-safe operations -
+ * no stdio, no locking and no allocation, the record is built on the stack and written with
+ * write(2). Intended for writing messages from a fatal signal handler
+ * @param md MessageData struct containing message info
+ * @param fd The file descriptor to write to
+ */
+void emergencyWrite(const MessageData* md, const int fd);
+
 /**
  * Initialize a mutex that may be used in direct write mode to ensure message
  * consistency, if required